@@ -0,0 +1,88 @@
+/*
+ *  Title: Simulated Smartknob Board
+
+ *  Description: Wires the simulation models to the host HAL using the real pin assignments.
+ *      A scripted hand turns the knob back and forth so the detent logic gets exercised,
+ *      starting once the control loop runs. The encoder has a realistic harmonic error.
+ *      Set SMARTKNOB_ENCODER_ERROR to 0 for a perfect encoder, and SMARTKNOB_MOTOR to
+ *      "pole_pairs,direction,zero_electric_angle" to try the motor calibration on another motor.
+ *      The strain gauge ADC is pressed periodically once it streams, SMARTKNOB_PRESS set to
+ *      "period_ms,length_ms,size" changes the presses.
+ *      Run time is set with the SMARTKNOB_SIM_MS environment variable, 20 s by default so the
+ *      first boot calibration is followed by 5 s of control.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <HAL.h>
+#include "SimModels.h"
+#include "../pin_assignments.h"
+
+/**
+ * @brief Applies a slow triangle of torque to the knob like a hand would
+*/
+class SimHand : public HAL::sim::Process {
+public:
+    SimHand(SimMotor* motor) : _motor(motor) {};
+    void step(uint64_t now_us, uint32_t dt_us) override {
+        const uint64_t period_us = 2000000u;
+        const float peak_torque = 0.015f;
+        uint64_t start_us = HAL::sim::core1_launch_us();
+        if(start_us == UINT64_MAX || now_us < start_us + 500000u) {
+            _motor->external_torque = 0.0f; // Let the controller settle first
+        } else if((now_us - start_us) % period_us < period_us / 2) {
+            _motor->external_torque = peak_torque;
+        } else {
+            _motor->external_torque = -peak_torque;
+        }
+    };
+private:
+    SimMotor* _motor;
+};
+
+/**
+ * @brief Motor parameters, the defaults match the motor on the board
+*/
+static SimMotor::params motor_params(void) {
+    SimMotor::params p;
+    const char* env = getenv("SMARTKNOB_MOTOR");
+    if(env != NULL) sscanf(env, "%d,%d,%f", &p.pole_pairs, &p.direction, &p.zero_electric_angle);
+    return p;
+}
+
+class SimBoard {
+public:
+    SimBoard() : motor(UH, VH, WH, motor_params()), encoder(&motor), hand(&motor), strain(STRAIN_IRQ) {
+        motor.angle = 1.0f;
+        const char* env = getenv("SMARTKNOB_ENCODER_ERROR");
+        if(env == NULL || strcmp(env, "0") != 0) {
+            encoder.first_harmonic = 0.012f;
+            encoder.second_harmonic = 0.006f;
+        }
+        HAL::sim::add_process(&motor);
+        HAL::sim::add_process(&hand);
+        HAL::sim::attach_spi_device(spi1, MAG_CSN, &encoder);
+        env = getenv("SMARTKNOB_PRESS");
+        if(env != NULL) sscanf(env, "%u,%u,%f", &strain.press_period_ms, &strain.press_length_ms, &strain.press_size);
+        HAL::sim::add_process(&strain);
+        HAL::sim::attach_spi_device(spi1, STRAIN_CSN, &strain);
+    };
+    ~SimBoard() {
+        printf("Simulated %llu ms, knob at %f rad\n", (unsigned long long)(HAL::time_us() / 1000u), motor.angle);
+        const HAL::sim::spi_stats& bus = HAL::sim::spi_statistics(spi1);
+        printf("spi1: %u blocking transfers, %u DMA transfers, %u baudrate writes, %u format writes, %u config writes\n",
+            bus.transfers, bus.dma_transfers, bus.baudrate_writes, bus.format_writes, bus.config_writes);
+        printf("Strain ADC: %u register reads, %u register writes, %u conversions, %u overwritten before they were read\n",
+            strain.register_reads, strain.register_writes, strain.conversions, strain.unread);
+    };
+
+    SimMotor motor;
+    SimMT6701 encoder;
+    SimHand hand;
+    SimMCP3564R strain;
+};
+
+static SimBoard board;
@@ -0,0 +1,269 @@
+/*
+ *  Title: Simulation Models
+
+ *  Description: Software models of the Smartknob hardware for the host HAL backend
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <math.h>
+#include <string.h>
+#include "SimModels.h"
+
+static const float _2pi = 6.28318530717958647692f;
+static const float _sqrt3 = 1.73205080756887729352f;
+
+/**
+ * @brief Constructor for the motor model
+ * @param u_h GPIO of the U phase high side PWM
+ * @param v_h GPIO of the V phase high side PWM
+ * @param w_h GPIO of the W phase high side PWM
+ * @param p Physical parameters of the motor
+*/
+SimMotor::SimMotor(uint u_h, uint v_h, uint w_h, params p) {
+    _u_h = u_h;
+    _v_h = v_h;
+    _w_h = w_h;
+    _p = p;
+    angle = 0.0f;
+    velocity = 0.0f;
+    external_torque = 0.0f;
+    torque = 0.0f;
+}
+
+/**
+ * @brief Integrate the rotor over one time step, inductance is neglected
+*/
+void SimMotor::step(uint64_t now_us, uint32_t dt_us) {
+    float v_u = HAL::sim::pwm_duty(_u_h) * _p.supply_voltage;
+    float v_v = HAL::sim::pwm_duty(_v_h) * _p.supply_voltage;
+    float v_w = HAL::sim::pwm_duty(_w_h) * _p.supply_voltage;
+
+    // Clarke then Park into the rotor frame
+    float v_alpha = (2.0f / 3.0f) * (v_u - 0.5f * v_v - 0.5f * v_w);
+    float v_beta = (1.0f / _sqrt3) * (v_v - v_w);
+    float electric_angle = (float)(_p.direction * _p.pole_pairs) * angle - _p.zero_electric_angle;
+    float v_q = -sinf(electric_angle) * v_alpha + cosf(electric_angle) * v_beta;
+
+    // Back-EMF opposes the electrical velocity
+    float electric_velocity = (float)(_p.direction * _p.pole_pairs) * velocity;
+    float i_q = (v_q - _p.kt * electric_velocity) / _p.resistance;
+    torque = (float)_p.direction * _p.kt * i_q;
+
+    float dt = (float)dt_us * 1e-6f;
+    float acceleration = (torque + external_torque - _p.friction * velocity) / _p.inertia;
+    velocity += acceleration * dt;
+    angle += velocity * dt;
+}
+
+/**
+ * @brief Constructor for the MT6701 model
+ * @param motor Motor whose angle is reported
+*/
+SimMT6701::SimMT6701(const SimMotor* motor) {
+    _motor = motor;
+}
+
+/**
+ * @brief Latch a new frame when chip select goes low
+*/
+void SimMT6701::select(bool selected) {
+    if(!selected) return;
+    float a = fmodf(_motor->angle + error(_motor->angle), _2pi);
+    if(a < 0.0f) a += _2pi;
+    uint32_t raw = (uint32_t)(a * 16384.0f / _2pi) & 0x3FFF;
+    uint32_t data = (raw << 4) | (status & 0x0F); // 18 bits of angle and status
+
+    // CRC6 with polynomial x^6 + x + 1 over the 18 data bits, MSB first
+    uint8_t crc = 0;
+    for(int i = 17; i >= 0; i--) {
+        uint8_t feedback = ((crc >> 5) & 0x01) ^ ((data >> i) & 0x01);
+        crc = (crc << 1) & 0x3F;
+        if(feedback) crc ^= 0x03;
+    }
+
+    uint32_t frame = (data << 6) | crc;
+    _frame[0] = (frame >> 16) & 0xFF;
+    _frame[1] = (frame >> 8) & 0xFF;
+    _frame[2] = frame & 0xFF;
+    _index = 0;
+}
+
+/**
+ * @brief Error between the reported and the true angle
+ * @param angle True mechanical angle in rad
+*/
+float SimMT6701::error(float angle) const {
+    return first_harmonic * sinf(angle + 0.7f) + second_harmonic * sinf(2.0f * angle + 1.9f);
+}
+
+uint8_t SimMT6701::transfer(uint8_t tx) {
+    if(_index >= sizeof(_frame)) return 0x00;
+    return _frame[_index++];
+}
+
+/**
+ * @brief Constructor for the MCP3564R model, registers start at their reset values
+ * @param irq_pin GPIO the IRQ output drives, open drain
+ * @param address Device address in the command byte
+*/
+SimMCP3564R::SimMCP3564R(uint irq_pin, uint8_t address) {
+    _irq_pin = irq_pin;
+    _address = address;
+    memset(_regs, 0, sizeof(_regs));
+    _regs[0x1][0] = 0xC0; // CONFIG0
+    _regs[0x2][0] = 0x0C; // CONFIG1
+    _regs[0x3][0] = 0x8B; // CONFIG2
+    _regs[0x5][0] = 0x73; // IRQ
+    _regs[0x6][0] = 0x01; // MUX
+    _regs[0xA][0] = 0x80; // GAINCAL
+    _regs[0xD][0] = 0xA5; // LOCK
+}
+
+/**
+ * @brief A transaction starts with a command byte when chip select goes low
+*/
+void SimMCP3564R::select(bool selected) {
+    if(selected) _command = true;
+}
+
+uint8_t SimMCP3564R::transfer(uint8_t tx) {
+    if(_command) {
+        _command = false;
+        _reg = (tx >> 2) & 0x0F;
+        _type = tx & 0x03;
+        _byte = 0;
+        if((tx >> 6) != _address) _type = 0; // Another device, ignore the rest
+        if(_type == 0x02) register_writes++;
+        if(_type == 0x03) register_reads++;
+        // Status byte: address, then DR_STATUS low while a conversion is waiting
+        return ((_address & 0x03) << 4) | ((~_address & 0x01) << 3) | (_data_ready ? 0x00 : 0x04) | 0x03;
+    }
+
+    uint8_t rx = 0x00;
+    if(_type == 0x01 || _type == 0x03) {
+        rx = _regs[_reg][_byte];
+        if(_reg == 0x0 && _byte == register_size(0x0) - 1) {
+            _data_ready = false;
+            HAL::sim::drive_gpio(_irq_pin, true);
+        }
+    } else if(_type == 0x02) {
+        if(_reg == 0x5) {
+            _regs[_reg][_byte] = (_regs[_reg][_byte] & 0xF0) | (tx & 0x0F); // The status bits are read only
+        } else if(_reg != 0x0 && _reg != 0xF) {
+            _regs[_reg][_byte] = tx;
+        }
+    } else {
+        return 0x00;
+    }
+    if(++_byte >= register_size(_reg)) {
+        _byte = 0;
+        if(_type != 0x01) _reg = (_reg + 1) % REGISTERS; // Static reads stay on the register
+    }
+    return rx;
+}
+
+/**
+ * @brief Convert whenever a conversion period has passed in continuous conversion mode
+*/
+void SimMCP3564R::step(uint64_t now_us, uint32_t dt_us) {
+    bool converting = (_regs[0x1][0] & 0x03) == 0x03 && (_regs[0x4][0] & 0xC0) == 0xC0;
+    if(!converting) {
+        _next_ns = 0;
+        return;
+    }
+    if(_next_ns == 0) {
+        _next_ns = now_us * 1000u + period_ns();
+        if(start_us == UINT64_MAX) start_us = now_us;
+    }
+    while(now_us * 1000u >= _next_ns) {
+        convert(now_us);
+        _next_ns += period_ns();
+    }
+}
+
+/**
+ * @brief Bridge output in ADC codes without noise
+*/
+float SimMCP3564R::bridge(uint64_t now_us) const {
+    float value = baseline + drift * (float)now_us * 1e-6f;
+    if(start_us == UINT64_MAX || now_us < start_us + press_delay_ms * 1000u) return value;
+    uint64_t t = (now_us - start_us - press_delay_ms * 1000u) % (press_period_ms * 1000u);
+    uint64_t rise = press_rise_ms * 1000u;
+    uint64_t length = press_length_ms * 1000u;
+    float level = 0.0f;
+    if(t < rise) {
+        level = (float)t / (float)rise;
+    } else if(t < length) {
+        level = 1.0f;
+    } else if(t < length + rise) {
+        level = 1.0f - (float)(t - length) / (float)rise;
+    }
+    return value + level * press_size;
+}
+
+/**
+ * @brief True while the bridge is pressed past half the press size
+*/
+bool SimMCP3564R::pressed(uint64_t now_us) const {
+    return bridge(now_us) - (baseline + drift * (float)now_us * 1e-6f) > 0.5f * press_size;
+}
+
+/**
+ * @brief Register contents as they would be read, most significant byte first
+*/
+uint32_t SimMCP3564R::get_register(uint8_t reg) const {
+    uint32_t value = 0;
+    for(uint8_t i = 0; i < register_size(reg); i++) value = (value << 8) | _regs[reg][i];
+    return value;
+}
+
+uint8_t SimMCP3564R::register_size(uint8_t reg) const {
+    switch(reg) {
+        case 0x0: return ((_regs[0x4][0] & 0x30) == 0x00) ? 3 : 4; // ADCDATA, 24 bits in data format 0
+        case 0x7: case 0x8: case 0x9: case 0xA: case 0xB: case 0xC: return 3;
+        case 0xF: return 2;
+        default: return 1;
+    }
+}
+
+/**
+ * @brief Conversion period from the internal clock, prescaler and oversampling ratio
+*/
+uint64_t SimMCP3564R::period_ns(void) const {
+    static const uint32_t osr[16] = {32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 20480, 24576, 40960, 49152, 81920, 98304};
+    const uint64_t mclk_hz = 4915200u;
+    uint8_t config1 = _regs[0x2][0];
+    uint64_t prescaler = 1u << ((config1 >> 6) & 0x03);
+    // The digital filter runs at a quarter of the analog clock
+    return (uint64_t)osr[(config1 >> 2) & 0x0F] * 4u * prescaler * 1000000000u / mclk_hz;
+}
+
+/**
+ * @brief Take a sample of the bridge into ADCDATA and signal it on the IRQ pin
+*/
+void SimMCP3564R::convert(uint64_t now_us) {
+    _seed = _seed * 1664525u + 1013904223u;
+    int32_t value = (int32_t)bridge(now_us) + (int32_t)((_seed >> 8) % (uint32_t)(2 * noise + 1)) - noise;
+    if(value > 0x7FFFFF) value = 0x7FFFFF;
+    if(value < -0x800000) value = -0x800000;
+    uint32_t code = (uint32_t)value & 0xFFFFFF;
+    uint8_t channel = 0;
+    uint16_t scan = ((uint16_t)_regs[0x7][1] << 8) | _regs[0x7][2];
+    while(channel < 15 && !(scan & (1u << channel))) channel++;
+
+    switch((_regs[0x4][0] >> 4) & 0x03) {
+        case 0: code <<= 8; break; // Only the top three bytes are read
+        case 1: code <<= 8; break;
+        case 2: code |= (value < 0) ? 0xFF000000 : 0; break;
+        default: code |= ((uint32_t)channel << 28) | ((value < 0) ? 0x0F000000 : 0); break;
+    }
+    for(int i = 0; i < 4; i++) _regs[0x0][i] = (code >> (24 - 8 * i)) & 0xFF;
+
+    if(_data_ready) unread++;
+    _data_ready = true;
+    conversions++;
+    // The pin goes high for a moment before every new conversion, so each one is a falling edge
+    HAL::sim::drive_gpio(_irq_pin, true);
+    HAL::sim::drive_gpio(_irq_pin, false);
+}
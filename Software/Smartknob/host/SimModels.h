@@ -0,0 +1,111 @@
+/*
+ *  Title: Simulation Models
+
+ *  Description: Software models of the Smartknob hardware for the host HAL backend
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <HAL.h>
+
+/**
+ * @brief Rigid body model of a gimbal BLDC with the knob attached, driven by the simulated PWM outputs
+*/
+class SimMotor : public HAL::sim::Process {
+public:
+    struct params {
+        int pole_pairs = 7;
+        int direction = -1;                     // Sign between mechanical and electrical angle
+        float zero_electric_angle = 4.062365f;  // Electrical offset of the rotor magnets
+        float supply_voltage = 5.0f;
+        float resistance = 5.6f;                // Phase resistance in ohm
+        float kt = 0.04f;                       // Torque and back-EMF constant in Nm/A and V*s/rad
+        float inertia = 2.0e-6f;                // Rotor and knob inertia in kg*m^2
+        float friction = 1.0e-5f;               // Viscous friction in Nm*s/rad
+    };
+
+    SimMotor(uint u_h, uint v_h, uint w_h, params p);
+    void step(uint64_t now_us, uint32_t dt_us) override;
+
+    float angle;            // Mechanical angle in rad, unwrapped
+    float velocity;         // Mechanical velocity in rad/s
+    float external_torque;  // Torque applied by the user in Nm
+    float torque;           // Torque produced by the motor in Nm
+private:
+    uint _u_h, _v_h, _w_h;
+    params _p;
+};
+
+/**
+ * @brief MT6701 SSI interface reporting the angle of a SimMotor.
+ *      Can add the first and second harmonic errors a real magnet and sensor have,
+ *      from eccentricity and from the field not being perfectly circular.
+*/
+class SimMT6701 : public HAL::sim::SpiDevice {
+public:
+    SimMT6701(const SimMotor* motor);
+    void select(bool selected) override;
+    uint8_t transfer(uint8_t tx) override;
+
+    float error(float angle) const;
+
+    uint8_t status = 0;             // 4 status bits reported in the frame
+    float first_harmonic = 0.0f;    // Amplitude of the angle error in rad
+    float second_harmonic = 0.0f;
+private:
+    const SimMotor* _motor;
+    uint8_t _frame[3];
+    uint _index = 0;
+};
+
+/**
+ * @brief MCP3564R reading a strain gauge bridge. Keeps its registers, converts continuously at the
+ *      rate the prescaler and oversampling give once it is put in conversion mode, and pulls the
+ *      IRQ pin low for every new conversion until ADCDATA is read. The bridge gives a noisy,
+ *      drifting baseline with presses on top, starting press_delay_ms after conversions start.
+*/
+class SimMCP3564R : public HAL::sim::SpiDevice, public HAL::sim::Process {
+public:
+    SimMCP3564R(uint irq_pin, uint8_t address = 0x1);
+    void select(bool selected) override;
+    uint8_t transfer(uint8_t tx) override;
+    void step(uint64_t now_us, uint32_t dt_us) override;
+
+    float bridge(uint64_t now_us) const;
+    bool pressed(uint64_t now_us) const;
+    uint32_t get_register(uint8_t reg) const;
+
+    float baseline = 120000.0f;     // ADC codes
+    float drift = 40.0f;            // ADC codes per second
+    int32_t noise = 150;            // Peak ADC codes of uniform noise
+    float press_size = 20000.0f;    // ADC codes a press adds
+    uint32_t press_delay_ms = 1000;
+    uint32_t press_period_ms = 2000;
+    uint32_t press_length_ms = 400;
+    uint32_t press_rise_ms = 5;     // Time a press takes to reach its full size, and to let go
+
+    uint32_t register_reads = 0;    // Incremental read transactions, the stream uses static reads
+    uint32_t register_writes = 0;
+    uint32_t conversions = 0;
+    uint32_t unread = 0;            // Conversions overwritten before they were read
+    uint64_t start_us = UINT64_MAX; // When conversions started
+private:
+    static const uint8_t REGISTERS = 16;
+    uint _irq_pin;
+    uint8_t _address;
+    uint8_t _regs[REGISTERS][4];
+    bool _data_ready = false;
+    uint64_t _next_ns = 0;
+    uint32_t _seed = 12345;
+
+    // SPI transaction
+    bool _command = true;
+    uint8_t _reg = 0;
+    uint8_t _type = 0;
+    uint8_t _byte = 0;
+
+    uint8_t register_size(uint8_t reg) const;
+    uint64_t period_ns(void) const;
+    void convert(uint64_t now_us);
+};
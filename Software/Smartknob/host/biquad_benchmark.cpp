@@ -0,0 +1,126 @@
+/*
+ *  Title: Biquad Benchmark
+
+ *  Description: Puts biquad cascades next to FIR filters doing the same job, a 50 Hz low pass
+ *      and a 50 Hz mains notch at 1 kHz. Prints the gain of each measured by running sines
+ *      through the filters, the Q15 biquad included so its rounding shows, and samples per
+ *      second on this machine for float, Q15 and Q31.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <FIR.h>
+#include <Biquad.h>
+
+const float SAMPLE_RATE = 1000.0f;  // Hz
+const float CUTOFF = 50.0f;         // Hz
+const uint32_t SAMPLES = 1 << 20;
+const size_t BLOCK = 64;
+const float _pi = 3.14159265358979323846f;
+
+volatile float sink = 0.0f; // Keeps the filters from being optimized away
+
+constexpr Biquad_params LOWPASS = {Biquad_type::BUTTERWORTH_LPF, CUTOFF, SAMPLE_RATE};
+constexpr Biquad_params MAINS = {Biquad_type::NOTCH, CUTOFF, SAMPLE_RATE, 10.0f};
+// The FIR cutoff is where it is down 6 dB, put it a little past the Butterworth -3 dB point
+constexpr FIR_params FIR_LOWPASS = {FIR_type::LPF, 1.15f * CUTOFF, SAMPLE_RATE};
+constexpr FIR_params FIR_MAINS = {FIR_type::BSF, 45.0f, SAMPLE_RATE, 55.0f};
+static_assert(Biquad_design::is_stable<4>(Biquad_design::generate<4, q15_t>(LOWPASS)));
+
+template <uint SECTIONS, typename T> Biquad<SECTIONS, T> make_biquad(const Biquad_params& params) {
+    static constexpr auto lowpass = Biquad_design::generate<SECTIONS, T>(LOWPASS);
+    static constexpr auto mains = Biquad_design::generate<SECTIONS, T>(MAINS);
+    return Biquad<SECTIONS, T>(params.type == Biquad_type::NOTCH ? mains : lowpass);
+}
+
+template <uint N, typename T> FIR<N, T> make_fir(const FIR_params& params) {
+    static constexpr auto lowpass = FIR_design::generate<N, T>(FIR_LOWPASS);
+    static constexpr auto mains = FIR_design::generate<N, T>(FIR_MAINS);
+    return FIR<N, T>(params.type == FIR_type::BSF ? mains : lowpass);
+}
+
+template <typename T> T to_sample(float x) {
+    if constexpr(std::is_same<T, float>::value) return x;
+    else if constexpr(std::is_same<T, q15_t>::value) return Fixed::float_to_q15(x);
+    else return Fixed::float_to_q31(x);
+}
+
+template <typename T> float to_float(T x) {
+    if constexpr(std::is_same<T, float>::value) return x;
+    else if constexpr(std::is_same<T, q15_t>::value) return Fixed::q15_to_float(x);
+    else return Fixed::q31_to_float(x);
+}
+
+/**
+ * @brief Gain for a sine at a frequency, from the output amplitude once the filter has settled
+*/
+template <typename T, typename F> float response_db(F filter, float frequency) {
+    const uint32_t count = 20000;
+    const float amplitude = 0.2f;
+    std::vector<T> samples(count);
+    for(uint32_t i = 0; i < count; i++) samples[i] = to_sample<T>(amplitude * sinf(2.0f * _pi * frequency * (float)i / SAMPLE_RATE));
+    for(uint32_t i = 0; i < count; i += BLOCK) filter.run(&samples[i], &samples[i], count - i < BLOCK ? count - i : BLOCK);
+
+    double power = 0.0;
+    for(uint32_t i = count / 2; i < count; i++) power += (double)to_float(samples[i]) * to_float(samples[i]);
+    double rms = sqrt(power / (count - count / 2));
+    return 20.0f * log10f((float)(rms * sqrt(2.0) / amplitude) + 1e-7f);
+}
+
+template <typename T, typename F> double msamples_per_second(F filter) {
+    std::vector<T> input(SAMPLES);
+    std::vector<T> output(SAMPLES);
+    uint32_t seed = 12345;
+    for(uint32_t i = 0; i < SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = to_sample<T>(((float)(seed >> 8) / 16777216.0f - 0.5f) * 0.01f);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < SAMPLES; i += BLOCK) filter.run(&input[i], &output[i], BLOCK);
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = sink + to_float(output[SAMPLES - 1]);
+    return SAMPLES / s * 1e-6;
+}
+
+template <typename F, typename G, typename H> void throughput(const char* name, F make_float, G make_q15, H make_q31) {
+    printf("%-26s  %9.1f  %9.1f  %9.1f\n", name, msamples_per_second<float>(make_float()),
+        msamples_per_second<q15_t>(make_q15()), msamples_per_second<q31_t>(make_q31()));
+}
+
+int main() {
+    printf("%.0f Hz low pass at %.0f Hz, gain in dB\n", CUTOFF, SAMPLE_RATE);
+    printf("   Hz  biquad x2  biquad x2 Q15  biquad x4    FIR 63   FIR 255\n");
+    const float lowpass_frequencies[] = {5, 25, 40, 50, 60, 75, 100, 150, 200, 300, 450};
+    for(float f : lowpass_frequencies) {
+        printf("%5.0f  %9.2f  %13.2f  %9.2f  %8.2f  %8.2f\n", f,
+            response_db<float>(make_biquad<2, float>(LOWPASS), f), response_db<q15_t>(make_biquad<2, q15_t>(LOWPASS), f),
+            response_db<float>(make_biquad<4, float>(LOWPASS), f), response_db<float>(make_fir<63, float>(FIR_LOWPASS), f),
+            response_db<float>(make_fir<255, float>(FIR_LOWPASS), f));
+    }
+
+    printf("\n%.0f Hz notch at %.0f Hz, gain in dB\n", CUTOFF, SAMPLE_RATE);
+    printf("   Hz  biquad x1  biquad x3 Q15   FIR 255\n");
+    const float notch_frequencies[] = {5, 30, 45, 48, 50, 52, 55, 70, 100, 150, 200};
+    for(float f : notch_frequencies) {
+        printf("%5.0f  %9.2f  %13.2f  %8.2f\n", f,
+            response_db<float>(make_biquad<1, float>(MAINS), f), response_db<q15_t>(make_biquad<3, q15_t>(MAINS), f),
+            response_db<float>(make_fir<255, float>(FIR_MAINS), f));
+    }
+
+    printf("\nMsamples/s, blocks of %u\n", (unsigned)BLOCK);
+    printf("                                float        Q15        Q31\n");
+    throughput("biquad x2 (10 multiplies)", [] { return make_biquad<2, float>(LOWPASS); },
+        [] { return make_biquad<2, q15_t>(LOWPASS); }, [] { return make_biquad<2, q31_t>(LOWPASS); });
+    throughput("biquad x4 (20 multiplies)", [] { return make_biquad<4, float>(LOWPASS); },
+        [] { return make_biquad<4, q15_t>(LOWPASS); }, [] { return make_biquad<4, q31_t>(LOWPASS); });
+    throughput("FIR 63 (32 multiplies)", [] { return make_fir<63, float>(FIR_LOWPASS); },
+        [] { return make_fir<63, q15_t>(FIR_LOWPASS); }, [] { return make_fir<63, q31_t>(FIR_LOWPASS); });
+    throughput("FIR 255 (128 multiplies)", [] { return make_fir<255, float>(FIR_LOWPASS); },
+        [] { return make_fir<255, q15_t>(FIR_LOWPASS); }, [] { return make_fir<255, q31_t>(FIR_LOWPASS); });
+    return 0;
+}
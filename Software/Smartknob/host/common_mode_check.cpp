@@ -0,0 +1,147 @@
+/*
+ *  Title: Common Mode Check
+
+ *  Description: Golden vectors for FOC::common_mode and FOC::common_mode_q15 with every
+ *      modulation. Balanced phases are checked against the closed forms, minus half the middle
+ *      phase for SPACE_VECTOR and A*cos(3t)/6 for THIRD_HARMONIC, unbalanced and edge
+ *      cases against the formulas in double. The Q15 vectors are exact, from the same integer
+ *      steps in Python. Exits with 1 if anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <FOC.h>
+
+const float FLOAT_TOLERANCE = 2e-6f;    // V
+const int32_t Q15_THEORY_TOLERANCE = 8; // LSB from A*cos(3t)/6, for amplitudes of 30% and up
+
+struct float_vector_t {
+    float v_u, v_v, v_w;
+    float space_vector;
+    float third_harmonic;
+};
+
+struct q15_vector_t {
+    int32_t v_u, v_v, v_w;
+    int32_t space_vector;
+    int32_t third_harmonic;
+};
+
+// Balanced phases of amplitude 0.1, 1, 2.5 and 2.88 V at 0, 0.3, 1, 2.2, 4 and 5.5 rad, then odd ones
+const float_vector_t float_vectors[] = {
+    {0.1f, -0.05f, -0.05f, 0.025f, 0.0166666667f},
+    {0.0955336489f, -0.0221740238f, -0.0733596251f, 0.0110870119f, 0.0103601661f},
+    {0.0540302306f, 0.0458584096f, -0.0998886402f, -0.0229292048f, -0.0164998749f},
+    {-0.0588501117f, 0.0994428983f, -0.0405927866f, 0.0202963933f, 0.0158372099f},
+    {-0.0653643621f, -0.0328588376f, 0.0982231997f, 0.0164294188f, 0.0140642326f},
+    {0.0708669774f, -0.0965350732f, 0.0256680958f, -0.0128340479f, -0.0117066176f},
+    {1.0f, -0.5f, -0.5f, 0.25f, 0.166666667f},
+    {0.955336489f, -0.221740238f, -0.733596251f, 0.110870119f, 0.103601661f},
+    {0.540302306f, 0.458584096f, -0.998886402f, -0.229292048f, -0.164998749f},
+    {-0.588501117f, 0.994428983f, -0.405927866f, 0.202963933f, 0.158372099f},
+    {-0.653643621f, -0.328588376f, 0.982231997f, 0.164294188f, 0.140642326f},
+    {0.708669774f, -0.965350732f, 0.256680958f, -0.128340479f, -0.117066176f},
+    {2.5f, -1.25f, -1.25f, 0.625f, 0.416666667f},
+    {2.38834122f, -0.554350596f, -1.83399063f, 0.277175298f, 0.259004153f},
+    {1.35075576f, 1.14646024f, -2.49721601f, -0.573230121f, -0.412496874f},
+    {-1.47125279f, 2.48607246f, -1.01481966f, 0.507409832f, 0.395930247f},
+    {-1.63410905f, -0.82147094f, 2.45557999f, 0.41073547f, 0.351605816f},
+    {1.77167444f, -2.41337683f, 0.641702395f, -0.320851198f, -0.292665441f},
+    {2.88f, -1.44f, -1.44f, 0.72f, 0.48f},
+    {2.75136909f, -0.638611886f, -2.1127572f, 0.319305943f, 0.298372785f},
+    {1.55607064f, 1.3207222f, -2.87679284f, -0.660361099f, -0.475196398f},
+    {-1.69488322f, 2.86395547f, -1.16907225f, 0.584536127f, 0.456111644f},
+    {-1.88249363f, -0.946334523f, 2.82882815f, 0.473167262f, 0.4050499f},
+    {2.04096895f, -2.78021011f, 0.73924116f, -0.36962058f, -0.337150588f},
+    {0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+    {1.0f, 2.0f, -0.5f, 0.75f, -0.19047619f},
+    {-4.0f, 1.0f, 2.4f, -0.8f, -0.421792619f},
+    {0.3f, 0.3f, 0.3f, 0.3f, 0.1f},
+    {5.0f, -5.0f, 0.0f, 0.0f, 0.0f},
+    {1e-07f, -1e-07f, 0.0f, 0.0f, 0.0f},
+};
+
+// Balanced phases of 5%, 30%, 50% and 57.7% of the limit at the same angles, then odd ones and full scale
+const q15_vector_t q15_vectors[] = {
+    {1638, -819, -819, 409, 270},
+    {1565, -363, -1202, 181, 0},
+    {885, 751, -1637, -376, -270},
+    {-964, 1629, -665, 332, 0},
+    {-1071, -538, 1609, 269, 0},
+    {1161, -1582, 421, -211, -268},
+    {9830, -4915, -4915, 2457, 1637},
+    {9391, -2180, -7211, 1090, 1015},
+    {5311, 4508, -9819, -2254, -1622},
+    {-5785, 9775, -3990, 1995, 1556},
+    {-6425, -3230, 9655, 1615, 1378},
+    {6966, -9489, 2523, -1262, -1156},
+    {16384, -8192, -8192, 4096, 2730},
+    {15652, -3633, -12019, 1816, 1696},
+    {8852, 7513, -16365, -3757, -2704},
+    {-9642, 16292, -6651, 3325, 2595},
+    {-10709, -5383, 16092, 2691, 2301},
+    {11610, -15816, 4205, -2103, -1920},
+    {18907, -9453, -9453, 4727, 3150},
+    {18062, -4192, -13870, 2096, 1958},
+    {10215, 8670, -18886, -4336, -3120},
+    {-11127, 18801, -7675, 3837, 2994},
+    {-12358, -6212, 18571, 3106, 2657},
+    {13399, -18251, 4853, -2426, -2215},
+    {0, 0, 0, 0, 0},
+    {3, -1, -2, 0, 0},
+    {40, -20, -20, 10, 0},
+    {1000, 2000, -500, 750, -206},
+    {-20000, 5000, 12000, -4000, -2109},
+    {32767, -32768, 0, -1, 0},
+    {32767, 32767, 32767, 32767, 10922},
+    {-32768, -32768, -32768, -32768, -10922},
+    {16384, -8192, -8192, 4096, 2730},
+};
+
+const uint BALANCED = 24;
+uint32_t failures = 0;
+
+int main() {
+    uint32_t checked = 0;
+    for(const float_vector_t& v : float_vectors) {
+        float sine = FOC::common_mode<Modulation::SINE>(v.v_u, v.v_v, v.v_w);
+        float space_vector = FOC::common_mode<Modulation::SPACE_VECTOR>(v.v_u, v.v_v, v.v_w);
+        float third_harmonic = FOC::common_mode<Modulation::THIRD_HARMONIC>(v.v_u, v.v_v, v.v_w);
+        if(sine != 0.0f || fabsf(space_vector - v.space_vector) > FLOAT_TOLERANCE || fabsf(third_harmonic - v.third_harmonic) > FLOAT_TOLERANCE) {
+            printf("FAIL: %g %g %g gave %g %g %g, expected 0 %g %g\n", v.v_u, v.v_v, v.v_w, sine, space_vector, third_harmonic,
+                v.space_vector, v.third_harmonic);
+            failures++;
+        }
+        checked++;
+    }
+
+    for(uint i = 0; i < sizeof(q15_vectors) / sizeof(q15_vectors[0]); i++) {
+        const q15_vector_t& v = q15_vectors[i];
+        int32_t sine = FOC::common_mode_q15<Modulation::SINE>(v.v_u, v.v_v, v.v_w);
+        int32_t space_vector = FOC::common_mode_q15<Modulation::SPACE_VECTOR>(v.v_u, v.v_v, v.v_w);
+        int32_t third_harmonic = FOC::common_mode_q15<Modulation::THIRD_HARMONIC>(v.v_u, v.v_v, v.v_w);
+        if(sine != 0 || space_vector != v.space_vector || third_harmonic != v.third_harmonic) {
+            printf("FAIL: %d %d %d gave %d %d %d, expected 0 %d %d\n", v.v_u, v.v_v, v.v_w, sine, space_vector, third_harmonic,
+                v.space_vector, v.third_harmonic);
+            failures++;
+        }
+
+        // The Q15 third harmonic follows the float one closely enough from 30% up, where clipping starts to matter
+        if(i >= 6 && i < BALANCED) {
+            const float angles[6] = {0.0f, 0.3f, 1.0f, 2.2f, 4.0f, 5.5f};
+            float amplitude = sqrtf((float)(v.v_u * v.v_u + v.v_v * v.v_v + v.v_w * v.v_w) * (2.0f / 3.0f));
+            int32_t theory = (int32_t)lrintf(amplitude * cosf(3.0f * angles[i % 6]) / 6.0f);
+            if(abs(third_harmonic - theory) > Q15_THEORY_TOLERANCE) {
+                printf("FAIL: %d %d %d third harmonic %d, %d from A*cos(3t)/6\n", v.v_u, v.v_v, v.v_w, third_harmonic, theory);
+                failures++;
+            }
+        }
+        checked++;
+    }
+
+    printf("%u vectors\n", checked);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+/*
+ *  Title: Control Tick Benchmark
+
+ *  Description: Times the work of one control tick of main.cpp on this machine, the float
+ *      path against the Q15 path, from the encoder count to the PWM levels. Both go through
+ *      EncoderAngle, their tracking observer, the haptic table, the damping and their FOC
+ *      update on the same counts of a knob turned back and forth over the detents. The SPI
+ *      read of the encoder is left out, it is a DMA transfer started before the work. The
+ *      host has an FPU, so the float path is much cheaper here than on the RP2040, where
+ *      every float operation is a soft float call. Prints ns per tick and the share of a
+ *      tick at a few control rates.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <HAL.h>
+#include <TMC6300.h>
+#include <FOC.h>
+#include <Fixed.h>
+#include <PIDBank.h>
+#include <EncoderAngle.h>
+#include <TrackingObserver.h>
+#include <FixedTrackingObserver.h>
+#include <Haptic.h>
+#include <HapticProfiles.h>
+#include "../pin_assignments.h"
+
+const uint32_t TICKS = 1 << 20;
+const uint32_t COUNTS = 1 << 14;        // Length of the knob trace, repeated
+const float DT = 1e-3f;
+const float VOLTAGE_LIMIT = 5.0f;
+const float DAMPING = 0.02f;            // V*s/rad, as in main.cpp
+const float END_STOP_DAMPING = 0.05f;
+const float TORQUE_LIMIT = 2.5f;
+const uint32_t RATES_HZ[] = {1000, 10000, 20000};
+
+const float _2pi = 6.28318530717958647692f;
+
+volatile int32_t sink = 0; // Keeps the ticks from being optimized away
+
+template <typename T> T constrain(T amt, T low, T high) {
+    if(amt < low) return low;
+    if(amt > high) return high;
+    return amt;
+}
+
+template <typename F> double ns_per_tick(F function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / TICKS;
+}
+
+void row(const char* name, double ns) {
+    printf("%-10s  %8.1f", name, ns);
+    for(uint32_t rate : RATES_HZ) printf("  %9.2f%%", ns * rate * 1e-7);
+    printf("\n");
+}
+
+int main() {
+    HAL::init();
+    TMC6300 tmc6300(UH, VH, WH, UL, VL, WL, 5.0f);
+    tmc6300.init(24000L, 0.05);
+    tmc6300.set_enabled(true);
+    FOC foc(7, NULL, &tmc6300, Direction::CCW, VOLTAGE_LIMIT);
+    foc.init(true);
+    foc.set_zero_electric_angle(4.062365f);
+
+    // Knob turned back and forth over about ten coarse detents, with some noise on the count
+    std::vector<uint16_t> counts;
+    uint32_t seed = 12345;
+    for(uint32_t i = 0; i < COUNTS; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float turns = 0.15f * sinf(_2pi * (float)i / (float)COUNTS) + 0.0002f * ((float)(seed >> 8) / (float)(1 << 24) - 0.5f);
+        counts.push_back((uint16_t)((int32_t)floorf(turns * 16384.0f) & 0x3FFF));
+    }
+    const uint32_t mask = COUNTS - 1;
+
+    printf("Work of a control tick on this machine, %u ticks, without the SPI read\n", TICKS);
+    printf("%-10s  %8s", "", "ns");
+    for(uint32_t rate : RATES_HZ) printf("  %7u Hz", rate);
+    printf("\n");
+
+    // Float path of main.cpp
+    EncoderAngle knob_angle;
+    TrackingObserver observer(150.0f, DT);
+    Haptic haptic;
+    SMARTKNOB::PIDBank<2> damping_loops;
+    damping_loops.configure(0, SMARTKNOB::PID(DAMPING, 0.0f, 0.0f));
+    damping_loops.configure(1, SMARTKNOB::PID(END_STOP_DAMPING, 0.0f, 0.0f));
+    haptic.select(&HapticProfiles::coarse);
+    knob_angle.reset(counts[0]);
+    haptic.reset(knob_angle.get_count(), 25);
+    observer.reset(knob_angle.get_radians());
+    float sum = 0.0f;
+    double float_ns = ns_per_tick([&]() {
+        for(uint32_t i = 0; i < TICKS; i++) {
+            uint16_t count = counts[i & mask];
+            int32_t angle = knob_angle.update(count);
+            observer.update(knob_angle.get_radians());
+            float profile_torque = haptic.update(angle) * (VOLTAGE_LIMIT / 32768.0f);
+            float velocity[2] = {observer.get_velocity(), 0.0f};
+            if(haptic.past_end_stop()) velocity[1] = velocity[0];
+            const float* damping_torque = damping_loops.update(velocity, DT);
+            float torque = constrain(profile_torque + damping_torque[0] + damping_torque[1], -TORQUE_LIMIT, TORQUE_LIMIT);
+            foc.update(foc.get_direction() * torque, count);
+            sum += torque;
+        }
+    });
+    row("float", float_ns);
+
+    // Q15 path of main.cpp
+    EncoderAngle fixed_knob_angle;
+    FixedTrackingObserver fixed_observer(150.0f, DT);
+    Haptic fixed_haptic;
+    const int32_t damping = (int32_t)(DAMPING * _2pi / VOLTAGE_LIMIT * 32768.0f);
+    const int32_t end_stop_damping = (int32_t)(END_STOP_DAMPING * _2pi / VOLTAGE_LIMIT * 32768.0f);
+    const q15_t torque_limit = Fixed::float_to_q15(TORQUE_LIMIT / VOLTAGE_LIMIT);
+    fixed_haptic.select(&HapticProfiles::coarse);
+    fixed_knob_angle.reset(counts[0]);
+    fixed_haptic.reset(fixed_knob_angle.get_count(), 25);
+    fixed_observer.reset(fixed_knob_angle.get_angle_q16());
+    int32_t sum_fixed = 0;
+    double fixed_ns = ns_per_tick([&]() {
+        for(uint32_t i = 0; i < TICKS; i++) {
+            uint16_t count = counts[i & mask];
+            int32_t angle = fixed_knob_angle.update(count);
+            fixed_observer.update(fixed_knob_angle.get_angle_q16());
+            q15_t profile_torque = fixed_haptic.update(angle);
+            int32_t damping_gain = damping + (fixed_haptic.past_end_stop() ? end_stop_damping : 0);
+            q15_t damping_torque = Fixed::q15_sat((int32_t)(((int64_t)damping_gain * fixed_observer.get_velocity()) >> 16));
+            q15_t torque = constrain<q15_t>(Fixed::q15_sat(profile_torque - damping_torque), -torque_limit, torque_limit);
+            foc.update_q15(foc.get_direction() * torque, count);
+            sum_fixed += torque;
+        }
+    });
+    row("Q15", fixed_ns);
+
+    sink = (int32_t)sum + sum_fixed;
+    return 0;
+}
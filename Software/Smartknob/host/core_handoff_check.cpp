@@ -0,0 +1,210 @@
+/*
+ *  Title: Core Handoff Check
+
+ *  Description: Stresses the two core emulation of the host HAL the way main.cpp uses it.
+ *      Core 1 ticks on busy_wait_until_us, pushes a sample per tick to core 0 and takes
+ *      commands back, both over SPSCQueues, while core 0 moves the virtual clock in steps
+ *      and sleeps of random length so the queues run full and empty. Every tick has to start
+ *      on time or be skipped because a wait for the mutex ran past it, the clock must not
+ *      move while core 1 works, no sample or command may be lost, repeated or reordered
+ *      except for samples dropped on a full queue, and a HAL mutex taken by both cores,
+ *      sometimes held while the clock moves, has to keep them apart. Exits with 1 if
+ *      anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <atomic>
+#include <HAL.h>
+#include <SPSCQueue.h>
+
+const uint64_t DURATION_US = 4000000;
+const uint32_t TICK_US = 50;            // A multiple of the clock step, so ticks can start exactly on time
+const uint32_t MUTEX_TICKS = 16;        // Core 1 takes the mutex every this many ticks
+
+struct tick_sample_t {
+    uint32_t tick;
+    uint64_t time_us;
+    uint32_t dropped;                   // Samples dropped before this one
+    uint32_t command;                   // Last command core 1 had taken
+};
+
+SPSCQueue<tick_sample_t, 64> samples;   // Core 1 to core 0, fills in 3.2 ms
+SPSCQueue<uint32_t, 16> commands;       // Core 0 to core 1
+
+HAL::mutex_t mutex;
+uint64_t shared_count = 0;              // Only touched with the mutex held
+int owner = -1;
+
+std::atomic<bool> finished{false};
+std::atomic<uint32_t> failures{0};
+
+// Core 1 results, read by core 0 once finished
+uint32_t ticks = 0;
+uint32_t dropped = 0;
+uint32_t late = 0;                      // Ticks that did not start on time
+uint32_t skipped = 0;                   // Ticks passed over because the mutex held core 1 past them
+uint32_t frozen = 0;                    // Ticks where the clock moved during the work
+uint32_t core1_locks = 0;
+uint32_t contended = 0;                 // Times the mutex made core 1 wait
+
+void check(bool ok, const char* format, ...) {
+    if(ok) return;
+    va_list args;
+    va_start(args, format);
+    printf("FAIL: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    failures++;
+}
+
+uint32_t next_random(uint32_t* seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+/**
+ * @brief Take the mutex, hold it for a while and check nobody else got in
+*/
+void locked_increment(int core, uint32_t hold_steps) {
+    HAL::mutex_enter_blocking(&mutex);
+    check(owner == -1, "core %d got the mutex while core %d held it", core, owner);
+    owner = core;
+    shared_count++;
+    for(uint32_t i = 0; i < hold_steps; i++) HAL::tight_loop_contents();
+    check(owner == core, "core %d lost the mutex to core %d", core, owner);
+    owner = -1;
+    HAL::mutex_exit(&mutex);
+}
+
+void core1_entry() {
+    uint32_t seed = 99;
+    uint32_t expected_command = 0;
+    uint32_t last_command = 0;
+    uint64_t next_tick = HAL::time_us() + TICK_US;
+    while(HAL::running()) {
+        HAL::busy_wait_until_us(next_tick);
+        if(!HAL::running()) break;
+        uint64_t start = HAL::time_us();
+        if(start != next_tick) late++;
+
+        // Commands have to come in order and none may be missing
+        uint32_t command;
+        while(commands.pop(&command)) {
+            check(command == expected_command, "tick %u: command %u, expected %u", ticks, command, expected_command);
+            expected_command = command + 1;
+            last_command = command;
+        }
+
+        // Work of random length, the clock has to stand still through it
+        uint32_t work = next_random(&seed) & 0x3FF;
+        volatile uint32_t sink = 0;
+        for(uint32_t i = 0; i < work; i++) {
+            sink = sink + i;
+            if(HAL::time_us() != start) {
+                frozen++;
+                break;
+            }
+        }
+
+        tick_sample_t sample = {ticks, start, dropped, last_command};
+        if(!samples.push(sample)) dropped++;
+        ticks++;
+
+        if(ticks % MUTEX_TICKS == 0) {
+            locked_increment(1, 0);
+            core1_locks++;
+            if(HAL::time_us() != start) contended++;
+        }
+
+        // Stay on the grid, a wait for the mutex that ran into the next tick skips it like the control loop would
+        next_tick += TICK_US;
+        while(next_tick < HAL::time_us()) {
+            if(next_tick < DURATION_US) skipped++;
+            next_tick += TICK_US;
+        }
+    }
+    finished.store(true, std::memory_order_release);
+}
+
+int main() {
+    HAL::init();
+    HAL::mutex_init(&mutex);
+    HAL::sim::set_duration_us(DURATION_US);
+    uint64_t launch = HAL::time_us();
+    HAL::multicore_launch_core1(core1_entry);
+
+    uint32_t seed = 12345;
+    uint32_t received = 0;
+    uint32_t next_tick = 0;             // Next sample expected
+    uint32_t missing = 0;               // Samples skipped, has to match what core 1 dropped
+    uint32_t sent = 0;
+    uint32_t last_command = 0;
+    uint32_t core0_locks = 0;
+    uint32_t sleeps = 0;
+    while(!finished.load(std::memory_order_acquire)) {
+        tick_sample_t batch[40];
+        uint32_t count = samples.pop(batch, 1 + next_random(&seed) % 40);
+        for(uint32_t i = 0; i < count; i++) {
+            const tick_sample_t& s = batch[i];
+            // A sample may only be skipped if core 1 dropped it
+            check(s.tick >= next_tick, "sample %u came after %u", s.tick, next_tick - 1);
+            check(s.dropped == missing + (s.tick - next_tick), "sample %u: %u dropped before it, %u skipped", s.tick, s.dropped,
+                missing + (s.tick - next_tick));
+            check(s.time_us >= launch + (uint64_t)(s.tick + 1) * TICK_US, "sample %u started at %llu us", s.tick,
+                (unsigned long long)s.time_us);
+            check(s.time_us <= HAL::time_us(), "sample %u is from %llu us, now is %llu us", s.tick, (unsigned long long)s.time_us,
+                (unsigned long long)HAL::time_us());
+            check(s.command >= last_command && s.command <= sent, "sample %u: core 1 took command %u, %u sent", s.tick, s.command, sent);
+            last_command = s.command;
+            missing += s.tick - next_tick;
+            next_tick = s.tick + 1;
+            received++;
+        }
+
+        uint32_t r = next_random(&seed);
+        for(uint32_t i = 0; i < (r & 0x03); i++) {
+            if(commands.push(sent)) sent++;
+        }
+        if((r >> 2) % 64 == 0) {
+            // Sometimes hold the mutex while the clock moves, core 1 has to wait it out
+            locked_increment(0, (r >> 8) % 6);
+            core0_locks++;
+        }
+        if((r >> 11) % 200 == 0) {
+            // Fall behind long enough for the sample queue to overflow
+            HAL::sleep_us(10 * ((r >> 13) % 500));
+            sleeps++;
+        } else {
+            HAL::tight_loop_contents();
+        }
+    }
+    // Core 1 is done, whatever is left in the queue is the tail of the run
+    tick_sample_t s;
+    while(samples.pop(&s)) {
+        check(s.tick >= next_tick && s.dropped == missing + (s.tick - next_tick), "sample %u out of order at the end", s.tick);
+        missing += s.tick - next_tick;
+        next_tick = s.tick + 1;
+        received++;
+    }
+
+    uint32_t expected_ticks = (uint32_t)((DURATION_US - launch - 1) / TICK_US);
+    check(ticks + skipped == expected_ticks, "core 1 ran %u ticks and skipped %u, expected %u", ticks, skipped, expected_ticks);
+    check(skipped <= contended, "%u ticks skipped over %u waits for the mutex", skipped, contended);
+    check(received + dropped == ticks && missing == dropped, "%u samples received and %u dropped of %u, %u skipped", received, dropped,
+        ticks, missing);
+    check(dropped > 0 && received > 0, "the sample queue never ran full, or never delivered");
+    check(late == 0, "%u ticks started late", late);
+    check(frozen == 0, "the clock moved during the work of %u ticks", frozen);
+    check(shared_count == core0_locks + core1_locks, "mutex count %llu, %u + %u increments", (unsigned long long)shared_count,
+        core0_locks, core1_locks);
+    check(contended > 0, "core 1 never had to wait for the mutex");
+
+    printf("%u ticks, %u skipped, %u samples received, %u dropped over %u sleeps, %u commands, mutex taken %u + %u times, "
+        "core 1 waited %u times\n", ticks, skipped, received, dropped, sleeps, sent, core0_locks, core1_locks, contended);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+/*
+ *  Title: Decimator Check
+
+ *  Description: Checks the strain gauge decimator from main.cpp. The output has to match a
+ *      plain CIC and full convolution FIR bit for bit for any block size, and the frequency
+ *      response has to stay inside the pass band ripple, cutoff and stop band limits below.
+ *      Exits with 1 if anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <Decimator.h>
+
+// Same as the strain gauge in main.cpp
+const float INPUT_RATE = 4800.0f;   // Hz
+const float CUTOFF = 100.0f;        // Hz
+typedef Decimator<2, 4, 31, 2> StrainDecimator;
+constexpr auto strain_taps = FIR_design::generate<31, q15_t>({FIR_type::LPF, CUTOFF, INPUT_RATE / 4});
+
+// Limits of the response
+const float PASSBAND_HZ = 50.0f;
+const float PASSBAND_RIPPLE_DB = 0.5f;
+const float CUTOFF_MIN_DB = -7.0f;
+const float CUTOFF_MAX_DB = -5.0f;
+const float STOPBAND_HZ = 200.0f;
+const float STOPBAND_DB = -50.0f;   // Up to half the CIC output rate
+const float ALIAS_DB = -45.0f;      // Above it, worst next to the CIC nulls where the CIC alone leaves a band in
+const float NOISE_RATIO = 0.25f;    // Output standard deviation over input for white noise
+
+const float _pi = 3.14159265358979323846f;
+uint32_t failures = 0;
+
+/**
+ * @brief The same decimation written out the long way: CIC as a convolution with its
+ *      impulse response, then every FIR_RATIO-th output of the full FIR, once both are full
+*/
+std::vector<int32_t> reference(const std::vector<int32_t>& input) {
+    // Two boxcars of 4 make the impulse response of the order 2 CIC
+    const int64_t cic[7] = {1, 2, 3, 4, 3, 2, 1};
+    std::vector<int32_t> cic_out;
+    for(size_t i = 3; i < input.size(); i += 4) {
+        int64_t sum = 0;
+        for(int k = 0; k < 7; k++) {
+            if(i >= (size_t)k) sum += cic[k] * input[i - k];
+        }
+        cic_out.push_back((int32_t)((sum + 8) >> 4));
+    }
+    std::vector<int32_t> output;
+    const size_t first = 35; // ORDER + TAPS CIC outputs to settle, then the next FIR phase
+    for(size_t m = first; m < cic_out.size(); m += 2) {
+        int64_t sum = 0;
+        for(uint k = 0; k < 31; k++) sum += (int64_t)strain_taps[k] * cic_out[m - 30 + k];
+        output.push_back((int32_t)((sum + (1 << 14)) >> 15));
+    }
+    return output;
+}
+
+/**
+ * @brief Decimate in blocks of a given size and compare with the reference
+*/
+void check_bit_exact(const std::vector<int32_t>& input, const std::vector<int32_t>& expected, uint32_t block) {
+    StrainDecimator decimator(strain_taps);
+    std::vector<int32_t> output(input.size() / StrainDecimator::RATIO + 1);
+    uint32_t written = 0;
+    for(uint32_t i = 0; i < input.size(); i += block) {
+        uint32_t count = (input.size() - i < block) ? (uint32_t)(input.size() - i) : block;
+        written += decimator.process(&input[i], count, &output[written]);
+    }
+    uint32_t mismatches = 0;
+    for(uint32_t i = 0; i < written && i < expected.size(); i++) {
+        if(output[i] != expected[i]) mismatches++;
+    }
+    if(written != expected.size() || mismatches > 0) {
+        printf("FAIL: blocks of %u give %u outputs, expected %zu, %u differ\n", block, written, expected.size(), mismatches);
+        failures++;
+    }
+}
+
+/**
+ * @brief Gain for a sine at a frequency, from the output amplitude once the filter has settled
+*/
+float response_db(float frequency) {
+    StrainDecimator decimator(strain_taps);
+    const uint32_t count = 48000;
+    const float amplitude = 1 << 20;
+    std::vector<int32_t> input(count);
+    std::vector<int32_t> output(count / StrainDecimator::RATIO + 1);
+    for(uint32_t i = 0; i < count; i++) input[i] = (int32_t)lrintf(amplitude * sinf(2.0f * _pi * frequency * (float)i / INPUT_RATE));
+    uint32_t written = decimator.process(input.data(), count, output.data());
+
+    // Skip the first quarter while the filter settles
+    double power = 0.0;
+    for(uint32_t i = written / 4; i < written; i++) power += (double)output[i] * output[i];
+    double rms = sqrt(power / (written - written / 4));
+    return 20.0f * log10f((float)(rms * sqrt(2.0) / amplitude) + 1e-9f);
+}
+
+void check_response(float frequency, float min_db, float max_db) {
+    float db = response_db(frequency);
+    bool ok = db >= min_db && db <= max_db;
+    printf("%5.0f Hz  %8.2f dB%s\n", frequency, db, ok ? "" : "  FAIL");
+    if(!ok) failures++;
+}
+
+int main() {
+    // Full scale steps, a ramp and noise, so the CIC wraps and the FIR sees both signs
+    std::vector<int32_t> input(20000);
+    uint32_t seed = 12345;
+    for(uint32_t i = 0; i < input.size(); i++) {
+        seed = seed * 1664525u + 1013904223u;
+        int32_t noise = (int32_t)(seed >> 20) - 2048;
+        int32_t level = ((i / 1500) & 1) ? 0x7FFFFF - 4096 : -0x800000 + 4096;
+        if(i >= 12000) level = (int32_t)i * 400 - 6400000;
+        input[i] = level + noise;
+    }
+    std::vector<int32_t> expected = reference(input);
+    const uint32_t blocks[] = {1, 3, 8, 31, 256, 20000};
+    for(uint32_t block : blocks) check_bit_exact(input, expected, block);
+    printf("Bit exact against the direct form for blocks of 1 to 20000\n\n");
+
+    for(float f = 5.0f; f <= PASSBAND_HZ; f += 5.0f) check_response(f, -PASSBAND_RIPPLE_DB, PASSBAND_RIPPLE_DB);
+    check_response(CUTOFF, CUTOFF_MIN_DB, CUTOFF_MAX_DB);
+    for(float f = STOPBAND_HZ; f < INPUT_RATE / 8; f += 25.0f) check_response(f, -200.0f, STOPBAND_DB);
+    for(float f = INPUT_RATE / 8; f <= INPUT_RATE / 2; f += 25.0f) check_response(f, -200.0f, ALIAS_DB);
+
+    // White noise, almost all of it is above the cutoff
+    StrainDecimator decimator(strain_taps);
+    const uint32_t count = 480000;
+    const int32_t noise = 1000;
+    std::vector<int32_t> noise_in(count);
+    std::vector<int32_t> noise_out(count / StrainDecimator::RATIO + 1);
+    for(uint32_t i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        noise_in[i] = (int32_t)((seed >> 8) % (uint32_t)(2 * noise + 1)) - noise;
+    }
+    uint32_t written = decimator.process(noise_in.data(), count, noise_out.data());
+    double power = 0.0;
+    for(uint32_t i = 0; i < written; i++) power += (double)noise_out[i] * noise_out[i];
+    float ratio = (float)(sqrt(power / written) / (noise / sqrt(3.0)));
+    printf("\nNoise: output standard deviation %.3f of the input%s\n", ratio, ratio <= NOISE_RATIO ? "" : "  FAIL");
+    if(ratio > NOISE_RATIO) failures++;
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+/*
+ *  Title: Decimator Response
+
+ *  Description: Runs the strain gauge decimator from main.cpp on generated input and prints
+ *      its frequency response, how much it takes off the noise and how many samples per
+ *      second it gets through on this machine, next to the same FIR run at the input rate.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <Decimator.h>
+
+// Same as the strain gauge in main.cpp
+const float INPUT_RATE = 4800.0f;   // Hz
+const float CUTOFF = 100.0f;        // Hz
+typedef Decimator<2, 4, 31, 2> StrainDecimator;
+constexpr auto strain_taps = FIR_design::generate<31, q15_t>({FIR_type::LPF, CUTOFF, INPUT_RATE / 4});
+
+const uint32_t BENCHMARK_SAMPLES = 1 << 22;
+const float _pi = 3.14159265358979323846f;
+
+/**
+ * @brief Gain for a sine at a frequency, from the output amplitude once the filter has settled
+*/
+float response_db(float frequency) {
+    StrainDecimator decimator(strain_taps);
+    const uint32_t count = 48000;
+    const float amplitude = 1 << 20;
+    std::vector<int32_t> input(count);
+    std::vector<int32_t> output(count / StrainDecimator::RATIO + 1);
+    for(uint32_t i = 0; i < count; i++) input[i] = (int32_t)lrintf(amplitude * sinf(2.0f * _pi * frequency * (float)i / INPUT_RATE));
+    uint32_t written = decimator.process(input.data(), count, output.data());
+
+    // Skip the first quarter while the filter settles
+    double power = 0.0;
+    for(uint32_t i = written / 4; i < written; i++) power += (double)output[i] * output[i];
+    double rms = sqrt(power / (written - written / 4));
+    return 20.0f * log10f((float)(rms * sqrt(2.0) / amplitude) + 1e-9f);
+}
+
+/**
+ * @brief Standard deviation of the output over that of the input for uniform noise
+*/
+float noise_ratio(void) {
+    StrainDecimator decimator(strain_taps);
+    const uint32_t count = 480000;
+    const int32_t noise = 1000;
+    std::vector<int32_t> input(count);
+    std::vector<int32_t> output(count / StrainDecimator::RATIO + 1);
+    uint32_t seed = 12345;
+    for(uint32_t i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = (int32_t)((seed >> 8) % (uint32_t)(2 * noise + 1)) - noise;
+    }
+    uint32_t written = decimator.process(input.data(), count, output.data());
+    double power = 0.0;
+    for(uint32_t i = 100; i < written; i++) power += (double)output[i] * output[i];
+    double output_std = sqrt(power / (written - 100));
+    double input_std = noise / sqrt(3.0);
+    return (float)(output_std / input_std);
+}
+
+int main() {
+    StrainDecimator decimator(strain_taps);
+    float output_rate = INPUT_RATE / StrainDecimator::RATIO;
+    printf("CIC order 2 by 4, 31 tap FIR by 2: %.0f Hz in, %.0f Hz out, cutoff %.0f Hz\n", INPUT_RATE, output_rate, CUTOFF);
+
+    printf("\n   Hz        dB\n");
+    const float frequencies[] = {10, 25, 50, 75, 100, 125, 150, 200, 250, 300, 350, 450, 600, 900, 1200, 1800, 2400};
+    for(float f : frequencies) printf("%5.0f  %8.2f%s\n", f, response_db(f), f >= 0.5f * output_rate ? "  aliases" : "");
+
+    printf("\nNoise: output standard deviation %.3f of the input\n", noise_ratio());
+
+    // Throughput against the same taps run at the input rate, calculating every output
+    std::vector<int32_t> input(BENCHMARK_SAMPLES);
+    std::vector<int32_t> output(BENCHMARK_SAMPLES);
+    for(uint32_t i = 0; i < BENCHMARK_SAMPLES; i++) input[i] = (int32_t)(i * 2654435761u) >> 8;
+    const int16_t* taps = decimator.get_taps();
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t written = 0;
+    for(uint32_t i = 0; i < BENCHMARK_SAMPLES; i += 256) written += decimator.process(&input[i], 256, &output[written]);
+    double decimator_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for(uint32_t i = 30; i < BENCHMARK_SAMPLES; i++) {
+        int64_t sum = 0;
+        for(uint k = 0; k < 31; k++) sum += (int64_t)taps[k] * input[i - k];
+        output[i] = (int32_t)(sum >> 15);
+    }
+    double direct_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("\nDecimator: %6.1f Msamples/s\n", BENCHMARK_SAMPLES / decimator_s * 1e-6);
+    printf("31 tap FIR at the input rate: %6.1f Msamples/s\n", BENCHMARK_SAMPLES / direct_s * 1e-6);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ *  Title: FastTrig Benchmark
+
+ *  Description: Times the FastTrig functions the control loop uses against sinf, cosf and
+ *      atan2f from libm on this machine, over angles in the range FOC::update sees. The
+ *      numbers only say how the table lookups compare to libm on the host, the RP2040 has
+ *      no FPU and soft float libm is far slower there. The accuracy is checked by
+ *      fasttrig_check.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <FastTrig.h>
+
+const uint32_t SAMPLES = 1 << 12;
+const uint32_t CALLS = 1 << 24;
+
+volatile float sink = 0.0f; // Keeps the calls from being optimized away
+volatile int32_t sink_q15 = 0;
+
+template <typename F> double ns_per_call(F function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / CALLS;
+}
+
+void row(const char* name, double fast_ns, double libm_ns) {
+    if(libm_ns > 0.0) {
+        printf("%-24s  %6.2f  %6.2f  %5.1fx\n", name, fast_ns, libm_ns, libm_ns / fast_ns);
+    } else {
+        printf("%-24s  %6.2f       -       -\n", name, fast_ns);
+    }
+}
+
+int main() {
+    std::vector<float> angles, xs, ys;
+    std::vector<uint16_t> angles_q16;
+    uint32_t seed = 12345;
+    for(uint32_t i = 0; i < SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float angle = ((float)(seed >> 8) / (float)(1 << 24) - 0.5f) * 2.0f * FastTrig::_2pi;
+        angles.push_back(angle);
+        xs.push_back(cosf(angle) * 3.0f);
+        ys.push_back(sinf(angle) * 3.0f);
+        angles_q16.push_back((uint16_t)(seed >> 16));
+    }
+    const uint32_t mask = SAMPLES - 1;
+
+    printf("ns per call, %u calls\n", CALLS);
+    printf("%-24s  %6s  %6s  %6s\n", "", "fast", "libm", "ratio");
+    float sum = 0.0f;
+
+    double fast = ns_per_call([&]() { for(uint32_t i = 0; i < CALLS; i++) sum += FastTrig::sin(angles[i & mask]); });
+    double libm = ns_per_call([&]() { for(uint32_t i = 0; i < CALLS; i++) sum += sinf(angles[i & mask]); });
+    row("sin", fast, libm);
+
+    fast = ns_per_call([&]() {
+        for(uint32_t i = 0; i < CALLS; i++) sum += FastTrig::sin<FastTrig::Accuracy::NEAREST>(angles[i & mask]);
+    });
+    row("sin, nearest", fast, libm);
+
+    fast = ns_per_call([&]() { for(uint32_t i = 0; i < CALLS; i++) sum += FastTrig::cos(angles[i & mask]); });
+    libm = ns_per_call([&]() { for(uint32_t i = 0; i < CALLS; i++) sum += cosf(angles[i & mask]); });
+    row("cos", fast, libm);
+
+    fast = ns_per_call([&]() {
+        for(uint32_t i = 0; i < CALLS; i++) {
+            float s, c;
+            FastTrig::sincos(angles[i & mask], &s, &c);
+            sum += s + c;
+        }
+    });
+    libm = ns_per_call([&]() { for(uint32_t i = 0; i < CALLS; i++) sum += sinf(angles[i & mask]) + cosf(angles[i & mask]); });
+    row("sincos", fast, libm);
+
+    fast = ns_per_call([&]() { for(uint32_t i = 0; i < CALLS; i++) sum += FastTrig::atan2(ys[i & mask], xs[i & mask]); });
+    libm = ns_per_call([&]() { for(uint32_t i = 0; i < CALLS; i++) sum += atan2f(ys[i & mask], xs[i & mask]); });
+    row("atan2", fast, libm);
+
+    fast = ns_per_call([&]() { for(uint32_t i = 0; i < CALLS; i++) sum += FastTrig::wrap_2pi(angles[i & mask] * 50.0f); });
+    libm = ns_per_call([&]() {
+        for(uint32_t i = 0; i < CALLS; i++) {
+            float a = fmodf(angles[i & mask] * 50.0f, FastTrig::_2pi);
+            sum += a < 0.0f ? a + FastTrig::_2pi : a;
+        }
+    });
+    row("wrap_2pi", fast, libm);
+
+    int32_t sum_q15 = 0;
+    fast = ns_per_call([&]() {
+        for(uint32_t i = 0; i < CALLS; i++) {
+            int16_t s, c;
+            FastTrig::sincos_q15(angles_q16[i & mask], &s, &c);
+            sum_q15 += s + c;
+        }
+    });
+    row("sincos_q15", fast, 0.0);
+
+    sink = sum;
+    sink_q15 = sum_q15;
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ *  Title: FastTrig Check
+
+ *  Description: Measures FastTrig against libm in double over dense sweeps and checks the
+ *      error bounds given in FastTrig.h. The float sine and cosine are swept over the
+ *      control loop range and out to MAX_ANGLE, where the float angle itself has lost
+ *      precision, atan2 over every octant and the Q15 sine over every 16 bit angle.
+ *      Exits with 1 if a bound is broken.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <FastTrig.h>
+
+// Bounds from FastTrig.h, with the rounding of the float result on top
+const double NEAREST_BOUND = 3.1e-3;
+const double INTERPOLATED_BOUND = 5e-6;
+const double PHASE_ROUNDING = 7.5e-8;  // rad per rad of angle, to_phase rounds angle * PHASE_SCALE to a float
+const double ATAN2_BOUND = 2.5e-6;      // rad
+const int32_t Q15_BOUND = 2;            // LSB
+
+const uint32_t SWEEP = 2000000;
+
+uint32_t failures = 0;
+
+void report(const char* name, double error, double bound) {
+    bool ok = error <= bound;
+    printf("%-40s  max error %.3e, bound %.3e%s\n", name, error, bound, ok ? "" : "  FAIL");
+    if(!ok) failures++;
+}
+
+/**
+ * @brief Largest sine and cosine error over [-range, range]. The reference is taken at the float
+ *      angle the function was given, so only the error of FastTrig itself shows.
+*/
+template <FastTrig::Accuracy A> double sweep_sincos(float range) {
+    double worst = 0.0;
+    for(uint32_t i = 0; i <= SWEEP; i++) {
+        float angle = (float)(-range + 2.0 * range * i / SWEEP);
+        float s, c;
+        FastTrig::sincos<A>(angle, &s, &c);
+        double error = fmax(fabs(s - sin((double)angle)), fabs(c - cos((double)angle)));
+        error = fmax(error, fmax(fabs(FastTrig::sin<A>(angle) - s), fabs(FastTrig::cos<A>(angle) - c)));
+        if(error > worst) worst = error;
+    }
+    return worst;
+}
+
+int main() {
+    const float two_pi = FastTrig::_2pi;
+
+    report("sin/cos nearest, |angle| < 2pi", sweep_sincos<FastTrig::Accuracy::NEAREST>(two_pi), NEAREST_BOUND);
+    report("sin/cos interpolated, |angle| < 2pi", sweep_sincos<FastTrig::Accuracy::INTERPOLATED>(two_pi), INTERPOLATED_BOUND);
+    // Further out the rounding of the phase grows with the angle
+    report("sin/cos interpolated, |angle| < 100", sweep_sincos<FastTrig::Accuracy::INTERPOLATED>(100.0f),
+        INTERPOLATED_BOUND + 100.0 * PHASE_ROUNDING);
+    report("sin/cos interpolated, |angle| < MAX_ANGLE", sweep_sincos<FastTrig::Accuracy::INTERPOLATED>(FastTrig::MAX_ANGLE),
+        INTERPOLATED_BOUND + FastTrig::MAX_ANGLE * PHASE_ROUNDING);
+
+    // atan2 on circles of a few radii, every octant and the axes
+    double worst = 0.0;
+    const float radii[] = {1e-3f, 1.0f, 5.0f, 1e4f};
+    for(float radius : radii) {
+        for(uint32_t i = 0; i < SWEEP / 4; i++) {
+            double t = -M_PI + 2.0 * M_PI * i / (SWEEP / 4);
+            float y = (float)(radius * sin(t));
+            float x = (float)(radius * cos(t));
+            double error = fabs(FastTrig::atan2(y, x) - atan2((double)y, (double)x));
+            if(error > M_PI) error = 2.0 * M_PI - error; // pi and -pi are the same angle
+            if(error > worst) worst = error;
+        }
+    }
+    report("atan2, every octant", worst, ATAN2_BOUND);
+    bool axes = FastTrig::atan2(0.0f, 0.0f) == 0.0f && FastTrig::atan2(0.0f, 1.0f) == 0.0f
+        && fabsf(FastTrig::atan2(1.0f, 0.0f) - FastTrig::_pi_2) < 1e-6f && fabsf(FastTrig::atan2(-1.0f, 0.0f) + FastTrig::_pi_2) < 1e-6f
+        && fabsf(fabsf(FastTrig::atan2(0.0f, -1.0f)) - FastTrig::_pi) < 1e-6f;
+    printf("%-40s  %s\n", "atan2 on the axes and at the origin", axes ? "exact" : "FAIL");
+    if(!axes) failures++;
+
+    // wrap_2pi and wrap_pi land in range and only move by whole turns
+    worst = 0.0;
+    uint32_t out_of_range = 0;
+    for(uint32_t i = 0; i <= SWEEP; i++) {
+        float angle = (float)(-FastTrig::MAX_ANGLE + 2.0 * FastTrig::MAX_ANGLE * i / SWEEP);
+        float a = FastTrig::wrap_2pi(angle);
+        float b = FastTrig::wrap_pi(angle);
+        if(!(a >= 0.0f && a < two_pi) || !(b >= -FastTrig::_pi && b < FastTrig::_pi)) out_of_range++;
+        double turns = ((double)angle - a) / (2.0 * M_PI);
+        worst = fmax(worst, fabs(turns - round(turns)) * 2.0 * M_PI);
+    }
+    bool ok = out_of_range == 0;
+    printf("%-40s  %u out of range%s\n", "wrap_2pi and wrap_pi, |angle| < MAX_ANGLE", out_of_range, ok ? "" : "  FAIL");
+    if(!ok) failures++;
+    report("wrap_2pi, off a whole turn by", worst, 1e-4);
+
+    // Every 16 bit angle of the Q15 sine and cosine
+    int32_t worst_q15 = 0;
+    for(uint32_t angle = 0; angle < 65536; angle++) {
+        int16_t s, c;
+        FastTrig::sincos_q15((uint16_t)angle, &s, &c);
+        double t = 2.0 * M_PI * angle / 65536.0;
+        int32_t error = abs(s - (int32_t)lround(32767.0 * sin(t)));
+        if(abs(c - (int32_t)lround(32767.0 * cos(t))) > error) error = abs(c - (int32_t)lround(32767.0 * cos(t)));
+        if(s != FastTrig::sin_q15((uint16_t)angle) || c != FastTrig::cos_q15((uint16_t)angle)) error = INT32_MAX;
+        if(error > worst_q15) worst_q15 = error;
+    }
+    report("sin_q15/cos_q15, every angle, LSB", worst_q15, Q15_BOUND);
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
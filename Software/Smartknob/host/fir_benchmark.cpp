@@ -0,0 +1,106 @@
+/*
+ *  Title: FIR Benchmark
+
+ *  Description: Times the folded block FIR against filtering one sample at a time through a
+ *      circular buffer, the way FIR::run used to, at a few lengths. Prints samples per second
+ *      on this machine for float, Q15 and Q31, and how far the float block output is from
+ *      the one sample at a time output.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <FIR.h>
+
+const uint32_t SAMPLES = 1 << 20;
+const size_t BLOCK = 64;
+
+volatile float sink = 0.0f; // Keeps the filters from being optimized away
+
+/**
+ * @brief One sample at a time with a wrapping index, every tap multiplied on its own
+*/
+template <uint N> float reference(const float* coeffs, float* buffer, uint& index, float input) {
+    buffer[index] = input;
+    if(++index == N) index = 0;
+    uint sum_index = index;
+    float output = 0.0f;
+    for(uint i = 0; i < N; i++) {
+        if(sum_index > 0) {
+            sum_index--;
+        } else {
+            sum_index = N - 1;
+        }
+        output += coeffs[i] * buffer[sum_index];
+    }
+    return output;
+}
+
+template <typename F> double seconds(F function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+constexpr FIR_params PARAMS = {FIR_type::LPF, 50.0f, 1000.0f};
+
+template <typename T, uint N> double block_seconds(const std::vector<T>& input, std::vector<T>& output) {
+    static constexpr auto taps = FIR_design::generate<N, T>(PARAMS);
+    FIR<N, T> filter(taps);
+    double s = seconds([&]() {
+        for(uint32_t i = 0; i < SAMPLES; i += BLOCK) filter.run(&input[i], &output[i], BLOCK);
+    });
+    sink = sink + (float)output[SAMPLES - 1];
+    return s;
+}
+
+template <uint N> void benchmark(void) {
+    std::vector<float> input(SAMPLES);
+    std::vector<q15_t> input_q15(SAMPLES);
+    std::vector<q31_t> input_q31(SAMPLES);
+    uint32_t seed = 12345;
+    for(uint32_t i = 0; i < SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = ((float)(seed >> 8) / 16777216.0f - 0.5f) * 0.01f;
+        input_q15[i] = Fixed::float_to_q15(input[i]);
+        input_q31[i] = Fixed::float_to_q31(input[i]);
+    }
+
+    // One sample at a time
+    static constexpr auto taps = FIR_design::generate<N, float>(PARAMS);
+    std::vector<float> expected(SAMPLES);
+    float buffer[N] = {0.0f};
+    uint index = 0;
+    double reference_s = seconds([&]() {
+        for(uint32_t i = 0; i < SAMPLES; i++) expected[i] = reference<N>(taps.data(), buffer, index, input[i]);
+    });
+    sink = sink + expected[SAMPLES - 1];
+
+    std::vector<float> output(SAMPLES);
+    std::vector<q15_t> output_q15(SAMPLES);
+    std::vector<q31_t> output_q31(SAMPLES);
+    double float_s = block_seconds<float, N>(input, output);
+    double q15_s = block_seconds<q15_t, N>(input_q15, output_q15);
+    double q31_s = block_seconds<q31_t, N>(input_q31, output_q31);
+
+    float error = 0.0f, largest = 0.0f;
+    for(uint32_t i = 0; i < SAMPLES; i++) {
+        error = fmaxf(error, fabsf(output[i] - expected[i]));
+        largest = fmaxf(largest, fabsf(expected[i]));
+    }
+    printf("%4u  %9.1f  %9.1f  %9.1f  %9.1f  %12.2e\n", N, SAMPLES / reference_s * 1e-6, SAMPLES / float_s * 1e-6,
+        SAMPLES / q15_s * 1e-6, SAMPLES / q31_s * 1e-6, error / largest);
+}
+
+int main() {
+    printf("Msamples/s, blocks of %u\n", (unsigned)BLOCK);
+    printf("   N  one by one      float        Q15        Q31  float error\n");
+    benchmark<15>();
+    benchmark<63>();
+    benchmark<255>();
+    return 0;
+}
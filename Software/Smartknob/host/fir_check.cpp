@@ -0,0 +1,115 @@
+/*
+ *  Title: FIR Check
+
+ *  Description: Checks the folded block FIR against a direct convolution in double of the
+ *      same taps and samples, for float, Q15 and Q31 at a few lengths. The input is fed in
+ *      blocks of uneven size, out of place and in place, and the two have to match bit for
+ *      bit. At 21, 63 and 255 taps the float filter takes the SSE or NEON path with taps left
+ *      over for the scalar tail, 15 taps stays scalar. The fixed point filters sum exactly and
+ *      only round at the end. Exits with 1 if a bound is broken.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <type_traits>
+#include <vector>
+#include <FIR.h>
+
+const uint32_t SAMPLES = 8192;
+const size_t BLOCKS[] = {1, 3, 64, 17, 250, 5, 128}; // Block sizes, taken in turn
+
+// Largest error against the double convolution
+const double FLOAT_BOUND = 1e-6;        // Of a full scale of 1
+const double FIXED_BOUND = 0.5 + 1e-3;  // LSB, the output is the exact sum rounded, the double sum of Q31 products rounds a little
+
+constexpr FIR_params PARAMS = {FIR_type::LPF, 50.0f, 1000.0f};
+
+uint32_t failures = 0;
+
+template <typename T> double scale(void) {
+    if constexpr(std::is_same<T, q15_t>::value) return 32768.0;
+    if constexpr(std::is_same<T, q31_t>::value) return 2147483648.0;
+    return 1.0;
+}
+
+/**
+ * @brief Sine with noise on top, at most half of full scale so nothing saturates
+*/
+template <typename T> std::vector<T> make_input(void) {
+    std::vector<T> input;
+    uint32_t seed = 12345;
+    for(uint32_t i = 0; i < SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        double x = 0.3 * sin(i * 0.05) + 0.2 * ((double)(seed >> 8) / (double)(1 << 24) - 0.5);
+        if constexpr(std::is_same<T, float>::value) {
+            input.push_back((float)x);
+        } else {
+            input.push_back((T)llround(x * scale<T>()));
+        }
+    }
+    return input;
+}
+
+/**
+ * @brief Filter the input in blocks of the sizes above
+ * @param in_place Copy the input to the output first and filter it there
+*/
+template <uint N, typename T> std::vector<T> filter_blocks(const std::array<T, N>& taps, const std::vector<T>& input, bool in_place) {
+    FIR<N, T> filter(taps);
+    std::vector<T> output(input.size());
+    if(in_place) output = input;
+    size_t i = 0;
+    for(uint b = 0; i < input.size(); b++) {
+        size_t n = BLOCKS[b % (sizeof(BLOCKS) / sizeof(BLOCKS[0]))];
+        if(n > input.size() - i) n = input.size() - i;
+        filter.run(in_place ? &output[i] : &input[i], &output[i], n);
+        i += n;
+    }
+    return output;
+}
+
+/**
+ * @brief Filter with both block paths and compare them to the convolution, in full scale or LSB
+*/
+template <uint N, typename T> void check(const char* type) {
+    static constexpr auto taps = FIR_design::generate<N, T>(PARAMS);
+    std::vector<T> input = make_input<T>();
+    std::vector<T> out_of_place = filter_blocks<N, T>(taps, input, false);
+    std::vector<T> in_place = filter_blocks<N, T>(taps, input, true);
+
+    // Direct convolution of the same taps and samples, zeros before the start like the delay line
+    double worst = 0.0;
+    uint32_t differ = 0;
+    for(uint32_t i = 0; i < SAMPLES; i++) {
+        double reference = 0.0;
+        for(uint j = 0; j < N && j <= i; j++) reference += (double)taps[j] * (double)input[i - j];
+        reference /= scale<T>(); // Taps are in the format of the samples, this leaves the LSB of the output
+        double error = fabs((double)out_of_place[i] - reference);
+        if(error > worst) worst = error;
+        if(memcmp(&out_of_place[i], &in_place[i], sizeof(T)) != 0) differ++;
+    }
+
+    double bound = std::is_same<T, float>::value ? FLOAT_BOUND : FIXED_BOUND;
+    bool ok = worst <= bound && differ == 0;
+    printf("%-5s %3u taps  max error %.3e, bound %.3e, %u samples differ in place%s\n", type, N, worst, bound, differ,
+        ok ? "" : "  FAIL");
+    if(!ok) failures++;
+}
+
+template <uint N> void check_types(void) {
+    check<N, float>("float");
+    check<N, q15_t>("Q15");
+    check<N, q31_t>("Q31");
+}
+
+int main() {
+    check_types<15>();
+    check_types<21>();
+    check_types<63>();
+    check_types<255>();
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
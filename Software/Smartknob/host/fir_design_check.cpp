@@ -0,0 +1,235 @@
+/*
+ *  Title: FIR Design Check
+
+ *  Description: Checks FIR_design against reference taps for five filters covering every type
+ *      and window. The double taps have to match within 1e-12 and the Q15 taps exactly,
+ *      center tap correction for DC included. The 31 tap low pass is also checked at compile
+ *      time. Exits with 1 if anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <FIRDesign.h>
+
+const double TOLERANCE = 1e-12;
+
+/*
+ * Reference taps from a double precision transcription of scipy.signal.firwin with scale=True,
+ * e.g. firwin(31, 100, fs=1200) for the first. The Q15 sets are the taps rounded half away
+ * from zero, then the center tap moved so the sum matches the rounded sum of the exact taps.
+ */
+constexpr double LPF_HAMMING_31[31] = {
+    0.0016922464235491702, 0.0017675077861578337, 0.0014616260576806894, -1.0870548826912953e-18,
+    -0.003348916073756609, -0.008518383779993479, -0.014026331939270189, -0.016896520164576358,
+    -0.013328323808752075, 4.41776868316133e-18, 0.02443180773999115, 0.05824101968542375,
+    0.09647368011027772, 0.1319292808578133, 0.15705335503849166, 0.16613590413392731, 0.15705335503849166,
+    0.13192928085781327, 0.09647368011027775, 0.058241019685423764, 0.024431807739991162,
+    4.417768683161331e-18, -0.013328323808752086, -0.016896520164576365, -0.014026331939270194,
+    -0.008518383779993479, -0.003348916073756608, -1.0870548826912957e-18, 0.0014616260576806887,
+    0.0017675077861578337, 0.0016922464235491702
+};
+constexpr q15_t LPF_HAMMING_31_Q15[31] = {  // Center tap corrected by +4
+    55, 58, 48, 0, -110, -279, -460, -554, -437, 0, 801, 1908, 3161, 4323, 5146, 5448, 5146, 4323, 3161,
+    1908, 801, 0, -437, -554, -460, -279, -110, 0, 48, 58, 55
+};
+
+constexpr double HPF_BLACKMAN_63[63] = {
+    -1.1528309112299674e-19, -1.1695654968342767e-19, -3.331439106050563e-05, -9.288894571059132e-05,
+    -5.69720257183989e-05, 0.00018093637720885733, 0.0004762251860165665, 0.0004111091452465289,
+    -0.000305629278953935, -0.0012920360566992736, -0.0014750424630083788, -4.115843400860026e-18,
+    0.0025161744740847133, 0.003779519324573931, 0.0015504032849355358, -0.003684487175477008,
+    -0.007761125913211857, -0.005604677530997367, 0.003596896991919786, 0.013445054779678743,
+    0.013841074651631475, -3.2901515141625185e-17, -0.02020085450274248, -0.02877569829678366,
+    -0.01140298815027109, 0.026760130654656135, 0.05726324585244953, 0.04371516799467998,
+    -0.031565694662417085, -0.14883451601322273, -0.25643535540359924, 0.699998858785802,
+    -0.2564353554035993, -0.14883451601322273, -0.031565694662417085, 0.04371516799467998,
+    0.05726324585244954, 0.02676013065465614, -0.011402988150271093, -0.02877569829678367,
+    -0.020200854502742487, -3.290151514162519e-17, 0.013841074651631475, 0.013445054779678752,
+    0.00359689699191979, -0.005604677530997369, -0.007761125913211866, -0.003684487175477007,
+    0.0015504032849355358, 0.0037795193245739335, 0.0025161744740847133, -4.1158434008600325e-18,
+    -0.0014750424630083788, -0.0012920360566992754, -0.0003056292789539351, 0.0004111091452465284,
+    0.0004762251860165663, 0.00018093637720885763, -5.69720257183988e-05, -9.288894571059132e-05,
+    -3.3314391060506006e-05, -1.1695654968342943e-19, -1.1528309112299674e-19
+};
+constexpr q15_t HPF_BLACKMAN_63_Q15[63] = {  // Center tap corrected by -1
+    0, 0, -1, -3, -2, 6, 16, 13, -10, -42, -48, 0, 82, 124, 51, -121, -254, -184, 118, 441, 454, 0, -662,
+    -943, -374, 877, 1876, 1432, -1034, -4877, -8403, 22937, -8403, -4877, -1034, 1432, 1876, 877, -374,
+    -943, -662, 0, 454, 441, 118, -184, -254, -121, 51, 124, 82, 0, -48, -42, -10, 13, 16, 6, -2, -3, -1, 0,
+    0
+};
+
+constexpr double BPF_KAISER_101[101] = {
+    -1.0389239239914825e-20, -5.904636604657561e-06, 9.847973380137857e-06, 6.427151748429448e-05,
+    9.393339928037299e-05, -2.838903642848673e-19, -0.00018042125269489441, -0.00024060341420318001,
+    -7.42720488959403e-05, 9.551888310684347e-05, -3.265829013286608e-19, -0.00015160267688520642,
+    0.00018769962538424257, 0.0009746925609102524, 0.0011841866075853573, -2.3849597734380706e-18,
+    -0.0017070726008673802, -0.00202820296878513, -0.0005653248627897943, 0.0006636666353359988,
+    -1.5675690705371458e-18, -0.00090055416523535, 0.001041727679161804, 0.005083266483654606,
+    0.005833019451444841, -7.961864276733864e-18, -0.007601808697371055, -0.008638881319184258,
+    -0.002311529250232562, 0.002613999497852392, -3.97828017381312e-18, -0.0033243039885402187,
+    0.003741140468130448, 0.01781998944199513, 0.020030215300495185, -1.6128331776371582e-17,
+    -0.02533415887309342, -0.028544997914423983, -0.007610603865600087, 0.008625248410871998,
+    -6.62266296083804e-18, -0.011260350782098494, 0.01302582886090303, 0.06462564018897518,
+    0.07701094146140496, -2.246153455510076e-17, -0.11933137190828755, -0.16092357222972592,
+    -0.057446401536842495, 0.11545164986874841, 0.20000973937222727, 0.11545164986874841,
+    -0.057446401536842495, -0.16092357222972592, -0.11933137190828755, -2.246153455510076e-17,
+    0.07701094146140496, 0.06462564018897518, 0.013025828860903059, -0.011260350782098494,
+    -6.62266296083804e-18, 0.008625248410871998, -0.007610603865600087, -0.028544997914423983,
+    -0.02533415887309342, -1.6128331776371582e-17, 0.020030215300495185, 0.01781998944199513,
+    0.003741140468130448, -0.0033243039885402187, -3.9782801738131225e-18, 0.0026139994978523957,
+    -0.002311529250232562, -0.008638881319184258, -0.007601808697371055, -7.961864276733864e-18,
+    0.005833019451444841, 0.005083266483654606, 0.001041727679161804, -0.00090055416523535,
+    -1.5675690705371443e-18, 0.0006636666353359988, -0.0005653248627897943, -0.00202820296878513,
+    -0.0017070726008673802, -2.3849597734380706e-18, 0.0011841866075853573, 0.0009746925609102524,
+    0.00018769962538424257, -0.00015160267688520642, -3.265829013286608e-19, 9.551888310684347e-05,
+    -7.427204889594019e-05, -0.00024060341420317958, -0.00018042125269489455, -2.8389036428486787e-19,
+    9.393339928037318e-05, 6.427151748429448e-05, 9.847973380137857e-06, -5.904636604657561e-06,
+    -1.0389239239914825e-20
+};
+constexpr q15_t BPF_KAISER_101_Q15[101] = {  // Center tap corrected by -4
+    0, 0, 0, 2, 3, 0, -6, -8, -2, 3, 0, -5, 6, 32, 39, 0, -56, -66, -19, 22, 0, -30, 34, 167, 191, 0, -249,
+    -283, -76, 86, 0, -109, 123, 584, 656, 0, -830, -935, -249, 283, 0, -369, 427, 2118, 2523, 0, -3910,
+    -5273, -1882, 3783, 6550, 3783, -1882, -5273, -3910, 0, 2523, 2118, 427, -369, 0, 283, -249, -935, -830,
+    0, 656, 584, 123, -109, 0, 86, -76, -283, -249, 0, 191, 167, 34, -30, 0, 22, -19, -66, -56, 0, 39, 32, 6,
+    -5, 0, 3, -2, -8, -6, 0, 3, 2, 0, 0, 0
+};
+
+constexpr double BSF_HAMMING_255[255] = {
+    -0.00017658970817265656, -9.109799821898967e-05, 8.182813729514355e-18, 8.81471400149316e-05,
+    0.00016526875177313383, 0.00022445049263904767, 0.0002605328066632411, 0.0002705749269945391,
+    0.0002541428419786586, 0.0002133819776384477, 0.0001528480962195448, 7.908958543514902e-05,
+    -2.905449092096317e-18, -7.60110477542627e-05, -0.0001409515933827558, -0.00018818458563481225,
+    -0.00021325351243412316, -0.00021448096315551185, -0.00019324095084414622, -0.00015383879248675558,
+    -0.0001029796191459574, -4.8863060165375086e-05, -1.7127327854061597e-18, 3.610110825777522e-05,
+    5.419484707909641e-05, 5.230985597845027e-05, 3.232879036864702e-05, -1.0423132843142073e-18,
+    -3.5685861598366087e-05, -6.373192445158469e-05, -7.286479250069857e-05, -5.3548103041784425e-05,
+    1.595990439520489e-18, 8.810227374612125e-05, 0.00020454141369357837, 0.0003363602818348086,
+    0.0004647027503351601, 0.0005667205199072086, 0.000618416545463011, 0.0005981402892533984,
+    0.0004903162310076738, 0.00028889659089109963, 4.915561158934601e-18, -0.00035675886269084697,
+    -0.0007486255546190222, -0.0011319399366505921, -0.0014562059142092893, -0.0016696984583232973,
+    -0.0017260633800907255, -0.0015911638054448415, -0.0012493023329217677, -0.0007079243699503643,
+    2.438265867740367e-17, 0.0008165111268593318, 0.0016624002285495704, 0.002444066162315571,
+    0.0030629938420481005, 0.003426974934566048, 0.0034618790401289355, 0.003122589980969832,
+    0.0024016826801796726, 0.0013345505317989726, 4.371498897341636e-17, -0.00148421445740652,
+    -0.002970879668272345, -0.004297193612334364, -0.005301789119009313, -0.005843199776706095,
+    -0.005817736721918509, -0.005174642180729137, -0.0039265289551082844, -0.0021535059526962145,
+    -1.5908937682371064e-17, 0.0023359431923381134, 0.004620241081861629, 0.006605759647215197,
+    0.008058493667047176, 0.008784211305411368, 0.008652591196980712, 0.007615966192800634,
+    0.0057202114444805585, 0.0031060469827357048, 4.6679067578653744e-18, -0.003304608759027278,
+    -0.006475147400181799, -0.009173080651614651, -0.01108995401548833, -0.011982134642215937,
+    -0.011700424276054323, -0.01021102792260098, -0.007605142751321468, -0.004095556290779855,
+    6.534187744174637e-17, 0.004287548736340214, 0.008335045065392828, 0.011716312840320816,
+    0.014056228882883397, 0.015072325957929908, 0.014608186077022847, 0.01265471440993122,
+    0.009356559046442886, 0.005002458454058687, -1.9019308939185023e-17, -0.005163023046374297,
+    -0.009966950319977692, -0.013913423854172173, -0.016577860708399637, -0.017655622322173336,
+    -0.01699680298599075, -0.014625653557096299, -0.010742208924014816, -0.00570553927787044,
+    1.1748166205938113e-16, 0.005812298490501597, 0.011148044889693657, 0.015462499311143959,
+    0.01830623568334227, 0.01937282955596097, 0.018532341357180706, 0.015846885390703853, 0.0115664316999189,
+    0.00610506503796353, 6.90583459629509e-17, -0.006142500625800452, -0.011708737796839792,
+    -0.01614031764607469, -0.018991466254084308, 0.9787703747160602, -0.018991466254084308,
+    -0.01614031764607469, -0.011708737796839792, -0.006142500625800452, 6.90583459629509e-17,
+    0.00610506503796353, 0.011566431699918901, 0.015846885390703853, 0.018532341357180706,
+    0.01937282955596097, 0.01830623568334227, 0.015462499311143959, 0.01114804488969366,
+    0.005812298490501597, 1.1748166205938116e-16, -0.00570553927787044, -0.010742208924014814,
+    -0.0146256535570963, -0.016996802985990753, -0.017655622322173332, -0.016577860708399637,
+    -0.013913423854172173, -0.009966950319977692, -0.005163023046374298, -1.9019308939185023e-17,
+    0.005002458454058687, 0.009356559046442886, 0.012654714409931222, 0.014608186077022849,
+    0.01507232595792991, 0.0140562288828834, 0.011716312840320816, 0.008335045065392828,
+    0.004287548736340216, 6.534187744174638e-17, -0.004095556290779856, -0.007605142751321469,
+    -0.010211027922600983, -0.011700424276054324, -0.011982134642215937, -0.011089954015488332,
+    -0.009173080651614653, -0.006475147400181799, -0.0033046087590272786, 4.667906757865376e-18,
+    0.0031060469827357056, 0.00572021144448056, 0.0076159661928006375, 0.008652591196980716,
+    0.008784211305411368, 0.008058493667047178, 0.006605759647215196, 0.004620241081861631,
+    0.0023359431923381142, -1.5908937682371064e-17, -0.002153505952696215, -0.003926528955108287,
+    -0.0051746421807291375, -0.005817736721918512, -0.0058431997767060965, -0.005301789119009312,
+    -0.004297193612334365, -0.0029708796682723464, -0.0014842144574065195, 4.371498897341638e-17,
+    0.0013345505317989734, 0.0024016826801796735, 0.003122589980969834, 0.0034618790401289355,
+    0.0034269749345660506, 0.0030629938420481005, 0.00244406616231557, 0.0016624002285495704,
+    0.000816511126859332, 2.438265867740366e-17, -0.0007079243699503644, -0.0012493023329217686,
+    -0.0015911638054448415, -0.0017260633800907264, -0.0016696984583232989, -0.0014562059142092885,
+    -0.0011319399366505917, -0.0007486255546190224, -0.0003567588626908469, 4.915561158934601e-18,
+    0.00028889659089109974, 0.0004903162310076738, 0.0005981402892533987, 0.0006184165454630117,
+    0.0005667205199072089, 0.00046470275033516054, 0.0003363602818348087, 0.00020454141369357826,
+    8.810227374612122e-05, 1.5959904395204898e-18, -5.354810304178441e-05, -7.286479250069861e-05,
+    -6.373192445158474e-05, -3.56858615983661e-05, -1.0423132843142082e-18, 3.232879036864706e-05,
+    5.230985597845031e-05, 5.419484707909639e-05, 3.610110825777525e-05, -1.712732785406159e-18,
+    -4.8863060165375106e-05, -0.00010297961914595752, -0.00015383879248675563, -0.0001932409508441463,
+    -0.00021448096315551207, -0.00021325351243412326, -0.00018818458563481244, -0.00014095159338275602,
+    -7.601104775426266e-05, -2.905449092096317e-18, 7.908958543514908e-05, 0.0001528480962195447,
+    0.0002133819776384477, 0.0002541428419786588, 0.0002705749269945391, 0.00026053280666324125,
+    0.00022445049263904784, 0.00016526875177313397, 8.81471400149316e-05, 8.182813729514355e-18,
+    -9.109799821898967e-05, -0.00017658970817265656
+};
+constexpr q15_t BSF_HAMMING_255_Q15[255] = {  // Center tap corrected by +4
+    -6, -3, 0, 3, 5, 7, 9, 9, 8, 7, 5, 3, 0, -2, -5, -6, -7, -7, -6, -5, -3, -2, 0, 1, 2, 2, 1, 0, -1, -2,
+    -2, -2, 0, 3, 7, 11, 15, 19, 20, 20, 16, 9, 0, -12, -25, -37, -48, -55, -57, -52, -41, -23, 0, 27, 54,
+    80, 100, 112, 113, 102, 79, 44, 0, -49, -97, -141, -174, -191, -191, -170, -129, -71, 0, 77, 151, 216,
+    264, 288, 284, 250, 187, 102, 0, -108, -212, -301, -363, -393, -383, -335, -249, -134, 0, 140, 273, 384,
+    461, 494, 479, 415, 307, 164, 0, -169, -327, -456, -543, -579, -557, -479, -352, -187, 0, 190, 365, 507,
+    600, 635, 607, 519, 379, 200, 0, -201, -384, -529, -622, 32076, -622, -529, -384, -201, 0, 200, 379, 519,
+    607, 635, 600, 507, 365, 190, 0, -187, -352, -479, -557, -579, -543, -456, -327, -169, 0, 164, 307, 415,
+    479, 494, 461, 384, 273, 140, 0, -134, -249, -335, -383, -393, -363, -301, -212, -108, 0, 102, 187, 250,
+    284, 288, 264, 216, 151, 77, 0, -71, -129, -170, -191, -191, -174, -141, -97, -49, 0, 44, 79, 102, 113,
+    112, 100, 80, 54, 27, 0, -23, -41, -52, -57, -55, -48, -37, -25, -12, 0, 9, 16, 20, 20, 19, 15, 11, 7, 3,
+    0, -2, -2, -2, -1, 0, 1, 2, 2, 1, 0, -2, -3, -5, -6, -7, -7, -6, -5, -2, 0, 3, 5, 7, 8, 9, 9, 7, 5, 3, 0,
+    -3, -6
+};
+
+constexpr double LPF_KAISER_15[15] = {
+    0.000981806315917833, -0.00646121962212033, -6.457719695200456e-09, 0.03435701040151316,
+    -0.04067058498627626, -0.07774224608815428, 0.28935571461275994, 0.6003590516481595, 0.28935571461275994,
+    -0.07774224608815422, -0.04067058498627626, 0.03435701040151316, -6.457719695200456e-09,
+    -0.00646121962212033, 0.000981806315917833
+};
+constexpr q15_t LPF_KAISER_15_Q15[15] = {  // Center tap corrected by -1
+    32, -212, 0, 1126, -1333, -2547, 9482, 19672, 9482, -2547, -1333, 1126, 0, -212, 32
+};
+
+uint32_t failures = 0;
+
+template <uint N> constexpr bool matches(const std::array<q15_t, N>& taps, const q15_t (&reference)[N]) {
+    for(uint i = 0; i < N; i++) {
+        if(taps[i] != reference[i]) return false;
+    }
+    return true;
+}
+
+static_assert(matches<31>(FIR_design::generate<31, q15_t>({FIR_type::LPF, 100, 1200}), LPF_HAMMING_31_Q15),
+    "31 tap Hamming low pass does not match the reference");
+
+/**
+ * @brief Compare the double and Q15 taps of one design with its reference
+*/
+template <uint N> void check(const char* name, const FIR_params& params, const double (&reference)[N], const q15_t (&reference_q15)[N]) {
+    std::array<double, N> taps = FIR_design::design<N>(params);
+    double error = 0.0;
+    for(uint i = 0; i < N; i++) error = fmax(error, fabs(taps[i] - reference[i]));
+
+    std::array<q15_t, N> taps_q15 = FIR_design::generate<N, q15_t>(params);
+    uint mismatches = 0;
+    int32_t sum = 0;
+    int32_t reference_sum = 0;
+    for(uint i = 0; i < N; i++) {
+        if(taps_q15[i] != reference_q15[i]) mismatches++;
+        sum += taps_q15[i];
+        reference_sum += reference_q15[i];
+    }
+
+    bool ok = error <= TOLERANCE && mismatches == 0;
+    printf("%-16s  max error %.1e  %u Q15 taps differ, Q15 sum %d, reference %d%s\n", name, error, mismatches,
+        sum, reference_sum, ok ? "" : "  FAIL");
+    if(!ok) failures++;
+}
+
+int main() {
+    check<31>("LPF Hamming 31", {FIR_type::LPF, 100, 1200}, LPF_HAMMING_31, LPF_HAMMING_31_Q15);
+    check<63>("HPF Blackman 63", {FIR_type::HPF, 150, 1000, 0, FIR_window::BLACKMAN}, HPF_BLACKMAN_63, HPF_BLACKMAN_63_Q15);
+    check<101>("BPF Kaiser 101", {FIR_type::BPF, 100, 1000, 200, FIR_window::KAISER, 8.6f}, BPF_KAISER_101, BPF_KAISER_101_Q15);
+    check<255>("BSF Hamming 255", {FIR_type::BSF, 45, 1000, 55}, BSF_HAMMING_255, BSF_HAMMING_255_Q15);
+    check<15>("LPF Kaiser 15", {FIR_type::LPF, 0.3f, 1.0f, 0, FIR_window::KAISER, 5.0f}, LPF_KAISER_15, LPF_KAISER_15_Q15);
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
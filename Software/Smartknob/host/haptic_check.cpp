@@ -0,0 +1,127 @@
+/*
+ *  Title: Haptic Check
+
+ *  Description: Checks the profiles generated into flash by HapticProfiles.h. Each one is
+ *      compiled again at runtime with Haptic::compile, and its torque is worked out again
+ *      from the profile with sinf, and both have to match the constexpr table exactly. The
+ *      end stops have to start at the centers of the first and last detent. Exits with 1 on
+ *      any difference.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <Haptic.h>
+#include <HapticProfiles.h>
+
+const float _pi = 3.14159265358979323846f;
+
+struct shipped_t {
+    const char* name;
+    const haptic_profile_t* profile;
+    const Haptic::table_t* table;
+};
+
+const shipped_t shipped[] = {
+    {"coarse", &HapticProfiles::coarse_profile, &HapticProfiles::coarse},
+    {"fine", &HapticProfiles::fine_profile, &HapticProfiles::fine},
+    {"unbounded", &HapticProfiles::unbounded_profile, &HapticProfiles::unbounded},
+    {"bounded", &HapticProfiles::bounded_profile, &HapticProfiles::bounded},
+    {"free spin", &HapticProfiles::free_profile, &HapticProfiles::free_spin},
+};
+
+/**
+ * @brief Torque of a profile at a table entry, written out from the profile description with sinf
+ *      instead of going through Haptic. Rounded and saturated to Q15 like the table.
+*/
+q15_t reference_torque(const haptic_profile_t& profile, int32_t entry, uint8_t shift) {
+    int32_t edges[Haptic::MAX_DETENTS + 1] = {0};
+    for(uint16_t i = 0; i < profile.detent_count; i++) edges[i + 1] = edges[i] + profile.detents[i].width;
+    int32_t period = edges[profile.detent_count];
+    int32_t low = profile.detents[0].width / 2;
+    int32_t high = edges[profile.detent_count - 1] + profile.detents[profile.detent_count - 1].width / 2;
+
+    int32_t x = entry << shift;
+    if(profile.repeat) x %= period;
+    float torque = 0.0f;
+    if(!profile.repeat && x < low) {
+        torque = (float)profile.end_stop_stiffness * (float)(low - x);
+    } else if(!profile.repeat && x > high) {
+        torque = -(float)profile.end_stop_stiffness * (float)(x - high);
+    } else if(!profile.free_spin) {
+        uint16_t i = 0;
+        while(i + 1 < profile.detent_count && x >= edges[i + 1]) i++;
+        float width = (float)profile.detents[i].width;
+        float center = (float)edges[i] + 0.5f * width;
+        torque = -(float)profile.detents[i].strength * sinf(2.0f * _pi * ((float)x - center) / width);
+    }
+    for(uint16_t i = 0; i < profile.bump_count; i++) {
+        const haptic_bump_t& bump = profile.bumps[i];
+        int32_t d = x - bump.angle;
+        if(profile.repeat) {
+            d %= period;
+            if(d >= period / 2) d -= period;
+            if(d < -period / 2) d += period;
+        }
+        if(2 * abs(d) < bump.width) torque += (float)bump.strength * sinf(2.0f * _pi * (float)d / (float)bump.width);
+    }
+    return (q15_t)roundf(fminf(fmaxf(torque, -32768.0f), 32767.0f));
+}
+
+int main() {
+    uint32_t failures = 0;
+    for(const shipped_t& s : shipped) {
+        const Haptic::table_t& generated = *s.table;
+
+        // Runtime compile of the same profile
+        Haptic haptic;
+        if(!haptic.compile(s.profile)) {
+            printf("FAIL: %s does not compile at runtime\n", s.name);
+            failures++;
+            continue;
+        }
+        haptic.reset(0, 0);
+        const Haptic::table_t& compiled = *haptic.get_table();
+        uint32_t compile_differences = 0;
+        for(int32_t i = 0; i <= Haptic::TABLE_SIZE; i++) {
+            if(compiled.torque[i] != generated.torque[i]) compile_differences++;
+        }
+        bool same_layout = compiled.detent_count == generated.detent_count && compiled.shift == generated.shift &&
+            compiled.repeat == generated.repeat && compiled.first_position == generated.first_position &&
+            compiled.spring_low == generated.spring_low && compiled.spring_high == generated.spring_high &&
+            compiled.end_stop_stiffness == generated.end_stop_stiffness &&
+            memcmp(compiled.edges, generated.edges, (generated.detent_count + 1) * sizeof(int32_t)) == 0;
+
+        // sinf reference
+        uint32_t reference_differences = 0;
+        int32_t worst = 0;
+        for(int32_t i = 0; i <= Haptic::TABLE_SIZE; i++) {
+            int32_t difference = generated.torque[i] - reference_torque(*s.profile, i, generated.shift);
+            if(difference != 0) reference_differences++;
+            if(abs(difference) > abs(worst)) worst = difference;
+        }
+
+        // The knob was put at the center of the first detent, the end stops start there and at the center of the last
+        int32_t span = generated.spring_high - generated.spring_low;
+        haptic.update(0);
+        bool past_first = haptic.past_end_stop();
+        haptic.update(span);
+        bool past_last = haptic.past_end_stop();
+        haptic.update(span + 1);
+        bool above = haptic.past_end_stop();
+        haptic.update(-1);
+        bool below = haptic.past_end_stop();
+        bool end_stops = !past_first && !past_last && above == !generated.repeat && below == !generated.repeat;
+        if(!end_stops) printf("FAIL: %s end stops are not at the centers of the first and last detent\n", s.name);
+
+        bool ok = same_layout && compile_differences == 0 && reference_differences == 0 && end_stops;
+        printf("%-10s %2u detents, %4d counts per entry: compile %s, %u entries differ, sinf %u entries differ (worst %d)%s\n",
+            s.name, generated.detent_count, 1 << generated.shift, same_layout ? "same layout" : "different layout",
+            compile_differences, reference_differences, worst, ok ? "" : "  FAIL");
+        if(!ok) failures++;
+    }
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*
+ *  Title: MCP3564R Check
+
+ *  Description: Drives the set_* methods and commit of the MCP3564R driver against the simulated
+ *      ADC and checks the registers bit for bit against the field layout of the datasheet,
+ *      that the setters only touch the shadow, and that commit writes everything changed
+ *      in a single transaction. Exits with 1 if anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <functional>
+#include <HAL.h>
+#include <SPIBus.h>
+#include <MCP3564R.h>
+#include "SimModels.h"
+#include "../pin_assignments.h"
+
+SimMCP3564R strain(STRAIN_IRQ);
+SPIBus spi1_bus(spi1);
+MCP3564R mcp3564r(&spi1_bus, STRAIN_CSN);
+
+// Registers the driver keeps in its shadow, CONFIG0 to TIMER
+const uint8_t FIRST = 0x1;
+const uint8_t LAST = 0x8;
+uint32_t expected[LAST + 1];
+uint32_t failures = 0;
+
+void check(bool ok, const char* format, ...) {
+    if(ok) return;
+    va_list args;
+    va_start(args, format);
+    printf("FAIL: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    failures++;
+}
+
+/**
+ * @brief Compare every shadowed register of the simulated ADC with what it should hold
+*/
+void check_registers(const char* what) {
+    for(uint8_t reg = FIRST; reg <= LAST; reg++) {
+        uint32_t value = strain.get_register(reg);
+        check(value == expected[reg], "%s: register 0x%X is 0x%06X, expected 0x%06X", what, reg, value, expected[reg]);
+    }
+}
+
+/**
+ * @brief A setter for one field of one register
+*/
+struct field_t {
+    const char* name;
+    uint8_t reg;
+    uint32_t mask;      // Bits of the field in the register as the datasheet lays it out
+    uint8_t shift;
+    uint8_t first;      // Valid settings
+    uint8_t last;
+    std::function<bool(uint8_t)> set;
+    std::function<uint32_t(uint8_t)> encode; // Field contents for a setting, the setting itself if empty
+};
+
+const field_t fields[] = {
+    {"select_vref_source", 0x1, 0x80, 7, 0, 1, [](uint8_t v) { return mcp3564r.select_vref_source(v); }, {}},
+    {"set_clock_source", 0x1, 0x30, 4, 0, 3, [](uint8_t v) { return mcp3564r.set_clock_source(v); }, {}},
+    {"set_current_source_sink", 0x1, 0x0C, 2, 0, 3, [](uint8_t v) { return mcp3564r.set_current_source_sink(v); }, {}},
+    {"set_adc_mode", 0x1, 0x03, 0, 0, 3, [](uint8_t v) { return mcp3564r.set_adc_mode(v); }, {}},
+    {"set_clock_prescaler", 0x2, 0xC0, 6, 0, 3, [](uint8_t v) { return mcp3564r.set_clock_prescaler(v); }, {}},
+    {"set_oversample_ratio", 0x2, 0x3C, 2, 0, 15, [](uint8_t v) { return mcp3564r.set_oversample_ratio(v); }, {}},
+    {"set_adc_bias_current", 0x3, 0xC0, 6, 0, 3, [](uint8_t v) { return mcp3564r.set_adc_bias_current(v); }, {}},
+    {"set_adc_gain", 0x3, 0x38, 3, 0, 7, [](uint8_t v) { return mcp3564r.set_adc_gain(v); }, {}},
+    {"set_auto_zero_mux", 0x3, 0x04, 2, 0, 1, [](uint8_t v) { return mcp3564r.set_auto_zero_mux(v); }, {}},
+    {"set_auto_zero_ref_buffer", 0x3, 0x02, 1, 0, 1, [](uint8_t v) { return mcp3564r.set_auto_zero_ref_buffer(v); }, {}},
+    {"set_conv_mode", 0x4, 0xC0, 6, 1, 3, [](uint8_t v) { return mcp3564r.set_conv_mode(v); },
+        [](uint8_t v) { return (uint32_t)(v == 1 ? 0 : v); }}, // 0 and 1 both shut down after one shot
+    {"set_data_format", 0x4, 0x30, 4, 0, 3, [](uint8_t v) { return mcp3564r.set_data_format(v); }, {}},
+    {"set_crc_format", 0x4, 0x08, 3, 0, 1, [](uint8_t v) { return mcp3564r.set_crc_format(v); }, {}},
+    {"set_en_crccom", 0x4, 0x04, 2, 0, 1, [](uint8_t v) { return mcp3564r.set_en_crccom(v); }, {}},
+    {"set_en_offcal", 0x4, 0x02, 1, 0, 1, [](uint8_t v) { return mcp3564r.set_en_offcal(v); }, {}},
+    {"set_en_gaincal", 0x4, 0x01, 0, 0, 1, [](uint8_t v) { return mcp3564r.set_en_gaincal(v); }, {}},
+    {"set_irq_mode_mdat", 0x5, 0x08, 3, 0, 1, [](uint8_t v) { return mcp3564r.set_irq_mode_mdat(v); }, {}},
+    {"set_irq_mode_hiz", 0x5, 0x04, 2, 0, 1, [](uint8_t v) { return mcp3564r.set_irq_mode_hiz(v); },
+        [](uint8_t v) { return (uint32_t)!v; }}, // The bit is set for a logic high output
+    {"set_scan_delay_multiplier", 0x7, 0xE00000, 21, 0, 7, [](uint8_t v) { return mcp3564r.set_scan_delay_multiplier(v); }, {}},
+};
+
+int main() {
+    HAL::init();
+    HAL::sim::attach_spi_device(spi1, STRAIN_CSN, &strain);
+    spi1_bus.init(10000000u);
+
+    check(mcp3564r.init(), "init failed");
+    check(strain.register_reads == 1 && strain.register_writes == 0, "init took %u reads and %u writes, expected one read",
+        strain.register_reads, strain.register_writes);
+    for(uint8_t reg = FIRST; reg <= LAST; reg++) expected[reg] = strain.get_register(reg);
+
+    // Every setting of every field, each committed on its own
+    for(const field_t& field : fields) {
+        for(uint8_t v = field.first; v <= field.last; v++) {
+            uint32_t writes = strain.register_writes;
+            check(field.set(v), "%s(%u) returned false", field.name, v);
+            check(strain.register_writes == writes, "%s(%u) wrote to the ADC before commit", field.name, v);
+            check_registers(field.name);
+            check(mcp3564r.commit(), "commit after %s(%u) failed", field.name, v);
+            check(strain.register_writes == writes + 1, "commit after %s(%u) took %u writes", field.name, v, strain.register_writes - writes);
+            uint32_t value = field.encode ? field.encode(v) : v;
+            expected[field.reg] = (expected[field.reg] & ~field.mask) | ((value << field.shift) & field.mask);
+            check_registers(field.name);
+        }
+        if(field.last == 1) continue; // Takes a bool
+        check(!field.set(field.last + 1), "%s(%u) accepted an invalid setting", field.name, field.last + 1);
+        if(field.first > 0) check(!field.set(field.first - 1), "%s(%u) accepted an invalid setting", field.name, field.first - 1);
+    }
+
+    // Scan channels go into the low 16 bits of SCAN, channel n is bit n
+    for(uint8_t channel = 0; channel < 16; channel++) {
+        check(mcp3564r.enable_scan_channel(channel), "enable_scan_channel(%u) returned false", channel);
+        check(mcp3564r.commit(), "commit after enable_scan_channel(%u) failed", channel);
+        expected[0x7] |= 1u << channel;
+        check_registers("enable_scan_channel");
+    }
+    for(uint8_t channel = 0; channel < 16; channel += 3) {
+        check(mcp3564r.disable_scan_channel(channel), "disable_scan_channel(%u) returned false", channel);
+        check(mcp3564r.commit(), "commit after disable_scan_channel(%u) failed", channel);
+        expected[0x7] &= ~(1u << channel);
+        check_registers("disable_scan_channel");
+    }
+    check(!mcp3564r.enable_scan_channel(16) && !mcp3564r.disable_scan_channel(16), "scan channel 16 accepted");
+
+    // Changes to CONFIG0 and SCAN go out in one write that also carries the registers between
+    uint32_t writes = strain.register_writes;
+    mcp3564r.set_adc_mode(2);
+    mcp3564r.set_clock_source(1);
+    mcp3564r.set_oversample_ratio(5);
+    mcp3564r.disable_scan_channel(1);
+    check(mcp3564r.is_dirty(), "setters left nothing dirty");
+    check(mcp3564r.commit(), "batched commit failed");
+    check(strain.register_writes == writes + 1, "batched commit took %u writes", strain.register_writes - writes);
+    expected[0x1] = (expected[0x1] & ~0x33u) | 0x12;
+    expected[0x2] = (expected[0x2] & ~0x3Cu) | (5 << 2);
+    expected[0x7] &= ~(1u << 1);
+    check_registers("batched commit");
+
+    // Nothing to commit costs nothing
+    writes = strain.register_writes;
+    check(!mcp3564r.is_dirty() && mcp3564r.commit() && strain.register_writes == writes, "empty commit touched the ADC");
+
+    // load drops what was not committed
+    mcp3564r.set_adc_gain(0);
+    check(mcp3564r.load() && !mcp3564r.is_dirty(), "load kept staged changes");
+    check(mcp3564r.commit() && strain.register_writes == writes, "commit after load wrote to the ADC");
+    check_registers("load");
+
+    // Locked registers refuse the commit and keep it staged
+    check(mcp3564r.lock_write_access(), "lock failed");
+    writes = strain.register_writes;
+    mcp3564r.set_adc_gain(7);
+    check(!mcp3564r.commit() && mcp3564r.is_dirty() && strain.register_writes == writes, "commit went through while locked");
+    check(mcp3564r.unlock_write_access() && mcp3564r.commit(), "commit after unlock failed");
+    expected[0x3] = (expected[0x3] & ~0x38u) | (7 << 3);
+    check_registers("unlock");
+
+    // start_stream sends its own settings and anything staged in one write
+    mcp3564r.set_adc_gain(5);
+    writes = strain.register_writes;
+    check(mcp3564r.start_stream(STRAIN_IRQ), "start_stream failed");
+    check(strain.register_writes == writes + 1, "start_stream took %u writes", strain.register_writes - writes);
+    expected[0x1] = (expected[0x1] & ~0x03u) | 0x03;                // Conversion mode
+    expected[0x3] = (expected[0x3] & ~0x38u) | (5 << 3);
+    expected[0x4] = (expected[0x4] & ~0xF0u) | 0xC0 | 0x30;         // Continuous, data format 3
+    expected[0x5] = (expected[0x5] & ~0x0Cu);                       // IRQ output, high-z when inactive
+    check_registers("start_stream");
+    mcp3564r.stop_stream();
+    expected[0x1] = (expected[0x1] & ~0x03u) | 0x02;                // Standby
+    check_registers("stop_stream");
+
+    printf("%u register reads, %u register writes, %u failures\n", strain.register_reads, strain.register_writes, failures);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*
+ *  Title: Motor Calibration Check
+
+ *  Description: Runs FOC::calibrate_motor against simulated motors with a few pole pair counts,
+ *      both directions and different magnet offsets, and checks the pole pairs, direction and
+ *      zero electric angle it finds. Each result is saved to flash and loaded into a fresh FOC,
+ *      which has to come out the same, and a damaged record has to be refused. Exits with 1
+ *      if anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <HAL.h>
+#include <SPIBus.h>
+#include <MT6701.h>
+#include <TMC6300.h>
+#include <FOC.h>
+#include "SimModels.h"
+#include "../pin_assignments.h"
+
+const float CAL_VOLTAGE = 2.0f;                 // Same as main.cpp
+const float ZERO_TOLERANCE = 0.1f;              // rad electrical
+const float ESTIMATE_TOLERANCE = 0.1f;          // Pole pairs before rounding
+const uint32_t FLASH_OFFSET = HAL::FLASH_SIZE_BYTES - 2 * HAL::FLASH_SECTOR_BYTES; // Same as main.cpp
+
+// Motors to calibrate, each on an encoder with its own chip select
+struct motor_case_t {
+    int pole_pairs;
+    int direction;
+    float zero_electric_angle;
+    uint csn_pin;
+};
+
+const motor_case_t cases[] = {
+    {7, -1, 4.062365f, MAG_CSN},    // The simulated board
+    {7, 1, 1.0f, 19},
+    {11, 1, 2.5f, 20},
+    {11, -1, 5.9f, 21},
+    {4, -1, 0.3f, 22},
+    {14, 1, 3.3f, 23},
+};
+
+const float _2pi = 6.28318530717958647692f;
+uint32_t failures = 0;
+
+void check(bool ok, const char* format, ...) {
+    if(ok) return;
+    va_list args;
+    va_start(args, format);
+    printf("FAIL: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    failures++;
+}
+
+/**
+ * @brief Distance between two angles, the short way around
+*/
+float angle_error(float a, float b) {
+    float error = fmodf(a - b, _2pi);
+    if(error > 0.5f * _2pi) error -= _2pi;
+    if(error < -0.5f * _2pi) error += _2pi;
+    return fabsf(error);
+}
+
+/**
+ * @brief Calibrate one motor, then save the result and load it back
+*/
+void check_case(const motor_case_t& c, TMC6300* tmc6300) {
+    SimMotor::params params;
+    params.pole_pairs = c.pole_pairs;
+    params.direction = c.direction;
+    params.zero_electric_angle = c.zero_electric_angle;
+    // Registered with the simulation for good, every motor follows the same PWM but only this one is read
+    SimMotor* motor = new SimMotor(UH, VH, WH, params);
+    motor->angle = 1.0f;
+    SimMT6701* encoder = new SimMT6701(motor);
+    HAL::sim::add_process(motor);
+    HAL::sim::attach_spi_device(spi1, c.csn_pin, encoder);
+
+    SPIBus* bus = new SPIBus(spi1); // Four devices at most per bus
+    bus->init(10000000u);
+    MT6701* mt6701 = new MT6701(bus, c.csn_pin);
+    mt6701->init();
+
+    // Start from settings that are wrong in every way
+    FOC foc(1, mt6701, tmc6300, c.direction > 0 ? Direction::CCW : Direction::CW, 5.0f);
+    foc.init(true);
+    foc.set_zero_electric_angle(c.zero_electric_angle + 2.0f);
+
+    motor_calibration_t result;
+    uint64_t start = HAL::time_us();
+    bool ok = foc.calibrate_motor(CAL_VOLTAGE, &result);
+    float seconds = (float)(HAL::time_us() - start) * 1e-6f;
+    check(ok, "%d pole pairs, direction %d: calibration failed", c.pole_pairs, c.direction);
+    if(!ok) return;
+
+    float zero_error = angle_error(result.zero_electric_angle, c.zero_electric_angle);
+    check(result.pole_pairs == c.pole_pairs && foc.get_pole_pairs() == c.pole_pairs, "%d pole pairs, direction %d: found %d pole pairs",
+        c.pole_pairs, c.direction, result.pole_pairs);
+    check(fabsf(result.pole_pairs_estimate - c.pole_pairs) <= ESTIMATE_TOLERANCE, "%d pole pairs, direction %d: estimate %f",
+        c.pole_pairs, c.direction, result.pole_pairs_estimate);
+    check(result.direction == c.direction && foc.get_direction() == c.direction, "%d pole pairs, direction %d: found direction %d",
+        c.pole_pairs, c.direction, (int)result.direction);
+    check(zero_error <= ZERO_TOLERANCE, "%d pole pairs, direction %d: zero electric angle %f, expected %f",
+        c.pole_pairs, c.direction, result.zero_electric_angle, c.zero_electric_angle);
+
+    // Round trip through flash into a FOC that knows nothing
+    check(foc.save_calibration(FLASH_OFFSET), "%d pole pairs, direction %d: save failed", c.pole_pairs, c.direction);
+    FOC loaded(1, mt6701, tmc6300, Direction::UNKNOWN, 5.0f);
+    check(loaded.load_calibration(FLASH_OFFSET), "%d pole pairs, direction %d: load failed", c.pole_pairs, c.direction);
+    check(loaded.get_pole_pairs() == foc.get_pole_pairs() && loaded.get_direction() == foc.get_direction()
+        && loaded._zero_electric_angle == foc._zero_electric_angle && loaded.electric_angle_q15(1234) == foc.electric_angle_q15(1234),
+        "%d pole pairs, direction %d: loaded %d pole pairs, direction %d, zero %f", c.pole_pairs, c.direction,
+        loaded.get_pole_pairs(), (int)loaded.get_direction(), loaded._zero_electric_angle);
+
+    printf("%2d pole pairs, direction %2d: found %2d (%.3f), direction %2d, zero %.4f off by %.4f rad, residual %.3f rad, %.1f s\n",
+        c.pole_pairs, c.direction, result.pole_pairs, result.pole_pairs_estimate, (int)result.direction,
+        result.zero_electric_angle, zero_error, result.residual, seconds);
+}
+
+/**
+ * @brief A record with a flipped bit or in the wrong place must not load, and must leave the FOC as it was
+*/
+void check_bad_records(TMC6300* tmc6300) {
+    FOC foc(3, NULL, tmc6300, Direction::CW, 5.0f);
+    foc.set_zero_electric_angle(1.5f);
+    float zero = foc._zero_electric_angle;
+
+    check(!foc.load_calibration(FLASH_OFFSET - HAL::FLASH_SECTOR_BYTES), "loaded a record from an empty sector");
+    uint8_t sector[HAL::FLASH_SECTOR_BYTES];
+    HAL::flash_read(FLASH_OFFSET, sector, sizeof(sector));
+    for(uint32_t byte = 0; byte < 16; byte++) {
+        uint8_t damaged[HAL::FLASH_SECTOR_BYTES];
+        memcpy(damaged, sector, sizeof(damaged));
+        damaged[byte] ^= 0x10;
+        HAL::flash_write(FLASH_OFFSET, damaged, sizeof(damaged));
+        check(!foc.load_calibration(FLASH_OFFSET), "loaded a record with byte %u damaged", byte);
+    }
+    check(foc.get_pole_pairs() == 3 && foc.get_direction() == Direction::CW && foc._zero_electric_angle == zero,
+        "a refused record changed the FOC");
+    HAL::flash_write(FLASH_OFFSET, sector, sizeof(sector));
+    check(foc.load_calibration(FLASH_OFFSET), "the undamaged record did not load");
+}
+
+int main() {
+    HAL::init();
+    HAL::gpio_set_function(MAG_MISO, HAL::gpio_func::SPI);
+    HAL::gpio_set_function(MAG_CLK, HAL::gpio_func::SPI);
+    TMC6300 tmc6300(UH, VH, WH, UL, VL, WL, 5.0f);
+    tmc6300.init(24000L, 0.05);
+    tmc6300.set_enabled(true);
+
+    for(const motor_case_t& c : cases) check_case(c, &tmc6300);
+    check_bad_records(&tmc6300);
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
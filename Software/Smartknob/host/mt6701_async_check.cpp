@@ -0,0 +1,113 @@
+/*
+ *  Title: MT6701 Async Check
+
+ *  Description: Runs the encoder half of the control tick on core 1 like main.cpp. The frame
+ *      started by start_read has to be in flight while the tick does other work, the virtual
+ *      clock has to move on through that work, and finish_read_raw then has to return the
+ *      new angle without waiting any longer. Without work in between it has to wait out the
+ *      transfer. Exits with 1 if anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <atomic>
+#include <HAL.h>
+#include <SPIBus.h>
+#include <MT6701.h>
+#include "SimModels.h"
+#include "../pin_assignments.h"
+
+const uint32_t TICKS = 1000;
+const uint32_t WORK_US = 20;    // Work done while the frame is in flight, the 24 bit frame takes 2 us at 15 MHz
+
+SimMotor::params motor_params;
+SimMotor motor(UH, VH, WH, motor_params); // Not stepped, the angle is set by hand
+SimMT6701 encoder(&motor);
+SPIBus spi1_bus(spi1);
+MT6701 mt6701(&spi1_bus, MAG_CSN);
+
+std::atomic<bool> finished{false};
+uint32_t failures = 0;          // Only touched by core 1 until finished
+uint64_t idle_wait_us = 0;      // Time finish_read_raw waited with nothing in between
+uint64_t work_wait_us = 0;      // Time finish_read_raw waited after the work
+uint32_t early = 0;             // Frames that were done before finish_read_raw was called
+
+void check(bool ok, const char* format, ...) {
+    if(ok) return;
+    va_list args;
+    va_start(args, format);
+    printf("FAIL: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    failures++;
+}
+
+/**
+ * @brief Put the knob in the middle of an encoder count that changes every tick
+ * @return The count the encoder should report
+*/
+uint16_t move_knob(uint32_t tick) {
+    uint16_t count = (uint16_t)((tick * 4099u + 1u) & 0x3FFF);
+    motor.angle = ((float)count + 0.5f) * (2.0f * 3.14159265358979f / 16384.0f);
+    return count;
+}
+
+/**
+ * @brief One encoder read, with or without work while the frame is in flight
+*/
+void tick(uint32_t number, uint32_t work_us) {
+    uint16_t expected = move_knob(number);
+    check(mt6701.start_read(), "tick %u: start_read refused", number);
+    uint64_t started = HAL::time_us();
+    if(work_us > 0) {
+        HAL::sleep_us(work_us); // Stands in for logging, the clock only moves if the work takes time
+        check(HAL::time_us() - started == work_us, "tick %u: the clock moved %llu us during %u us of work", number,
+            (unsigned long long)(HAL::time_us() - started), work_us);
+        uint16_t latest = UINT16_MAX;
+        mt6701.get_latest_raw(&latest);
+        if(latest == expected) early++;
+    }
+    uint64_t before = HAL::time_us();
+    uint16_t count = UINT16_MAX;
+    mt6701_err_t error = mt6701.finish_read_raw(&count);
+    uint64_t waited = HAL::time_us() - before;
+    if(work_us > 0) {
+        work_wait_us += waited;
+    } else {
+        idle_wait_us += waited;
+    }
+    check(error == mt6701_err_t::OK && count == expected, "tick %u: read %u with error %d, expected %u", number, count, (int)error, expected);
+}
+
+void core1_entry() {
+    check(mt6701.init_async(), "init_async failed");
+    for(uint32_t i = 0; i < TICKS; i++) tick(i, 0);
+    for(uint32_t i = 0; i < TICKS; i++) tick(TICKS + i, WORK_US);
+    finished.store(true);
+}
+
+int main() {
+    HAL::init();
+    HAL::sim::attach_spi_device(spi1, MAG_CSN, &encoder);
+    spi1_bus.init(10000000u);
+    HAL::gpio_set_function(MAG_MISO, HAL::gpio_func::SPI);
+    HAL::gpio_set_function(MAG_CLK, HAL::gpio_func::SPI);
+    mt6701.init();
+
+    HAL::multicore_launch_core1(core1_entry);
+    while(!finished.load()) HAL::tight_loop_contents();
+
+    check(idle_wait_us >= TICKS * 2, "finish_read_raw waited %llu us over %u reads with nothing in flight, less than the transfers take",
+        (unsigned long long)idle_wait_us, TICKS);
+    check(work_wait_us == 0, "finish_read_raw waited %llu us after the work", (unsigned long long)work_wait_us);
+    check(early == TICKS, "%u of %u frames were done by the end of the work", early, TICKS);
+
+    printf("Without work finish_read_raw waited %.1f us per read, after %u us of work %.1f us, %u of %u frames done early\n",
+        (double)idle_wait_us / TICKS, WORK_US, (double)work_wait_us / TICKS, early, TICKS);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/*
+ *  Title: PID Benchmark
+
+ *  Description: Times StaticPID against PID and FixedPID on this machine, and a PIDBank against
+ *      the PIDs it was loaded from. That they give the same output bit for bit is checked by
+ *      pid_check.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <PID.h>
+#include <FixedPID.h>
+#include <StaticPID.h>
+#include <PIDBank.h>
+
+using namespace SMARTKNOB;
+using namespace SMARTKNOB::PIDPolicy;
+
+const uint32_t BENCHMARK_STEPS = 1 << 22;
+const float DT = 1e-3f;
+const float INPUT_SCALE = 2.0f * 3.14159265358979323846f / 65536.0f; // 16 bit angle
+const float OUTPUT_SCALE = 2.5f;
+
+volatile float sink = 0.0f; // Keeps the controllers from being optimized away
+
+static uint32_t seed = 12345;
+static uint32_t next(void) {
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+/**
+ * @brief Random walk of the input with jumps of the setpoint, crossing +-pi so angular errors wrap
+*/
+struct trace_t {
+    std::vector<float> pv;
+    std::vector<float> setpoint;
+    std::vector<int32_t> pv_fixed;
+    std::vector<int32_t> setpoint_fixed;
+};
+
+static trace_t make_trace(uint32_t steps) {
+    trace_t trace;
+    float pv = 0.0f, setpoint = 1.0f;
+    int32_t pv_fixed = 0, setpoint_fixed = 10000;
+    for(uint32_t i = 0; i < steps; i++) {
+        pv += ((float)(next() & 0xFFFF) / 65536.0f - 0.5f) * 0.2f;
+        pv_fixed += (int32_t)(next() & 0x3FF) - 512;
+        if((next() & 0x3FF) == 0) {
+            setpoint = ((float)(next() & 0xFFFF) / 65536.0f - 0.5f) * 20.0f;
+            setpoint_fixed = (int32_t)(next() & 0x1FFFF) - 65536;
+        }
+        trace.pv.push_back(pv);
+        trace.setpoint.push_back(setpoint);
+        trace.pv_fixed.push_back(pv_fixed);
+        trace.setpoint_fixed.push_back(setpoint_fixed);
+    }
+    return trace;
+}
+
+template <class E, class D, class P, class A> void configure(PID& pid) {
+    pid.errorMode = E::MODE;
+    pid.derivativeMode = D::MODE;
+    pid.proportionalMode = P::MODE;
+    pid.enableAntiwindup = A::ENABLED;
+}
+
+template <class E, class D, class P, class A> void configure(FixedPID& pid) {
+    pid.errorMode = E::MODE;
+    pid.derivativeMode = D::MODE;
+    pid.proportionalMode = P::MODE;
+    pid.enableAntiwindup = A::ENABLED;
+    pid.configure();
+}
+
+template <typename F> double ns_per_update(F function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / BENCHMARK_STEPS;
+}
+
+/**
+ * @brief Time the runtime and compile time versions of one set of modes
+*/
+template <class E, class D, class P, class A> void benchmark(const char* name, const trace_t& trace) {
+    PID runtime(0.8f, 2.0f, 0.01f, 50.0f);
+    runtime.antiwindup = 0.05f;
+    configure<E, D, P, A>(runtime);
+    runtime.reset();
+    StaticPID<E, D, P, A> compiled(0.8f, 2.0f, 0.01f, 50.0f, 0.05f);
+    FixedPID runtime_fixed(0.02f, 0.5f, 0.0004f, 200.0f, DT, INPUT_SCALE, OUTPUT_SCALE);
+    runtime_fixed.antiwindup = 2.0f;
+    configure<E, D, P, A>(runtime_fixed);
+    StaticPID<E, D, P, A, q15_t> compiled_fixed(0.02f, 0.5f, 0.0004f, 200.0f, DT, INPUT_SCALE, OUTPUT_SCALE);
+    compiled_fixed.antiwindup = 2.0f;
+    compiled_fixed.configure();
+
+    const uint32_t mask = (uint32_t)trace.pv.size() - 1;
+    float sum = 0.0f;
+    int32_t sum_fixed = 0;
+    double pid_ns = ns_per_update([&]() { for(uint32_t i = 0; i < BENCHMARK_STEPS; i++) sum += runtime.update(trace.pv[i & mask], DT); });
+    double static_ns = ns_per_update([&]() { for(uint32_t i = 0; i < BENCHMARK_STEPS; i++) sum += compiled.update(trace.pv[i & mask], DT); });
+    double fixed_ns = ns_per_update([&]() { for(uint32_t i = 0; i < BENCHMARK_STEPS; i++) sum_fixed += runtime_fixed.update(trace.pv_fixed[i & mask]); });
+    double static_fixed_ns = ns_per_update([&]() { for(uint32_t i = 0; i < BENCHMARK_STEPS; i++) sum_fixed += compiled_fixed.update(trace.pv_fixed[i & mask]); });
+    sink = sink + sum + (float)sum_fixed;
+    printf("%-36s  %6.2f  %9.2f  %8.2f  %15.2f\n", name, pid_ns, static_ns, fixed_ns, static_fixed_ns);
+}
+
+/**
+ * @brief One PID for each of the 16 float combinations of modes, with gains that differ a little
+*/
+static PID make_pid(uint k) {
+    PID pid(0.8f + 0.01f * k, 2.0f, 0.01f, 50.0f - k);
+    pid.antiwindup = 0.05f;
+    pid.errorMode = (k & 1) ? ErrorMode::ANGULAR : ErrorMode::LINEAR;
+    pid.derivativeMode = (DerivativeMode)((k >> 1) & 3);
+    pid.proportionalMode = (k & 8) ? ProportionalMode::PROPORTIONAL_ON_MEASUREMENT : ProportionalMode::PROPORTIONAL_ON_ERROR;
+    pid.enableAntiwindup = (k & 16) != 0;
+    pid.reset();
+    return pid;
+}
+
+/**
+ * @brief Time K PIDs one after the other against a bank of K, all linear so the bank takes no branches
+*/
+template <uint K> void benchmark_bank(const trace_t& trace) {
+    PID pids[K];
+    PIDBank<K> bank;
+    for(uint k = 0; k < K; k++) {
+        pids[k] = make_pid(k & ~1u);
+        bank.configure(k, pids[k]);
+    }
+    const uint32_t mask = (uint32_t)trace.pv.size() - 1;
+    const uint32_t ticks = BENCHMARK_STEPS / K;
+    float sum = 0.0f;
+    double pid_ns = ns_per_update([&]() {
+        for(uint32_t i = 0; i < ticks; i++) {
+            for(uint k = 0; k < K; k++) sum += pids[k].update(trace.pv[(i + k) & mask], DT);
+        }
+    });
+    double bank_ns = ns_per_update([&]() {
+        for(uint32_t i = 0; i < ticks; i++) {
+            sum += bank.update(&trace.pv[i & (mask >> 1)], DT)[K - 1];
+        }
+    });
+    sink = sink + sum;
+    printf("%2u controllers  %6.2f  %9.2f\n", K, pid_ns, bank_ns);
+}
+
+int main() {
+    trace_t bench_trace = make_trace(1 << 16);
+    printf("%-36s  %6s  %9s  %8s  %15s\n", "ns per update", "PID", "StaticPID", "FixedPID", "StaticPID Q15");
+    benchmark<LinearError, DerivativeOnError, ProportionalOnError, ClampAntiwindup>("velocity loop, antiwindup", bench_trace);
+    benchmark<AngularError, DerivativeOnMeasurementFiltered, ProportionalOnMeasurement, NoAntiwindup>("angular, filtered D on measurement", bench_trace);
+
+    printf("\nns per controller update     PID   PIDBank\n");
+    benchmark_bank<4>(bench_trace);
+    benchmark_bank<8>(bench_trace);
+    benchmark_bank<32>(bench_trace);
+    return 0;
+}
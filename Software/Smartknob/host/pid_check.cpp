@@ -0,0 +1,212 @@
+/*
+ *  Title: PID Check
+
+ *  Description: Checks that StaticPID gives the same output and terms as PID and FixedPID,
+ *      bit for bit, for all 32 combinations of modes, on a random walk of the input with
+ *      setpoint jumps that crosses +-pi and ticks of uneven length, and that PIDBanks of a few
+ *      sizes give the same as the PIDs they were loaded from. Exits with 1 if any step differs.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <PID.h>
+#include <FixedPID.h>
+#include <StaticPID.h>
+#include <PIDBank.h>
+
+using namespace SMARTKNOB;
+using namespace SMARTKNOB::PIDPolicy;
+
+const uint32_t STEPS = 200000;
+const float DT = 1e-3f;
+const float INPUT_SCALE = 2.0f * 3.14159265358979323846f / 65536.0f; // 16 bit angle
+const float OUTPUT_SCALE = 2.5f;
+
+static uint32_t seed = 12345;
+static uint32_t next(void) {
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+static bool same(float a, float b) { return memcmp(&a, &b, sizeof(float)) == 0; }
+
+/**
+ * @brief Random walk of the input with jumps of the setpoint, crossing +-pi so angular errors wrap
+*/
+struct trace_t {
+    std::vector<float> pv;
+    std::vector<float> setpoint;
+    std::vector<int32_t> pv_fixed;
+    std::vector<int32_t> setpoint_fixed;
+};
+
+static trace_t make_trace(uint32_t steps) {
+    trace_t trace;
+    float pv = 0.0f, setpoint = 1.0f;
+    int32_t pv_fixed = 0, setpoint_fixed = 10000;
+    for(uint32_t i = 0; i < steps; i++) {
+        pv += ((float)(next() & 0xFFFF) / 65536.0f - 0.5f) * 0.2f;
+        pv_fixed += (int32_t)(next() & 0x3FF) - 512;
+        if((next() & 0x3FF) == 0) {
+            setpoint = ((float)(next() & 0xFFFF) / 65536.0f - 0.5f) * 20.0f;
+            setpoint_fixed = (int32_t)(next() & 0x1FFFF) - 65536;
+        }
+        trace.pv.push_back(pv);
+        trace.setpoint.push_back(setpoint);
+        trace.pv_fixed.push_back(pv_fixed);
+        trace.setpoint_fixed.push_back(setpoint_fixed);
+    }
+    return trace;
+}
+
+template <class E, class D, class P, class A> void configure(PID& pid) {
+    pid.errorMode = E::MODE;
+    pid.derivativeMode = D::MODE;
+    pid.proportionalMode = P::MODE;
+    pid.enableAntiwindup = A::ENABLED;
+}
+
+template <class E, class D, class P, class A> void configure(FixedPID& pid) {
+    pid.errorMode = E::MODE;
+    pid.derivativeMode = D::MODE;
+    pid.proportionalMode = P::MODE;
+    pid.enableAntiwindup = A::ENABLED;
+    pid.configure();
+}
+
+/**
+ * @brief Run both on the same trace
+ * @return Number of steps where any output or term differs
+*/
+template <class E, class D, class P, class A> uint32_t compare(const trace_t& trace) {
+    uint32_t mismatches = 0;
+
+    PID runtime(0.8f, 2.0f, 0.01f, 50.0f);
+    runtime.antiwindup = 0.05f;
+    configure<E, D, P, A>(runtime);
+    runtime.reset();
+    StaticPID<E, D, P, A> compiled(0.8f, 2.0f, 0.01f, 50.0f, 0.05f);
+    for(uint32_t i = 0; i < trace.pv.size(); i++) {
+        runtime.setpoint = compiled.setpoint = trace.setpoint[i];
+        float dt = DT * (1.0f + 0.1f * (float)(i % 7)); // Uneven ticks
+        float a = runtime.update(trace.pv[i], dt);
+        float b = compiled.update(trace.pv[i], dt);
+        if(!same(a, b) || !same(runtime.pTerm, compiled.pTerm) || !same(runtime.iTerm, compiled.iTerm) || !same(runtime.dTerm, compiled.dTerm)) mismatches++;
+    }
+
+    FixedPID runtime_fixed(0.02f, 0.5f, 0.0004f, 200.0f, DT, INPUT_SCALE, OUTPUT_SCALE);
+    runtime_fixed.antiwindup = 2.0f;
+    configure<E, D, P, A>(runtime_fixed);
+    StaticPID<E, D, P, A, q15_t> compiled_fixed(0.02f, 0.5f, 0.0004f, 200.0f, DT, INPUT_SCALE, OUTPUT_SCALE);
+    compiled_fixed.antiwindup = 2.0f;
+    compiled_fixed.configure();
+    for(uint32_t i = 0; i < trace.pv_fixed.size(); i++) {
+        runtime_fixed.setpoint = compiled_fixed.setpoint = trace.setpoint_fixed[i];
+        q15_t a = runtime_fixed.update(trace.pv_fixed[i]);
+        q15_t b = compiled_fixed.update(trace.pv_fixed[i]);
+        if(a != b || runtime_fixed.pTerm != compiled_fixed.pTerm || runtime_fixed.iTerm != compiled_fixed.iTerm || runtime_fixed.dTerm != compiled_fixed.dTerm) mismatches++;
+    }
+    return mismatches;
+}
+
+// Every combination of the four policies, one level at a time
+template <class E, class D, class P> uint32_t compare_antiwindup(const trace_t& trace, const char* name, uint& count) {
+    uint32_t mismatches = 0;
+    uint32_t without = compare<E, D, P, NoAntiwindup>(trace);
+    uint32_t with = compare<E, D, P, ClampAntiwindup>(trace);
+    if(without != 0) printf("  %s, no antiwindup: %u steps differ\n", name, without);
+    if(with != 0) printf("  %s, antiwindup: %u steps differ\n", name, with);
+    count += 2;
+    mismatches += without + with;
+    return mismatches;
+}
+
+template <class E, class D> uint32_t compare_proportional(const trace_t& trace, const char* name, uint& count) {
+    char on_error[96], on_measurement[96];
+    snprintf(on_error, sizeof(on_error), "%s, P on error", name);
+    snprintf(on_measurement, sizeof(on_measurement), "%s, P on measurement", name);
+    return compare_antiwindup<E, D, ProportionalOnError>(trace, on_error, count) +
+        compare_antiwindup<E, D, ProportionalOnMeasurement>(trace, on_measurement, count);
+}
+
+template <class E> uint32_t compare_derivative(const trace_t& trace, const char* name, uint& count) {
+    char names[4][64];
+    snprintf(names[0], sizeof(names[0]), "%s, D on error", name);
+    snprintf(names[1], sizeof(names[1]), "%s, D on error filtered", name);
+    snprintf(names[2], sizeof(names[2]), "%s, D on measurement", name);
+    snprintf(names[3], sizeof(names[3]), "%s, D on measurement filtered", name);
+    return compare_proportional<E, DerivativeOnError>(trace, names[0], count) +
+        compare_proportional<E, DerivativeOnErrorFiltered>(trace, names[1], count) +
+        compare_proportional<E, DerivativeOnMeasurement>(trace, names[2], count) +
+        compare_proportional<E, DerivativeOnMeasurementFiltered>(trace, names[3], count);
+}
+
+/**
+ * @brief One PID for each of the 16 float combinations of modes, with gains that differ a little
+*/
+static PID make_pid(uint k) {
+    PID pid(0.8f + 0.01f * k, 2.0f, 0.01f, 50.0f - k);
+    pid.antiwindup = 0.05f;
+    pid.errorMode = (k & 1) ? ErrorMode::ANGULAR : ErrorMode::LINEAR;
+    pid.derivativeMode = (DerivativeMode)((k >> 1) & 3);
+    pid.proportionalMode = (k & 8) ? ProportionalMode::PROPORTIONAL_ON_MEASUREMENT : ProportionalMode::PROPORTIONAL_ON_ERROR;
+    pid.enableAntiwindup = (k & 16) != 0;
+    pid.reset();
+    return pid;
+}
+
+/**
+ * @brief Run K PIDs and a bank loaded from them on the same inputs, each controller on its own part of the trace
+ * @return Number of steps where any output or term differs
+*/
+template <uint K> uint32_t compare_bank(const trace_t& trace) {
+    PID pids[K];
+    PIDBank<K> bank;
+    for(uint k = 0; k < K; k++) {
+        pids[k] = make_pid(k);
+        bank.configure(k, pids[k]);
+    }
+    uint32_t mismatches = 0;
+    float pv[K];
+    for(uint32_t i = 0; i < trace.pv.size(); i++) {
+        float dt = DT * (1.0f + 0.1f * (float)(i % 7));
+        for(uint k = 0; k < K; k++) {
+            uint32_t j = (i + k * 4999) % trace.pv.size();
+            pids[k].setpoint = bank.setpoint[k] = trace.setpoint[j];
+            pv[k] = trace.pv[j];
+            pids[k].update(pv[k], dt);
+        }
+        bank.update(pv, dt);
+        bool differ = false;
+        for(uint k = 0; k < K; k++) {
+            differ |= !same(pids[k].output, bank.output[k]) || !same(pids[k].pTerm, bank.pTerm[k]) ||
+                !same(pids[k].iTerm, bank.iTerm[k]) || !same(pids[k].dTerm, bank.dTerm[k]);
+        }
+        if(differ) mismatches++;
+    }
+    return mismatches;
+}
+
+int main() {
+    trace_t trace = make_trace(STEPS);
+    uint count = 0;
+    uint32_t mismatches = compare_derivative<LinearError>(trace, "linear", count) + compare_derivative<AngularError>(trace, "angular", count);
+    printf("%u combinations of modes against PID and FixedPID over %u steps: %s\n", count, STEPS, mismatches == 0 ? "bit exact" : "DIFFERENT");
+
+    // 32 is every combination of modes, the others leave a tail after the vectorized part of the update
+    const uint bank_sizes[] = {32, 3, 5, 1};
+    uint32_t bank_mismatches[] = {compare_bank<32>(trace), compare_bank<3>(trace), compare_bank<5>(trace), compare_bank<1>(trace)};
+    for(uint i = 0; i < 4; i++) {
+        printf("PIDBank of %u against the PIDs it was loaded from over %u steps: %s\n", bank_sizes[i], STEPS,
+            bank_mismatches[i] == 0 ? "bit exact" : "DIFFERENT");
+        mismatches += bank_mismatches[i];
+    }
+
+    printf("%s\n", mismatches == 0 ? "PASS" : "FAIL");
+    return mismatches == 0 ? 0 : 1;
+}
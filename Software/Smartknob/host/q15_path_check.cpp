@@ -0,0 +1,132 @@
+/*
+ *  Title: Q15 Path Check
+
+ *  Description: Feeds the float and the fixed-point control paths the same 5000 encoder counts,
+ *      with detent jumps that cross the encoder wrap, and compares them step by step. PID
+ *      against FixedPID with the gains and modes of the position loop, FOC::update on the angle
+ *      in radians against FOC::update_q15 on the count given the same voltage, and the PWM
+ *      levels at the end of the whole path. The levels are read back from the simulated PWM
+ *      slices. Exits with 1 if the paths differ by more than the tolerances below.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <HAL.h>
+#include <TMC6300.h>
+#include <FOC.h>
+#include <PID.h>
+#include <FixedPID.h>
+#include <Fixed.h>
+#include "../pin_assignments.h"
+
+const uint32_t STEPS = 5000;
+const float DT = 1e-3f;
+const float VOLTAGE_LIMIT = 5.0f;
+const float TORQUE_LIMIT = 2.5f;
+
+// Largest difference allowed between the paths
+const float PID_TOLERANCE = 2e-3f;      // V
+const int32_t FOC_TOLERANCE = 3;        // PWM counts, same voltage into both FOC paths
+const int32_t PATH_TOLERANCE = 4;       // PWM counts, encoder count to PWM levels
+
+const float _2pi = 6.28318530717958647692f;
+const uint pins[3] = {UH, VH, WH};
+
+template <typename T> T constrain(T amt, T low, T high) {
+    if(amt < low) return low;
+    if(amt > high) return high;
+    return amt;
+}
+
+/**
+ * @brief Compare levels the FOC last gave the three high side pins
+*/
+void read_levels(int32_t* levels) {
+    for(int i = 0; i < 3; i++) {
+        const HAL::sim::pwm_slice_state& p = HAL::sim::pwm_slice(HAL::pwm_gpio_to_slice_num(pins[i]));
+        levels[i] = p.cc_buffer[HAL::pwm_gpio_to_channel(pins[i])];
+    }
+}
+
+int32_t level_difference(const int32_t* a, const int32_t* b) {
+    int32_t worst = 0;
+    for(int i = 0; i < 3; i++) {
+        if(abs(a[i] - b[i]) > worst) worst = abs(a[i] - b[i]);
+    }
+    return worst;
+}
+
+int main() {
+    HAL::init();
+    TMC6300 tmc6300(UH, VH, WH, UL, VL, WL, 5.0f);
+    tmc6300.init(24000L, 0.05);
+    tmc6300.set_enabled(true);
+    FOC foc(7, NULL, &tmc6300, Direction::CCW, VOLTAGE_LIMIT);
+    foc.init(true);
+    foc.set_zero_electric_angle(4.062365f);
+
+    // Position loop of the knob, the fixed one on 16 bit turns
+    SMARTKNOB::PID pid(8.0f, 2.0f, 0.02f, 10.0f);
+    SMARTKNOB::FixedPID fixed_pid(8.0f, 2.0f, 0.02f, 10.0f, DT, _2pi / 65536.0f, VOLTAGE_LIMIT);
+    pid.errorMode = fixed_pid.errorMode = SMARTKNOB::ErrorMode::ANGULAR;
+    pid.derivativeMode = fixed_pid.derivativeMode = SMARTKNOB::DerivativeMode::DERIVATIVE_ON_ERROR_FILTERED;
+    fixed_pid.configure();
+    const q15_t torque_limit = Fixed::float_to_q15(TORQUE_LIMIT / VOLTAGE_LIMIT);
+
+    float pid_worst = 0.0f;
+    int32_t foc_worst = 0;
+    int32_t path_worst = 0;
+    uint32_t seed = 12345;
+    uint16_t detent = 62000;    // 16 bit turns, a few detents short of the wrap
+    float wander = 0.0f;        // rad
+    for(uint32_t step = 0; step < STEPS; step++) {
+        // The detent moves on every half second and crosses the wrap, the knob wanders around it
+        if(step % 500 == 499) detent += 2400;
+        seed = seed * 1664525u + 1013904223u;
+        wander = 0.98f * wander + ((float)(seed >> 8) / (float)(1 << 24) - 0.5f) * 0.05f;
+        float knob = detent * (_2pi / 65536.0f) + 0.2f * sinf(step * 0.013f) + wander;
+        uint16_t count = (uint16_t)((int32_t)floorf(knob * (16384.0f / _2pi)) & 0x3FFF);
+
+        // Same encoder count and setpoint into both position loops
+        pid.setpoint = detent * (_2pi / 65536.0f);
+        fixed_pid.setpoint = detent;
+        float torque = constrain(pid.update(count * (_2pi / 16384.0f), DT), -TORQUE_LIMIT, TORQUE_LIMIT);
+        q15_t fixed_torque = constrain<q15_t>(fixed_pid.update((int32_t)count << 2), -torque_limit, torque_limit);
+        float difference = fabsf(torque - fixed_torque * (VOLTAGE_LIMIT / 32768.0f));
+        if(difference > pid_worst) pid_worst = difference;
+
+        // The float path with the float electrical angle, then the fixed one given the same voltage,
+        // then the whole fixed path
+        int32_t float_levels[3], fixed_levels[3];
+        float angle = count * (_2pi / 16384.0f);
+        foc.update(torque, &angle);
+        read_levels(float_levels);
+        foc.update_q15(Fixed::float_to_q15(torque / VOLTAGE_LIMIT), count);
+        read_levels(fixed_levels);
+        int32_t foc_difference = level_difference(float_levels, fixed_levels);
+        if(foc_difference > foc_worst) foc_worst = foc_difference;
+        foc.update_q15(fixed_torque, count);
+        read_levels(fixed_levels);
+        int32_t path_difference = level_difference(float_levels, fixed_levels);
+        if(path_difference > path_worst) path_worst = path_difference;
+    }
+
+    uint32_t failures = 0;
+    bool ok = pid_worst <= PID_TOLERANCE;
+    printf("PID against FixedPID        max %.2f mV, tolerance %.2f mV%s\n", pid_worst * 1e3f, PID_TOLERANCE * 1e3f, ok ? "" : "  FAIL");
+    if(!ok) failures++;
+    ok = foc_worst <= FOC_TOLERANCE;
+    printf("update against update_q15   max %d counts of %u, tolerance %d%s\n", foc_worst, tmc6300.get_wrap() + 1, FOC_TOLERANCE,
+        ok ? "" : "  FAIL");
+    if(!ok) failures++;
+    ok = path_worst <= PATH_TOLERANCE;
+    printf("Count to PWM levels         max %d counts of %u, tolerance %d%s\n", path_worst, tmc6300.get_wrap() + 1, PATH_TOLERANCE,
+        ok ? "" : "  FAIL");
+    if(!ok) failures++;
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
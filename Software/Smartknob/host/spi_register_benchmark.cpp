@@ -0,0 +1,117 @@
+/*
+ *  Title: SPI Register Benchmark
+
+ *  Description: Counts the SPI configuration register writes per control tick on spi1, with
+ *      the MT6701 read every tick and optionally an MCP3564R data read next to it. Before
+ *      is the sequence the drivers used to run on the raw bus, which set and restored the
+ *      baudrate and format around every transaction. After is the drivers on SPIBus, which
+ *      only write the cached configuration when the other device had the bus. The HAL calls
+ *      are turned into RP2040 register writes the way the pico-sdk makes them.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <HAL.h>
+#include <SPIBus.h>
+#include <MT6701.h>
+#include <MCP3564R.h>
+#include "SimModels.h"
+#include "../pin_assignments.h"
+
+const uint32_t TICKS = 1000;
+const uint32_t TICK_US = 1000;
+
+// Register writes per HAL call on the RP2040
+const uint32_t BAUDRATE_WRITES = 2;     // CPSR and CR0, after a divider search
+const uint32_t FORMAT_WRITES = 3;       // CR0 with SSE cleared and set around it
+const uint32_t CONFIG_WRITES = 4;       // CPSR and CR0 with SSE cleared and set around them
+
+SimMotor::params motor_params;
+SimMotor motor(UH, VH, WH, motor_params); // Not stepped, the encoder only has to answer
+SimMT6701 encoder(&motor);
+SimMCP3564R strain(STRAIN_IRQ);
+SPIBus spi1_bus(spi1);
+MT6701 mt6701(&spi1_bus, MAG_CSN);
+MCP3564R mcp3564r(&spi1_bus, STRAIN_CSN);
+uint32_t failed = 0;                    // Reads through the drivers that went wrong, the counts mean nothing then
+
+/**
+ * @brief Encoder read as MT6701::read_raw did it before SPIBus
+*/
+void legacy_encoder_read(void) {
+    uint old_baudrate = HAL::spi_get_baudrate(spi1);
+    HAL::spi_set_baudrate(spi1, 15000000u);
+    HAL::spi_set_format(spi1, 8, 0, 1);
+    uint8_t buffer[3];
+    HAL::gpio_put(MAG_CSN, false);
+    HAL::spi_read_blocking(spi1, 0x00, buffer, 3);
+    HAL::gpio_put(MAG_CSN, true);
+    HAL::spi_set_format(spi1, 8, 0, 0);
+    HAL::spi_set_baudrate(spi1, old_baudrate);
+}
+
+/**
+ * @brief ADC data read as MCP3564R::read_register did it before SPIBus
+*/
+void legacy_adc_read(void) {
+    uint old_baudrate = HAL::spi_get_baudrate(spi1);
+    HAL::spi_set_baudrate(spi1, 1000000u);
+    uint8_t header = (0x1 << 6) | 0x03; // Incremental read of ADCDATA
+    uint8_t data[3];
+    HAL::gpio_put(STRAIN_CSN, false);
+    HAL::spi_write_blocking(spi1, &header, 1);
+    HAL::sleep_us(1);
+    HAL::spi_read_blocking(spi1, 0x00, data, 3);
+    HAL::gpio_put(STRAIN_CSN, true);
+    HAL::spi_set_baudrate(spi1, old_baudrate);
+}
+
+void encoder_read(void) {
+    uint16_t count;
+    if(mt6701.read_raw(&count) != mt6701_err_t::OK) failed++;
+}
+
+void adc_read(void) {
+    int32_t data;
+    uint8_t channel;
+    if(!mcp3564r.read_data(&data, &channel)) failed++;
+}
+
+/**
+ * @brief Run the ticks and print what they cost on the bus
+*/
+void run(const char* name, void (*read_encoder)(void), void (*read_adc)(void)) {
+    HAL::sim::reset_statistics();
+    for(uint32_t tick = 0; tick < TICKS; tick++) {
+        read_encoder();
+        if(read_adc != NULL) read_adc();
+        HAL::sleep_us(TICK_US);
+    }
+    const HAL::sim::spi_stats& bus = HAL::sim::spi_statistics(spi1);
+    uint32_t writes = bus.baudrate_writes * BAUDRATE_WRITES + bus.format_writes * FORMAT_WRITES + bus.config_writes * CONFIG_WRITES;
+    printf("%-36s  %8.2f  %8.2f  %8.2f  %8.2f\n", name, (double)bus.baudrate_writes / TICKS, (double)bus.format_writes / TICKS,
+        (double)bus.config_writes / TICKS, (double)writes / TICKS);
+}
+
+int main() {
+    HAL::init();
+    HAL::sim::attach_spi_device(spi1, MAG_CSN, &encoder);
+    HAL::sim::attach_spi_device(spi1, STRAIN_CSN, &strain);
+    HAL::sim::add_process(&strain);
+    HAL::gpio_set_function(MAG_MISO, HAL::gpio_func::SPI);
+    HAL::gpio_set_function(MAG_CLK, HAL::gpio_func::SPI);
+    HAL::gpio_set_function(STRAIN_MOSI, HAL::gpio_func::SPI);
+    spi1_bus.init(10000000u);
+    mt6701.init();
+    mcp3564r.init();
+
+    printf("Per control tick, %u ticks\n", TICKS);
+    printf("%-36s  %8s  %8s  %8s  %8s\n", "", "baudrate", "format", "config", "registers");
+    run("Encoder, before", legacy_encoder_read, NULL);
+    run("Encoder, after", encoder_read, NULL);
+    run("Encoder and ADC data, before", legacy_encoder_read, legacy_adc_read);
+    run("Encoder and ADC data, after", encoder_read, adc_read);
+    if(failed > 0) printf("%u reads failed\n", failed);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+/*
+ *  Title: SPSC Benchmark
+
+ *  Description: Throughput of SPSCQueue between two threads, one item at a time and in
+ *      batches of a few sizes, for the 4 byte ADC samples and a 16 byte telemetry sized item.
+ *      Configure with -DCMAKE_BUILD_TYPE=Release for numbers that mean anything.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include <SPSCQueue.h>
+
+const uint32_t ITEMS = 1 << 22;
+const uint32_t QUEUE_SIZE = 256;
+
+struct telemetry_t {
+    uint32_t words[4];
+};
+
+/**
+ * @brief Wait on a full or empty queue, sleeping now and then so a single CPU host gets through
+*/
+void backoff(uint32_t* misses) {
+    if((++*misses & 63) == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @brief Move ITEMS items through a queue with batches of a given size on both sides
+ * @return Items per second
+*/
+template <typename T> double run(uint32_t batch) {
+    static SPSCQueue<T, QUEUE_SIZE> queue; // Empty again after every run
+    static T out[QUEUE_SIZE];
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([batch] {
+        T items[QUEUE_SIZE] = {};
+        uint32_t sent = 0;
+        uint32_t misses = 0;
+        while(sent < ITEMS) {
+            uint32_t count = (ITEMS - sent < batch) ? ITEMS - sent : batch;
+            uint32_t pushed = (batch == 1) ? (uint32_t)queue.push(items[0]) : queue.push(items, count);
+            if(pushed == 0) backoff(&misses);
+            sent += pushed;
+        }
+    });
+    uint32_t received = 0;
+    uint32_t misses = 0;
+    while(received < ITEMS) {
+        uint32_t popped = (batch == 1) ? (uint32_t)queue.pop(&out[0]) : queue.pop(out, batch);
+        if(popped == 0) backoff(&misses);
+        received += popped;
+    }
+    producer.join();
+    return ITEMS / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    printf("Mitems/s through a %u slot queue between two threads\n", QUEUE_SIZE);
+    printf("batch   int32_t  16 bytes\n");
+    const uint32_t batches[] = {1, 4, 16, 64};
+    for(uint32_t batch : batches) {
+        printf("%5u  %8.1f  %8.1f\n", batch, run<int32_t>(batch) * 1e-6, run<telemetry_t>(batch) * 1e-6);
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ *  Title: SPSC Check
+
+ *  Description: Runs a producer and a consumer thread flat out on a small SPSCQueue so it is
+ *      full and empty all the time, mixing single and batch pushes and pops of random sizes.
+ *      Every item carries its sequence number in all of its words, so a lost, repeated,
+ *      reordered or torn item shows. Exits with 1 if one does.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include <SPSCQueue.h>
+
+const uint32_t ITEMS = 4000000;
+const uint32_t MAX_BATCH = 40;  // Larger than the queue so batches get cut short
+
+// Several words so a torn copy is caught
+struct item_t {
+    uint32_t sequence;
+    uint32_t inverted;
+    uint32_t scrambled;
+    uint32_t last;
+};
+
+SPSCQueue<item_t, 32> queue;
+
+item_t make_item(uint32_t sequence) {
+    return {sequence, ~sequence, sequence * 2654435761u, sequence ^ 0xA5A5A5A5u};
+}
+
+/**
+ * @brief Wait a little on a full or empty queue. Spinning on is the real stress with a CPU for
+ *      each thread, but with a single CPU the other thread only gets to run if this one sleeps.
+*/
+void backoff(uint32_t* misses) {
+    if((++*misses & 63) == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+uint32_t next_random(uint32_t* seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+void producer(void) {
+    uint32_t seed = 1;
+    item_t batch[MAX_BATCH];
+    uint32_t sequence = 0;
+    uint32_t misses = 0;
+    while(sequence < ITEMS) {
+        if(next_random(&seed) & 1) {
+            if(queue.push(make_item(sequence))) {
+                sequence++;
+            } else {
+                backoff(&misses);
+            }
+        } else {
+            uint32_t count = 1 + next_random(&seed) % MAX_BATCH;
+            if(count > ITEMS - sequence) count = ITEMS - sequence;
+            for(uint32_t i = 0; i < count; i++) batch[i] = make_item(sequence + i);
+            uint32_t pushed = queue.push(batch, count); // Only the ones that fit went in, the rest go again
+            if(pushed == 0) backoff(&misses);
+            sequence += pushed;
+        }
+    }
+}
+
+int main() {
+    std::thread thread(producer);
+
+    uint32_t seed = 2;
+    item_t batch[MAX_BATCH];
+    uint32_t expected = 0;
+    uint32_t errors = 0;
+    uint32_t oversize = 0;
+    uint32_t empty_pops = 0;
+    while(expected < ITEMS && errors < 10) {
+        if(queue.size() > queue.capacity()) oversize++;
+        uint32_t count;
+        if(next_random(&seed) & 1) {
+            count = queue.pop(&batch[0]) ? 1 : 0;
+        } else {
+            count = queue.pop(batch, 1 + next_random(&seed) % MAX_BATCH);
+        }
+        if(count == 0) backoff(&empty_pops);
+        for(uint32_t i = 0; i < count; i++) {
+            item_t want = make_item(expected);
+            const item_t& got = batch[i];
+            if(got.sequence != want.sequence || got.inverted != want.inverted || got.scrambled != want.scrambled || got.last != want.last) {
+                printf("FAIL: item %u came out as %u %08X %08X %08X\n", expected, got.sequence, got.inverted, got.scrambled, got.last);
+                errors++;
+                expected = got.sequence; // Resynchronize so one error does not cascade
+            }
+            expected++;
+        }
+    }
+    thread.join();
+    if(!queue.empty()) {
+        printf("FAIL: %u items left over\n", queue.size());
+        errors++;
+    }
+    if(oversize > 0) {
+        printf("FAIL: size was over capacity %u times\n", oversize);
+        errors++;
+    }
+
+    printf("%u items through a %u slot queue, consumer found it empty %u times\n", ITEMS, queue.capacity(), empty_pops);
+    printf("%s\n", errors == 0 ? "PASS" : "FAIL");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/*
+ *  Title: Step Response
+
+ *  Description: Runs the cascaded position, velocity and torque loops against the simulated
+ *      motor and encoder at a few base tick rates and loop dividers, steps the position
+ *      and prints rise time, overshoot and settling time for each. The gains are the same
+ *      for every rate so the effect of the rates shows. Pass "csv" to get the traces instead.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <HAL.h>
+#include <SPIBus.h>
+#include <MT6701.h>
+#include <TMC6300.h>
+#include <FOC.h>
+#include <EncoderAngle.h>
+#include <TrackingObserver.h>
+#include <Cascade.h>
+#include "SimModels.h"
+#include "../pin_assignments.h"
+
+// Schedule of one run, the loop rates are base rate over divider
+struct rate_t {
+    uint32_t base_us;
+    uint16_t velocity_divider;
+    uint16_t position_divider;
+};
+
+const rate_t rates[] = {
+    {100, 1, 10},   // 10 kHz torque and velocity, 1 kHz position
+    {100, 4, 20},
+    {250, 2, 4},
+    {500, 1, 2},
+    {1000, 1, 1},   // Everything at the 1 kHz of the single loop in main.cpp
+};
+
+const float STEP = 0.05f;               // rad, small enough to stay off the limits
+const uint32_t RUN_US = 150000;
+const float VELOCITY_BANDWIDTH = 3000.0f;// rad/s
+const float POSITION_BANDWIDTH = 200.0f;// rad/s
+const float OBSERVER_BANDWIDTH = 3000.0f;
+const float ZERO_ELECTRIC_ANGLE = 4.062365f; // Known for the simulated motor, no calibration needed
+
+SimMotor::params motor_params;
+SimMotor motor(UH, VH, WH, motor_params);
+SimMT6701 encoder(&motor);
+SPIBus spi1_bus(spi1);
+MT6701 mt6701(&spi1_bus, MAG_CSN);
+TMC6300 tmc6300(UH, VH, WH, UL, VL, WL, motor_params.supply_voltage);
+FOC foc(motor_params.pole_pairs, &mt6701, &tmc6300, (Direction)motor_params.direction, 5.0f);
+
+struct result_t {
+    float rise_ms;      // 10% to 90% of the step
+    float overshoot;    // Percent of the step
+    float settle_ms;    // Last time outside 2% of the step
+    float final_error;  // rad
+};
+
+/**
+ * @brief Step the position from standstill and measure the response
+*/
+result_t run(const rate_t& rate, bool csv) {
+    cascade_motor_t constants = {
+        motor_params.resistance,
+        motor_params.kt,
+        motor_params.kt * motor_params.pole_pairs,
+        (int8_t)motor_params.direction
+    };
+    float base_period = rate.base_us * 1e-6f;
+    CascadeController cascade(base_period, rate.velocity_divider, rate.position_divider, constants);
+    float kp = motor_params.inertia * VELOCITY_BANDWIDTH;
+    float ki = kp * VELOCITY_BANDWIDTH / 4.0f;
+    cascade.velocity_pid = CascadeController::velocity_pid_t(kp, ki, 0.0f, 1.0f, cascade.torque_limit / ki);
+    cascade.position_pid = CascadeController::position_pid_t(POSITION_BANDWIDTH, 0.0f, 0.0f);
+    cascade.velocity_limit = 8.0f;
+    cascade.voltage_limit = 2.5f;
+    cascade.reset();
+
+    // Start from standstill at the same place every run
+    motor.angle = 0.0f;
+    motor.velocity = 0.0f;
+    uint16_t count = 0;
+    mt6701.read_raw(&count);
+    EncoderAngle angle;
+    angle.reset(count);
+    TrackingObserver observer(OBSERVER_BANDWIDTH, base_period);
+    observer.reset(angle.get_radians());
+    cascade.set_position(STEP);
+
+    result_t result = {0.0f, 0.0f, 0.0f, 0.0f};
+    float t10 = -1.0f, t90 = -1.0f, peak = 0.0f;
+    uint64_t start = HAL::time_us();
+    uint64_t next_tick = start;
+    while(next_tick - start < RUN_US) {
+        next_tick += rate.base_us;
+        HAL::busy_wait_until_us(next_tick);
+        mt6701.read_raw(&count);
+        angle.update(count);
+        observer.update(angle.get_radians());
+        float position = EncoderAngle::to_radians(angle.get_count());
+        float voltage = cascade.update(position, observer.get_velocity());
+        foc.update(voltage, count);
+
+        float t_ms = (next_tick - start) * 1e-3f;
+        float y = motor.angle;  // True angle, not the encoder, so quantization does not count against the loops
+        if(t10 < 0.0f && y >= 0.1f * STEP) t10 = t_ms;
+        if(t90 < 0.0f && y >= 0.9f * STEP) t90 = t_ms;
+        if(y > peak) peak = y;
+        if(fabsf(y - STEP) > 0.02f * STEP) result.settle_ms = t_ms;
+        result.final_error = y - STEP;
+        if(csv) printf("%u,%u,%u,%.3f,%.5f,%.4f,%.6f,%.4f\n", rate.base_us, rate.velocity_divider, rate.position_divider,
+            t_ms, y, motor.velocity, cascade.get_torque_reference(), voltage);
+    }
+    foc.update(0.0f, count);
+    result.rise_ms = (t10 >= 0.0f && t90 >= 0.0f) ? t90 - t10 : NAN;
+    result.overshoot = (peak - STEP) / STEP * 100.0f;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    bool csv = argc > 1 && strcmp(argv[1], "csv") == 0;
+    HAL::init();
+    HAL::sim::add_process(&motor);
+    HAL::sim::attach_spi_device(spi1, MAG_CSN, &encoder);
+    spi1_bus.init(10000000u);
+    HAL::gpio_set_function(MAG_MISO, HAL::gpio_func::SPI);
+    HAL::gpio_set_function(MAG_CLK, HAL::gpio_func::SPI);
+    mt6701.init();
+    tmc6300.init(24000L, 0.05);
+    tmc6300.set_enabled(true);
+    foc.set_zero_electric_angle(ZERO_ELECTRIC_ANGLE);
+    foc.init(true);
+
+    if(csv) {
+        printf("base_us,velocity_divider,position_divider,time_ms,angle,velocity,torque_reference,voltage\n");
+    } else {
+        printf("Step of %.2f rad, velocity loop %.0f rad/s, position loop %.0f rad/s\n", STEP, VELOCITY_BANDWIDTH, POSITION_BANDWIDTH);
+        printf("torque   velocity  position |  rise ms  overshoot %%  settle ms  final error rad\n");
+    }
+    for(const rate_t& rate : rates) {
+        result_t r = run(rate, csv);
+        if(csv) continue;
+        printf("%5.0f Hz  %5.0f Hz  %5.0f Hz  |  %7.2f  %11.2f  %9.2f  %15.5f\n",
+            1e6f / rate.base_us, 1e6f / (rate.base_us * rate.velocity_divider), 1e6f / (rate.base_us * rate.position_divider),
+            r.rise_ms, r.overshoot, r.settle_ms, r.final_error);
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ *  Title: Strain Stream Check
+
+ *  Description: Streams the simulated MCP3564R while the encoder keeps the shared SPI bus busy
+ *      for most of the time, and checks that every conversion is read. Data ready edges that
+ *      find the bus taken have to wait for the release instead of being dropped.
+ *      Exits with 1 if a conversion was lost.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <HAL.h>
+#include <SPIBus.h>
+#include <MT6701.h>
+#include <MCP3564R.h>
+#include "SimModels.h"
+#include "../pin_assignments.h"
+
+const uint32_t RUN_US = 2000000;
+const uint32_t HOLD_US = 40;    // Encoder holds the bus this long per read
+const uint32_t IDLE_US = 20;    // and leaves it free this long, so most edges find it taken
+
+SimMotor::params motor_params;
+SimMotor motor(UH, VH, WH, motor_params);
+SimMT6701 encoder(&motor);
+SimMCP3564R strain(STRAIN_IRQ);
+SPIBus spi1_bus(spi1);
+MT6701 mt6701(&spi1_bus, MAG_CSN);
+MCP3564R mcp3564r(&spi1_bus, STRAIN_CSN);
+
+int main() {
+    HAL::init();
+    HAL::sim::add_process(&motor);
+    HAL::sim::add_process(&strain);
+    HAL::sim::attach_spi_device(spi1, MAG_CSN, &encoder);
+    HAL::sim::attach_spi_device(spi1, STRAIN_CSN, &strain);
+    spi1_bus.init(10000000u);
+    HAL::gpio_init(STRAIN_IRQ);
+    HAL::gpio_set_dir(STRAIN_IRQ, false);
+    HAL::gpio_pull_up(STRAIN_IRQ);
+    mt6701.init();
+    mt6701.init_async();
+    uint8_t other = spi1_bus.add_device(1000000u, 8, 0, 0); // Stands in for a slow device holding the bus
+
+    if(!mcp3564r.init()) {
+        printf("FAIL: strain ADC not responding\n");
+        return 1;
+    }
+    mcp3564r.set_clock_source(3);
+    mcp3564r.select_vref_source(false);
+    mcp3564r.enable_scan_channel(8);
+    mcp3564r.set_adc_gain(5);
+    mcp3564r.set_oversample_ratio(3);
+    if(!mcp3564r.start_stream(STRAIN_IRQ)) {
+        printf("FAIL: streaming did not start\n");
+        return 1;
+    }
+
+    // Alternate the encoder DMA read and the other device, both hold the bus from different places
+    uint32_t samples_read = 0;
+    uint32_t reads = 0;
+    int32_t samples[32];
+    uint64_t start = HAL::time_us();
+    while(HAL::time_us() - start < RUN_US) {
+        uint16_t count = 0;
+        if(reads++ & 1) {
+            mt6701.start_read();
+            HAL::sleep_us(HOLD_US);
+            mt6701.finish_read_raw(&count);
+        } else {
+            spi1_bus.acquire(other);
+            HAL::sleep_us(HOLD_US);
+            spi1_bus.release();
+        }
+        HAL::sleep_us(IDLE_US);
+        samples_read += mcp3564r.read_stream(samples, 32);
+    }
+    mcp3564r.stop_stream();
+    HAL::sleep_us(1000);
+    samples_read += mcp3564r.read_stream(samples, 32);
+
+    printf("%u conversions, %u read, %u overwritten in the ADC, %u dropped by the driver, %u bus holds\n",
+        strain.conversions, samples_read, strain.unread, mcp3564r.get_dropped(), reads);
+    bool ok = strain.conversions > RUN_US / 250 && strain.unread == 0 && mcp3564r.get_dropped() == 0 &&
+        strain.conversions - samples_read <= 1; // The last conversion can land after stop_stream
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
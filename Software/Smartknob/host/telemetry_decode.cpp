@@ -0,0 +1,68 @@
+/*
+ *  Title: Telemetry Decoder
+
+ *  Description: Turns a capture of the binary telemetry stream into CSV.
+ *      Reads the capture from a file or stdin and writes CSV to stdout. Anything that is not
+ *      a valid frame, like the text printed between frames, is skipped and counted.
+ *      Usage: telemetry_decode [capture.bin] [voltage_limit]
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Telemetry.h>
+
+int main(int argc, char** argv) {
+    FILE* in = stdin;
+    if(argc > 1 && argv[1][0] != '-') {
+        in = fopen(argv[1], "rb");
+        if(in == NULL) {
+            fprintf(stderr, "Could not open %s\n", argv[1]);
+            return 1;
+        }
+    }
+    float voltage_limit = (argc > 2) ? strtof(argv[2], NULL) : 5.0f; // Scale of the Q15 torque fields
+    const float angle_scale = 3.14159265358979f / 32768.0f;
+    const float velocity_scale = 6.28318530718f / 65536.0f;
+    const float torque_scale = voltage_limit / 32768.0f;
+
+    printf("sequence,time_us,angle,velocity,torque,p_term,i_term,d_term,position,error\n");
+
+    uint8_t frame[256];
+    size_t len = 0;
+    bool overflow = false;
+    uint32_t frames = 0;
+    uint32_t bad_frames = 0;
+    uint32_t missing = 0;
+    bool first = true;
+    uint16_t expected = 0;
+    int c;
+    while((c = fgetc(in)) != EOF) {
+        if(c != 0) {
+            if(len < sizeof(frame)) frame[len++] = (uint8_t)c;
+            else overflow = true;
+            continue;
+        }
+
+        telemetry_sample_t sample;
+        uint16_t sequence;
+        if(!overflow && len > 0 && Telemetry::decode_frame(frame, len, &sample, &sequence)) {
+            if(!first) missing += (uint16_t)(sequence - expected);
+            first = false;
+            expected = sequence + 1;
+            frames++;
+            printf("%u,%u,%f,%f,%f,%f,%f,%f,%d,%u\n", sequence, sample.time_us, sample.angle * angle_scale,
+                sample.velocity * velocity_scale, sample.torque * torque_scale, sample.p_term * torque_scale, sample.i_term * torque_scale,
+                sample.d_term * torque_scale, sample.position, sample.error);
+        } else if(len > 0) {
+            bad_frames++;
+        }
+        len = 0;
+        overflow = false;
+    }
+
+    if(in != stdin) fclose(in);
+    fprintf(stderr, "%u frames, %u dropped by the firmware, %u unreadable\n", frames, missing, bad_frames);
+    return 0;
+}
@@ -0,0 +1,334 @@
+/*
+ *  Title: TMC6300 Check
+
+ *  Description: Drives set_levels of the TMC6300 driver against the simulated PWM slices with
+ *      the counters at every position of the phase correct period. The stores must wait out
+ *      the counters being near the wrap, land in the compare buffers of all slices, and
+ *      latch on every phase in the same period. A layout with one driver channel per slice
+ *      has to leave the other channels alone. The waveform player has to hand one waveform
+ *      to the next without a gap, ignore set_levels while it plays and hold the last step
+ *      after stop. Exits with 1 if anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <HAL.h>
+#include <TMC6300.h>
+#include "../pin_assignments.h"
+
+const long FREQUENCY = 24000;           // Hz, like main.cpp
+const float DEAD_ZONE = 0.05f;
+const float SUPPLY_VOLTAGE = 5.0f;
+const uint16_t LATCH_GUARD = 64;        // Same as TMC6300::LATCH_GUARD
+const uint32_t CALLS = 2000;
+
+uint32_t failures = 0;
+
+void check(bool ok, const char* format, ...) {
+    if(ok) return;
+    va_list args;
+    va_start(args, format);
+    printf("FAIL: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    failures++;
+}
+
+/**
+ * @brief Pins of one driver, high sides then low sides like the TMC6300 constructor
+*/
+struct layout_t {
+    const char* name;
+    uint pins[6];
+};
+
+/**
+ * @brief Compare levels the pins of a layout should end up with for a set of phase levels
+*/
+void expected_levels(TMC6300* motor, const uint16_t levels[3], uint16_t out[6]) {
+    uint32_t top = (uint32_t)motor->get_wrap() + 1;
+    uint32_t dead_zone = (uint32_t)(top * DEAD_ZONE);
+    for(int phase = 0; phase < 3; phase++) {
+        uint32_t low = levels[phase] + dead_zone;
+        out[phase] = levels[phase];
+        out[phase + 3] = (uint16_t)(low > top ? top : low);
+    }
+}
+
+/**
+ * @brief How many pins of a layout have their output level, not the buffered one, at a value
+*/
+uint latched(const layout_t& layout, const uint16_t levels[6]) {
+    uint count = 0;
+    for(int i = 0; i < 6; i++) {
+        const HAL::sim::pwm_slice_state& p = HAL::sim::pwm_slice(HAL::pwm_gpio_to_slice_num(layout.pins[i]));
+        if(p.cc[HAL::pwm_gpio_to_channel(layout.pins[i])] == levels[i]) count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Call set_levels at every counter position and follow each update until it latches
+*/
+void check_phase_consistency(const layout_t& layout) {
+    TMC6300 motor(layout.pins[0], layout.pins[1], layout.pins[2], layout.pins[3], layout.pins[4], layout.pins[5], SUPPLY_VOLTAGE);
+    motor.init(FREQUENCY, DEAD_ZONE);
+    motor.set_enabled(true);
+    const uint slice = HAL::pwm_gpio_to_slice_num(layout.pins[0]);
+    const uint32_t period_us = 2 * ((uint32_t)motor.get_wrap() + 1) / 125 + 1;
+    check(HAL::sim::pwm_slice(slice).phase_correct, "%s: slice %u is not phase correct", layout.name, slice);
+
+    uint32_t waits = 0;
+    uint32_t split = 0;
+    for(uint32_t call = 0; call < CALLS; call++) {
+        HAL::sleep_us(1 + call % period_us); // 1 us is 125 counts, walks the call over the whole period
+
+        // Every level differs from the last call so a latch shows on every pin
+        uint16_t levels[3];
+        for(int phase = 0; phase < 3; phase++) levels[phase] = (uint16_t)((call * 397 + phase * 601) % (motor.get_wrap() - 400) + 1 + (call & 1) * 100);
+        uint16_t want[6];
+        expected_levels(&motor, levels, want);
+
+        uint16_t counter = HAL::pwm_get_counter(slice);
+        uint64_t start = HAL::time_us();
+        motor.set_levels(levels[0], levels[1], levels[2]);
+        uint64_t waited = HAL::time_us() - start;
+        if(counter < LATCH_GUARD) {
+            waits++;
+            check(waited > 0, "%s: set_levels stored at counter %u", layout.name, counter);
+        } else {
+            check(waited == 0, "%s: set_levels waited %llu us at counter %u", layout.name, (unsigned long long)waited, counter);
+        }
+        check(HAL::pwm_get_counter(slice) >= LATCH_GUARD, "%s: set_levels returned at counter %u", layout.name, HAL::pwm_get_counter(slice));
+
+        for(int i = 0; i < 6; i++) {
+            const HAL::sim::pwm_slice_state& p = HAL::sim::pwm_slice(HAL::pwm_gpio_to_slice_num(layout.pins[i]));
+            uint16_t buffered = p.cc_buffer[HAL::pwm_gpio_to_channel(layout.pins[i])];
+            check(buffered == want[i], "%s: pin %u buffered %u, expected %u", layout.name, layout.pins[i], buffered, want[i]);
+        }
+
+        // Step 1 us at a time up to the wrap, the pins have to go from none to all latched in one step
+        uint count = latched(layout, want);
+        uint32_t elapsed = 0;
+        while(count < 6 && elapsed <= period_us) {
+            if(count > 0) split++;
+            HAL::sleep_us(1);
+            elapsed++;
+            count = latched(layout, want);
+        }
+        if(count > 0 && count < 6) split++;
+        check(count == 6, "%s: levels of call %u had not latched after %u us", layout.name, call, elapsed);
+    }
+    check(waits > 0, "%s: no call landed near the wrap", layout.name);
+    check(split == 0, "%s: %u updates latched over two periods", layout.name, split);
+    printf("%-16s  %u calls, %u waited for the wrap, %u split over two periods\n", layout.name, CALLS, waits, split);
+}
+
+/**
+ * @brief One driver pin per slice, the channel next to each must keep the level it had
+*/
+void check_single_channel(const layout_t& layout) {
+    const uint16_t OTHER_LEVEL = 1234;
+    uint other[6];
+    for(int i = 0; i < 6; i++) {
+        other[i] = layout.pins[i] ^ 1u; // The other channel of the same slice
+        HAL::pwm_set_chan_level(HAL::pwm_gpio_to_slice_num(other[i]), HAL::pwm_gpio_to_channel(other[i]), OTHER_LEVEL);
+        HAL::pwm_set_channel_inverted(HAL::pwm_gpio_to_slice_num(other[i]), HAL::pwm_gpio_to_channel(other[i]), false);
+    }
+
+    TMC6300 motor(layout.pins[0], layout.pins[1], layout.pins[2], layout.pins[3], layout.pins[4], layout.pins[5], SUPPLY_VOLTAGE);
+    motor.init(FREQUENCY, DEAD_ZONE);
+    motor.set_enabled(true);
+    check(!motor.init_player(), "%s: init_player accepted phases split over slices", layout.name);
+
+    uint16_t levels[3] = {300, 1200, 2400};
+    uint16_t want[6];
+    expected_levels(&motor, levels, want);
+    motor.set_levels(levels[0], levels[1], levels[2]);
+    HAL::sleep_us(100);
+    check(latched(layout, want) == 6, "%s: levels did not latch", layout.name);
+    for(int i = 0; i < 6; i++) {
+        const HAL::sim::pwm_slice_state& p = HAL::sim::pwm_slice(HAL::pwm_gpio_to_slice_num(other[i]));
+        uint channel = HAL::pwm_gpio_to_channel(other[i]);
+        check(p.cc[channel] == OTHER_LEVEL && p.cc_buffer[channel] == OTHER_LEVEL, "%s: pin %u next to pin %u changed to %u",
+            layout.name, other[i], layout.pins[i], p.cc[channel]);
+        check(p.inverted[channel] == false, "%s: pin %u next to pin %u got inverted", layout.name, other[i], layout.pins[i]);
+    }
+
+    // Off leaves them alone too
+    motor.set_enabled(false);
+    motor.set_levels(levels[0], levels[1], levels[2]);
+    HAL::sleep_us(100);
+    uint16_t off[6] = {0, 0, 0, 0, 0, 0};
+    check(latched(layout, off) == 6, "%s: disabled levels are not 0", layout.name);
+    for(int i = 0; i < 6; i++) {
+        const HAL::sim::pwm_slice_state& p = HAL::sim::pwm_slice(HAL::pwm_gpio_to_slice_num(other[i]));
+        check(p.cc[HAL::pwm_gpio_to_channel(other[i])] == OTHER_LEVEL, "%s: pin %u changed when disabled", layout.name, other[i]);
+    }
+    printf("%-16s  neighbouring channels untouched\n", layout.name);
+}
+
+const size_t LENGTH_A = 50;
+const size_t LENGTH_B = 30;
+uint32_t words_a[3][LENGTH_A];
+uint32_t words_b[3][LENGTH_B];
+tmc6300_waveform_t wave_a = {{words_a[0], words_a[1], words_a[2]}, LENGTH_A};
+tmc6300_waveform_t wave_b = {{words_b[0], words_b[1], words_b[2]}, LENGTH_B};
+
+// Lives as long as the simulated DMA that points back at it
+TMC6300 player(UH, VH, WH, UL, VL, WL, SUPPLY_VOLTAGE);
+
+/**
+ * @brief Both compare levels of the slice of a phase, as the player writes them
+ * @param buffered The levels written since the last wrap instead of the ones in use
+*/
+uint32_t slice_word(uint phase, bool buffered) {
+    const HAL::sim::pwm_slice_state& p = HAL::sim::pwm_slice(HAL::pwm_gpio_to_slice_num(phase == 0 ? UH : (phase == 1 ? VH : WH)));
+    const uint16_t* cc = buffered ? p.cc_buffer : p.cc;
+    return ((uint32_t)cc[1] << 16) | cc[0];
+}
+
+/**
+ * @brief Step 1 us at a time until the phase correct counter has turned at zero, where the levels latch
+*/
+void wait_for_wrap(void) {
+    const uint slice = HAL::pwm_gpio_to_slice_num(UH);
+    uint16_t last = HAL::pwm_get_counter(slice);
+    bool falling = false;
+    while(true) {
+        HAL::sleep_us(1);
+        uint16_t counter = HAL::pwm_get_counter(slice);
+        if(falling && counter > last) return;
+        falling = counter < last;
+        last = counter;
+    }
+}
+
+bool same_step(const tmc6300_waveform_t& wave, size_t index, const uint32_t words[3]) {
+    for(int phase = 0; phase < 3; phase++) {
+        if(wave.words[phase][index] != words[phase]) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Queue two waveforms and follow the latched levels one PWM period at a time
+*/
+void check_player(void) {
+    player.init(FREQUENCY, DEAD_ZONE);
+    check(player.init_player(), "init_player failed on the board layout");
+    check(!player.play(&wave_a), "play went through with the motor disabled");
+    player.set_enabled(true);
+    tmc6300_waveform_t empty = {{words_a[0], words_a[1], words_a[2]}, 0};
+    check(!player.play(&empty), "play took an empty waveform");
+
+    // Every step differs from the one before, and the two waveforms never share a step
+    for(size_t i = 0; i < LENGTH_A; i++) {
+        player.set_waveform_levels(&wave_a, i, (uint16_t)(100 + 20 * i), (uint16_t)(1100 + 20 * i), (uint16_t)(2100 - 20 * i));
+    }
+    for(size_t i = 0; i < LENGTH_B; i++) {
+        player.set_waveform_levels(&wave_b, i, (uint16_t)(1500 - 25 * i), (uint16_t)(50 + 25 * i), (uint16_t)(777 + 25 * i));
+    }
+    uint16_t level_a[3] = {100, 1100, 2100};
+    uint16_t want[6];
+    expected_levels(&player, level_a, want);
+    check(words_a[0][0] == ((uint32_t)want[3] << 16 | want[0]), "set_waveform_levels gave 0x%08X for U, expected 0x%08X",
+        words_a[0][0], (uint32_t)want[3] << 16 | want[0]);
+
+    wait_for_wrap();
+    check(player.play(&wave_a) && player.is_playing(), "play of the first waveform failed");
+    check(player.play(&wave_b), "queueing the second waveform failed");
+    check(!player.play(&wave_a), "a third waveform got queued");
+
+    // One sample per period, from the wrap the first step latches at until well after the end
+    const size_t PERIODS = LENGTH_A + LENGTH_B + 10;
+    uint32_t latched_words[PERIODS][3];
+    uint32_t ignored = 0;
+    size_t ended = 0;
+    for(size_t period = 0; period < PERIODS; period++) {
+        wait_for_wrap();
+        for(int phase = 0; phase < 3; phase++) latched_words[period][phase] = slice_word(phase, false);
+        if(ended == 0 && !player.is_playing()) ended = period;
+
+        // set_levels in the middle of each waveform must leave the compare registers to the player
+        if(period == LENGTH_A / 2 || period == LENGTH_A + LENGTH_B / 2) {
+            uint32_t before[3] = {slice_word(0, true), slice_word(1, true), slice_word(2, true)};
+            uint64_t start = HAL::time_us();
+            player.set_levels(5, 5, 5);
+            bool untouched = HAL::time_us() == start;
+            for(int phase = 0; phase < 3; phase++) untouched = untouched && slice_word(phase, true) == before[phase];
+            check(untouched, "set_levels touched the compare registers in period %zu of the waveforms", period);
+            if(untouched) ignored++;
+        }
+    }
+
+    uint32_t mismatches = 0;
+    for(size_t period = 0; period < PERIODS; period++) {
+        bool ok;
+        if(period < LENGTH_A) {
+            ok = same_step(wave_a, period, latched_words[period]);
+        } else if(period < LENGTH_A + LENGTH_B) {
+            ok = same_step(wave_b, period - LENGTH_A, latched_words[period]);
+        } else {
+            ok = same_step(wave_b, LENGTH_B - 1, latched_words[period]); // The last step holds
+        }
+        if(!ok) {
+            if(mismatches < 5) {
+                printf("FAIL: period %zu latched %08X %08X %08X\n", period, latched_words[period][0], latched_words[period][1], latched_words[period][2]);
+            }
+            mismatches++;
+        }
+    }
+    if(mismatches > 0) failures++;
+    // The DMA is done once the last step is in the buffer, a period before it latches
+    check(ended == LENGTH_A + LENGTH_B - 2, "playing ended in period %zu, expected %zu", ended, LENGTH_A + LENGTH_B - 2);
+
+    // set_levels is back once the player is done
+    uint16_t levels[3] = {400, 800, 1200};
+    expected_levels(&player, levels, want);
+    player.set_levels(levels[0], levels[1], levels[2]);
+    check(slice_word(0, true) == ((uint32_t)want[3] << 16 | want[0]), "set_levels ignored after the waveforms ended");
+
+    // stop drops the queued waveform, the coils stay on a step of the one that was playing
+    check(player.play(&wave_a) && player.play(&wave_b), "play after the end failed");
+    for(int period = 0; period < 5; period++) wait_for_wrap();
+    player.stop();
+    check(!player.is_playing(), "still playing after stop");
+    wait_for_wrap(); // A step the DMA had already written still latches
+    wait_for_wrap();
+    uint32_t held[3] = {slice_word(0, false), slice_word(1, false), slice_word(2, false)};
+    bool from_a = false;
+    for(size_t i = 0; i < LENGTH_A; i++) from_a = from_a || same_step(wave_a, i, held);
+    check(from_a, "the coils are not on a step of the first waveform after stop");
+    for(int period = 0; period < 10; period++) wait_for_wrap();
+    bool still = true;
+    for(int phase = 0; phase < 3; phase++) still = still && slice_word(phase, false) == held[phase];
+    check(still, "the levels moved on after stop");
+
+    // set_enabled(false) stops too
+    check(player.play(&wave_a), "play after stop failed");
+    player.set_enabled(false);
+    check(!player.is_playing() && !player.play(&wave_b), "set_enabled(false) left the player running");
+
+    printf("%-16s  %zu periods, %u differ from the waveforms, set_levels ignored %u times\n", "player", PERIODS, mismatches, ignored);
+}
+
+int main() {
+    HAL::init();
+
+    // The board, the high and low side of a phase share a slice
+    const layout_t board = {"board", {UH, VH, WH, UL, VL, WL}};
+    // Every pin on a slice of its own, the low sides on channel B. Slice 0 is shared with U of the board.
+    const layout_t single = {"single channel", {0, 2, 4, 7, 9, 11}};
+
+    check_phase_consistency(board);
+    check_phase_consistency(single);
+    check_single_channel(single);
+    check_player();
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
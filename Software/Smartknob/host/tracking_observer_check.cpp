@@ -0,0 +1,183 @@
+/*
+ *  Title: Tracking Observer Check
+
+ *  Description: Feeds TrackingObserver and FixedTrackingObserver the 14 bit counts the MT6701
+ *      would give for synthetic knob trajectories, at the bandwidth and rate of main.cpp.
+ *      Ramps and constant acceleration have to be followed without lag once settled, a step
+ *      has to settle in bounded time with bounded overshoot, and the velocity noise from the
+ *      count quantization and sensor noise has to stay bounded. Exits with 1 if anything is off.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <TrackingObserver.h>
+#include <FixedTrackingObserver.h>
+#include <EncoderAngle.h>
+
+const float BANDWIDTH = 150.0f;     // rad/s, same as main.cpp
+const float DT = 1e-3f;             // s
+const uint32_t TICKS = 3000;
+const uint32_t SETTLE_TICKS = 200;  // Checked from here on, 30 time constants
+
+const double _2pi = 6.28318530717958647692;
+const double COUNT = _2pi / EncoderAngle::COUNTS_PER_TURN; // rad
+
+// Worst error allowed once settled, per trajectory
+struct limits_t {
+    double angle;           // rad
+    double velocity_rms;    // rad/s
+    double velocity_max;    // rad/s
+};
+
+// Knob angle as a function of time
+struct trajectory_t {
+    const char* name;
+    double start;           // rad
+    double velocity;        // rad/s
+    double acceleration;    // rad/s^2
+    double noise;           // Standard deviation of the sensor noise in counts
+    limits_t limits;
+};
+
+const trajectory_t trajectories[] = {
+    {"standstill", 1.0, 0.0, 0.0, 0.0, {1.5 * COUNT, 0.02, 0.05}},
+    {"standstill, noisy", 1.0, 0.0, 0.0, 1.0, {4.0 * COUNT, 0.06, 0.2}},
+    {"ramp 2 rad/s", 0.5, 2.0, 0.0, 0.0, {1.5 * COUNT, 0.02, 0.05}},
+    {"ramp -25 rad/s", 3.0, -25.0, 0.0, 0.0, {1.5 * COUNT, 0.02, 0.05}},
+    {"ramp 60 rad/s, noisy", 6.0, 60.0, 0.0, 1.0, {4.0 * COUNT, 0.06, 0.2}},
+    {"accelerating 40 rad/s^2", 0.0, -10.0, 40.0, 0.0, {1.5 * COUNT, 0.02, 0.05}},
+};
+
+// Step of the knob angle at SETTLE_TICKS. The zeros of the loop make a position step overshoot
+// by about 16% even with the poles all real
+const double STEP = 0.5;                // rad
+const double STEP_OVERSHOOT = 0.2;      // Fraction of the step
+const uint32_t STEP_SETTLE_MS = 80;     // To within 2 counts
+
+uint32_t failures = 0;
+
+double next_noise(uint32_t* seed) {
+    // Sum of four uniforms, close enough to a normal with unit standard deviation
+    double sum = 0.0;
+    for(int i = 0; i < 4; i++) {
+        *seed = *seed * 1664525u + 1013904223u;
+        sum += (double)(*seed >> 8) / (double)(1 << 24) - 0.5;
+    }
+    return sum * sqrt(3.0);
+}
+
+/**
+ * @brief 14 bit encoder count for an angle, like the MT6701 gives
+*/
+uint16_t to_count(double angle, double noise_counts) {
+    double counts = floor(angle / COUNT + noise_counts);
+    return (uint16_t)((int64_t)counts & (EncoderAngle::COUNTS_PER_TURN - 1));
+}
+
+/**
+ * @brief Errors of one observer after settling
+*/
+struct errors_t {
+    double angle_max;
+    double velocity_sum_squares;
+    double velocity_max;
+    uint32_t samples;
+
+    void add(double angle_error, double velocity_error) {
+        if(fabs(angle_error) > angle_max) angle_max = fabs(angle_error);
+        if(fabs(velocity_error) > velocity_max) velocity_max = fabs(velocity_error);
+        velocity_sum_squares += velocity_error * velocity_error;
+        samples++;
+    }
+    double velocity_rms(void) const { return sqrt(velocity_sum_squares / samples); }
+};
+
+bool report(const char* observer, const char* trajectory, const errors_t& e, const limits_t& limits) {
+    bool ok = e.angle_max <= limits.angle && e.velocity_rms() <= limits.velocity_rms && e.velocity_max <= limits.velocity_max;
+    printf("%-6s %-24s  angle %5.2f counts  velocity rms %.4f  max %.4f rad/s%s\n", observer, trajectory, e.angle_max / COUNT,
+        e.velocity_rms(), e.velocity_max, ok ? "" : "  FAIL");
+    if(!ok) failures++;
+    return ok;
+}
+
+/**
+ * @brief Run both observers along a trajectory. Their unwrapped angle is compared to the true one
+ *      through the turns they counted, so a missed wrap shows as a whole turn of error.
+*/
+void check_trajectory(const trajectory_t& t) {
+    TrackingObserver observer(BANDWIDTH, DT);
+    FixedTrackingObserver fixed(BANDWIDTH, DT);
+    EncoderAngle encoder;
+    uint32_t seed = 7;
+
+    uint16_t count = to_count(t.start, 0.0);
+    encoder.reset(count);
+    observer.reset(encoder.get_radians());
+    fixed.reset(encoder.get_angle_q16());
+    // Both start on turn zero at the first count
+    double origin = floor(t.start / _2pi) * _2pi;
+
+    errors_t errors = {};
+    errors_t fixed_errors = {};
+    for(uint32_t tick = 1; tick <= TICKS; tick++) {
+        double time = tick * (double)DT;
+        double angle = t.start + t.velocity * time + 0.5 * t.acceleration * time * time;
+        double velocity = t.velocity + t.acceleration * time;
+        count = to_count(angle, t.noise * next_noise(&seed));
+        encoder.update(count);
+        observer.update(encoder.get_radians());
+        fixed.update(encoder.get_angle_q16());
+        if(tick < SETTLE_TICKS) continue;
+
+        errors.add(observer.get_angle() - (angle - origin), observer.get_velocity() - velocity);
+        double fixed_angle = fixed.get_angle() * (_2pi / 65536.0);
+        double fixed_velocity = fixed.get_velocity() * (_2pi / 65536.0);
+        fixed_errors.add(fixed_angle - (angle - origin), fixed_velocity - velocity);
+    }
+    report("float", t.name, errors, t.limits);
+    report("fixed", t.name, fixed_errors, t.limits);
+}
+
+/**
+ * @brief Step the angle from standstill, then measure overshoot and the time to settle
+*/
+void check_step(bool use_fixed) {
+    TrackingObserver observer(BANDWIDTH, DT);
+    FixedTrackingObserver fixed(BANDWIDTH, DT);
+    const double start = 2.0;
+    uint16_t count = to_count(start, 0.0);
+    observer.reset(count * COUNT);
+    fixed.reset((uint16_t)(count << 2));
+
+    double overshoot = 0.0;
+    uint32_t settled = 0;   // Last tick outside two counts
+    double target = 0.0;
+    for(uint32_t tick = 1; tick <= TICKS; tick++) {
+        double angle = start + (tick >= SETTLE_TICKS ? STEP : 0.0);
+        count = to_count(angle, 0.0);
+        observer.update(count * COUNT);
+        fixed.update((uint16_t)(count << 2));
+        if(tick < SETTLE_TICKS) continue;
+
+        target = count * COUNT;
+        double estimate = use_fixed ? fixed.get_angle() * (_2pi / 65536.0) : observer.get_angle();
+        double error = estimate - target;
+        if(error > overshoot) overshoot = error;
+        if(fabs(error) > 2.0 * COUNT) settled = tick - SETTLE_TICKS + 1;
+    }
+    bool ok = overshoot <= STEP_OVERSHOOT * STEP && settled <= STEP_SETTLE_MS;
+    printf("%-6s %-24s  overshoot %.1f%%  settled in %u ms%s\n", use_fixed ? "fixed" : "float", "step 0.5 rad",
+        100.0 * overshoot / STEP, settled, ok ? "" : "  FAIL");
+    if(!ok) failures++;
+}
+
+int main() {
+    for(const trajectory_t& t : trajectories) check_trajectory(t);
+    check_step(false);
+    check_step(true);
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/*
+ *  Title: Biquad Library
+
+ *  Description: Cascade of SECTIONS second order IIR sections in direct form II transposed, on
+ *      float, Q15 or Q31 samples, running sections designed at compile time with
+ *      BiquadDesign.h. A section costs 5 multiplies a sample, so a 4th order Butterworth low
+ *      pass is 10 multiplies where a FIR as steep needs around a hundred taps. Blocks are
+ *      run one section at a time, so each section keeps its coefficients and state in
+ *      registers for the whole block.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <Fixed.h>
+#include "BiquadDesign.h"
+
+/**
+ * @brief Arithmetic of a biquad sample type. Fixed point coefficients are Q30, products and state
+ *      are kept in 64 bits at Q30 so nothing is lost between sections, and each output is
+ *      rounded and saturated to the sample type.
+*/
+template <typename T> struct Biquad_arithmetic;
+
+template <> struct Biquad_arithmetic<float> {
+    typedef float state_t;
+    static float multiply(float coeff, float x) { return coeff * x; };
+    static float output(float acc) { return acc; };
+};
+
+template <> struct Biquad_arithmetic<q15_t> {
+    typedef int64_t state_t;    // Q45, a 32 by 32 bit multiply is a library call on the Cortex-M0+ either way
+    static int64_t multiply(int32_t coeff, q15_t x) { return (int64_t)coeff * x; };
+    static q15_t output(int64_t acc) {
+        acc = (acc + (1 << (Biquad_design::COEFF_BITS - 1))) >> Biquad_design::COEFF_BITS;
+        if(acc > Fixed::Q15_MAX) return Fixed::Q15_MAX;
+        if(acc < Fixed::Q15_MIN) return Fixed::Q15_MIN;
+        return (q15_t)acc;
+    };
+};
+
+// Q31 samples need 2 bits of headroom so the state of a section near its peak gain fits in 64 bits
+template <> struct Biquad_arithmetic<q31_t> {
+    typedef int64_t state_t;    // Q61
+    static int64_t multiply(int32_t coeff, q31_t x) { return (int64_t)coeff * x; };
+    static q31_t output(int64_t acc) {
+        acc = (acc + (1 << (Biquad_design::COEFF_BITS - 1))) >> Biquad_design::COEFF_BITS;
+        if(acc > INT32_MAX) return INT32_MAX;
+        if(acc < INT32_MIN) return INT32_MIN;
+        return (q31_t)acc;
+    };
+};
+
+/**
+ * @brief Biquad class
+ * @param SECTIONS Number of second order sections, the filter order is twice this
+ * @param T Sample type, float, q15_t or q31_t
+*/
+template <uint SECTIONS, typename T = float> class Biquad {
+    static_assert(SECTIONS >= 1, "SECTIONS is 0");
+    typedef Biquad_arithmetic<T> arithmetic;
+public:
+    typedef biquad_section_t<biquad_coeff_t<T>> section_t;
+
+    /**
+     * @brief Constructor for the Biquad class
+     * @param sections Sections from Biquad_design::generate, kept by reference so make them static constexpr
+    */
+    Biquad(const std::array<section_t, SECTIONS>& sections) : _sections(sections.data()) {
+        reset();
+    };
+
+    /**
+     * @brief Zero the state of every section
+    */
+    void reset(void) {
+        for(uint i = 0; i < SECTIONS; i++) {
+            _state[i][0] = 0;
+            _state[i][1] = 0;
+        }
+    };
+
+    /**
+     * @brief Filter one sample
+     * @return Filtered sample
+    */
+    T run(T input) {
+        T output;
+        run(&input, &output, 1);
+        return output;
+    };
+
+    /**
+     * @brief Filter a block of samples, the state carries over between blocks
+     * @param in Samples to filter
+     * @param out Where the filtered samples go, can be the same as in
+     * @param n Number of samples
+    */
+    void run(const T* in, T* out, size_t n) {
+        for(uint s = 0; s < SECTIONS; s++) {
+            const section_t& c = _sections[s];
+            state_t s1 = _state[s][0];
+            state_t s2 = _state[s][1];
+            const T* x = (s == 0) ? in : out; // Later sections work in place on the output
+            for(size_t i = 0; i < n; i++) {
+                T input = x[i];
+                T output = arithmetic::output(arithmetic::multiply(c.b0, input) + s1);
+                s1 = arithmetic::multiply(c.b1, input) - arithmetic::multiply(c.a1, output) + s2;
+                s2 = arithmetic::multiply(c.b2, input) - arithmetic::multiply(c.a2, output);
+                out[i] = output;
+            }
+            _state[s][0] = s1;
+            _state[s][1] = s2;
+        }
+    };
+
+    const section_t* get_sections(void) const { return _sections; };
+private:
+    typedef typename arithmetic::state_t state_t;
+
+    const section_t* _sections;         // Usually in flash
+    state_t _state[SECTIONS][2];        // The two delays of each section
+};
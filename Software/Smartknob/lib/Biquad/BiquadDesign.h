@@ -0,0 +1,181 @@
+/*
+ *  Title: Biquad Library
+
+ *  Description: Compile time design of biquad cascades. Butterworth low and high pass filters
+ *      of order 2 * SECTIONS, and notch filters with one notch per section on the harmonics of
+ *      the cutoff, for mains hum. Analog prototypes go through the bilinear transform with the
+ *      cutoff prewarped, so the -3 dB point (or the notch) lands exactly where asked. Uses the
+ *      constexpr trigonometry of FIRDesign.h, so
+ *          static constexpr auto sections = Biquad_design::generate<2, float>({Biquad_type::BUTTERWORTH_LPF, 50.0f, 1000.0f});
+ *      is a table in flash.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <array>
+#include <type_traits>
+#include <Fixed.h>
+#include <FIRDesign.h>
+
+/**
+ * @brief Biquad cascade type
+*/
+enum Biquad_type : uint8_t {
+    BUTTERWORTH_LPF = 0,
+    BUTTERWORTH_HPF = 1,
+    NOTCH = 2           // A notch at the cutoff and each harmonic of it, one per section
+};
+
+/**
+ * @brief Struct containing the parameters for a biquad cascade design
+ * @param type Biquad cascade type
+ * @param cutoff -3 dB frequency in Hz, or the frequency of the first notch
+ * @param sample_rate Filter sample rate in Hz
+ * @param q Notch quality, the notch frequency over its -3 dB width
+*/
+struct Biquad_params {
+    Biquad_type type = Biquad_type::BUTTERWORTH_LPF;
+    float cutoff;
+    float sample_rate;
+    float q = 10.0f;
+};
+
+/**
+ * @brief One second order section, y = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2) x
+ * @param C Coefficient type, float, or Q30 in an int32_t for fixed point samples
+*/
+template <typename C> struct biquad_section_t {
+    C b0, b1, b2;
+    C a1, a2;
+};
+
+/**
+ * @brief Coefficient type for a sample type. Fixed point coefficients are Q30 since a1 is close to
+ *      -2 for a low cutoff, and Q15 would leave too few bits to put the poles where they belong.
+*/
+template <typename T> using biquad_coeff_t = typename std::conditional<std::is_same<T, float>::value, float, int32_t>::type;
+
+namespace Biquad_design {
+    const int COEFF_BITS = 30;
+
+    /**
+     * @brief Check the cutoff is under half the sample rate, for static_assert
+    */
+    constexpr bool is_valid(const Biquad_params& params) {
+        if(params.sample_rate <= 0.0f || params.cutoff <= 0.0f || params.cutoff >= 0.5f * params.sample_rate) return false;
+        if(params.type == Biquad_type::NOTCH) return params.q > 0.0f;
+        return true;
+    }
+
+    /**
+     * @brief Design the sections in double
+     * @return The sections, all pass through if the params are not valid
+    */
+    template <uint SECTIONS> constexpr std::array<biquad_section_t<double>, SECTIONS> design(const Biquad_params& params) {
+        static_assert(SECTIONS >= 1, "SECTIONS is 0");
+        std::array<biquad_section_t<double>, SECTIONS> sections{};
+        for(uint i = 0; i < SECTIONS; i++) sections[i] = {1.0, 0.0, 0.0, 0.0, 0.0};
+        if(!is_valid(params)) return sections;
+
+        for(uint i = 0; i < SECTIONS; i++) {
+            double cutoff = (double)params.cutoff;
+            double q = (double)params.q;
+            if(params.type == Biquad_type::NOTCH) {
+                cutoff *= (double)(i + 1);
+                if(cutoff >= 0.5 * (double)params.sample_rate) continue; // Harmonics past Nyquist stay pass through
+            } else {
+                // Butterworth poles are spread evenly on the left half of the unit circle, two per section
+                double angle = FIR_design::PI * (double)(2 * i + 1) / (double)(4 * SECTIONS);
+                q = 1.0 / (2.0 * FIR_design::cosine(angle));
+            }
+
+            double warped = FIR_design::PI * cutoff / (double)params.sample_rate;
+            double k = FIR_design::sine(warped) / FIR_design::cosine(warped);
+            double k2 = k * k;
+            double norm = 1.0 / (1.0 + k / q + k2);
+            biquad_section_t<double>& section = sections[i];
+            section.a1 = 2.0 * (k2 - 1.0) * norm;
+            section.a2 = (1.0 - k / q + k2) * norm;
+            switch(params.type) {
+                case Biquad_type::BUTTERWORTH_HPF:
+                    section.b0 = norm;
+                    section.b1 = -2.0 * norm;
+                    section.b2 = norm;
+                    break;
+                case Biquad_type::NOTCH:
+                    section.b0 = (1.0 + k2) * norm;
+                    section.b1 = section.a1;
+                    section.b2 = section.b0;
+                    break;
+                default:
+                    section.b0 = k2 * norm;
+                    section.b1 = 2.0 * k2 * norm;
+                    section.b2 = k2 * norm;
+                    break;
+            }
+        }
+        return sections;
+    }
+
+    /**
+     * @brief Gain of a cascade at a frequency
+     * @param f Frequency in cycles per sample
+    */
+    template <uint SECTIONS> constexpr double gain(const std::array<biquad_section_t<double>, SECTIONS>& sections, double f) {
+        double w = 2.0 * FIR_design::PI * f;
+        double c1 = FIR_design::cosine(w), s1 = FIR_design::sine(w);
+        double c2 = FIR_design::cosine(2.0 * w), s2 = FIR_design::sine(2.0 * w);
+        double result = 1.0;
+        for(uint i = 0; i < SECTIONS; i++) {
+            const biquad_section_t<double>& section = sections[i];
+            double num_re = section.b0 + section.b1 * c1 + section.b2 * c2;
+            double num_im = section.b1 * s1 + section.b2 * s2;
+            double den_re = 1.0 + section.a1 * c1 + section.a2 * c2;
+            double den_im = section.a1 * s1 + section.a2 * s2;
+            result *= FIR_design::square_root((num_re * num_re + num_im * num_im) / (den_re * den_re + den_im * den_im));
+        }
+        return result;
+    }
+
+    /**
+     * @brief Check every section has its poles inside the unit circle, for static_assert.
+     *      Also catches fixed point coefficients rounded onto the circle.
+    */
+    template <uint SECTIONS, typename C> constexpr bool is_stable(const std::array<biquad_section_t<C>, SECTIONS>& sections) {
+        const double scale = std::is_same<C, float>::value || std::is_same<C, double>::value ? 1.0 : (double)(1 << COEFF_BITS);
+        for(uint i = 0; i < SECTIONS; i++) {
+            double a1 = (double)sections[i].a1 / scale;
+            double a2 = (double)sections[i].a2 / scale;
+            if(!(a2 < 1.0 && a2 > -1.0 + (a1 > 0.0 ? a1 : -a1))) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Design the sections and convert them to the coefficients of a sample type
+     * @param T float, q15_t or q31_t
+    */
+    template <uint SECTIONS, typename T> constexpr std::array<biquad_section_t<biquad_coeff_t<T>>, SECTIONS> generate(const Biquad_params& params) {
+        static_assert(std::is_same<T, float>::value || std::is_same<T, q15_t>::value || std::is_same<T, q31_t>::value, "T is not float, q15_t or q31_t");
+        std::array<biquad_section_t<double>, SECTIONS> sections = design<SECTIONS>(params);
+        std::array<biquad_section_t<biquad_coeff_t<T>>, SECTIONS> result{};
+        for(uint i = 0; i < SECTIONS; i++) {
+            const double values[5] = {sections[i].b0, sections[i].b1, sections[i].b2, sections[i].a1, sections[i].a2};
+            biquad_coeff_t<T> coeffs[5] = {};
+            for(uint k = 0; k < 5; k++) {
+                if constexpr(std::is_same<T, float>::value) {
+                    coeffs[k] = (float)values[k];
+                } else {
+                    double c = values[k] * (double)(1 << COEFF_BITS);
+                    c = c > (double)INT32_MAX ? (double)INT32_MAX : (c < (double)INT32_MIN ? (double)INT32_MIN : c);
+                    coeffs[k] = (int32_t)(int64_t)(c >= 0.0 ? c + 0.5 : c - 0.5);
+                }
+            }
+            result[i] = {coeffs[0], coeffs[1], coeffs[2], coeffs[3], coeffs[4]};
+        }
+        return result;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ *  Title: Cascade Library
+
+ *  Description: Cascaded position, velocity and torque loops run from one base tick
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <math.h>
+#include "Cascade.h"
+
+template <typename T> T constrain(T amt, T low, T high) {
+    if(amt < low) return low;
+    if(amt > high) return high;
+    return amt;
+}
+
+/**
+ * @brief Constructor for the CascadeController class
+ * @param base_period Time between calls to update in seconds, the torque loop rate
+ * @param velocity_divider Run the velocity loop every this many ticks, 0 for off
+ * @param position_divider Run the position loop every this many ticks, 0 for off
+ * @param motor Electrical constants of the motor
+*/
+CascadeController::CascadeController(float base_period, uint16_t velocity_divider, uint16_t position_divider, cascade_motor_t motor) {
+    _velocity_divider = velocity_divider;
+    _position_divider = position_divider;
+    _velocity_dt = base_period * velocity_divider;
+    _position_dt = base_period * position_divider;
+    _volts_per_nm = motor.direction * motor.resistance / motor.torque_constant;
+    _back_emf_constant = motor.direction * motor.back_emf_constant;
+    reset();
+}
+
+/******************************* PUBLIC METHODS *******************************/
+
+/**
+ * @brief Clear the loop states and references, the next update runs every loop
+*/
+void CascadeController::reset(void) {
+    position_pid.reset();
+    velocity_pid.reset();
+    _velocity_count = 0;
+    _position_count = 0;
+    _torque = 0.0f;
+    _voltage = 0.0f;
+}
+
+/**
+ * @brief Run one base tick. The slow loops run first when they are due, so the torque
+ *      loop always works on the newest reference.
+ * @param position Measured position in rad, unwrapped
+ * @param velocity Measured velocity in rad/s
+ * @return q axis voltage for the FOC
+*/
+float CascadeController::update(float position, float velocity) {
+    if(_position_divider != 0 && _position_count == 0) {
+        velocity_pid.setpoint = constrain(position_pid.update(position, _position_dt), -velocity_limit, velocity_limit);
+    }
+    if(_velocity_divider != 0 && _velocity_count == 0) {
+        _torque = constrain(velocity_pid.update(velocity, _velocity_dt), -torque_limit, torque_limit);
+    }
+    if(++_position_count >= _position_divider) _position_count = 0;
+    if(++_velocity_count >= _velocity_divider) _velocity_count = 0;
+
+    // Torque loop, the resistive drop for the torque plus what the back-EMF takes away
+    _voltage = constrain(_torque * _volts_per_nm + _back_emf_constant * velocity, -voltage_limit, voltage_limit);
+    return _voltage;
+}
@@ -0,0 +1,68 @@
+/*
+ *  Title: Cascade Library
+
+ *  Description: Cascaded position, velocity and torque loops run from one base tick.
+ *      The torque loop runs every tick and only turns the torque reference into a q axis
+ *      voltage, with the back-EMF of the measured velocity added on, so it stays a few
+ *      multiplies. The velocity and position loops run every velocity_divider and
+ *      position_divider ticks and do the PID work. A divider of 0 turns a loop off so
+ *      the reference below it can be set directly, for a detent loop that wants torque.
+ *      Without current sensing the torque loop is open loop on the motor resistance,
+ *      a current loop can take its place once the board measures current.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <StaticPID.h>
+
+// Electrical constants of the motor for the torque loop, all in mechanical units
+struct cascade_motor_t {
+    float resistance;           // Phase resistance in ohm
+    float torque_constant;      // Nm/A
+    float back_emf_constant;    // V*s/rad of mechanical velocity, torque constant times pole pairs
+    int8_t direction;           // Sign of the torque a positive q axis voltage gives, FOC::get_direction()
+};
+
+class CascadeController {
+public:
+    // The loops never change mode, so they are fixed at compile time
+    typedef SMARTKNOB::StaticPID<SMARTKNOB::PIDPolicy::LinearError, SMARTKNOB::PIDPolicy::DerivativeOnError,
+        SMARTKNOB::PIDPolicy::ProportionalOnError, SMARTKNOB::PIDPolicy::NoAntiwindup> position_pid_t;
+    typedef SMARTKNOB::StaticPID<SMARTKNOB::PIDPolicy::LinearError, SMARTKNOB::PIDPolicy::DerivativeOnError,
+        SMARTKNOB::PIDPolicy::ProportionalOnError, SMARTKNOB::PIDPolicy::ClampAntiwindup> velocity_pid_t;
+
+    CascadeController(float base_period, uint16_t velocity_divider, uint16_t position_divider, cascade_motor_t motor);
+    void reset(void);
+
+    float update(float position, float velocity);
+
+    void set_position(float position) { position_pid.setpoint = position; };
+    void set_velocity(float velocity) { velocity_pid.setpoint = velocity; };
+    void set_torque(float torque) { _torque = torque; };
+
+    float get_velocity_reference(void) const { return velocity_pid.setpoint; };
+    float get_torque_reference(void) const { return _torque; };
+    float get_voltage(void) const { return _voltage; };
+
+    position_pid_t position_pid;    // Position in rad to velocity in rad/s
+    velocity_pid_t velocity_pid;    // Velocity in rad/s to torque in Nm, antiwindup clamps the integrator
+
+    float velocity_limit = 10.0f;   // rad/s
+    float torque_limit = 0.02f;     // Nm
+    float voltage_limit = 2.5f;     // V on the q axis
+private:
+    uint16_t _velocity_divider;
+    uint16_t _position_divider;
+    uint16_t _velocity_count = 0;
+    uint16_t _position_count = 0;
+    float _velocity_dt;
+    float _position_dt;
+
+    float _volts_per_nm;            // Resistance over torque constant, signed with the direction
+    float _back_emf_constant;       // Signed with the direction
+
+    float _torque = 0.0f;
+    float _voltage = 0.0f;
+};
@@ -0,0 +1,117 @@
+/*
+ *  Title: Decimator Library
+
+ *  Description: Two stage decimator for blocks of ADC samples. A CIC filter of ORDER stages takes
+ *      the rate down by CIC_RATIO with only adds and subtracts, then a low pass FIR of TAPS
+ *      Q15 taps from FIR_design::generate takes it down by FIR_RATIO more. The FIR is run in
+ *      polyphase form with its symmetric taps folded like FIR, only the outputs that are kept
+ *      are calculated, so an input costs ORDER adds plus (TAPS + 1) / 2 / RATIO multiplies
+ *      instead of TAPS. Outputs are in the same
+ *      ADC codes as the inputs, and only start once both stages are full of input so
+ *      they never ramp up from 0.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <type_traits>
+#include "FIR.h"
+
+/**
+ * @brief Decimator class
+ * @param ORDER Number of CIC integrator and comb stages
+ * @param CIC_RATIO Decimation of the CIC stage, a power of two so its gain is a shift
+ * @param TAPS Number of taps of the FIR stage - must be an odd number
+ * @param FIR_RATIO Decimation of the FIR stage
+*/
+template <uint ORDER, uint CIC_RATIO, uint TAPS, uint FIR_RATIO> class Decimator {
+    static_assert(ORDER >= 1, "ORDER is 0");
+    static_assert(CIC_RATIO >= 1 && (CIC_RATIO & (CIC_RATIO - 1)) == 0, "CIC_RATIO is not a power of two");
+    static_assert((TAPS % 2) != 0, "TAPS is not an odd number");
+    static_assert(FIR_RATIO >= 1, "FIR_RATIO is 0");
+public:
+    static const uint RATIO = CIC_RATIO * FIR_RATIO;
+    static const int INPUT_BITS = 25; // 24 bit codes with the extra sign bit of an over range
+
+    /**
+     * @brief Constructor for the Decimator class
+     * @param taps FIR stage taps, designed for the input rate over CIC_RATIO with a cutoff under
+     *      half the output rate and kept by reference so make them static constexpr
+    */
+    Decimator(const std::array<q15_t, TAPS>& taps) : _taps(taps.data()) {
+        reset();
+    };
+
+    /**
+     * @brief Clear the filter state, outputs start again once the filter is full
+    */
+    void reset(void) {
+        for(uint i = 0; i < ORDER; i++) {
+            _integrators[i] = 0;
+            _combs[i] = 0;
+        }
+        _delay.reset();
+        _cic_phase = 0;
+        _fir_phase = 0;
+        _settling = ORDER + TAPS;
+    };
+
+    /**
+     * @brief Decimate a block of samples, the state carries over so blocks can be any length
+     * @param input ADC codes, within INPUT_BITS
+     * @param count Number of samples in input
+     * @param output Where the decimated samples go, needs room for count / RATIO + 1
+     * @return Number of samples written to output
+    */
+    uint32_t process(const int32_t* input, uint32_t count, int32_t* output) {
+        uint32_t written = 0;
+        for(uint32_t i = 0; i < count; i++) {
+            // Integrators at the input rate, wrapping is fine since the combs take it out again
+            _integrators[0] += (acc_t)(signed_acc_t)input[i];
+            for(uint k = 1; k < ORDER; k++) _integrators[k] += _integrators[k - 1];
+            if(++_cic_phase < CIC_RATIO) continue;
+            _cic_phase = 0;
+
+            // Combs at the CIC output rate
+            acc_t y = _integrators[ORDER - 1];
+            for(uint k = 0; k < ORDER; k++) {
+                acc_t difference = y - _combs[k];
+                _combs[k] = y;
+                y = difference;
+            }
+            int32_t sample = (int32_t)((signed_acc_t)(y + CIC_ROUNDING) >> CIC_GAIN_BITS);
+
+            const int32_t* window = _delay.push(sample);
+            if(++_fir_phase < FIR_RATIO) continue;
+            _fir_phase = 0;
+            if(_settling > 0) {
+                _settling = _settling > FIR_RATIO ? _settling - FIR_RATIO : 0;
+                continue;
+            }
+
+            // Two CIC outputs add up to 26 bits, times a Q15 tap needs 64
+            int64_t sum = FIR_fold<TAPS, int64_t, int64_t>(_taps, window);
+            output[written++] = (int32_t)((sum + (1 << 14)) >> 15);
+        }
+        return written;
+    };
+
+    const q15_t* get_taps(void) const { return _taps; };
+private:
+    static constexpr int log2(uint value) { return value <= 1 ? 0 : 1 + log2(value >> 1); };
+    static const int CIC_GAIN_BITS = ORDER * log2(CIC_RATIO); // The CIC gain is CIC_RATIO^ORDER
+    static const int CIC_ROUNDING = CIC_GAIN_BITS > 0 ? 1 << (CIC_GAIN_BITS - 1) : 0;
+    // 32 bits are cheaper on the RP2040 and enough as long as the CIC output fits
+    typedef typename std::conditional<INPUT_BITS + CIC_GAIN_BITS <= 32, uint32_t, uint64_t>::type acc_t;
+    typedef typename std::make_signed<acc_t>::type signed_acc_t;
+
+    acc_t _integrators[ORDER];
+    acc_t _combs[ORDER];            // Last input of each comb
+    uint _cic_phase = 0;
+    const q15_t* _taps;             // Usually in flash
+    FIR_delay<TAPS, int32_t> _delay;
+    uint _fir_phase = 0;
+    uint _settling = 0;             // CIC outputs left before the output is valid
+};
@@ -1,114 +1,225 @@
 /*
  *  Title: FIR Library
 
- *  Description: FIR LPF or HPF filter of type 1 with Hamming window of variable length
+ *  Description: Type 1 FIR filter of variable length on float, Q15 or Q31 samples, running
+ *      taps designed at compile time with FIRDesign.h. The filter only holds a pointer to
+ *      the taps and its delay line. The delay line holds every sample twice so the last N
+ *      are always in one piece, and the symmetric taps are folded so a sample costs
+ *      (N + 1) / 2 multiplies. Float filters use SSE or NEON on the host.
  * 
  *  Author: Mani Magnusson
  */
 
 #pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <array>
+#include <type_traits>
+#include <Fixed.h>
+#include "FIRDesign.h"
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /**
- * @brief FIR filter type
+ * @brief Arithmetic of a FIR sample type. Fixed point taps are in the format of the samples, the
+ *      sum of two samples and the products are kept wide enough not to overflow, and the
+ *      output is rounded and saturated.
 */
-enum FIR_type : uint8_t {
-    LPF = 0,
-    HPF = 1
+template <typename T> struct FIR_arithmetic;
+
+template <> struct FIR_arithmetic<float> {
+    typedef float product_t;
+    typedef float acc_t;
+    static float to_float(float x) { return x; };
+    static float output(float acc) { return acc; };
+};
+
+template <> struct FIR_arithmetic<q15_t> {
+    typedef int32_t product_t;  // Sum of two samples times a tap fits unless the tap is -1
+    typedef int64_t acc_t;      // Q30, adding to it is two instructions on the Cortex-M0+
+    static float to_float(q15_t x) { return Fixed::q15_to_float(x); };
+    static q15_t output(int64_t acc) {
+        acc = (acc + (1 << 14)) >> 15;
+        if(acc > Fixed::Q15_MAX) return Fixed::Q15_MAX;
+        if(acc < Fixed::Q15_MIN) return Fixed::Q15_MIN;
+        return (q15_t)acc;
+    };
+};
+
+// Q31 inputs need log2(N) bits of headroom, as with any Q31 FIR accumulating in 64 bits
+template <> struct FIR_arithmetic<q31_t> {
+    typedef int64_t product_t;
+    typedef int64_t acc_t;      // Q62
+    static float to_float(q31_t x) { return Fixed::q31_to_float(x); };
+    static q31_t output(int64_t acc) {
+        acc = (acc + (1ll << 30)) >> 31;
+        if(acc > INT32_MAX) return INT32_MAX;
+        if(acc < INT32_MIN) return INT32_MIN;
+        return (q31_t)acc;
+    };
 };
 
 /**
- * @brief Struct containing the parameters for a FIR filter instance
- * @param type FIR filter type LPF or HPF (see FIR::Type)
- * @param length Length of the filter
- * @param cutoff Filter cutoff frequency in Hz
- * @param sample_rate Filter sample rate in Hz
+ * @brief Delay line of the last N samples that keeps every sample twice, at index and index + N,
+ *      so the last N are always in one piece and filtering never has to wrap around
 */
-struct FIR_params {
-    FIR_type type = FIR_type::LPF;
-    float cutoff;
-    float sample_rate;
+template <uint N, typename T> struct FIR_delay {
+    std::array<T, 2 * N> buffer;
+    uint index = 0;                     // Where the next sample goes, the oldest sample is here after it
+
+    void reset(void) {
+        for(uint i = 0; i < 2 * N; i++) {
+            buffer[i] = 0;
+        }
+        index = 0;
+    };
+
+    /**
+     * @brief Add a sample
+     * @return The last N samples, oldest first
+    */
+    const T* push(T sample) {
+        buffer[index] = sample;
+        buffer[index + N] = sample;
+        if(++index == N) index = 0;
+        return &buffer[index];
+    };
+
+    const T* window(void) const { return &buffer[index]; };
 };
 
+/**
+ * @brief Sum of N symmetric taps times the last N samples, adding the samples that share a tap
+ *      first so it takes (N + 1) / 2 multiplies
+ * @param product_t Type the two samples are added in and multiplied by the tap in
+ * @param acc_t Type the products are summed in
+ * @param window The last N samples, oldest first. The taps are symmetric so they need no reversing
+*/
+template <uint N, typename product_t, typename acc_t, typename Tap, typename Sample>
+inline acc_t FIR_fold(const Tap* taps, const Sample* window) {
+    const uint middle = (N - 1) / 2;
+    acc_t acc = (acc_t)((product_t)taps[middle] * (product_t)window[middle]);
+    for(uint k = 0; k < middle; k++) {
+        acc += (acc_t)(((product_t)window[k] + (product_t)window[N - 1 - k]) * (product_t)taps[k]);
+    }
+    return acc;
+}
+
 /**
  * @brief FIR class
  * @param N Number of taps of the FIR filter - must be an odd number
+ * @param T Sample type, float, q15_t or q31_t
 */
-template <uint N> class FIR {
+template <uint N, typename T = float> class FIR {
     static_assert((N % 2) != 0, "N is not an odd number");
+    typedef FIR_arithmetic<T> arithmetic;
 public:
-    FIR() {};
-    
     /**
-     * @brief Initialize the FIR library. Calculates coefficients and zero-initializes the buffer.
-     * @param params Pointer to params struct containing FIR filter parameters
+     * @brief Constructor for the FIR class
+     * @param coeffs Taps from FIR_design::generate, kept by reference so make them static constexpr
     */
-    void init(FIR_params* params) {
-        _params = *params;
-        calculate_coeffs(params);
-        for(uint i = 0; i < N; i++) {
-            _buffer[i] = 0.0f;
-        }
+    FIR(const std::array<T, N>& coeffs) : _coeffs(coeffs.data()) {
+        reset();
     };
 
-    float run(float input) {
-        float output = 0.0f;
-        _buffer[index] = input;
-        index = index++;
-        if(index == N) index = 0;
-        uint sum_index = index;
-        for(uint i = 0; i < N; i++) {
-            if(sum_index > 0) {
-                sum_index--;
-            } else {
-                sum_index = N-1;
-            }
-            output += _coeffs[i] * _buffer[sum_index];
-        }
+    /**
+     * @brief Zero the delay line
+    */
+    void reset(void) {
+        _delay.reset();
+    };
+
+    /**
+     * @brief Filter one sample
+     * @return Filtered sample
+    */
+    T run(T input) {
+        T output;
+        run(&input, &output, 1);
         return output;
     };
 
+    /**
+     * @brief Filter a block of samples, the state carries over between blocks
+     * @param in Samples to filter
+     * @param out Where the filtered samples go, can be the same as in
+     * @param n Number of samples
+    */
+    void run(const T* in, T* out, size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            out[i] = folded(_delay.push(in[i]));
+        }
+    };
+
+    const T* get_coeffs(void) const { return _coeffs; };
+
     void dump_coeffs(void) {
         printf("N: %d\n\n", N);
         for(uint i = 0; i < N; i++) {
-            printf("%f ", _coeffs[i]);
+            printf("%f ", arithmetic::to_float(_coeffs[i]));
         }
         printf("\n");
     };
     void dump_buffer(void) {
         for(uint i = 0; i < N; i++) {
-            printf("%f ", _buffer[i]);
+            printf("%f ", arithmetic::to_float(_delay.window()[i]));
         }
         printf("\n");
     };
 private:
-    const float _pi = 3.14159265358979323846f;
-    FIR_params _params;
-    uint index = N-1;
-    std::array<float, N> _coeffs;
-    std::array<float, N> _buffer;
+    typedef typename arithmetic::product_t product_t;
+    typedef typename arithmetic::acc_t acc_t;
+    static const uint MIDDLE = (N - 1) / 2;
+
+    const T* _coeffs;                   // Usually in flash
+    FIR_delay<N, T> _delay;
+
+    /**
+     * @brief Sum of the taps times the last N samples, see FIR_fold
+    */
+    T folded(const T* window) const {
+#if defined(__SSE__) || defined(__ARM_NEON)
+        // Short filters are faster scalar, the compiler unrolls them
+        if constexpr(std::is_same<T, float>::value && MIDDLE >= 8) return folded_simd(window);
+#endif
+        return arithmetic::output(FIR_fold<N, product_t, acc_t>(_coeffs, window));
+    };
 
+#if defined(__SSE__) || defined(__ARM_NEON)
     /**
-     * @brief Calculate coefficients of a FIR filter. Uses a Hamming window and type 1 FIR filter (symmetric sequence of odd length)
-     * @param params Pointer to params struct containing FIR filter parameters
-     * @return std::array of type float containing the coefficients
+     * @brief folded for float on the host, four taps at a time
     */
-    void calculate_coeffs(FIR_params* params) {
-        float discrete_frequency = params->cutoff * 2.0f * _pi / params->sample_rate; // rad/s
-        if(params->type == FIR_type::HPF) discrete_frequency = _pi - discrete_frequency;
-        uint length = N;
-        std::array<float, N> coeffs;
-        for(int n = (int)(-((length-1)/2)); n <= (int)((length-1)/2); n++) {
-            if(n == 0) {
-                coeffs[(int)(n + (length-1)/2)] = 1.0f;
-            } else if(params->type == FIR_type::HPF) {
-                coeffs[(int)(n + (length-1)/2)] = pow(-1.0f, (float)(n))*(sin(discrete_frequency * (float)(n)) / _pi * (float)(n)) * (0.54f * 0.46f * cos(2.0f * _pi * n / (float)(length)));
-            } else {
-                coeffs[(int)(n + (length-1)/2)] = (sin(discrete_frequency * (float)(n)) / _pi * (float)(n)) * (0.54f + 0.46f * cos(2.0f * _pi * n / (float)(length)));
-            }
+    float folded_simd(const float* window) const {
+        uint k = 0;
+        float acc;
+#if defined(__SSE__)
+        __m128 acc4 = _mm_setzero_ps();
+        for(; k + 4 <= MIDDLE; k += 4) {
+            __m128 older = _mm_loadu_ps(&window[k]);
+            __m128 newer = _mm_loadu_ps(&window[N - 4 - k]);
+            newer = _mm_shuffle_ps(newer, newer, _MM_SHUFFLE(0, 1, 2, 3)); // Reversed so the lanes share taps
+            acc4 = _mm_add_ps(acc4, _mm_mul_ps(_mm_add_ps(older, newer), _mm_loadu_ps(&_coeffs[k])));
         }
-        for(uint i = 0; i < N; i++) {
-            _coeffs[i] = coeffs[i];
+        acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+        acc = _mm_cvtss_f32(_mm_add_ss(acc4, _mm_shuffle_ps(acc4, acc4, 1)));
+#else
+        float32x4_t acc4 = vdupq_n_f32(0.0f);
+        for(; k + 4 <= MIDDLE; k += 4) {
+            float32x4_t older = vld1q_f32(&window[k]);
+            float32x4_t newer = vrev64q_f32(vld1q_f32(&window[N - 4 - k]));
+            newer = vcombine_f32(vget_high_f32(newer), vget_low_f32(newer)); // Reversed so the lanes share taps
+            acc4 = vmlaq_f32(acc4, vaddq_f32(older, newer), vld1q_f32(&_coeffs[k]));
         }
+        float32x2_t pairs = vadd_f32(vget_low_f32(acc4), vget_high_f32(acc4));
+        acc = vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+#endif
+        acc += _coeffs[MIDDLE] * window[MIDDLE];
+        for(; k < MIDDLE; k++) acc += (window[k] + window[N - 1 - k]) * _coeffs[k];
+        return acc;
     };
-};
\ No newline at end of file
+#endif
+};
@@ -0,0 +1,217 @@
+/*
+ *  Title: FIR Library
+
+ *  Description: Compile time design of type 1 FIR filters. Low pass, high pass, band pass and
+ *      band stop (notch) filters are an ideal response times a Hamming, Blackman or Kaiser
+ *      window, scaled to a gain of 1 in the pass band the same way scipy.signal.firwin does.
+ *      Everything is constexpr, so
+ *          static constexpr auto taps = FIR_design::generate<31, q15_t>({FIR_type::LPF, 100.0f, 1200.0f});
+ *      is a table in flash and no trigonometry runs on the RP2040.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <array>
+#include <type_traits>
+#include <Fixed.h>
+
+/**
+ * @brief FIR filter type
+*/
+enum FIR_type : uint8_t {
+    LPF = 0,
+    HPF = 1,
+    BPF = 2,
+    BSF = 3     // Band stop, a notch when the band is narrow
+};
+
+/**
+ * @brief FIR window, from narrowest transition to most stop band attenuation: Hamming (about
+ *      53 dB), Blackman (about 74 dB). Kaiser trades the two with its beta.
+*/
+enum FIR_window : uint8_t {
+    HAMMING = 0,
+    BLACKMAN = 1,
+    KAISER = 2
+};
+
+/**
+ * @brief Struct containing the parameters for a FIR filter design
+ * @param type FIR filter type
+ * @param cutoff Filter cutoff frequency in Hz, the lower edge of the band for BPF and BSF
+ * @param sample_rate Filter sample rate in Hz
+ * @param cutoff_high Upper edge of the band in Hz for BPF and BSF
+ * @param window Window the ideal response is multiplied with
+ * @param kaiser_beta Shape of the Kaiser window, 8.6 is close to Blackman and 5.0 to Hamming
+*/
+struct FIR_params {
+    FIR_type type = FIR_type::LPF;
+    float cutoff;
+    float sample_rate;
+    float cutoff_high = 0.0f;
+    FIR_window window = FIR_window::HAMMING;
+    float kaiser_beta = 8.6f;
+};
+
+namespace FIR_design {
+    constexpr double PI = 3.14159265358979323846;
+
+    /**
+     * @brief Sine, a Taylor series since sin is not constexpr. Within 1e-15 after folding onto [-pi/2, pi/2].
+    */
+    constexpr double sine(double x) {
+        double turns = x / (2.0 * PI);
+        x -= 2.0 * PI * (double)(long long)(turns >= 0.0 ? turns + 0.5 : turns - 0.5);
+        if(x > 0.5 * PI) x = PI - x;
+        if(x < -0.5 * PI) x = -PI - x;
+        double x2 = x * x;
+        double term = x;
+        double sum = x;
+        for(int k = 1; k <= 10; k++) {
+            term *= -x2 / (double)((2 * k) * (2 * k + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double cosine(double x) {
+        return sine(x + 0.5 * PI);
+    }
+
+    constexpr double square_root(double x) {
+        if(x <= 0.0) return 0.0;
+        double root = x > 1.0 ? x : 1.0;
+        for(int i = 0; i < 64; i++) root = 0.5 * (root + x / root);
+        return root;
+    }
+
+    /**
+     * @brief Modified Bessel function of the first kind and order 0, for the Kaiser window
+    */
+    constexpr double bessel_i0(double x) {
+        double term = 1.0;
+        double sum = 1.0;
+        for(int k = 1; k < 100 && term > 1e-17 * sum; k++) {
+            term *= (0.5 * x / (double)k) * (0.5 * x / (double)k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    /**
+     * @brief Check the band edges are in order and under half the sample rate, for static_assert
+    */
+    constexpr bool is_valid(const FIR_params& params) {
+        if(params.sample_rate <= 0.0f || params.cutoff <= 0.0f || params.cutoff >= 0.5f * params.sample_rate) return false;
+        if(params.type == FIR_type::BPF || params.type == FIR_type::BSF) {
+            return params.cutoff_high > params.cutoff && params.cutoff_high < 0.5f * params.sample_rate;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Window value of tap i of N
+    */
+    constexpr double window(const FIR_params& params, uint i, uint N) {
+        if(N == 1) return 1.0;
+        double phase = 2.0 * PI * (double)i / (double)(N - 1);
+        switch(params.window) {
+            case FIR_window::BLACKMAN:
+                return 0.42 - 0.5 * cosine(phase) + 0.08 * cosine(2.0 * phase);
+            case FIR_window::KAISER: {
+                double r = 2.0 * (double)i / (double)(N - 1) - 1.0;
+                return bessel_i0(params.kaiser_beta * square_root(1.0 - r * r)) / bessel_i0(params.kaiser_beta);
+            }
+            default:
+                return 0.54 - 0.46 * cosine(phase);
+        }
+    }
+
+    /**
+     * @brief Ideal low pass at tap n from the center, sin(2 pi f n) / (pi n)
+     * @param f Cutoff in cycles per sample
+    */
+    constexpr double ideal_lowpass(double f, int n) {
+        if(n == 0) return 2.0 * f;
+        return sine(2.0 * PI * f * (double)n) / (PI * (double)n);
+    }
+
+    /**
+     * @brief Gain of symmetric taps at a frequency
+     * @param f Frequency in cycles per sample
+    */
+    template <uint N> constexpr double gain(const std::array<double, N>& taps, double f) {
+        const int middle = (N - 1) / 2;
+        double sum = 0.0;
+        for(int i = 0; i < (int)N; i++) sum += taps[i] * cosine(2.0 * PI * f * (double)(i - middle));
+        return sum;
+    }
+
+    /**
+     * @brief Design the taps in double, scaled to a gain of 1 at DC for LPF and BSF, at half the
+     *      sample rate for HPF and in the middle of the band for BPF
+     * @return The taps, all 0 if the params are not valid
+    */
+    template <uint N> constexpr std::array<double, N> design(const FIR_params& params) {
+        static_assert((N % 2) != 0, "N is not an odd number");
+        std::array<double, N> taps{};
+        if(!is_valid(params)) return taps;
+
+        const int middle = (N - 1) / 2;
+        double low = (double)params.cutoff / (double)params.sample_rate;
+        double high = (double)params.cutoff_high / (double)params.sample_rate;
+        for(int i = 0; i < (int)N; i++) {
+            int n = i - middle;
+            double impulse = (n == 0) ? 1.0 : 0.0;
+            double ideal = 0.0;
+            switch(params.type) {
+                case FIR_type::HPF: ideal = impulse - ideal_lowpass(low, n); break;
+                case FIR_type::BPF: ideal = ideal_lowpass(high, n) - ideal_lowpass(low, n); break;
+                case FIR_type::BSF: ideal = impulse - ideal_lowpass(high, n) + ideal_lowpass(low, n); break;
+                default: ideal = ideal_lowpass(low, n); break;
+            }
+            taps[i] = ideal * window(params, i, N);
+        }
+
+        double reference = 0.0;
+        if(params.type == FIR_type::HPF) reference = 0.5;
+        if(params.type == FIR_type::BPF) reference = 0.5 * (low + high);
+        double scale = 1.0 / gain<N>(taps, reference);
+        for(uint i = 0; i < N; i++) taps[i] *= scale;
+        return taps;
+    }
+
+    /**
+     * @brief Design the taps and round them to the sample type. Fixed point taps have the
+     *      rounding error of their sum put on the center tap, so a low pass still passes DC
+     *      exactly and a high pass still blocks it.
+     * @param T float, q15_t or q31_t
+    */
+    template <uint N, typename T> constexpr std::array<T, N> generate(const FIR_params& params) {
+        std::array<double, N> taps = design<N>(params);
+        std::array<T, N> result{};
+        if constexpr(std::is_same<T, float>::value) {
+            for(uint i = 0; i < N; i++) result[i] = (float)taps[i];
+        } else {
+            static_assert(std::is_same<T, q15_t>::value || std::is_same<T, q31_t>::value, "T is not float, q15_t or q31_t");
+            const double one = std::is_same<T, q15_t>::value ? 32768.0 : 2147483648.0;
+            const double largest = one - 1.0;
+            double sum = 0.0;
+            int64_t total = 0;
+            for(uint i = 0; i < N; i++) {
+                double tap = taps[i] * one;
+                tap = tap > largest ? largest : (tap < -one ? -one : tap);
+                result[i] = (T)(int64_t)(tap >= 0.0 ? tap + 0.5 : tap - 0.5);
+                sum += taps[i] * one;
+                total += result[i];
+            }
+            int64_t target = (int64_t)(sum >= 0.0 ? sum + 0.5 : sum - 0.5);
+            int64_t center = (int64_t)result[(N - 1) / 2] + (target - total);
+            result[(N - 1) / 2] = (T)(center > (int64_t)largest ? (int64_t)largest : center);
+        }
+        return result;
+    }
+}
@@ -7,13 +7,15 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
-#include <hardware/pwm.h>
-#include <hardware/gpio.h>
+#include <HAL.h>
 #include <MT6701.h>
 #include <TMC6300.h>
-#include "pico/stdlib.h"
+#include <FastTrig.h>
+#include <EncoderAngle.h>
+#include <Storage.h>
 #include "FOC.h"
 
 template <typename T> T constrain(T amt, T low, T high) {
@@ -33,20 +35,18 @@ FOC::FOC(int pole_pairs, MT6701* encoder,TMC6300* motor, Direction direction, fl
 /******************************* PUBLIC METHODS *******************************/
 
 /**
- * @brief Initialize the FOC library
- * @param type True for SVM, false for sine
+ * @brief Initialize the FOC library, the modulation is picked at compile time with FOC_MODULATION
+ * @param skip_zea_check True to leave the zero electric angle, direction and pole pairs as given
 */
-void FOC::init(bool type, bool skip_zea_check) {
+void FOC::init(bool skip_zea_check) {
     if(!skip_zea_check) {
-        set_phase_voltage(3.0f, 0.0f, _3pi_2);
-        sleep_ms(500);
-        float encoder_angle = 0.0f;
-        _encoder->read(&encoder_angle);
-        _zero_electric_angle = 0.0f;
-        _zero_electric_angle = electric_angle(encoder_angle);
+        calibrate_motor(_voltage_limit * 0.4f, NULL);
     }
     set_phase_voltage(0, 0, 0);
-    _type = type;
+
+    // Precompute the voltage to PWM level conversion for the fixed-point path
+    float ratio = constrain(_voltage_limit / _motor->get_supply_voltage(), 0.0f, 1.0f);
+    _level_scale = (int32_t)(ratio * ((float)_motor->get_wrap() + 1.0f));
 }
 
 /**
@@ -56,71 +56,17 @@ void FOC::init(bool type, bool skip_zea_check) {
  * @param angle voltage angle
 */
 void FOC::set_phase_voltage(float v_q, float v_d, float angle) {
-    float center;
     float _ca, _sa;
-    float v_u, v_v, v_w;
-    if(_type) {
-        // Space Vector PWM
-        angle = normalize_angle(angle + atan2(v_q, v_d));
-        int sector;
-        float v_out = sqrt(v_d * v_d + v_q + v_q) / _voltage_limit;
-        sector = floor(angle / _pi_3) + 1;
-        float T1 = _sqrt3*sin(sector * _pi_3 - angle) * v_out;
-        float T2 = _sqrt3*sin(angle - (sector-1.0f)*_pi_3) * v_out;
-        float T0 = 1.0f - T1 - T2;
-        float Tu, Tv, Tw;
-        switch(sector) {
-            case 1:
-                Tu = T1 + T2 + T0/2.0f;
-                Tv = T1 + T0/2.0f;
-                Tw = T0/2.0f;
-                break;
-            case 2:
-                Tu = T1 + T0/2.0f;
-                Tv = T1 + T2 + T0/2.0f;
-                Tw = T0/2.0f;
-                break;
-            case 3:
-                Tu = T0/2.0f;
-                Tv = T1 + T2 + T0/2.0f;
-                Tw = T2 + T0/2.0f;
-                break;
-            case 4:
-                Tu = T0/2.0f;
-                Tv = T1 + T0/2.0f;
-                Tw = T1 + T2 + T0/2.0f;
-                break;
-            case 5:
-                Tu = T2 + T0/2.0f;
-                Tv = T0/2.0f;
-                Tw = T1 + T2 + T0/2.0f;
-                break;
-            case 6:
-                Tu = T1 + T2 + T0/2.0f;
-                Tv = T0/2.0f;
-                Tw = T1 + T0/2.0f;
-                break;
-            default:
-                Tu = 0;
-                Tv = 0;
-                Tw = 0;
-        }
-        v_u = Tu * _voltage_limit;
-        v_v = Tv * _voltage_limit;
-        v_w = Tw * _voltage_limit;
-    } else {
-        // Sine PWM
-        angle = normalize_angle(angle);
-        _ca = cos(angle);
-        _sa = sin(angle);
-        float v_alpha = _ca * v_d - _sa * v_q;
-        float v_beta = _sa * v_d + _ca * v_q;
-        center = _voltage_limit/2;
-        v_u = v_alpha + center;
-        v_v = ((-v_alpha + (_sqrt3 * v_beta)) / 2.0f) + center;
-        v_w = ((-v_alpha - (_sqrt3 * v_beta)) / 2.0f) + center;
-    }
-    _motor->set_voltages(v_u, v_v, v_w);
+    // Inverse Park, the table lookup wraps the angle by itself
+    FastTrig::sincos<FOC_TRIG_ACCURACY>(angle, &_sa, &_ca);
+    float v_alpha = _ca * v_d - _sa * v_q;
+    float v_beta = _sa * v_d + _ca * v_q;
+    // Inverse Clarke
+    float v_u = v_alpha;
+    float v_v = -0.5f * v_alpha + _sqrt3_2 * v_beta;
+    float v_w = -0.5f * v_alpha - _sqrt3_2 * v_beta;
+    float center = _voltage_limit/2 - common_mode<FOC_MODULATION>(v_u, v_v, v_w);
+    _motor->set_voltages(v_u + center, v_v + center, v_w + center);
 }
 
 void FOC::update(float requested_voltage, float* encoder_angle) {
@@ -129,20 +75,315 @@ void FOC::update(float requested_voltage, float* encoder_angle) {
     set_phase_voltage(requested_voltage, 0.0f, electric_angle(*encoder_angle));
 }
 
+/**
+ * @brief Same as update but takes the raw count, the electrical angle wraps in integers
+ * @param requested_voltage q axis voltage
+ * @param encoder_count Raw 14 bit count from the encoder
+*/
+void FOC::update(float requested_voltage, uint16_t encoder_count) {
+    set_phase_voltage(requested_voltage, 0.0f, electric_angle_q15(encoder_count) * (_2pi / 65536.0f));
+}
+
 void FOC::set_angle(float voltage, float angle) {
     set_phase_voltage(voltage, 0.0f, electric_angle(angle));
 }
 
+/**
+ * @brief Set the zero electric angle, keeping the fixed-point copy in sync
+ * @param angle Zero electric angle in radians
+*/
+void FOC::set_zero_electric_angle(float angle) {
+    _zero_electric_angle = angle;
+    _zero_electric_angle_q16 = (uint16_t)(FastTrig::wrap_2pi(angle) * (65536.0f / _2pi));
+}
+
+/**
+ * @brief Find the zero electric angle, direction and number of pole pairs.
+ *      Turns the field open loop until the rotor, pulled along by the d axis, has made a full turn
+ *      and then back again, and fits the mechanical angle to the electrical angle by least squares.
+ *      The slope gives direction and pole pairs, the circular mean of what is left gives the zero
+ *      electric angle, taken each way and averaged since the rotor lags the field by up to a radian.
+ *      A full turn averages out the encoder nonlinearity, which would skew the slope.
+ *      Takes about five seconds with 7 pole pairs, call before the control loop starts and with the knob untouched.
+ * @param voltage d axis voltage holding the rotor to the field
+ * @param result Everything that was found, can be NULL
+ * @return True if the fit is good and the results are in use, false if nothing was changed
+*/
+bool FOC::calibrate_motor(float voltage, motor_calibration_t* result) {
+    const int32_t steps_per_turn = 128;             // Electrical
+    const int32_t max_steps = (MAX_POLE_PAIRS + 1) * steps_per_turn;
+    const int32_t lead_in = steps_per_turn / 4;     // Let the rotor catch up before recording
+    const float step = _2pi / steps_per_turn;
+    const uint32_t step_us = (uint32_t)(step / _cal_speed * 1e6f);
+
+    uint16_t count = 0;
+    if(_encoder->read_raw(&count) == mt6701_err_t::FAILED_CRC) return false;
+    EncoderAngle mechanical;
+    mechanical.reset(count);
+
+    float electrical = 0.0f;
+    set_phase_voltage(0.0f, voltage, electrical);
+    HAL::sleep_ms(200);
+
+    // Sums for the line fit, mechanical angle against electrical angle
+    float sum_x = 0.0f, sum_y = 0.0f, sum_xx = 0.0f, sum_xy = 0.0f;
+    int32_t n = 0;
+    // Unit vectors of the zero electric angle for each sweep and every direction and pole pair count,
+    // the right one is picked after the fit
+    float sum_sin[2][2][MAX_POLE_PAIRS + 1] = {};
+    float sum_cos[2][2][MAX_POLE_PAIRS + 1] = {};
+    int32_t samples[2] = {0, 0};
+
+    // The rotor lags the field by the same amount each way, so doing both keeps the fit centered.
+    // Forward runs until one mechanical turn is recorded, backward takes as many steps.
+    int32_t steps = max_steps;
+    int32_t start = 0;
+    for(int32_t direction = 1; direction >= -1; direction -= 2) {
+        int sweep = (direction > 0) ? 0 : 1;
+        for(int32_t i = 0; i < steps + lead_in; i++) {
+            electrical += direction * step;
+            set_phase_voltage(0.0f, voltage, electrical);
+            HAL::sleep_us(step_us);
+            if(_encoder->read_raw(&count) != mt6701_err_t::OK) continue;
+            int32_t position = mechanical.update(count);
+            float m = EncoderAngle::to_radians(position);
+            if(i < lead_in) continue;
+            if(i == lead_in) start = position;
+            if(direction > 0 && abs(position - start) >= EncoderAngle::COUNTS_PER_TURN) steps = i - lead_in + 1;
+
+            sum_x += electrical;
+            sum_y += m;
+            sum_xx += electrical * electrical;
+            sum_xy += electrical * m;
+            n++;
+            samples[sweep]++;
+            for(int d = 0; d < 2; d++) {
+                for(int p = 1; p <= MAX_POLE_PAIRS; p++) {
+                    float s, c;
+                    FastTrig::sincos((d ? -p : p) * m - electrical, &s, &c);
+                    sum_sin[sweep][d][p] += s;
+                    sum_cos[sweep][d][p] += c;
+                }
+            }
+        }
+    }
+    set_phase_voltage(0, 0, 0);
+    if(samples[0] < steps_per_turn || samples[1] < steps_per_turn) return false;
+
+    float slope = (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+    if(slope == 0.0f) return false;
+    float estimate = 1.0f / fabsf(slope);
+    int pole_pairs = (int)(estimate + 0.5f);
+    int d = (slope > 0.0f) ? 0 : 1;
+    if(pole_pairs < 1 || pole_pairs > MAX_POLE_PAIRS || fabsf(estimate - pole_pairs) > 0.2f) return false;
+
+    // Length of the mean unit vector of each sweep, 1 if every sample agreed exactly
+    float residual = 0.0f;
+    float mean_sin = 0.0f, mean_cos = 0.0f;
+    for(int sweep = 0; sweep < 2; sweep++) {
+        float s = sum_sin[sweep][d][pole_pairs] / samples[sweep];
+        float c = sum_cos[sweep][d][pole_pairs] / samples[sweep];
+        float length = sqrtf(s * s + c * c);
+        if(length < 1.0f) residual += 0.5f * sqrtf(-2.0f * logf(length));
+        mean_sin += s / length;
+        mean_cos += c / length;
+    }
+    float zero_electric_angle = FastTrig::wrap_2pi(FastTrig::atan2(mean_sin, mean_cos));
+    if(residual > 0.3f) return false;
+
+    _direction = d ? Direction::CCW : Direction::CW;
+    _pole_pairs = pole_pairs;
+    set_zero_electric_angle(zero_electric_angle);
+    if(result != NULL) {
+        result->zero_electric_angle = zero_electric_angle;
+        result->direction = _direction;
+        result->pole_pairs = pole_pairs;
+        result->pole_pairs_estimate = estimate;
+        result->residual = residual;
+    }
+    return true;
+}
+
+/**
+ * @brief Load the motor calibration from flash
+ * @param flash_offset Byte offset of the record from the start of flash
+ * @return True if a valid record was found and is now in use, false if not
+*/
+bool FOC::load_calibration(uint32_t flash_offset) {
+    motor_record_t record;
+    if(!Storage::load(flash_offset, CAL_MAGIC, &record, sizeof(record))) return false;
+    if(record.pole_pairs < 1 || record.pole_pairs > MAX_POLE_PAIRS) return false;
+    _direction = (record.direction > 0) ? Direction::CW : Direction::CCW;
+    _pole_pairs = record.pole_pairs;
+    set_zero_electric_angle(record.zero_electric_angle);
+    return true;
+}
+
+/**
+ * @brief Store the motor calibration in flash, erases the whole sector
+ * @param flash_offset Byte offset of the record from the start of flash, sector aligned
+ * @return True if successful, false if the write failed
+*/
+bool FOC::save_calibration(uint32_t flash_offset) const {
+    motor_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.zero_electric_angle = _zero_electric_angle;
+    record.direction = (int8_t)_direction;
+    record.pole_pairs = (uint8_t)_pole_pairs;
+    return Storage::save(flash_offset, CAL_MAGIC, &record, sizeof(record));
+}
+
+/**
+ * @brief Measure the encoder nonlinearity and load a correction table into the encoder.
+ *      Turns the rotor open loop with set_angle one turn each way and compares the encoder
+ *      to the commanded angle, then does it again with the table in use to check the result.
+ *      Takes about 10 seconds with 7 pole pairs, call before the control loop starts and with the knob untouched.
+ * @param voltage Voltage holding the rotor to the commanded angle
+ * @param result Peak error before and after, can be NULL
+ * @return True if successful, false if some part of the turn was never seen by the encoder
+*/
+bool FOC::calibrate_encoder(float voltage, encoder_calibration_t* result) {
+    int32_t peak[2] = {0, 0};
+    int16_t table[MT6701::CAL_SIZE];
+    _encoder->clear_calibration();
+
+    for(int pass = 0; pass < 2; pass++) {
+        int32_t sum[2][MT6701::CAL_SIZE] = {};
+        int32_t samples[2][MT6701::CAL_SIZE] = {};
+
+        // Lock the rotor to where it is before moving it
+        uint16_t start = 0;
+        _encoder->read_raw(&start);
+        int32_t commanded = start;
+        set_angle(voltage, commanded * (_2pi / 16384.0f));
+        HAL::sleep_ms(200);
+
+        // The rotor lags the field by the same amount each way, so averaging the two sweeps cancels it
+        sweep_encoder(voltage, &commanded, 1, sum[0], samples[0]);
+        sweep_encoder(voltage, &commanded, -1, sum[1], samples[1]);
+
+        // The average error is the offset of the rotor to the field, only the rest is nonlinearity
+        int32_t average[MT6701::CAL_SIZE];
+        int32_t mean = 0;
+        for(int i = 0; i < MT6701::CAL_SIZE; i++) {
+            if(samples[0][i] == 0 || samples[1][i] == 0) {
+                set_phase_voltage(0, 0, 0);
+                return false;
+            }
+            average[i] = (sum[0][i] / samples[0][i] + sum[1][i] / samples[1][i]) / 2;
+            mean += average[i];
+        }
+        mean /= MT6701::CAL_SIZE;
+        for(int i = 0; i < MT6701::CAL_SIZE; i++) {
+            int32_t error = average[i] - mean;
+            if(error > peak[pass]) peak[pass] = error;
+            if(-error > peak[pass]) peak[pass] = -error;
+            if(pass == 0) table[i] = (int16_t)(-error);
+        }
+        if(pass == 0) _encoder->set_calibration(table);
+    }
+    set_phase_voltage(0, 0, 0);
+
+    if(result != NULL) {
+        result->error_before = peak[0] * (_2pi / 16384.0f);
+        result->error_after = peak[1] * (_2pi / 16384.0f);
+    }
+    return true;
+}
+
+/**
+ * @brief Fixed-point version of update, same modulation as the float path
+ * @param requested_voltage q axis voltage as a Q15 fraction of the voltage limit
+ * @param encoder_count Raw 14 bit count from the encoder
+*/
+void FOC::update_q15(q15_t requested_voltage, uint16_t encoder_count) {
+    set_phase_voltage_q15(requested_voltage, 0, electric_angle_q15(encoder_count));
+}
+
+/**
+ * @brief Fixed-point version of set_phase_voltage, inverse Park and Clarke in Q15 straight to PWM levels
+ * @param v_q q axis voltage as a Q15 fraction of the voltage limit
+ * @param v_d d axis voltage as a Q15 fraction of the voltage limit
+ * @param angle Electrical angle where one turn is 65536
+*/
+void FOC::set_phase_voltage_q15(q15_t v_q, q15_t v_d, uint16_t angle) {
+    const int32_t center = 16384;       // Half the voltage limit
+    const int32_t sqrt3_2 = 28378;      // sqrt(3)/2 in Q15
+    q15_t s, c;
+    FastTrig::sincos_q15(angle, &s, &c);
+    int32_t v_alpha = ((int32_t)c * v_d - (int32_t)s * v_q) >> 15;
+    int32_t v_beta = ((int32_t)s * v_d + (int32_t)c * v_q) >> 15;
+    int32_t beta_term = (v_beta * sqrt3_2) >> 15;
+    int32_t v_u = v_alpha;
+    int32_t v_v = -(v_alpha >> 1) + beta_term;
+    int32_t v_w = -(v_alpha >> 1) - beta_term;
+    int32_t offset = center - common_mode_q15<FOC_MODULATION>(v_u, v_v, v_w);
+    _motor->set_levels(to_level(v_u + offset), to_level(v_v + offset), to_level(v_w + offset));
+}
+
+/**
+ * @brief Electrical angle from a raw encoder count, wraps for free in 16 bits
+ * @param encoder_count Raw 14 bit count from the encoder
+ * @return Electrical angle where one turn is 65536
+*/
+uint16_t FOC::electric_angle_q15(uint16_t encoder_count) {
+    int32_t mechanical = (int32_t)encoder_count << 2;
+    return (uint16_t)(mechanical * (int32_t)(_direction * _pole_pairs) - (int32_t)_zero_electric_angle_q16);
+}
+
 /******************************* PUBLIC METHODS *******************************/
 
+/**
+ * @brief Step the field one turn in one direction and sum up the encoder error at each table node
+ * @param commanded Commanded angle in counts, updated as the field moves
+ * @param direction 1 for increasing angle, -1 for decreasing
+ * @param sum Error in counts per node, added to
+ * @param samples Number of samples per node, added to
+ * @return Number of samples taken
+*/
+int32_t FOC::sweep_encoder(float voltage, int32_t* commanded, int32_t direction, int32_t* sum, int32_t* samples) {
+    const int32_t step_counts = 16;                 // 1024 steps per turn, 16 per table node
+    const int32_t steps = 16384 / step_counts;
+    const int32_t lead_in = steps / 8;              // Let the rotor catch up before recording
+    const uint32_t step_us = (uint32_t)(step_counts * (_2pi / 16384.0f) * _pole_pairs / _cal_speed * 1e6f);
+    const int32_t shift = 14 - MT6701::CAL_BITS;
+    int32_t taken = 0;
+    for(int32_t i = 0; i < steps + lead_in; i++) {
+        *commanded += direction * step_counts;
+        set_angle(voltage, *commanded * (_2pi / 16384.0f));
+        HAL::sleep_us(step_us);
+        if(i < lead_in) continue;
+
+        uint16_t count = 0;
+        mt6701_err_t error = _encoder->read_raw(&count);
+        if(error != mt6701_err_t::OK) continue;
+        // Sign extend the 14 bit difference so the wrap doesn't matter
+        int32_t difference = (int32_t)((uint32_t)(count - *commanded) << 18) >> 18;
+        int32_t node = ((count + (1 << (shift - 1))) >> shift) & (MT6701::CAL_SIZE - 1);
+        sum[node] += difference;
+        samples[node]++;
+        taken++;
+    }
+    return taken;
+}
+
 /**
  * @brief Normalize angle between 0 and 2pi
  * @param angle Input angle
  * @return Normalized output angle
 */
 float FOC::normalize_angle(float angle) {
-    float a = fmodf(angle, _2pi);
-    return a >= 0.0f ? a : (a + _2pi);
+    return FastTrig::wrap_2pi(angle);
+}
+
+/**
+ * @brief Convert a Q15 phase voltage to a PWM level, clamping to the valid range
+ * @param phase_voltage Phase voltage as a Q15 fraction of the voltage limit
+ * @return PWM compare level
+*/
+uint16_t FOC::to_level(int32_t phase_voltage) {
+    phase_voltage = constrain<int32_t>(phase_voltage, 0, 32767);
+    return (uint16_t)((phase_voltage * _level_scale) >> 15);
 }
 
 float FOC::electric_angle(float sensor_angle) {
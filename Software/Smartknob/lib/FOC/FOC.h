@@ -7,10 +7,31 @@
  */
 
 #pragma once
-#include <hardware/pwm.h>
-#include <hardware/gpio.h>
+#include <math.h>
+#include <HAL.h>
 #include <MT6701.h>
 #include <TMC6300.h>
+#include <FastTrig.h>
+#include <Fixed.h>
+#include <Storage.h>
+
+// Sine table accuracy used by the FOC, NEAREST trades about 3e-3 of error for a few cycles per call
+#ifndef FOC_TRIG_ACCURACY
+#define FOC_TRIG_ACCURACY FastTrig::Accuracy::INTERPOLATED
+#endif
+
+// How the phase voltages are centered in the supply, the line to line voltages are the same for all of them.
+// SINE centers every phase on half the limit and reaches voltage_limit/2 before clipping, SPACE_VECTOR and
+// THIRD_HARMONIC move the common mode so the phases use the whole range and reach voltage_limit/sqrt(3)
+enum class Modulation : uint8_t {
+    SINE,
+    SPACE_VECTOR,   // Min/max injection, same result as the sector based SVPWM
+    THIRD_HARMONIC  // One sixth third harmonic
+};
+
+#ifndef FOC_MODULATION
+#define FOC_MODULATION Modulation::SPACE_VECTOR
+#endif
 
 enum Direction : int8_t {
     CW = 1,
@@ -18,33 +39,122 @@ enum Direction : int8_t {
     UNKNOWN = 0
 };
 
+// Motor parameters found by calibrate_motor
+struct motor_calibration_t {
+    float zero_electric_angle;  // rad
+    Direction direction;
+    int pole_pairs;
+    float pole_pairs_estimate;  // Before rounding, far from a whole number means a bad fit
+    float residual;             // Spread of the electrical angle around the fit in rad
+};
+
+// Peak encoder error in radians before and after a calibration, the constant offset removed
+struct encoder_calibration_t {
+    float error_before;
+    float error_after;
+};
+
 class FOC {
 public:
     FOC(int pole_pairs, MT6701* encoder,TMC6300* motor, Direction direction, float voltage_limit);
-    void init(bool type, bool skip_zea_check);
+    void init(bool skip_zea_check);
 
     void update(float requested_voltage, float* encoder_angle);
 
+    void update(float requested_voltage, uint16_t encoder_count);
+
     void set_phase_voltage(float v_q, float v_d, float angle);
 
     void set_angle(float voltage, float angle);
 
     float electric_angle(float sensor_angle);
+
+    // Fixed-point path, voltages are Q15 fractions of voltage_limit and angles are 16 bit turns
+    void update_q15(q15_t requested_voltage, uint16_t encoder_count);
+
+    void set_phase_voltage_q15(q15_t v_q, q15_t v_d, uint16_t angle);
+
+    uint16_t electric_angle_q15(uint16_t encoder_count);
+
+    void set_zero_electric_angle(float angle);
+
+    bool calibrate_motor(float voltage, motor_calibration_t* result);
+    bool load_calibration(uint32_t flash_offset);
+    bool save_calibration(uint32_t flash_offset) const;
+
+    bool calibrate_encoder(float voltage, encoder_calibration_t* result);
+
+    int get_pole_pairs(void) const { return _pole_pairs; };
+    Direction get_direction(void) const { return _direction; };
+
+    // Common mode of each modulation, public so it can be checked on its own
+    template <Modulation M> static float common_mode(float v_u, float v_v, float v_w);
+    template <Modulation M> static int32_t common_mode_q15(int32_t v_u, int32_t v_v, int32_t v_w);
     
     float _zero_electric_angle = 0.0f;
 private:
     const float _pi = 3.14159265358979323846f;
     const float _2pi = 6.28318530717958647692f;
-    const float _pi_3 = 1.04719755119659774615f;
-    const float _3pi_2 = 4.71238898038468985769f;
-    const float _sqrt3 = 1.73205080756887729352f;
+    const float _sqrt3_2 = 0.86602540378443864676f;
+    static const int MAX_POLE_PAIRS = 24;
+    const float _cal_speed = 20.0f;     // Electrical rad/s of the calibration sweeps, faster and back-EMF lets the rotor slip
+    static const uint32_t CAL_MAGIC = 0x4C41434D; // "MCAL", change when motor_record_t changes
+
+    // Layout of the motor calibration in flash
+    struct motor_record_t {
+        float zero_electric_angle;
+        int8_t direction;
+        uint8_t pole_pairs;
+    };
     float _voltage_limit = 0.0f;
     int _pole_pairs = 0;
     Direction _direction;
-    bool _type = false;
+    uint16_t _zero_electric_angle_q16 = 0;
+    int32_t _level_scale = 0; // PWM level at a phase voltage of voltage_limit
 
     MT6701* _encoder;
     TMC6300* _motor;
 
     float normalize_angle(float angle);
-};
\ No newline at end of file
+    int32_t sweep_encoder(float voltage, int32_t* commanded, int32_t direction, int32_t* sum, int32_t* samples);
+    uint16_t to_level(int32_t phase_voltage);
+};
+
+/**
+ * @brief Common mode voltage to take away from the three phases, the phases are centered on zero
+*/
+template <Modulation M>
+inline float FOC::common_mode(float v_u, float v_v, float v_w) {
+    if constexpr (M == Modulation::SPACE_VECTOR) {
+        // Centers the phase pair furthest apart, equal to the six sector SVPWM without finding the sector
+        return 0.5f * (fmaxf(v_u, fmaxf(v_v, v_w)) + fminf(v_u, fminf(v_v, v_w)));
+    } else if constexpr (M == Modulation::THIRD_HARMONIC) {
+        // With v_u = A*cos(t), v_u*v_v*v_w = A^3*cos(3t)/4 and the sum of squares is 3*A^2/2,
+        // so this is A*cos(3t)/6 without the angle or amplitude
+        float squares = v_u * v_u + v_v * v_v + v_w * v_w;
+        return squares > 1e-12f ? (v_u * v_v * v_w) / squares : 0.0f;
+    } else {
+        return 0.0f;
+    }
+}
+
+/**
+ * @brief Fixed-point common_mode, phases are Q15 fractions of the voltage limit centered on zero
+*/
+template <Modulation M>
+inline int32_t FOC::common_mode_q15(int32_t v_u, int32_t v_v, int32_t v_w) {
+    if constexpr (M == Modulation::SPACE_VECTOR) {
+        int32_t max = v_u > v_v ? v_u : v_v;
+        int32_t min = v_u > v_v ? v_v : v_u;
+        max = v_w > max ? v_w : max;
+        min = v_w < min ? v_w : min;
+        return (max + min) >> 1;
+    } else if constexpr (M == Modulation::THIRD_HARMONIC) {
+        int32_t product = (((v_u * v_v) >> 15) * v_w) >> 15;
+        int32_t squares = ((v_u * v_u) >> 15) + ((v_v * v_v) >> 15) + ((v_w * v_w) >> 15);
+        // Below about 1% of the limit nothing clips and the division runs out of bits
+        return squares > 16 ? (product << 15) / squares : 0;
+    } else {
+        return 0;
+    }
+}
\ No newline at end of file
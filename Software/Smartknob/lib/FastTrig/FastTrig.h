@@ -0,0 +1,154 @@
+/*
+ *  Title: FastTrig Library
+
+ *  Description: Table based sine/cosine and polynomial atan2 for the control loop.
+ *      The RP2040 has no FPU so every libm call is a soft-float routine, these avoid them.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+
+namespace FastTrig {
+    /**
+     * @brief Accuracy/speed tradeoff of the sine table lookup
+     * @param NEAREST Nearest table entry, max error about 3e-3
+     * @param INTERPOLATED Linear interpolation between entries, max error about 5e-6
+    */
+    enum class Accuracy : uint8_t {
+        NEAREST = 0,
+        INTERPOLATED
+    };
+
+    const float _pi = 3.14159265358979323846f;
+    const float _2pi = 6.28318530717958647692f;
+    const float _pi_2 = 1.57079632679489661923f;
+    const float _1_2pi = 0.15915494309189533577f;
+
+    const uint32_t TABLE_BITS = 8;                  // Table entries per quarter wave as a power of two
+    const uint32_t PHASE_BITS = 24;                 // One full turn is 2^PHASE_BITS
+    const uint32_t QUARTER = 1u << (PHASE_BITS - 2);
+    const uint32_t FRAC_BITS = PHASE_BITS - 2 - TABLE_BITS;
+    const float PHASE_SCALE = (float)(1u << PHASE_BITS) / _2pi;
+
+    // Largest angle to_phase takes, angle * PHASE_SCALE has to fit in an int32_t. Wrap larger angles first
+    constexpr float MAX_ANGLE = 800.0f;
+    static_assert((double)MAX_ANGLE * (1u << PHASE_BITS) / 6.28318530717958647692 < 2147483648.0,
+        "MAX_ANGLE overflows to_phase");
+
+    // Quarter wave of sine, 2^TABLE_BITS + 1 entries padded with one extra for the interpolation
+    extern const float quarter_sine[(1u << TABLE_BITS) + 2];
+
+    /**
+     * @brief Convert an angle to a phase where one turn is 2^PHASE_BITS, valid for |angle| < MAX_ANGLE.
+     *      The product rounds to a float, which adds about |angle| * 6e-8 rad of error, 5e-5 rad at MAX_ANGLE
+    */
+    inline uint32_t to_phase(float angle) {
+        return (uint32_t)(int32_t)(angle * PHASE_SCALE);
+    }
+
+    /**
+     * @brief Sine of a phase
+     * @param phase Phase where one turn is 2^PHASE_BITS, wraps naturally
+    */
+    template <Accuracy A = Accuracy::INTERPOLATED> inline float sin_phase(uint32_t phase) {
+        uint32_t quadrant = (phase >> (PHASE_BITS - 2)) & 0x03;
+        uint32_t p = phase & (QUARTER - 1);
+        if(quadrant & 0x01) p = QUARTER - p; // Mirror the rising quarter for the falling ones
+        float value;
+        if(A == Accuracy::NEAREST) {
+            value = quarter_sine[(p + (1u << (FRAC_BITS - 1))) >> FRAC_BITS];
+        } else {
+            uint32_t i = p >> FRAC_BITS;
+            float frac = (float)(p & ((1u << FRAC_BITS) - 1)) * (1.0f / (float)(1u << FRAC_BITS));
+            value = quarter_sine[i] + (quarter_sine[i + 1] - quarter_sine[i]) * frac;
+        }
+        return (quadrant & 0x02) ? -value : value;
+    }
+
+    template <Accuracy A = Accuracy::INTERPOLATED> inline float sin(float angle) {
+        return sin_phase<A>(to_phase(angle));
+    }
+
+    template <Accuracy A = Accuracy::INTERPOLATED> inline float cos(float angle) {
+        return sin_phase<A>(to_phase(angle) + QUARTER);
+    }
+
+    /**
+     * @brief Sine and cosine sharing a single angle to phase conversion
+    */
+    template <Accuracy A = Accuracy::INTERPOLATED> inline void sincos(float angle, float* s, float* c) {
+        uint32_t phase = to_phase(angle);
+        *s = sin_phase<A>(phase);
+        *c = sin_phase<A>(phase + QUARTER);
+    }
+
+    /**
+     * @brief atan2 using octant reduction and an 11th order odd polynomial, max error about 2e-6 rad
+     * @return Angle in [-pi, pi]
+    */
+    inline float atan2(float y, float x) {
+        float abs_x = x < 0.0f ? -x : x;
+        float abs_y = y < 0.0f ? -y : y;
+        if(abs_x == 0.0f && abs_y == 0.0f) return 0.0f;
+        bool swap = abs_y > abs_x;
+        float a = swap ? (abs_x / abs_y) : (abs_y / abs_x);
+        float s = a * a;
+        float r = a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f + s * (0.05265332f + s * -0.01172120f)))));
+        if(swap) r = _pi_2 - r;
+        if(x < 0.0f) r = _pi - r;
+        return y < 0.0f ? -r : r;
+    }
+
+    /**
+     * @brief Wrap an angle into [0, 2pi) without fmodf
+    */
+    inline float wrap_2pi(float angle) {
+        float turns = angle * _1_2pi;
+        int32_t n = (int32_t)turns;
+        if(turns < (float)n) n--; // Truncation to floor for negative angles
+        float a = angle - (float)n * _2pi;
+        if(a >= _2pi) a -= _2pi;
+        if(a < 0.0f) a += _2pi;
+        return a;
+    }
+
+    /**
+     * @brief Wrap an angle into [-pi, pi) without fmodf
+    */
+    inline float wrap_pi(float angle) {
+        return wrap_2pi(angle + _pi) - _pi;
+    }
+
+    /******************************* FIXED POINT *******************************/
+
+    // Quarter wave of sine in Q15, same layout as quarter_sine
+    extern const int16_t quarter_sine_q15[(1u << TABLE_BITS) + 2];
+
+    const uint32_t Q15_FRAC_BITS = 16 - 2 - TABLE_BITS;
+
+    /**
+     * @brief Interpolated sine of a 16 bit angle, max error about 2 LSB
+     * @param angle Angle where one turn is 65536, so 32768 is pi when read as a Q15 value
+     * @return Sine in Q15
+    */
+    inline int16_t sin_q15(uint16_t angle) {
+        uint32_t quadrant = (angle >> 14) & 0x03;
+        uint32_t p = angle & 0x3FFF;
+        if(quadrant & 0x01) p = 0x4000 - p;
+        uint32_t i = p >> Q15_FRAC_BITS;
+        int32_t frac = (int32_t)(p & ((1u << Q15_FRAC_BITS) - 1));
+        int32_t value = quarter_sine_q15[i] + (((quarter_sine_q15[i + 1] - quarter_sine_q15[i]) * frac) >> Q15_FRAC_BITS);
+        return (int16_t)((quadrant & 0x02) ? -value : value);
+    }
+
+    inline int16_t cos_q15(uint16_t angle) {
+        return sin_q15((uint16_t)(angle + 0x4000));
+    }
+
+    inline void sincos_q15(uint16_t angle, int16_t* s, int16_t* c) {
+        *s = sin_q15(angle);
+        *c = sin_q15((uint16_t)(angle + 0x4000));
+    }
+}
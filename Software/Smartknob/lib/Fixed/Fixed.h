@@ -0,0 +1,61 @@
+/*
+ *  Title: Fixed Point Library
+
+ *  Description: Q15/Q31 types and helpers for the fixed-point control path
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+
+typedef int16_t q15_t;  // [-1, 1) with 15 fractional bits
+typedef int32_t q31_t;  // [-1, 1) with 31 fractional bits
+
+namespace Fixed {
+    const q15_t Q15_MAX = 32767;
+    const q15_t Q15_MIN = -32768;
+
+    constexpr q15_t float_to_q15(float x) {
+        return (x >= 1.0f) ? Q15_MAX : ((x <= -1.0f) ? Q15_MIN : (q15_t)(x * 32768.0f));
+    }
+
+    constexpr float q15_to_float(q15_t x) {
+        return (float)x * (1.0f / 32768.0f);
+    }
+
+    constexpr q31_t float_to_q31(float x) {
+        return (x >= 1.0f) ? INT32_MAX : ((x <= -1.0f) ? INT32_MIN : (q31_t)((double)x * 2147483648.0));
+    }
+
+    constexpr float q31_to_float(q31_t x) {
+        return (float)x * (1.0f / 2147483648.0f);
+    }
+
+    /**
+     * @brief Saturate a 32 bit intermediate to Q15
+    */
+    inline q15_t q15_sat(int32_t x) {
+        if(x > Q15_MAX) return Q15_MAX;
+        if(x < Q15_MIN) return Q15_MIN;
+        return (q15_t)x;
+    }
+
+    /**
+     * @brief Q15 multiply, a single 32 bit multiply on the Cortex-M0+
+    */
+    inline q15_t q15_mul(q15_t a, q15_t b) {
+        return (q15_t)(((int32_t)a * (int32_t)b) >> 15);
+    }
+
+    inline q31_t q31_mul(q31_t a, q31_t b) {
+        return (q31_t)(((int64_t)a * (int64_t)b) >> 31);
+    }
+
+    /**
+     * @brief Convert to a gain with 24 fractional bits, used where Q15 lacks range or resolution
+    */
+    constexpr int32_t float_to_q24(float x) {
+        return (int32_t)((double)x * 16777216.0 + ((x < 0.0f) ? -0.5 : 0.5));
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ *  Title: HAL Library
+
+ *  Description: Thin hardware abstraction layer for SPI, GPIO, PWM and time.
+ *      The Pico backend maps straight onto the Pico SDK with inline wrappers,
+ *      the host backend runs the same code against simulated peripherals.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace HAL {
+    /**
+     * @brief GPIO functions used by the libraries
+    */
+    enum class gpio_func : uint8_t {
+        SIO = 0,
+        SPI,
+        PWM
+    };
+}
+
+#ifdef SMARTKNOB_HOST
+#include "HAL_host.h"
+#else
+#include "HAL_pico.h"
+#endif
@@ -0,0 +1,809 @@
+/*
+ *  Title: HAL Library
+
+ *  Description: Host backend of the hardware abstraction layer, simulated peripherals
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "HAL.h"
+
+namespace HAL {
+    struct spi_t {
+        uint num;
+        uint baudrate;
+        uint data_bits;
+        uint cpol;
+        uint cpha;
+        sim::spi_stats stats;
+    };
+}
+
+namespace {
+    struct spi_attachment {
+        HAL::spi_t* spi;
+        uint csn_pin;
+        HAL::sim::SpiDevice* device;
+    };
+
+    struct gpio_state {
+        HAL::gpio_func func;
+        bool out;
+        bool pull_up;
+        bool value;
+        HAL::gpio_irq_callback_t irq_callback; // Falling edge interrupt
+        void* irq_user_data;
+    };
+
+    struct host_state {
+        HAL::spi_t spi[2];
+        gpio_state gpio[HAL::sim::NUM_GPIO];
+        HAL::sim::pwm_slice_state pwm[HAL::sim::NUM_PWM_SLICES];
+        int64_t pwm_start_tick[HAL::sim::NUM_PWM_SLICES];   // Clock tick the counter was last started from zero
+        uint64_t pwm_period[HAL::sim::NUM_PWM_SLICES];      // Index of the period the buffered levels were last latched in
+        bool pwm_dreq[HAL::sim::NUM_PWM_SLICES];            // Wrapped since DMA last wrote the compare register
+        std::vector<spi_attachment> spi_devices;
+        std::vector<HAL::sim::Process*> processes;
+        std::vector<HAL::repeating_timer_t*> timers;
+        std::vector<HAL::spi_dma_t*> dmas;
+        std::vector<HAL::pwm_dma_t*> pwm_dmas;
+        std::atomic<uint64_t> now_us{0};
+        uint64_t duration_us = 20000000u; // First boot calibration takes 15 s, then 5 s of control
+        const char* input = NULL; // Characters typed on the simulated USB serial, one per getchar
+        const char* flash_path = NULL; // File backing the simulated flash, NULL to start blank every run
+        std::vector<uint8_t> flash;
+        std::atomic<uint64_t> core1_launch_us{UINT64_MAX};
+        bool in_irq = false;
+
+        // Peripheral state is shared by both simulated cores
+        std::recursive_mutex mutex;
+
+        // Lockstep between the virtual clock and core 1
+        std::mutex clock_mutex;
+        std::condition_variable clock_cv;
+        std::thread core1;
+        bool core1_running = false;
+        bool core1_busy = false;
+        bool core0_done = false; // Core 0 has left main, core 1 drives the clock to finish up
+        uint64_t core1_wake_us = 0;
+
+        host_state() {
+            memset(spi, 0, sizeof(spi));
+            memset(gpio, 0, sizeof(gpio));
+            memset(pwm, 0, sizeof(pwm));
+            memset(pwm_start_tick, 0, sizeof(pwm_start_tick));
+            memset(pwm_period, 0, sizeof(pwm_period));
+            memset(pwm_dreq, 0, sizeof(pwm_dreq));
+            for(uint i = 0; i < 2; i++) {
+                spi[i].num = i;
+                spi[i].data_bits = 8;
+            }
+            for(uint i = 0; i < HAL::sim::NUM_PWM_SLICES; i++) {
+                pwm[i].top = 0xFFFF;
+            }
+            const char* env = getenv("SMARTKNOB_SIM_MS");
+            if(env != NULL) duration_us = strtoull(env, NULL, 10) * 1000u;
+            input = getenv("SMARTKNOB_INPUT");
+            flash.assign(HAL::FLASH_SIZE_BYTES, 0xFF); // Erased
+            flash_path = getenv("SMARTKNOB_FLASH");
+            if(flash_path != NULL) {
+                FILE* f = fopen(flash_path, "rb");
+                if(f != NULL) {
+                    size_t read = fread(flash.data(), 1, flash.size(), f);
+                    (void)read; // A short file leaves the rest erased
+                    fclose(f);
+                }
+            }
+        }
+    };
+
+    // Function local static so simulated devices can attach from static constructors
+    host_state& state(void) {
+        static host_state s;
+        return s;
+    }
+
+    thread_local int lock_depth = 0;
+    thread_local bool is_core1 = false;
+
+    /**
+     * @brief Scoped lock of the peripheral state, recursive so simulated devices can call back into the HAL
+    */
+    struct host_lock {
+        host_lock() { state().mutex.lock(); lock_depth++; }
+        ~host_lock() { lock_depth--; state().mutex.unlock(); }
+    };
+
+    /**
+     * @brief Block until core 1 has finished the work it was released for
+    */
+    void wait_for_core1(void) {
+        host_state& s = state();
+        std::unique_lock<std::mutex> lock(s.clock_mutex);
+        s.clock_cv.wait(lock, [&s] { return !s.core1_running || !s.core1_busy; });
+    }
+
+    /**
+     * @brief Release core 1 if the time it is waiting for has come
+    */
+    void release_core1(void) {
+        host_state& s = state();
+        std::lock_guard<std::mutex> lock(s.clock_mutex);
+        if(!s.core1_running) return;
+        if(!s.core1_busy && (s.now_us >= s.core1_wake_us || s.now_us >= s.duration_us)) {
+            s.core1_busy = true;
+            s.clock_cv.notify_all();
+        }
+    }
+
+    void join_core1(void) {
+        host_state& s = state();
+        {
+            std::lock_guard<std::mutex> lock(s.clock_mutex);
+            s.core1_busy = true;
+            s.core0_done = true;
+            s.clock_cv.notify_all();
+        }
+        if(s.core1.joinable()) s.core1.join();
+    }
+
+    /**
+     * @brief Fire every repeating timer that is due, emulating the timer interrupt
+    */
+    void service_timers(void) {
+        host_state& s = state();
+        if(s.in_irq) return;
+        s.in_irq = true;
+        for(size_t i = 0; i < s.timers.size(); i++) {
+            HAL::repeating_timer_t* t = s.timers[i];
+            while(t->callback != NULL && t->next_us <= s.now_us) {
+                uint64_t period = (t->delay_us < 0) ? (uint64_t)(-t->delay_us) : (uint64_t)t->delay_us;
+                t->next_us += period;
+                if(!t->callback(t)) t->callback = NULL;
+            }
+        }
+        s.in_irq = false;
+    }
+
+    /**
+     * @brief Finish every DMA transfer that is due, emulating the DMA completion interrupt
+    */
+    void service_dma(void) {
+        host_state& s = state();
+        for(HAL::spi_dma_t* dma : s.dmas) {
+            if(dma->busy && dma->done_us <= s.now_us) {
+                dma->busy = false;
+                if(dma->callback != NULL) dma->callback(dma->user_data);
+            }
+        }
+    }
+
+    const int64_t PWM_TICKS_PER_US = 125; // System clock with a clock divider of 1
+
+    /**
+     * @brief Clock ticks since a PWM slice counter was at zero
+    */
+    int64_t pwm_ticks(uint slice) {
+        host_state& s = state();
+        return (int64_t)s.now_us.load() * PWM_TICKS_PER_US - s.pwm_start_tick[slice];
+    }
+
+    /**
+     * @brief Clock ticks per PWM period, phase correct counts up to top and back down
+    */
+    int64_t pwm_period_ticks(uint slice) {
+        const HAL::sim::pwm_slice_state& p = state().pwm[slice];
+        return p.phase_correct ? 2 * ((int64_t)p.top + 1) : (int64_t)p.top + 1;
+    }
+
+    /**
+     * @brief Write a buffered compare level, a stopped slice takes it straight away
+    */
+    void write_pwm_level(uint slice, uint channel, uint16_t level) {
+        HAL::sim::pwm_slice_state& p = state().pwm[slice];
+        p.cc_buffer[channel] = level;
+        if(!p.enabled) p.cc[channel] = level;
+    }
+
+    /**
+     * @brief Give each streaming slice that has wrapped its next word, and call back when a stream is done
+    */
+    void service_pwm_dma(void) {
+        host_state& s = state();
+        for(HAL::pwm_dma_t* dma : s.pwm_dmas) {
+            if(!dma->busy) continue;
+            bool done = true;
+            for(uint i = 0; i < dma->count; i++) {
+                uint slice = dma->slices[i];
+                if(dma->remaining[i] > 0 && s.pwm_dreq[slice]) {
+                    uint32_t word = *dma->words[i]++;
+                    write_pwm_level(slice, 0, (uint16_t)word);
+                    write_pwm_level(slice, 1, (uint16_t)(word >> 16));
+                    s.pwm_dreq[slice] = false;
+                    dma->remaining[i]--;
+                }
+                if(dma->remaining[i] > 0) done = false;
+            }
+            if(done) {
+                dma->busy = false;
+                if(dma->callback != NULL) dma->callback(dma->user_data);
+            }
+        }
+    }
+
+    /**
+     * @brief Run the enabled PWM counters up to now and latch the buffered levels at each wrap
+    */
+    void service_pwm(void) {
+        host_state& s = state();
+        for(uint i = 0; i < HAL::sim::NUM_PWM_SLICES; i++) {
+            HAL::sim::pwm_slice_state& p = s.pwm[i];
+            if(!p.enabled) continue;
+            int64_t ticks = pwm_ticks(i);
+            int64_t period = pwm_period_ticks(i);
+            int64_t t = ticks % period;
+            p.counter = (uint16_t)((p.phase_correct && t > p.top) ? period - t : t);
+            if((uint64_t)(ticks / period) != s.pwm_period[i]) {
+                s.pwm_period[i] = ticks / period;
+                p.cc[0] = p.cc_buffer[0];
+                p.cc[1] = p.cc_buffer[1];
+                s.pwm_dreq[i] = true;
+            }
+        }
+        service_pwm_dma();
+    }
+
+    /**
+     * @brief Start a PWM counter from its current count
+    */
+    void start_pwm(uint slice) {
+        host_state& s = state();
+        s.pwm_start_tick[slice] = (int64_t)s.now_us.load() * PWM_TICKS_PER_US - s.pwm[slice].counter;
+        s.pwm_period[slice] = 0;
+        s.pwm_dreq[slice] = false;
+    }
+
+    /**
+     * @brief Move the virtual clock one step and run everything that happens in it
+    */
+    void step_clock(uint32_t dt) {
+        host_state& s = state();
+        host_lock lock;
+        s.now_us += dt;
+        service_pwm();
+        for(HAL::sim::Process* p : s.processes) p->step(s.now_us, dt);
+        service_dma();
+        service_timers();
+    }
+
+    /**
+     * @brief Baudrate the RP2040 divider search ends up with at a 125 MHz peripheral clock
+    */
+    uint actual_baudrate(uint baudrate) {
+        const uint freq_in = 125000000u;
+        uint prescale, postdiv;
+        for(prescale = 2; prescale <= 254; prescale += 2) {
+            if((uint64_t)freq_in < (uint64_t)(prescale + 2) * 256 * baudrate) break;
+        }
+        if(prescale > 254) prescale = 254;
+        for(postdiv = 256; postdiv > 1; postdiv--) {
+            if(freq_in / (prescale * (postdiv - 1)) > baudrate) break;
+        }
+        return freq_in / (prescale * postdiv);
+    }
+
+    HAL::sim::SpiDevice* selected_device(HAL::spi_t* spi) {
+        for(spi_attachment& a : state().spi_devices) {
+            if(a.spi == spi && !state().gpio[a.csn_pin].value) return a.device;
+        }
+        return NULL;
+    }
+
+    uint8_t transfer_byte(HAL::spi_t* spi, uint8_t tx) {
+        spi->stats.bytes++;
+        HAL::sim::SpiDevice* device = selected_device(spi);
+        if(device == NULL) return 0xFF;
+        return device->transfer(tx);
+    }
+}
+
+/******************************* SYSTEM *******************************/
+
+HAL::spi_t* HAL::spi_instance(uint num) {
+    return &state().spi[num & 0x01];
+}
+
+void HAL::init(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+/**
+ * @brief Start core 1 as a thread. It runs concurrently with core 0, but the virtual
+ *      clock does not move on while core 1 is busy between two busy_wait_until_us calls.
+*/
+void HAL::multicore_launch_core1(void (*entry)(void)) {
+    host_state& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.clock_mutex);
+        s.core1_running = true;
+        s.core1_busy = true;
+        s.core1_launch_us = s.now_us.load();
+    }
+    s.core1 = std::thread([entry, &s] {
+        is_core1 = true;
+        entry();
+        std::lock_guard<std::mutex> lock(s.clock_mutex);
+        s.core1_running = false;
+        s.clock_cv.notify_all();
+    });
+    atexit(join_core1);
+}
+
+uint HAL::get_core_num(void) {
+    return is_core1 ? 1 : 0;
+}
+
+int HAL::getchar_timeout_us(uint32_t timeout_us) {
+    (void)timeout_us;
+    host_lock lock;
+    host_state& s = state();
+    if(s.input == NULL || *s.input == '\0') return -1;
+    return (unsigned char)*s.input++;
+}
+
+void HAL::stdio_write(const uint8_t* data, size_t len) {
+    host_lock lock;
+    fwrite(data, 1, len, stdout);
+}
+
+bool HAL::running(void) {
+    return state().now_us < state().duration_us;
+}
+
+void HAL::tight_loop_contents(void) {
+    if(is_core1) {
+        busy_wait_until_us(state().now_us + sim::STEP_US);
+    } else {
+        sim::advance_us(sim::STEP_US);
+    }
+}
+
+/******************************* SYNC *******************************/
+
+void HAL::mutex_init(mutex_t* mutex) {
+    mutex->locked.store(false);
+}
+
+bool HAL::mutex_try_enter(mutex_t* mutex) {
+    return !mutex->locked.exchange(true, std::memory_order_acquire);
+}
+
+void HAL::mutex_enter_blocking(mutex_t* mutex) {
+    // Let time pass while waiting, the holder may be waiting on the clock itself
+    while(!mutex_try_enter(mutex)) tight_loop_contents();
+}
+
+void HAL::mutex_exit(mutex_t* mutex) {
+    mutex->locked.store(false, std::memory_order_release);
+}
+
+/******************************* TIME *******************************/
+
+void HAL::sleep_us(uint64_t us) {
+    if(is_core1) {
+        busy_wait_until_us(state().now_us + us);
+    } else {
+        sim::advance_us(us);
+    }
+}
+
+void HAL::sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t)ms * 1000u);
+}
+
+/**
+ * @brief Wait for an absolute time. On core 1 this hands the clock back to core 0 until then.
+*/
+void HAL::busy_wait_until_us(uint64_t time_us) {
+    host_state& s = state();
+    if(!is_core1) {
+        if(time_us > s.now_us) sim::advance_us(time_us - s.now_us);
+        return;
+    }
+    if(time_us <= s.now_us) return;
+    std::unique_lock<std::mutex> lock(s.clock_mutex);
+    if(s.core0_done) {
+        // Nobody else moves the clock any more, let pending transfers finish so core 1 can return
+        lock.unlock();
+        while(s.now_us < time_us) step_clock(sim::STEP_US);
+        return;
+    }
+    s.core1_wake_us = time_us;
+    s.core1_busy = false;
+    s.clock_cv.notify_all();
+    s.clock_cv.wait(lock, [&s] { return s.core1_busy; });
+}
+
+uint64_t HAL::time_us(void) {
+    return state().now_us;
+}
+
+bool HAL::add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out) {
+    host_lock lock;
+    if(delay_us == 0 || callback == NULL || out == NULL) return false;
+    out->delay_us = delay_us;
+    out->next_us = state().now_us + ((delay_us < 0) ? -delay_us : delay_us);
+    out->callback = callback;
+    out->user_data = user_data;
+    state().timers.push_back(out);
+    return true;
+}
+
+/******************************* SPI *******************************/
+
+uint HAL::spi_init(spi_t* spi, uint baudrate) {
+    return spi_set_baudrate(spi, baudrate);
+}
+
+uint HAL::spi_set_baudrate(spi_t* spi, uint baudrate) {
+    host_lock lock;
+    spi->baudrate = actual_baudrate(baudrate);
+    spi->stats.baudrate_writes++;
+    return spi->baudrate;
+}
+
+uint HAL::spi_get_baudrate(const spi_t* spi) {
+    return spi->baudrate;
+}
+
+HAL::spi_config_t HAL::spi_make_config(uint baudrate, uint data_bits, uint cpol, uint cpha) {
+    spi_config_t config = {actual_baudrate(baudrate), data_bits, cpol, cpha};
+    return config;
+}
+
+void HAL::spi_apply_config(spi_t* spi, const spi_config_t& config) {
+    host_lock lock;
+    spi->baudrate = config.baudrate;
+    spi->data_bits = config.data_bits;
+    spi->cpol = config.cpol;
+    spi->cpha = config.cpha;
+    spi->stats.config_writes++;
+}
+
+void HAL::spi_set_format(spi_t* spi, uint data_bits, uint cpol, uint cpha) {
+    host_lock lock;
+    spi->data_bits = data_bits;
+    spi->cpol = cpol;
+    spi->cpha = cpha;
+    spi->stats.format_writes++;
+}
+
+int HAL::spi_read_blocking(spi_t* spi, uint8_t repeated_tx_data, uint8_t* dst, size_t len) {
+    host_lock lock;
+    spi->stats.transfers++;
+    for(size_t i = 0; i < len; i++) dst[i] = transfer_byte(spi, repeated_tx_data);
+    return (int)len;
+}
+
+int HAL::spi_write_blocking(spi_t* spi, const uint8_t* src, size_t len) {
+    host_lock lock;
+    spi->stats.transfers++;
+    for(size_t i = 0; i < len; i++) transfer_byte(spi, src[i]);
+    return (int)len;
+}
+
+int HAL::spi_write_read_blocking(spi_t* spi, const uint8_t* src, uint8_t* dst, size_t len) {
+    host_lock lock;
+    spi->stats.transfers++;
+    for(size_t i = 0; i < len; i++) dst[i] = transfer_byte(spi, src[i]);
+    return (int)len;
+}
+
+bool HAL::spi_dma_init(spi_dma_t* dma, spi_t* spi, dma_callback_t callback, void* user_data) {
+    host_lock lock;
+    dma->spi = spi;
+    dma->callback = callback;
+    dma->user_data = user_data;
+    dma->done_us = 0;
+    dma->busy = false;
+    state().dmas.push_back(dma);
+    return true;
+}
+
+void HAL::spi_dma_read(spi_dma_t* dma, uint8_t repeated_tx_data, uint8_t* dst, size_t len) {
+    host_lock lock;
+    spi_t* spi = dma->spi;
+    spi->stats.dma_transfers++;
+    for(size_t i = 0; i < len; i++) dst[i] = transfer_byte(spi, repeated_tx_data);
+    uint64_t bits = (uint64_t)len * spi->data_bits;
+    uint64_t duration_us = (bits * 1000000u + spi->baudrate - 1) / ((spi->baudrate > 0) ? spi->baudrate : 1);
+    dma->done_us = state().now_us + ((duration_us > 0) ? duration_us : 1);
+    dma->busy = true;
+}
+
+void HAL::spi_dma_transfer(spi_dma_t* dma, const uint8_t* src, uint8_t* dst, size_t len) {
+    host_lock lock;
+    spi_t* spi = dma->spi;
+    spi->stats.dma_transfers++;
+    for(size_t i = 0; i < len; i++) dst[i] = transfer_byte(spi, src[i]);
+    uint64_t bits = (uint64_t)len * spi->data_bits;
+    uint64_t duration_us = (bits * 1000000u + spi->baudrate - 1) / ((spi->baudrate > 0) ? spi->baudrate : 1);
+    dma->done_us = state().now_us + ((duration_us > 0) ? duration_us : 1);
+    dma->busy = true;
+}
+
+bool HAL::spi_dma_busy(const spi_dma_t* dma) {
+    host_lock lock;
+    return dma->busy;
+}
+
+/******************************* GPIO *******************************/
+
+void HAL::gpio_init(uint pin) {
+    host_lock lock;
+    gpio_state& g = state().gpio[pin];
+    g.func = gpio_func::SIO;
+    g.out = false;
+    g.value = false;
+}
+
+void HAL::gpio_set_dir(uint pin, bool out) {
+    host_lock lock;
+    state().gpio[pin].out = out;
+}
+
+void HAL::gpio_pull_up(uint pin) {
+    host_lock lock;
+    gpio_state& g = state().gpio[pin];
+    g.pull_up = true;
+    if(!g.out) g.value = true;
+}
+
+void HAL::gpio_put(uint pin, bool value) {
+    host_lock lock;
+    gpio_state& g = state().gpio[pin];
+    if(g.value == value) return;
+    g.value = value;
+    for(spi_attachment& a : state().spi_devices) {
+        if(a.csn_pin == pin) a.device->select(!value);
+    }
+}
+
+bool HAL::gpio_get(uint pin) {
+    host_lock lock;
+    return state().gpio[pin].value;
+}
+
+void HAL::gpio_set_irq_handler(uint pin, gpio_irq_callback_t callback, void* user_data) {
+    host_lock lock;
+    gpio_state& g = state().gpio[pin];
+    g.irq_callback = callback;
+    g.irq_user_data = user_data;
+}
+
+void HAL::gpio_set_function(uint pin, gpio_func func) {
+    host_lock lock;
+    state().gpio[pin].func = func;
+}
+
+/******************************* PWM *******************************/
+
+uint HAL::pwm_gpio_to_slice_num(uint gpio) {
+    return (gpio >> 1u) & 7u;
+}
+
+uint HAL::pwm_gpio_to_channel(uint gpio) {
+    return gpio & 1u;
+}
+
+void HAL::pwm_set_clkdiv_int_frac(uint slice, uint8_t integer, uint8_t fract) {
+    (void)slice; (void)integer; (void)fract;
+}
+
+void HAL::pwm_set_phase_correct(uint slice, bool phase_correct) {
+    host_lock lock;
+    state().pwm[slice].phase_correct = phase_correct;
+}
+
+void HAL::pwm_set_wrap(uint slice, uint16_t wrap) {
+    host_lock lock;
+    state().pwm[slice].top = wrap;
+}
+
+uint16_t HAL::pwm_get_wrap(uint slice) {
+    host_lock lock;
+    return state().pwm[slice].top;
+}
+
+void HAL::pwm_set_chan_level(uint slice, uint channel, uint16_t level) {
+    host_lock lock;
+    write_pwm_level(slice, channel & 1u, level);
+}
+
+void HAL::pwm_set_both_levels(uint slice, uint16_t level_a, uint16_t level_b) {
+    host_lock lock;
+    write_pwm_level(slice, 0, level_a);
+    write_pwm_level(slice, 1, level_b);
+}
+
+void HAL::pwm_set_enabled(uint slice, bool enabled) {
+    host_lock lock;
+    sim::pwm_slice_state& p = state().pwm[slice];
+    if(enabled && !p.enabled) start_pwm(slice);
+    p.enabled = enabled;
+}
+
+void HAL::pwm_set_counter(uint slice, uint16_t count) {
+    host_lock lock;
+    state().pwm[slice].counter = count;
+    if(state().pwm[slice].enabled) start_pwm(slice);
+}
+
+uint16_t HAL::pwm_get_counter(uint slice) {
+    host_lock lock;
+    return state().pwm[slice].counter;
+}
+
+void HAL::pwm_set_mask_enabled(uint32_t mask) {
+    host_lock lock;
+    for(uint i = 0; i < sim::NUM_PWM_SLICES; i++) {
+        pwm_set_enabled(i, (mask >> i) & 1u);
+    }
+}
+
+void HAL::pwm_set_channel_inverted(uint slice, uint channel, bool inverted) {
+    host_lock lock;
+    state().pwm[slice].inverted[channel & 1u] = inverted;
+}
+
+bool HAL::pwm_dma_init(pwm_dma_t* dma, const uint* slices, uint count, dma_callback_t callback, void* user_data) {
+    if(count == 0 || count > PWM_DMA_MAX_SLICES) return false;
+    host_lock lock;
+    for(uint i = 0; i < count; i++) {
+        dma->slices[i] = slices[i];
+        dma->words[i] = NULL;
+        dma->remaining[i] = 0;
+    }
+    dma->count = count;
+    dma->callback = callback;
+    dma->user_data = user_data;
+    dma->busy = false;
+    state().pwm_dmas.push_back(dma);
+    return true;
+}
+
+/**
+ * @brief Start streaming, a slice that wrapped since its last DMA write takes the first word right away
+*/
+void HAL::pwm_dma_start(pwm_dma_t* dma, const uint32_t* const* words, size_t len) {
+    host_lock lock;
+    for(uint i = 0; i < dma->count; i++) {
+        dma->words[i] = words[i];
+        dma->remaining[i] = len;
+    }
+    dma->busy = true;
+    service_pwm_dma();
+}
+
+bool HAL::pwm_dma_busy(const pwm_dma_t* dma) {
+    host_lock lock;
+    return dma->busy;
+}
+
+void HAL::pwm_dma_abort(pwm_dma_t* dma) {
+    host_lock lock;
+    for(uint i = 0; i < dma->count; i++) dma->remaining[i] = 0;
+    dma->busy = false;
+}
+
+/******************************* FLASH *******************************/
+
+void HAL::flash_read(uint32_t offset, void* dst, size_t len) {
+    host_lock lock;
+    memcpy(dst, &state().flash[offset], len);
+}
+
+/**
+ * @brief Erase and program like the Pico SDK would, and write the image back to SMARTKNOB_FLASH if set
+*/
+bool HAL::flash_write(uint32_t offset, const void* src, size_t len) {
+    host_lock lock;
+    host_state& s = state();
+    if(offset % FLASH_SECTOR_BYTES != 0 || offset + len > FLASH_SIZE_BYTES) return false;
+    uint32_t erase_len = (len + FLASH_SECTOR_BYTES - 1) / FLASH_SECTOR_BYTES * FLASH_SECTOR_BYTES;
+    memset(&s.flash[offset], 0xFF, erase_len);
+    memcpy(&s.flash[offset], src, len);
+    if(s.flash_path != NULL) {
+        FILE* f = fopen(s.flash_path, "wb");
+        if(f == NULL) return false;
+        size_t written = fwrite(s.flash.data(), 1, s.flash.size(), f);
+        fclose(f);
+        if(written != s.flash.size()) return false;
+    }
+    return true;
+}
+
+/******************************* SIMULATION *******************************/
+
+void HAL::sim::attach_spi_device(spi_t* spi, uint csn_pin, SpiDevice* device) {
+    host_lock lock;
+    state().spi_devices.push_back({spi, csn_pin, device});
+}
+
+void HAL::sim::add_process(Process* process) {
+    host_lock lock;
+    state().processes.push_back(process);
+}
+
+/**
+ * @brief Drive an input pin from a simulated device, a falling edge runs the pin's interrupt right away
+ * @param value Level to drive, true releases an open drain output to its pull-up
+*/
+void HAL::sim::drive_gpio(uint pin, bool value) {
+    host_lock lock;
+    gpio_state& g = state().gpio[pin];
+    if(g.out) return;
+    bool level = value ? g.pull_up : false;
+    bool falling = g.value && !level;
+    g.value = level;
+    if(falling && g.irq_callback != NULL) g.irq_callback(g.irq_user_data);
+}
+
+const HAL::sim::pwm_slice_state& HAL::sim::pwm_slice(uint slice) {
+    return state().pwm[slice];
+}
+
+/**
+ * @brief Get the duty cycle a GPIO sees, taking inversion into account
+ * @param gpio GPIO pin number
+ * @return Duty cycle [0, 1], 0 if the slice is disabled
+*/
+float HAL::sim::pwm_duty(uint gpio) {
+    host_lock lock;
+    const pwm_slice_state& p = state().pwm[pwm_gpio_to_slice_num(gpio)];
+    uint channel = pwm_gpio_to_channel(gpio);
+    if(!p.enabled) return 0.0f;
+    float duty = (float)p.cc[channel] / ((float)p.top + 1.0f);
+    if(duty > 1.0f) duty = 1.0f;
+    return p.inverted[channel] ? 1.0f - duty : duty;
+}
+
+const HAL::sim::spi_stats& HAL::sim::spi_statistics(spi_t* spi) {
+    return spi->stats;
+}
+
+void HAL::sim::reset_statistics(void) {
+    host_lock lock;
+    for(uint i = 0; i < 2; i++) memset(&state().spi[i].stats, 0, sizeof(spi_stats));
+}
+
+void HAL::sim::set_duration_us(uint64_t duration_us) {
+    state().duration_us = duration_us;
+}
+
+uint64_t HAL::sim::core1_launch_us(void) {
+    return state().core1_launch_us;
+}
+
+/**
+ * @brief Advance virtual time, stepping every process and firing due timers along the way
+ * @param us Number of microseconds to advance
+*/
+void HAL::sim::advance_us(uint64_t us) {
+    while(us > 0) {
+        // Core 1 has to finish its tick before time moves on, unless we are called from inside a lock
+        if(lock_depth == 0) wait_for_core1();
+        uint32_t dt = (us > STEP_US) ? STEP_US : (uint32_t)us;
+        step_clock(dt);
+        us -= dt;
+        release_core1();
+    }
+}
@@ -0,0 +1,238 @@
+/*
+ *  Title: HAL Library
+
+ *  Description: Host backend of the hardware abstraction layer.
+ *      Peripherals are simulated in software and time is virtual, it only moves
+ *      forward through sleep_us/sleep_ms and tight_loop_contents. Repeating timers
+ *      fire synchronously as time passes, just like an interrupt would preempt.
+ *      Set SMARTKNOB_INPUT to feed characters to getchar_timeout_us and SMARTKNOB_FLASH
+ *      to a file to keep the simulated flash between runs.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <atomic>
+
+typedef unsigned int uint;
+
+namespace HAL {
+    struct spi_t;
+    struct repeating_timer_t;
+    typedef bool (*repeating_timer_callback_t)(repeating_timer_t* t);
+
+    /**
+     * @brief Mirrors the fields of the Pico SDK repeating_timer struct that are used
+    */
+    struct repeating_timer_t {
+        int64_t delay_us;
+        uint64_t next_us;
+        repeating_timer_callback_t callback;
+        void* user_data;
+    };
+
+    spi_t* spi_instance(uint num);
+
+    /**
+     * @brief Lock shared by both cores, waiting on it keeps the virtual clock moving
+    */
+    struct mutex_t {
+        std::atomic<bool> locked;
+    };
+
+    /**
+     * @brief Precomputed SPI settings, applying them counts as a single configuration write
+    */
+    struct spi_config_t {
+        uint baudrate;
+        uint data_bits;
+        uint cpol;
+        uint cpha;
+    };
+
+    typedef void (*dma_callback_t)(void* user_data);
+    typedef void (*gpio_irq_callback_t)(void* user_data);
+
+    /**
+     * @brief Simulated pair of DMA channels between memory and an SPI peripheral.
+     *      The bytes move when the transfer starts, the completion callback fires once the
+     *      virtual clock has covered the time the transfer takes at the current baudrate.
+    */
+    struct spi_dma_t {
+        spi_t* spi;
+        dma_callback_t callback;
+        void* user_data;
+        uint64_t done_us;
+        bool busy;
+    };
+
+    const uint PWM_DMA_MAX_SLICES = 3;
+
+    /**
+     * @brief Simulated DMA channels streaming 32 bit words into PWM compare registers.
+     *      Each slice takes one word when its counter wraps, like the RP2040 wrap DREQ.
+    */
+    struct pwm_dma_t {
+        dma_callback_t callback;
+        void* user_data;
+        uint slices[PWM_DMA_MAX_SLICES];
+        const uint32_t* words[PWM_DMA_MAX_SLICES];
+        size_t remaining[PWM_DMA_MAX_SLICES];
+        uint count;
+        bool busy;
+    };
+
+    /******************************* SYSTEM *******************************/
+
+    void init(void);
+    bool running(void);
+    void tight_loop_contents(void);
+    void multicore_launch_core1(void (*entry)(void));
+    uint get_core_num(void);
+
+    /******************************* SYNC *******************************/
+
+    void mutex_init(mutex_t* mutex);
+    bool mutex_try_enter(mutex_t* mutex);
+    void mutex_enter_blocking(mutex_t* mutex);
+    void mutex_exit(mutex_t* mutex);
+    int getchar_timeout_us(uint32_t timeout_us);
+    void stdio_write(const uint8_t* data, size_t len);
+
+    /******************************* TIME *******************************/
+
+    void sleep_us(uint64_t us);
+    void sleep_ms(uint32_t ms);
+    uint64_t time_us(void);
+    void busy_wait_until_us(uint64_t time_us);
+    bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out);
+
+    /******************************* SPI *******************************/
+
+    uint spi_init(spi_t* spi, uint baudrate);
+    uint spi_set_baudrate(spi_t* spi, uint baudrate);
+    uint spi_get_baudrate(const spi_t* spi);
+    spi_config_t spi_make_config(uint baudrate, uint data_bits, uint cpol, uint cpha);
+    void spi_apply_config(spi_t* spi, const spi_config_t& config);
+    void spi_set_format(spi_t* spi, uint data_bits, uint cpol, uint cpha);
+    int spi_read_blocking(spi_t* spi, uint8_t repeated_tx_data, uint8_t* dst, size_t len);
+    int spi_write_blocking(spi_t* spi, const uint8_t* src, size_t len);
+    int spi_write_read_blocking(spi_t* spi, const uint8_t* src, uint8_t* dst, size_t len);
+    bool spi_dma_init(spi_dma_t* dma, spi_t* spi, dma_callback_t callback, void* user_data);
+    void spi_dma_read(spi_dma_t* dma, uint8_t repeated_tx_data, uint8_t* dst, size_t len);
+    void spi_dma_transfer(spi_dma_t* dma, const uint8_t* src, uint8_t* dst, size_t len);
+    bool spi_dma_busy(const spi_dma_t* dma);
+
+    /******************************* GPIO *******************************/
+
+    void gpio_init(uint pin);
+    void gpio_set_dir(uint pin, bool out);
+    void gpio_pull_up(uint pin);
+    void gpio_put(uint pin, bool value);
+    bool gpio_get(uint pin);
+    void gpio_set_irq_handler(uint pin, gpio_irq_callback_t callback, void* user_data);
+    void gpio_set_function(uint pin, gpio_func func);
+
+    /******************************* PWM *******************************/
+
+    uint pwm_gpio_to_slice_num(uint gpio);
+    uint pwm_gpio_to_channel(uint gpio);
+    void pwm_set_clkdiv_int_frac(uint slice, uint8_t integer, uint8_t fract);
+    void pwm_set_phase_correct(uint slice, bool phase_correct);
+    void pwm_set_wrap(uint slice, uint16_t wrap);
+    uint16_t pwm_get_wrap(uint slice);
+    void pwm_set_chan_level(uint slice, uint channel, uint16_t level);
+    void pwm_set_both_levels(uint slice, uint16_t level_a, uint16_t level_b);
+    void pwm_set_enabled(uint slice, bool enabled);
+    void pwm_set_counter(uint slice, uint16_t count);
+    uint16_t pwm_get_counter(uint slice);
+    void pwm_set_mask_enabled(uint32_t mask);
+    void pwm_set_channel_inverted(uint slice, uint channel, bool inverted);
+    bool pwm_dma_init(pwm_dma_t* dma, const uint* slices, uint count, dma_callback_t callback, void* user_data);
+    void pwm_dma_start(pwm_dma_t* dma, const uint32_t* const* words, size_t len);
+    bool pwm_dma_busy(const pwm_dma_t* dma);
+    void pwm_dma_abort(pwm_dma_t* dma);
+
+    /******************************* FLASH *******************************/
+
+    const uint32_t FLASH_SECTOR_BYTES = 4096;
+    const uint32_t FLASH_SIZE_BYTES = 2u * 1024u * 1024u;
+
+    void flash_read(uint32_t offset, void* dst, size_t len);
+    bool flash_write(uint32_t offset, const void* src, size_t len);
+
+    /**
+     * @brief Hooks for simulated devices to attach to the host peripherals
+    */
+    namespace sim {
+        const uint32_t STEP_US = 10; // Resolution of the virtual clock in us
+        const uint NUM_GPIO = 30;
+        const uint NUM_PWM_SLICES = 8;
+
+        /**
+         * @brief A device on a simulated SPI bus, selected by its chip select pin going low
+        */
+        class SpiDevice {
+        public:
+            virtual ~SpiDevice() {};
+            virtual void select(bool selected) {};
+            virtual uint8_t transfer(uint8_t tx) = 0;
+        };
+
+        /**
+         * @brief Anything that evolves with time, a motor model for example
+        */
+        class Process {
+        public:
+            virtual ~Process() {};
+            virtual void step(uint64_t now_us, uint32_t dt_us) = 0;
+        };
+
+        void attach_spi_device(spi_t* spi, uint csn_pin, SpiDevice* device);
+        void add_process(Process* process);
+        void drive_gpio(uint pin, bool value);
+
+        /**
+         * @brief Snapshot of a simulated PWM slice. Like the RP2040 the compare levels are
+         *      double buffered, writes land in cc_buffer and are copied to cc when the counter
+         *      wraps to zero, right away if the slice is disabled. The counter runs at 125 MHz.
+        */
+        struct pwm_slice_state {
+            uint16_t top;
+            uint16_t cc[2];         // Levels the outputs use
+            uint16_t cc_buffer[2];  // Levels written since the last wrap
+            bool inverted[2];
+            bool phase_correct;
+            bool enabled;
+            uint16_t counter;
+        };
+
+        const pwm_slice_state& pwm_slice(uint slice);
+        float pwm_duty(uint gpio);
+
+        /**
+         * @brief Bus statistics, useful for counting configuration writes per tick
+        */
+        struct spi_stats {
+            uint32_t transfers;
+            uint32_t bytes;
+            uint32_t baudrate_writes;
+            uint32_t format_writes;
+            uint32_t dma_transfers;
+            uint32_t config_writes;
+        };
+
+        const spi_stats& spi_statistics(spi_t* spi);
+        void reset_statistics(void);
+
+        void set_duration_us(uint64_t duration_us);
+        uint64_t core1_launch_us(void); // UINT64_MAX until core 1 is launched
+        void advance_us(uint64_t us);
+    }
+}
+
+#define spi0 (HAL::spi_instance(0))
+#define spi1 (HAL::spi_instance(1))
@@ -0,0 +1,443 @@
+/*
+ *  Title: HAL Library
+
+ *  Description: Pico SDK backend of the hardware abstraction layer.
+ *      Everything is inline so the wrappers cost nothing in the control loop.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <pico/stdlib.h>
+#include <pico/time.h>
+#include <hardware/spi.h>
+#include <hardware/gpio.h>
+#include <hardware/pwm.h>
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <pico/multicore.h>
+#include <pico/mutex.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <string.h>
+
+namespace HAL {
+    typedef spi_inst_t spi_t;
+    typedef struct ::repeating_timer repeating_timer_t;
+    typedef bool (*repeating_timer_callback_t)(repeating_timer_t* t);
+    typedef void (*dma_callback_t)(void* user_data);
+    typedef void (*gpio_irq_callback_t)(void* user_data);
+    typedef ::mutex_t mutex_t;
+
+    /**
+     * @brief Precomputed SPI clock divider and frame format, applied in two register writes
+    */
+    struct spi_config_t {
+        uint32_t cr0;
+        uint32_t cpsr;
+    };
+
+    /**
+     * @brief A pair of DMA channels between memory and an SPI peripheral, TX repeats one byte
+    */
+    struct spi_dma_t {
+        spi_t* spi;
+        dma_callback_t callback;
+        void* user_data;
+        int tx_channel;
+        int rx_channel;
+        uint8_t tx_data;
+    };
+
+    const uint PWM_DMA_MAX_SLICES = 3;
+
+    /**
+     * @brief One DMA channel per PWM slice writing 32 bit words to its compare register,
+     *      each paced by the wrap of its own slice
+    */
+    struct pwm_dma_t {
+        dma_callback_t callback;
+        void* user_data;
+        uint slices[PWM_DMA_MAX_SLICES];
+        int channels[PWM_DMA_MAX_SLICES];
+        uint count;
+    };
+
+    namespace detail {
+        struct dma_handler_t {
+            dma_callback_t callback;
+            void* user_data;
+            uint irq_index;     // 0 for DMA_IRQ_0, 1 for DMA_IRQ_1
+        };
+
+        inline dma_handler_t dma_handlers[NUM_DMA_CHANNELS];
+        inline bool dma_irq_installed[2] = {false, false};
+
+        inline void dma_irq_dispatch(uint irq_index) {
+            for(uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+                const dma_handler_t& handler = dma_handlers[ch];
+                if(handler.callback != NULL && handler.irq_index == irq_index && dma_irqn_get_channel_status(irq_index, ch)) {
+                    dma_irqn_acknowledge_channel(irq_index, ch);
+                    handler.callback(handler.user_data);
+                }
+            }
+        }
+        inline void dma_irq0_handler(void) { dma_irq_dispatch(0); }
+        inline void dma_irq1_handler(void) { dma_irq_dispatch(1); }
+
+        /**
+         * @brief Call back when a channel finishes, on the core that calls this. Core 0 gets DMA_IRQ_0
+         *      and core 1 DMA_IRQ_1, so neither core ever takes the other one's channels.
+        */
+        inline void dma_set_handler(int channel, dma_callback_t callback, void* user_data) {
+            uint irq_index = ::get_core_num();
+            dma_handlers[channel].callback = callback;
+            dma_handlers[channel].user_data = user_data;
+            dma_handlers[channel].irq_index = irq_index;
+            dma_irqn_set_channel_enabled(irq_index, channel, true);
+            if(!dma_irq_installed[irq_index]) {
+                uint irq = (irq_index == 0) ? DMA_IRQ_0 : DMA_IRQ_1;
+                irq_add_shared_handler(irq, (irq_index == 0) ? dma_irq0_handler : dma_irq1_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+                irq_set_enabled(irq, true);
+                dma_irq_installed[irq_index] = true;
+            }
+        }
+
+        struct gpio_handler_t {
+            gpio_irq_callback_t callback;
+            void* user_data;
+        };
+
+        inline gpio_handler_t gpio_handlers[NUM_BANK0_GPIOS];
+        inline bool gpio_irq_installed[2] = {false, false};
+
+        inline void gpio_irq_handler(void) {
+            for(uint pin = 0; pin < NUM_BANK0_GPIOS; pin++) {
+                if(gpio_handlers[pin].callback != NULL && (gpio_get_irq_event_mask(pin) & GPIO_IRQ_EDGE_FALL)) {
+                    gpio_acknowledge_irq(pin, GPIO_IRQ_EDGE_FALL);
+                    gpio_handlers[pin].callback(gpio_handlers[pin].user_data);
+                }
+            }
+        }
+    }
+
+    /******************************* SYSTEM *******************************/
+
+    inline void init(void) { stdio_init_all(); }
+    inline bool running(void) { return true; }
+    inline void tight_loop_contents(void) { ::tight_loop_contents(); }
+    inline void multicore_launch_core1(void (*entry)(void)) { ::multicore_launch_core1(entry); }
+    inline uint get_core_num(void) { return ::get_core_num(); }
+
+    /******************************* SYNC *******************************/
+
+    inline void mutex_init(mutex_t* mutex) { ::mutex_init(mutex); }
+    inline bool mutex_try_enter(mutex_t* mutex) { return ::mutex_try_enter(mutex, NULL); }
+    inline void mutex_enter_blocking(mutex_t* mutex) { ::mutex_enter_blocking(mutex); }
+    inline void mutex_exit(mutex_t* mutex) { ::mutex_exit(mutex); }
+    inline int getchar_timeout_us(uint32_t timeout_us) { return ::getchar_timeout_us(timeout_us); }
+
+    /**
+     * @brief Write raw bytes to stdio, no CR/LF translation so binary data survives
+    */
+    inline void stdio_write(const uint8_t* data, size_t len) {
+        for(size_t i = 0; i < len; i++) putchar_raw(data[i]);
+    }
+
+    /******************************* TIME *******************************/
+
+    inline void sleep_us(uint64_t us) { ::sleep_us(us); }
+    inline void sleep_ms(uint32_t ms) { ::sleep_ms(ms); }
+    inline uint64_t time_us(void) { return time_us_64(); }
+    inline void busy_wait_until_us(uint64_t time_us) { ::busy_wait_until(from_us_since_boot(time_us)); }
+
+    inline bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out) {
+        return ::add_repeating_timer_us(delay_us, callback, user_data, out);
+    }
+
+    /******************************* SPI *******************************/
+
+    inline uint spi_init(spi_t* spi, uint baudrate) { return ::spi_init(spi, baudrate); }
+    inline uint spi_set_baudrate(spi_t* spi, uint baudrate) { return ::spi_set_baudrate(spi, baudrate); }
+    inline uint spi_get_baudrate(const spi_t* spi) { return ::spi_get_baudrate(spi); }
+
+    /**
+     * @brief Work out the register values for a baudrate and format, same divider search as spi_set_baudrate
+     * @param data_bits Number of data bits per frame
+     * @param cpol Clock polarity, 0 or 1
+     * @param cpha Clock phase, 0 or 1
+    */
+    inline spi_config_t spi_make_config(uint baudrate, uint data_bits, uint cpol, uint cpha) {
+        uint freq_in = clock_get_hz(clk_peri);
+        uint prescale, postdiv;
+        for(prescale = 2; prescale <= 254; prescale += 2) {
+            if(freq_in < (prescale + 2) * 256 * (uint64_t)baudrate) break;
+        }
+        for(postdiv = 256; postdiv > 1; postdiv--) {
+            if(freq_in / (prescale * (postdiv - 1)) > baudrate) break;
+        }
+        spi_config_t config;
+        config.cpsr = prescale;
+        config.cr0 = ((postdiv - 1) << SPI_SSPCR0_SCR_LSB) | (cpha << SPI_SSPCR0_SPH_LSB) |
+                     (cpol << SPI_SSPCR0_SPO_LSB) | ((data_bits - 1) << SPI_SSPCR0_DSS_LSB);
+        return config;
+    }
+
+    /**
+     * @brief Switch the peripheral to a precomputed configuration, always MSB first
+    */
+    inline void spi_apply_config(spi_t* spi, const spi_config_t& config) {
+        spi_hw_t* hw = spi_get_hw(spi);
+        uint32_t enable = hw->cr1 & SPI_SSPCR1_SSE_BITS; // The format can only change while disabled
+        hw_clear_bits(&hw->cr1, SPI_SSPCR1_SSE_BITS);
+        hw->cpsr = config.cpsr;
+        hw->cr0 = config.cr0;
+        hw_set_bits(&hw->cr1, enable);
+    }
+
+    /**
+     * @brief Set SPI frame format, always MSB first
+     * @param data_bits Number of data bits per frame
+     * @param cpol Clock polarity, 0 or 1
+     * @param cpha Clock phase, 0 or 1
+    */
+    inline void spi_set_format(spi_t* spi, uint data_bits, uint cpol, uint cpha) {
+        ::spi_set_format(spi, data_bits, (spi_cpol_t)cpol, (spi_cpha_t)cpha, SPI_MSB_FIRST);
+    }
+
+    inline int spi_read_blocking(spi_t* spi, uint8_t repeated_tx_data, uint8_t* dst, size_t len) {
+        return ::spi_read_blocking(spi, repeated_tx_data, dst, len);
+    }
+    inline int spi_write_blocking(spi_t* spi, const uint8_t* src, size_t len) {
+        return ::spi_write_blocking(spi, src, len);
+    }
+    inline int spi_write_read_blocking(spi_t* spi, const uint8_t* src, uint8_t* dst, size_t len) {
+        return ::spi_write_read_blocking(spi, src, dst, len);
+    }
+
+    /**
+     * @brief Claim and configure DMA channels for SPI transfers.
+     *      The completion interrupt runs on the core that calls this.
+     * @param callback Called from the interrupt when the receive side has finished
+     * @return True if successful, false if there are no free channels
+    */
+    inline bool spi_dma_init(spi_dma_t* dma, spi_t* spi, dma_callback_t callback, void* user_data) {
+        int tx = dma_claim_unused_channel(false);
+        int rx = dma_claim_unused_channel(false);
+        if(tx < 0 || rx < 0) return false;
+        dma->spi = spi;
+        dma->callback = callback;
+        dma->user_data = user_data;
+        dma->tx_channel = tx;
+        dma->rx_channel = rx;
+        dma->tx_data = 0;
+
+        dma_channel_config c = dma_channel_get_default_config(tx);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, false);
+        channel_config_set_dreq(&c, spi_get_dreq(spi, true));
+        dma_channel_configure(tx, &c, &spi_get_hw(spi)->dr, &dma->tx_data, 0, false);
+
+        c = dma_channel_get_default_config(rx);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_dreq(&c, spi_get_dreq(spi, false));
+        dma_channel_configure(rx, &c, NULL, &spi_get_hw(spi)->dr, 0, false);
+
+        detail::dma_set_handler(rx, callback, user_data);
+        return true;
+    }
+
+    /**
+     * @brief Start reading len bytes while clocking out repeated_tx_data, returns immediately
+    */
+    inline void spi_dma_read(spi_dma_t* dma, uint8_t repeated_tx_data, uint8_t* dst, size_t len) {
+        dma->tx_data = repeated_tx_data;
+        dma_channel_config c = dma_get_channel_config(dma->tx_channel);
+        channel_config_set_read_increment(&c, false);
+        dma_channel_set_config(dma->tx_channel, &c, false);
+        dma_channel_set_write_addr(dma->rx_channel, dst, false);
+        dma_channel_set_trans_count(dma->rx_channel, len, false);
+        dma_channel_set_read_addr(dma->tx_channel, &dma->tx_data, false);
+        dma_channel_set_trans_count(dma->tx_channel, len, false);
+        dma_start_channel_mask((1u << dma->tx_channel) | (1u << dma->rx_channel));
+    }
+
+    /**
+     * @brief Start clocking out len bytes from src while reading len bytes into dst, returns immediately
+    */
+    inline void spi_dma_transfer(spi_dma_t* dma, const uint8_t* src, uint8_t* dst, size_t len) {
+        dma_channel_config c = dma_get_channel_config(dma->tx_channel);
+        channel_config_set_read_increment(&c, true);
+        dma_channel_set_config(dma->tx_channel, &c, false);
+        dma_channel_set_write_addr(dma->rx_channel, dst, false);
+        dma_channel_set_trans_count(dma->rx_channel, len, false);
+        dma_channel_set_read_addr(dma->tx_channel, src, false);
+        dma_channel_set_trans_count(dma->tx_channel, len, false);
+        dma_start_channel_mask((1u << dma->tx_channel) | (1u << dma->rx_channel));
+    }
+
+    inline bool spi_dma_busy(const spi_dma_t* dma) { return dma_channel_is_busy(dma->rx_channel); }
+
+    /******************************* GPIO *******************************/
+
+    inline void gpio_init(uint pin) { ::gpio_init(pin); }
+    inline void gpio_set_dir(uint pin, bool out) { ::gpio_set_dir(pin, out); }
+    inline void gpio_pull_up(uint pin) { ::gpio_pull_up(pin); }
+    inline void gpio_put(uint pin, bool value) { ::gpio_put(pin, value); }
+    inline bool gpio_get(uint pin) { return ::gpio_get(pin); }
+
+    /**
+     * @brief Call back on every falling edge of a pin, from IO_IRQ_BANK0 on the core that calls this
+     * @param callback NULL to stop the interrupts
+    */
+    inline void gpio_set_irq_handler(uint pin, gpio_irq_callback_t callback, void* user_data) {
+        gpio_set_irq_enabled(pin, GPIO_IRQ_EDGE_FALL, false);
+        detail::gpio_handlers[pin].callback = callback;
+        detail::gpio_handlers[pin].user_data = user_data;
+        if(callback == NULL) return;
+        uint core = ::get_core_num();
+        if(!detail::gpio_irq_installed[core]) {
+            irq_add_shared_handler(IO_IRQ_BANK0, detail::gpio_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+            irq_set_enabled(IO_IRQ_BANK0, true);
+            detail::gpio_irq_installed[core] = true;
+        }
+        gpio_acknowledge_irq(pin, GPIO_IRQ_EDGE_FALL); // Drop an edge from before
+        gpio_set_irq_enabled(pin, GPIO_IRQ_EDGE_FALL, true);
+    }
+
+    inline void gpio_set_function(uint pin, gpio_func func) {
+        switch(func) {
+            case gpio_func::SPI: ::gpio_set_function(pin, GPIO_FUNC_SPI); break;
+            case gpio_func::PWM: ::gpio_set_function(pin, GPIO_FUNC_PWM); break;
+            default:             ::gpio_set_function(pin, GPIO_FUNC_SIO); break;
+        }
+    }
+
+    /******************************* PWM *******************************/
+
+    inline uint pwm_gpio_to_slice_num(uint gpio) { return ::pwm_gpio_to_slice_num(gpio); }
+    inline uint pwm_gpio_to_channel(uint gpio) { return ::pwm_gpio_to_channel(gpio); }
+    inline void pwm_set_clkdiv_int_frac(uint slice, uint8_t integer, uint8_t fract) { ::pwm_set_clkdiv_int_frac(slice, integer, fract); }
+    inline void pwm_set_phase_correct(uint slice, bool phase_correct) { ::pwm_set_phase_correct(slice, phase_correct); }
+    inline void pwm_set_wrap(uint slice, uint16_t wrap) { ::pwm_set_wrap(slice, wrap); }
+    inline uint16_t pwm_get_wrap(uint slice) { return pwm_hw->slice[slice].top; }
+    inline void pwm_set_chan_level(uint slice, uint channel, uint16_t level) { ::pwm_set_chan_level(slice, channel, level); }
+    // Both channels in one 32 bit store to CC, no read-modify-write
+    inline void pwm_set_both_levels(uint slice, uint16_t level_a, uint16_t level_b) { ::pwm_set_both_levels(slice, level_a, level_b); }
+    inline void pwm_set_enabled(uint slice, bool enabled) { ::pwm_set_enabled(slice, enabled); }
+    inline void pwm_set_counter(uint slice, uint16_t count) { ::pwm_set_counter(slice, count); }
+    inline uint16_t pwm_get_counter(uint slice) { return ::pwm_get_counter(slice); }
+    inline void pwm_set_mask_enabled(uint32_t mask) { ::pwm_set_mask_enabled(mask); }
+
+    /**
+     * @brief Invert the output of a single channel of a PWM slice
+    */
+    inline void pwm_set_channel_inverted(uint slice, uint channel, bool inverted) {
+        if(channel == 0) {
+            hw_write_masked(&pwm_hw->slice[slice].csr, (uint)inverted << PWM_CH0_CSR_A_INV_LSB, PWM_CH0_CSR_A_INV_BITS);
+        } else {
+            hw_write_masked(&pwm_hw->slice[slice].csr, (uint)inverted << PWM_CH0_CSR_B_INV_LSB, PWM_CH0_CSR_B_INV_BITS);
+        }
+    }
+
+    /**
+     * @brief Claim a DMA channel for each slice to stream compare words, the slices should be synced
+     * @param slices PWM slices, the completion callback follows the first one
+     * @param count Number of slices, at most PWM_DMA_MAX_SLICES
+     * @param callback Called from the interrupt when the first slice has taken its last word
+     * @return True if successful, false if there are not enough free channels
+    */
+    inline bool pwm_dma_init(pwm_dma_t* dma, const uint* slices, uint count, dma_callback_t callback, void* user_data) {
+        if(count == 0 || count > PWM_DMA_MAX_SLICES) return false;
+        for(uint i = 0; i < count; i++) {
+            int ch = dma_claim_unused_channel(false);
+            if(ch < 0) {
+                while(i > 0) dma_channel_unclaim(dma->channels[--i]);
+                return false;
+            }
+            dma->channels[i] = ch;
+            dma->slices[i] = slices[i];
+
+            dma_channel_config c = dma_channel_get_default_config(ch);
+            channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+            channel_config_set_read_increment(&c, true);
+            channel_config_set_write_increment(&c, false);
+            channel_config_set_dreq(&c, pwm_get_dreq(slices[i]));
+            dma_channel_configure(ch, &c, &pwm_hw->slice[slices[i]].cc, NULL, 0, false);
+        }
+        dma->count = count;
+        dma->callback = callback;
+        dma->user_data = user_data;
+        detail::dma_set_handler(dma->channels[0], callback, user_data);
+        return true;
+    }
+
+    /**
+     * @brief Start streaming len words to each slice, one per PWM period, returns immediately
+     * @param words One array per slice in the order given to pwm_dma_init
+    */
+    inline void pwm_dma_start(pwm_dma_t* dma, const uint32_t* const* words, size_t len) {
+        uint32_t mask = 0;
+        for(uint i = 0; i < dma->count; i++) {
+            // The other channels take their last word a few cycles after the one that interrupts
+            while(dma_channel_is_busy(dma->channels[i])) tight_loop_contents();
+            dma_channel_set_read_addr(dma->channels[i], words[i], false);
+            dma_channel_set_trans_count(dma->channels[i], len, false);
+            mask |= 1u << dma->channels[i];
+        }
+        dma_start_channel_mask(mask);
+    }
+
+    inline bool pwm_dma_busy(const pwm_dma_t* dma) { return dma_channel_is_busy(dma->channels[0]); }
+
+    /**
+     * @brief Stop streaming, the compare registers keep the last word written
+    */
+    inline void pwm_dma_abort(pwm_dma_t* dma) {
+        // An abort can raise the completion interrupt (RP2040-E13), keep it from calling back
+        uint irq_index = detail::dma_handlers[dma->channels[0]].irq_index;
+        dma_irqn_set_channel_enabled(irq_index, dma->channels[0], false);
+        for(uint i = 0; i < dma->count; i++) dma_channel_abort(dma->channels[i]);
+        dma_irqn_acknowledge_channel(irq_index, dma->channels[0]);
+        dma_irqn_set_channel_enabled(irq_index, dma->channels[0], true);
+    }
+
+    /******************************* FLASH *******************************/
+
+    const uint32_t FLASH_SECTOR_BYTES = FLASH_SECTOR_SIZE;
+    const uint32_t FLASH_SIZE_BYTES = PICO_FLASH_SIZE_BYTES;
+
+    /**
+     * @brief Read from flash through the XIP window
+     * @param offset Byte offset from the start of flash
+    */
+    inline void flash_read(uint32_t offset, void* dst, size_t len) {
+        memcpy(dst, (const void*)(XIP_BASE + offset), len);
+    }
+
+    /**
+     * @brief Erase the sectors covering len bytes and program the data, the rest of the last page is 0xFF.
+     *      Execution from flash stops while this runs, so only call it before core 1 is launched.
+     * @param offset Byte offset from the start of flash, has to be sector aligned
+     * @return True if successful, false if the offset is not sector aligned or out of range
+    */
+    inline bool flash_write(uint32_t offset, const void* src, size_t len) {
+        if(offset % FLASH_SECTOR_SIZE != 0 || offset + len > PICO_FLASH_SIZE_BYTES) return false;
+        uint32_t erase_len = (len + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+        uint8_t page[FLASH_PAGE_SIZE];
+        uint32_t interrupts = save_and_disable_interrupts();
+        flash_range_erase(offset, erase_len);
+        for(size_t i = 0; i < len; i += FLASH_PAGE_SIZE) {
+            size_t chunk = (len - i < FLASH_PAGE_SIZE) ? (len - i) : FLASH_PAGE_SIZE;
+            memset(page, 0xFF, sizeof(page));
+            memcpy(page, (const uint8_t*)src + i, chunk);
+            flash_range_program(offset + i, page, FLASH_PAGE_SIZE);
+        }
+        restore_interrupts(interrupts);
+        return true;
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ *  Title: Haptic Library
+
+ *  Description: Haptic profile engine, profiles compiled to torque tables
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include "Haptic.h"
+
+template <typename T> T constrain(T amt, T low, T high) {
+    if(amt < low) return low;
+    if(amt > high) return high;
+    return amt;
+}
+
+/******************************* PUBLIC METHODS *******************************/
+
+/**
+ * @brief Compile a profile into the RAM table not in use and select it.
+ *      Runs the same code generate does at compile time, keep it out of the control loop.
+ * @param profile Profile to compile, not needed any more once this returns
+ * @return True if queued, false if the last table has not been swapped in yet, or the
+ *      profile has no detents, more than MAX_DETENTS, or detents too narrow for the table
+*/
+bool Haptic::compile(const haptic_profile_t* profile) {
+    if(_pending.load() != NULL) return false;
+    // Core 1 only changes the active table when one is pending, so the other buffer is free
+    table_t* table = (_active.load() == &_buffers[0]) ? &_buffers[1] : &_buffers[0];
+    if(!build(*profile, *table)) return false;
+    return select(table);
+}
+
+/**
+ * @brief Ask core 1 to swap in a table at its next update, nothing is copied
+ * @param table Table to use, from generate or compile. Has to stay valid while it is in use
+ * @return True if queued, false if the last table has not been swapped in yet or the table is empty
+*/
+bool Haptic::select(const table_t* table) {
+    if(table->detent_count == 0) return false;
+    if(_pending.load() != NULL) return false;
+    _pending.store(table);
+    return true;
+}
+
+/**
+ * @brief Put the knob at the center of a position, taking a table that is waiting.
+ *      Call before the first update, and from the core that runs update.
+ * @param angle Knob angle in counts
+ * @param position Position to be at, clamped to the ends of the profile
+*/
+void Haptic::reset(int32_t angle, int32_t position) {
+    const table_t* pending = _pending.load();
+    if(pending != NULL) {
+        _active.store(pending);
+        _pending.store(NULL);
+    }
+    if(_active.load() != NULL) place(*_active.load(), angle, position, 0);
+}
+
+/**
+ * @brief Torque for the knob angle, one lookup in the active table. Swaps in a newly compiled
+ *      profile first, keeping the position and where in its detent the knob is.
+ * @param angle Knob angle in counts, unwrapped
+ * @return Torque, Q15 of the voltage limit
+*/
+q15_t Haptic::update(int32_t angle) {
+    const table_t* pending = _pending.load();
+    if(pending != NULL) {
+        const table_t* old = _active.load(std::memory_order_relaxed);
+        int32_t offset = 0;
+        if(old != NULL) offset = angle - _origin - (_base + (old->edges[_index] + old->edges[_index + 1]) / 2);
+        place(*pending, angle, _position, offset);
+        _active.store(pending);
+        _pending.store(NULL);
+    }
+    _past_end_stop = false;
+    if(_active.load(std::memory_order_relaxed) == NULL) return 0;
+    const table_t& table = *_active.load(std::memory_order_relaxed);
+    int32_t x = angle - _origin;
+
+    // Follow the knob across detent edges, at most one edge per tick in practice
+    while(x >= _base + table.edges[_index + 1]) {
+        if(_index + 1 < table.detent_count) {
+            _index++;
+        } else if(table.repeat) {
+            _index = 0;
+            _base += table.edges[table.detent_count];
+        } else {
+            break;
+        }
+        _position++;
+    }
+    while(x < _base + table.edges[_index]) {
+        if(_index > 0) {
+            _index--;
+        } else if(table.repeat) {
+            _index = table.detent_count - 1;
+            _base -= table.edges[table.detent_count];
+        } else {
+            break;
+        }
+        _position--;
+    }
+
+    // Past the table there is only the end stop spring, repeating profiles never get here
+    int32_t local = x - _base;
+    _past_end_stop = !table.repeat && (local < table.spring_low || local > table.spring_high);
+    if(local < 0) {
+        return Fixed::q15_sat(table.end_stop_stiffness * constrain<int32_t>(table.spring_low - local, 0, 32767));
+    }
+    if(local >= (TABLE_SIZE << table.shift)) {
+        return Fixed::q15_sat(-table.end_stop_stiffness * constrain<int32_t>(local - table.spring_high, 0, 32767));
+    }
+
+    int32_t i = local >> table.shift;
+    int32_t fraction = local & ((1 << table.shift) - 1);
+    int32_t a = table.torque[i];
+    int32_t b = table.torque[i + 1];
+    return (q15_t)(a + (((b - a) * fraction) >> table.shift));
+}
+
+/******************************* PRIVATE METHODS *******************************/
+
+/**
+ * @brief Move the tracking state to a position of a table
+ * @param offset Where the knob should be from the center of the detent, clamped to the detent
+*/
+void Haptic::place(const table_t& table, int32_t angle, int32_t position, int32_t offset) {
+    int32_t count = table.detent_count;
+    int32_t relative = position - table.first_position;
+    if(table.repeat) {
+        int32_t periods = relative / count;
+        if(relative % count < 0) periods--; // Round towards minus infinity
+        _index = (uint16_t)(relative - periods * count);
+        _base = periods * table.edges[count];
+    } else {
+        relative = constrain<int32_t>(relative, 0, count - 1);
+        _index = (uint16_t)relative;
+        _base = 0;
+    }
+    _position = table.first_position + relative;
+
+    int32_t left = table.edges[_index];
+    int32_t right = table.edges[_index + 1];
+    int32_t center = (left + right) / 2;
+    offset = constrain(offset, left - center, right - center - 1);
+    _origin = angle - (_base + center + offset);
+}
@@ -0,0 +1,218 @@
+/*
+ *  Title: Haptic Library
+
+ *  Description: Haptic profile engine. A profile describes detents of any width and strength,
+ *      spring end stops, bumps and free spin, and is compiled into a table of torque against
+ *      knob angle. Each control tick is then one interpolated lookup plus following the
+ *      position across detent edges. Tables are handed to core 1 as a pointer that it swaps
+ *      in at the start of a tick, so core 0 can change the profile while core 1 keeps
+ *      running on the old one. Fixed profiles are generated at compile time into flash with
+ *      generate(), anything else is compiled at runtime into one of two RAM tables.
+ *      Angles are unwrapped encoder counts (16384 per turn), torques are Q15 fractions of
+ *      the voltage limit and positive torque pushes the angle up.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <Fixed.h>
+
+// One position of a profile, a torque valley centered in its width
+struct haptic_detent_t {
+    uint16_t width;     // Counts
+    q15_t strength;     // Peak torque, reached a quarter width from the center
+};
+
+// A hill pushing the knob away from its center, added on top of the detents
+struct haptic_bump_t {
+    int32_t angle;      // Center in counts from the left edge of the first detent
+    uint16_t width;     // Counts
+    q15_t strength;     // Peak torque
+};
+
+struct haptic_profile_t {
+    const haptic_detent_t* detents;     // Left to right
+    uint16_t detent_count;
+    int32_t first_position;             // Position of the first detent
+    bool repeat;                        // Repeat the detents forever instead of having end stops
+    bool free_spin;                     // No detent torque, positions are still counted
+    int32_t end_stop_stiffness;         // Q15 torque per count past the center of the first or last detent
+    const haptic_bump_t* bumps;         // Can be NULL, in the first period of a repeating profile
+    uint16_t bump_count;
+};
+
+class Haptic {
+public:
+    static const int TABLE_BITS = 10;
+    static const int32_t TABLE_SIZE = 1 << TABLE_BITS;
+    static const uint16_t MAX_DETENTS = 64;
+    static const int32_t MIN_ENTRIES_PER_DETENT = 8;
+
+    // A compiled profile, all the update needs
+    struct table_t {
+        q15_t torque[TABLE_SIZE + 1];       // One extra so the last entry interpolates
+        int32_t edges[MAX_DETENTS + 1];     // Left edge of each detent in counts, the last is the period
+        uint16_t detent_count;              // 0 if the profile could not be compiled
+        uint8_t shift;                      // Counts per entry as a power of two
+        bool repeat;
+        int32_t first_position;
+        int32_t spring_low;                 // End stops start at the centers of the first and last detent
+        int32_t spring_high;
+        int32_t end_stop_stiffness;
+    };
+
+    Haptic() {};
+
+    bool compile(const haptic_profile_t* profile);
+    bool select(const table_t* table);
+    bool swap_pending(void) const { return _pending.load() != NULL; };
+
+    void reset(int32_t angle, int32_t position);
+    q15_t update(int32_t angle);
+    int32_t get_position(void) const { return _position; };
+    bool past_end_stop(void) const { return _past_end_stop; }; // Past the center of the first or last detent at the last update
+    const table_t* get_table(void) const { return _active.load(); }; // In use since the last reset or update, NULL before
+
+    static constexpr bool build(const haptic_profile_t& profile, table_t& table);
+    static constexpr table_t generate(const haptic_profile_t& profile);
+    static constexpr bool is_monotonic(const table_t& table);
+    static constexpr float profile_torque(const haptic_profile_t& profile, const table_t& table, int32_t x);
+private:
+    table_t _buffers[2];                            // For compile, the one not in use is written
+    std::atomic<const table_t*> _active{NULL};      // Written by core 1 only
+    std::atomic<const table_t*> _pending{NULL};     // Set by select, cleared by core 1 when it swaps
+
+    // Where the knob is in the active profile, core 1 only
+    int32_t _origin = 0;    // Knob angle at the left edge of the first detent
+    int32_t _base = 0;      // Profile angle of the current period, always 0 without repeat
+    uint16_t _index = 0;    // Detent within the period
+    int32_t _position = 0;
+    bool _past_end_stop = false;
+
+    void place(const table_t& table, int32_t angle, int32_t position, int32_t offset);
+    static constexpr float sine_turns(float turns);
+};
+
+/**************************** COMPILE TIME METHODS ****************************/
+
+/**
+ * @brief Fill a table from a profile. Evaluates at compile time for generate and at runtime for
+ *      compile, so both give the same table.
+ * @return False and a detent_count of 0 if the profile has no detents, more than MAX_DETENTS,
+ *      a zero width or detents too narrow for the table
+*/
+constexpr bool Haptic::build(const haptic_profile_t& profile, table_t& table) {
+    table.detent_count = 0;
+    if(profile.detent_count == 0 || profile.detent_count > MAX_DETENTS) return false;
+
+    uint16_t narrowest = UINT16_MAX;
+    table.edges[0] = 0;
+    for(uint16_t i = 0; i < profile.detent_count; i++) {
+        uint16_t width = profile.detents[i].width;
+        if(width == 0) return false;
+        if(width < narrowest) narrowest = width;
+        table.edges[i + 1] = table.edges[i] + width;
+    }
+    int32_t span = table.edges[profile.detent_count];
+    uint8_t shift = 0;
+    while((TABLE_SIZE << shift) < span) shift++;
+    if((narrowest >> shift) < MIN_ENTRIES_PER_DETENT) return false;
+
+    table.detent_count = profile.detent_count;
+    table.shift = shift;
+    table.repeat = profile.repeat;
+    table.first_position = profile.first_position;
+    table.spring_low = profile.detents[0].width / 2;
+    table.spring_high = table.edges[profile.detent_count - 1] + profile.detents[profile.detent_count - 1].width / 2;
+    table.end_stop_stiffness = profile.end_stop_stiffness;
+    for(int32_t i = 0; i <= TABLE_SIZE; i++) {
+        int32_t x = i << shift;
+        if(table.repeat) x %= span;
+        float torque = profile_torque(profile, table, x);
+        if(torque > Fixed::Q15_MAX) torque = Fixed::Q15_MAX;
+        if(torque < Fixed::Q15_MIN) torque = Fixed::Q15_MIN;
+        table.torque[i] = (q15_t)(torque >= 0.0f ? torque + 0.5f : torque - 0.5f);
+    }
+    return true;
+}
+
+/**
+ * @brief Build a table at compile time, check it with static_assert
+ *      static constexpr Haptic::table_t table = Haptic::generate(profile);
+ *      static_assert(table.detent_count > 0 && Haptic::is_monotonic(table));
+*/
+constexpr Haptic::table_t Haptic::generate(const haptic_profile_t& profile) {
+    table_t table{};
+    build(profile, table);
+    return table;
+}
+
+/**
+ * @brief Check that the detent edges only go up and that the torque only falls through the
+ *      middle half of every detent, so each detent pulls the knob to its center
+*/
+constexpr bool Haptic::is_monotonic(const table_t& table) {
+    for(uint16_t d = 0; d < table.detent_count; d++) {
+        int32_t width = table.edges[d + 1] - table.edges[d];
+        if(width <= 0) return false;
+        int32_t first = (table.edges[d] + width / 4) >> table.shift;
+        int32_t last = (table.edges[d + 1] - width / 4) >> table.shift;
+        for(int32_t i = first; i < last && i < TABLE_SIZE; i++) {
+            if(table.torque[i + 1] > table.torque[i]) return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Torque of a profile at a profile angle, in Q15 but not saturated
+ * @param x Counts from the left edge of the first detent, within the first period if repeating
+*/
+constexpr float Haptic::profile_torque(const haptic_profile_t& profile, const table_t& table, int32_t x) {
+    float torque = 0.0f;
+    if(!table.repeat && x < table.spring_low) {
+        torque = (float)table.end_stop_stiffness * (float)(table.spring_low - x);
+    } else if(!table.repeat && x > table.spring_high) {
+        torque = -(float)table.end_stop_stiffness * (float)(x - table.spring_high);
+    } else if(!profile.free_spin) {
+        uint16_t i = 0;
+        while(i + 1 < table.detent_count && x >= table.edges[i + 1]) i++;
+        float width = (float)profile.detents[i].width;
+        float center = (float)table.edges[i] + 0.5f * width;
+        torque = -(float)profile.detents[i].strength * sine_turns(((float)x - center) / width);
+    }
+
+    int32_t period = table.edges[table.detent_count];
+    for(uint16_t i = 0; i < profile.bump_count; i++) {
+        const haptic_bump_t& bump = profile.bumps[i];
+        int32_t d = x - bump.angle;
+        if(table.repeat) {
+            // Nearest copy of the bump
+            d %= period;
+            if(d >= period / 2) d -= period;
+            if(d < -period / 2) d += period;
+        }
+        if(2 * d < bump.width && -2 * d < bump.width) {
+            torque += (float)bump.strength * sine_turns((float)d / (float)bump.width);
+        }
+    }
+    return torque;
+}
+
+/**
+ * @brief Sine of an angle in turns, a Taylor series since sinf is not constexpr.
+ *      Within 4e-6 of sinf, well under one Q15 step.
+ * @param turns Angle in [-0.5, 0.5] turns
+*/
+constexpr float Haptic::sine_turns(float turns) {
+    const float _pi = 3.14159265358979323846f;
+    float x = 2.0f * _pi * turns;
+    // Fold onto [-pi/2, pi/2] where the series converges fast
+    if(x > 0.5f * _pi) x = _pi - x;
+    if(x < -0.5f * _pi) x = -_pi - x;
+    float x2 = x * x;
+    return x * (1.0f - x2 / 6.0f * (1.0f - x2 / 20.0f * (1.0f - x2 / 42.0f * (1.0f - x2 / 72.0f * (1.0f - x2 / 110.0f)))));
+}
@@ -0,0 +1,63 @@
+/*
+ *  Title: Haptic Profiles
+
+ *  Description: The profiles the knob ships with, generated into flash at compile time.
+ *      Selecting one is a pointer swap, no RAM and no startup time. Strengths are Q15 of
+ *      the 5 V voltage limit, widths are encoder counts (16384 per turn).
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include "Haptic.h"
+
+namespace HapticProfiles {
+    const uint16_t COARSE_WIDTH = 16384 / 16;
+    const uint16_t FINE_WIDTH = 16384 / 64;
+    const uint16_t LEVEL_COUNT = 51;    // Positions 0 to 50, the gain in dB
+    const uint16_t BOUNDED_COUNT = 11;  // Positions 0 to 10
+
+    // Detents of a profile, a struct so a constexpr function can return them
+    template <size_t N> struct detents_t {
+        haptic_detent_t detents[N];
+    };
+
+    template <size_t N> constexpr detents_t<N> uniform(uint16_t width, float strength_volts) {
+        detents_t<N> result{};
+        for(size_t i = 0; i < N; i++) result.detents[i] = {width, Fixed::float_to_q15(strength_volts / 5.0f)};
+        return result;
+    }
+
+    // Twice as wide as coarse and stronger towards 10
+    constexpr detents_t<BOUNDED_COUNT> ramp(void) {
+        detents_t<BOUNDED_COUNT> result{};
+        for(size_t i = 0; i < BOUNDED_COUNT; i++) result.detents[i] = {2 * COARSE_WIDTH, Fixed::float_to_q15((1.0f + 0.1f * i) / 5.0f)};
+        return result;
+    }
+
+    inline constexpr detents_t<LEVEL_COUNT> coarse_detents = uniform<LEVEL_COUNT>(COARSE_WIDTH, 1.5f);
+    inline constexpr detents_t<LEVEL_COUNT> fine_detents = uniform<LEVEL_COUNT>(FINE_WIDTH, 1.0f);
+    inline constexpr detents_t<BOUNDED_COUNT> bounded_detents = ramp();
+    inline constexpr detents_t<1> free_detent = uniform<1>(COARSE_WIDTH, 0.0f);
+    // A bump on the edge between 4 and 5 makes 5 harder to get into
+    inline constexpr haptic_bump_t bounded_bump = {5 * 2 * COARSE_WIDTH, COARSE_WIDTH / 2, Fixed::float_to_q15(0.5f / 5.0f)};
+
+    inline constexpr haptic_profile_t coarse_profile = {coarse_detents.detents, LEVEL_COUNT, 0, false, false, 8, NULL, 0};
+    inline constexpr haptic_profile_t fine_profile = {fine_detents.detents, LEVEL_COUNT, 0, false, false, 8, NULL, 0};
+    inline constexpr haptic_profile_t unbounded_profile = {coarse_detents.detents, 1, 0, true, false, 0, NULL, 0};
+    inline constexpr haptic_profile_t bounded_profile = {bounded_detents.detents, BOUNDED_COUNT, 0, false, false, 16, &bounded_bump, 1};
+    inline constexpr haptic_profile_t free_profile = {free_detent.detents, 1, 0, true, true, 0, NULL, 0};
+
+    inline constexpr Haptic::table_t coarse = Haptic::generate(coarse_profile);
+    inline constexpr Haptic::table_t fine = Haptic::generate(fine_profile);
+    inline constexpr Haptic::table_t unbounded = Haptic::generate(unbounded_profile);
+    inline constexpr Haptic::table_t bounded = Haptic::generate(bounded_profile);
+    inline constexpr Haptic::table_t free_spin = Haptic::generate(free_profile);
+
+    static_assert(sizeof(coarse.torque) / sizeof(coarse.torque[0]) == Haptic::TABLE_SIZE + 1, "Torque table has the wrong size");
+    static_assert(coarse.detent_count == LEVEL_COUNT && Haptic::is_monotonic(coarse), "Coarse profile does not compile");
+    static_assert(fine.detent_count == LEVEL_COUNT && Haptic::is_monotonic(fine), "Fine profile does not compile");
+    static_assert(unbounded.detent_count == 1 && Haptic::is_monotonic(unbounded), "Unbounded profile does not compile");
+    static_assert(bounded.detent_count == BOUNDED_COUNT && Haptic::is_monotonic(bounded), "Bounded profile does not compile");
+    static_assert(free_spin.detent_count == 1, "Free spin profile does not compile");
+}
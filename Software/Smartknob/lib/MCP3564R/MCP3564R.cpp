@@ -7,30 +7,71 @@
  */
 
 #include <string.h>
-#include <hardware/spi.h>
-#include <hardware/gpio.h>
 #include <stdio.h>
-#include "pico/stdlib.h"
+#include <HAL.h>
 #include "MCP3564R.h"
 #include "MCP3564R_regs.h"
 
-MCP3564R::MCP3564R(spi_inst_t* spi, uint csn_pin, uint8_t addr) {
-    _spi = spi;
+MCP3564R::MCP3564R(SPIBus* bus, uint csn_pin, uint8_t addr) {
+    _bus = bus;
+    _spi = bus->get_spi();
     _csn_pin = csn_pin;
     _addr = addr;
+
+    // Power on values until load reads the real ones
+    memset(_shadow, 0, sizeof(_shadow));
+    _shadow[SHADOW_OFFSET[MCP3564R_REG::CONFIG0]] = MCP3564R_CONFIG0_REG::DEFAULT;
+    _shadow[SHADOW_OFFSET[MCP3564R_REG::CONFIG1]] = MCP3564R_CONFIG1_REG::DEFAULT;
+    _shadow[SHADOW_OFFSET[MCP3564R_REG::CONFIG2]] = MCP3564R_CONFIG2_REG::DEFAULT;
+    _shadow[SHADOW_OFFSET[MCP3564R_REG::CONFIG3]] = MCP3564R_CONFIG3_REG::DEFAULT;
+    _shadow[SHADOW_OFFSET[MCP3564R_REG::IRQ]] = MCP3564R_IRQ_REG::DEFAULT;
+    _shadow[SHADOW_OFFSET[MCP3564R_REG::MUX]] = MCP3564R_MUX_REG::DEFAULT;
 }
 
 /******************************* PUBLIC METHODS *******************************/
 
 /**
- * @brief Initialize the MCP3564R
+ * @brief Initialize the MCP3564R and load the configuration registers into the shadow
  * @return True if successful, false if not
 */
-void MCP3564R::init(void) {
-    gpio_init(_csn_pin);
-    gpio_set_dir(_csn_pin, GPIO_OUT);
-    gpio_pull_up(_csn_pin);
-    gpio_put(_csn_pin, true);
+bool MCP3564R::init(void) {
+    HAL::gpio_init(_csn_pin);
+    HAL::gpio_set_dir(_csn_pin, true);
+    HAL::gpio_pull_up(_csn_pin);
+    HAL::gpio_put(_csn_pin, true);
+    _device = _bus->add_device(10000000u, 8, 0, 0); // 10 MHz like the encoder so streamed reads hold the bus briefly, mode 0
+    return load();
+}
+
+/**
+ * @brief Read CONFIG0 to TIMER into the shadow in one incremental read, dropping anything not committed
+ * @return True if successful, false if not
+*/
+bool MCP3564R::load(void) {
+    if(!read_register(SHADOW_FIRST, _shadow, SHADOW_BYTES)) return false;
+    _dirty = 0;
+    data_format = (_shadow[SHADOW_OFFSET[MCP3564R_REG::CONFIG3]] & MCP3564R_CONFIG3_REG_MASK::DATA_FORMAT) >> 4;
+    return true;
+}
+
+/**
+ * @brief Write the registers changed since the last commit in one incremental write.
+ *      The burst runs from the first to the last changed register, the ones in between
+ *      are written with what they already hold.
+ * @return True if successful or nothing changed, false if the registers are locked or the write failed
+*/
+bool MCP3564R::commit(void) {
+    if(_dirty == 0) return true;
+    if(locked) return false;
+    uint8_t first = SHADOW_FIRST;
+    while(!(_dirty & (1u << first))) first++;
+    uint8_t last = SHADOW_LAST;
+    while(!(_dirty & (1u << last))) last--;
+    uint8_t offset = SHADOW_OFFSET[first];
+    if(!write_register(first, &_shadow[offset], SHADOW_OFFSET[last + 1] - offset)) return false;
+    _dirty = 0;
+    data_format = (_shadow[SHADOW_OFFSET[MCP3564R_REG::CONFIG3]] & MCP3564R_CONFIG3_REG_MASK::DATA_FORMAT) >> 4;
+    return true;
 }
 
 /**
@@ -44,7 +85,6 @@ void MCP3564R::init(void) {
  * @return True if successful, false if not
 */
 bool MCP3564R::read_data(int32_t* data, uint8_t* channel) {
-    uint8_t selected_channel = 255u;
     uint8_t message_length = 0; // Length of the message in bytes
     if(data_format == 0) {
         message_length = 3;
@@ -54,58 +94,69 @@ bool MCP3564R::read_data(int32_t* data, uint8_t* channel) {
 
     uint8_t buffer[message_length];
     if(!read_register(MCP3564R_REG::ADCDATA, buffer, message_length)) return false;
+    return decode(buffer, data_format, data, channel);
+}
 
-    int32_t output_data = 0;
-    int32_t temp = 0x00000000;
-    switch(data_format) {
-        case 0:
-            output_data = ((buffer[0] & 0x80) == 1) ? 0xFF800000 : 0x00000000;
-            temp |= buffer[0];
-            temp <<= 8;
-            temp |= buffer[1];
-            temp <<= 8;
-            temp |= buffer[2] & 0x7F;
-            output_data |= temp;
-            break;
-        case 1:
-            output_data = ((buffer[0] & 0x80) == 1) ? 0xFF800000 : 0x00000000;
-            temp |= buffer[0];
-            temp <<= 8;
-            temp |= buffer[1];
-            temp <<= 8;
-            temp |= buffer[2] & 0x7F;
-            output_data |= temp;
-            break;
-        case 2:
-            output_data = ((buffer[0]) == 0xFF) ? 0xFF000000 : 0x00000000;
-            temp |= buffer[1];
-            temp <<= 8;
-            temp |= buffer[2];
-            temp <<= 8;
-            temp |= buffer[3];
-            output_data |= temp;
-            break;
-        case 3:
-            output_data = (buffer[0] & 0x08) ? 0xFF000000 : 0x00000000;
-            temp <<= 8;
-            temp |= buffer[1];
-            temp <<= 8;
-            temp |= buffer[2];
-            temp <<= 8;
-            temp |= buffer[3];
-            output_data |= temp;
-            selected_channel = (buffer[0] & 0xF0) >> 4;
-            break;
-        default:
-            return false;
-            break;
+/**
+ * @brief Stream conversions in the background. Sets continuous conversion with the channel ID
+ *      in the data, and every falling edge of the IRQ pin starts a DMA read of ADCDATA whose
+ *      completion queues the sample for read_stream. The interrupts run on the calling core, a read
+ *      that finds the bus busy is started by whoever releases it, so it can run on either core.
+ *      The IRQ pin needs its pull-up. Settings made since the last commit go out in the same
+ *      write as the ones streaming needs, so set up the scan channels, gain and oversampling first.
+ * @param irq_pin GPIO the IRQ output is connected to
+ * @return True if successful, false if already streaming, the write failed or there are no free DMA channels
+*/
+bool MCP3564R::start_stream(uint irq_pin) {
+    if(_streaming.load()) return false;
+    if(!_dma_ready) {
+        if(!HAL::spi_dma_init(&_dma, _spi, dma_complete, this)) return false;
+        _dma_ready = true;
+    }
+    set_data_format(3);
+    set_conv_mode(3);
+    set_irq_mode_mdat(false);
+    set_irq_mode_hiz(true);
+    set_adc_mode(3);
+
+    memset(_stream_tx, 0, sizeof(_stream_tx));
+    _stream_tx[0] = ((_addr & 0x03) << 6) | (MCP3564R_REG::ADCDATA << 2) | MCP3564R_COMMAND::STATIC_READ;
+    _irq_pin = irq_pin;
+    _reading.store(false);
+    _pending.store(false);
+    _bus->set_release_hook(_device, bus_released, this);
+    _streaming.store(true);
+    HAL::gpio_set_irq_handler(irq_pin, data_ready, this);
+    if(!commit()) {
+        stop_stream();
+        return false;
     }
-
-    *channel = selected_channel;
-    *data = output_data;
     return true;
 }
 
+/**
+ * @brief Stop streaming and put the ADC in standby, samples already queued can still be read.
+ *      Commits anything else waiting in the shadow too.
+*/
+void MCP3564R::stop_stream(void) {
+    if(!_streaming.load()) return;
+    HAL::gpio_set_irq_handler(_irq_pin, NULL, NULL);
+    _streaming.store(false);
+    while(_reading.load(std::memory_order_acquire)) HAL::tight_loop_contents();
+    set_adc_mode(2);
+    commit();
+}
+
+/**
+ * @brief Take the samples streamed since the last call, oldest first. Only call from one core.
+ * @param samples Where the samples go, sign extended ADC codes
+ * @param max_count Room in samples
+ * @return Number of samples taken
+*/
+uint32_t MCP3564R::read_stream(int32_t* samples, uint32_t max_count) {
+    return _stream.pop(samples, max_count);
+}
+
 /**
  * @brief Select a voltage reference source
  * @param internal
@@ -114,13 +165,13 @@ bool MCP3564R::read_data(int32_t* data, uint8_t* channel) {
 */
 bool MCP3564R::select_vref_source(bool internal) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG0, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG0, buffer);
     if(internal) {
         buffer[0] |= MCP3564R_CONFIG0_REG::VREF_SEL_INTERNAL;
     } else {
         buffer[0] &= ~MCP3564R_CONFIG0_REG_MASK::VREF_SEL;
     }
-    if(!write_register(MCP3564R_REG::CONFIG0, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG0, buffer);
     return true;
 }
 
@@ -132,7 +183,7 @@ bool MCP3564R::select_vref_source(bool internal) {
 */
 bool MCP3564R::set_clock_source(uint8_t source) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG0, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG0, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG0_REG_MASK::CLK_SEL;
@@ -155,7 +206,7 @@ bool MCP3564R::set_clock_source(uint8_t source) {
             break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG0, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG0, buffer);
     return true;
 }
 
@@ -167,7 +218,7 @@ bool MCP3564R::set_clock_source(uint8_t source) {
 */
 bool MCP3564R::set_current_source_sink(uint8_t config) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG0, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG0, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG0_REG_MASK::CS_SEL;
@@ -190,7 +241,7 @@ bool MCP3564R::set_current_source_sink(uint8_t config) {
             break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG0, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG0, buffer);
     return true;
 }
 
@@ -202,7 +253,7 @@ bool MCP3564R::set_current_source_sink(uint8_t config) {
 */
 bool MCP3564R::set_adc_mode(uint8_t mode) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG0, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG0, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG0_REG_MASK::ADC_MODE;
@@ -225,7 +276,7 @@ bool MCP3564R::set_adc_mode(uint8_t mode) {
             break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG0, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG0, buffer);
     return true;
 }
 
@@ -237,7 +288,7 @@ bool MCP3564R::set_adc_mode(uint8_t mode) {
 */
 bool MCP3564R::set_clock_prescaler(uint8_t value) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG1, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG1, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG1_REG_MASK::PRE;
@@ -260,7 +311,7 @@ bool MCP3564R::set_clock_prescaler(uint8_t value) {
             break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG1, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG1, buffer);
     return true;
 }
 
@@ -273,7 +324,7 @@ bool MCP3564R::set_clock_prescaler(uint8_t value) {
 */
 bool MCP3564R::set_oversample_ratio(uint8_t ratio) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG1, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG1, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG1_REG_MASK::OSR;
@@ -298,7 +349,7 @@ bool MCP3564R::set_oversample_ratio(uint8_t ratio) {
         default: return false; break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG1, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG1, buffer);
     return true;
 }
 
@@ -310,7 +361,7 @@ bool MCP3564R::set_oversample_ratio(uint8_t ratio) {
 */
 bool MCP3564R::set_adc_bias_current(uint8_t selection) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG2, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG2, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG2_REG_MASK::BOOST;
@@ -323,7 +374,7 @@ bool MCP3564R::set_adc_bias_current(uint8_t selection) {
         default: return false; break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG2, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG2, buffer);
     return true;
 }
 
@@ -336,7 +387,7 @@ bool MCP3564R::set_adc_bias_current(uint8_t selection) {
 */
 bool MCP3564R::set_adc_gain(uint8_t gain) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG2, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG2, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG2_REG_MASK::GAIN;
@@ -353,7 +404,7 @@ bool MCP3564R::set_adc_gain(uint8_t gain) {
         default: return false; break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG2, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG2, buffer);
     return true;
 }
 
@@ -365,13 +416,13 @@ bool MCP3564R::set_adc_gain(uint8_t gain) {
 */
 bool MCP3564R::set_auto_zero_mux(bool enable) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG2, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG2, buffer);
     if(enable) {
         buffer[0] |= MCP3564R_CONFIG2_REG::AZ_MUX_ENABLED;
     } else {
         buffer[0] &= ~MCP3564R_CONFIG2_REG_MASK::AZ_MUX;
     }
-    if(!write_register(MCP3564R_REG::CONFIG2, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG2, buffer);
     return true;
 }
 
@@ -383,13 +434,13 @@ bool MCP3564R::set_auto_zero_mux(bool enable) {
 */
 bool MCP3564R::set_auto_zero_ref_buffer(bool enabled) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG2, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG2, buffer);
     if(enabled) {
         buffer[0] |= MCP3564R_CONFIG2_REG::AZ_REF_ENABLED;
     } else {
         buffer[0] &= ~MCP3564R_CONFIG2_REG_MASK::AZ_REF;
     }
-    if(!write_register(MCP3564R_REG::CONFIG2, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG2, buffer);
     return true;
 }
 
@@ -401,7 +452,7 @@ bool MCP3564R::set_auto_zero_ref_buffer(bool enabled) {
 */
 bool MCP3564R::set_conv_mode(uint8_t mode) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG3, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG3_REG_MASK::CONV_MODE;
@@ -413,7 +464,7 @@ bool MCP3564R::set_conv_mode(uint8_t mode) {
         default: return false; break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG3, buffer);
     return true;
 }
 
@@ -425,7 +476,7 @@ bool MCP3564R::set_conv_mode(uint8_t mode) {
 */
 bool MCP3564R::set_data_format(uint8_t format) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG3, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_CONFIG3_REG_MASK::DATA_FORMAT;
@@ -438,8 +489,7 @@ bool MCP3564R::set_data_format(uint8_t format) {
         default: return false; break;
     }
 
-    if(!write_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
-    data_format = format; // Update internal value for the data format
+    set_shadow(MCP3564R_REG::CONFIG3, buffer);
     return true;
 }
 
@@ -451,13 +501,13 @@ bool MCP3564R::set_data_format(uint8_t format) {
 */
 bool MCP3564R::set_crc_format(bool trailing_zeros) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG3, buffer);
     if(trailing_zeros) {
         buffer[0] |= MCP3564R_CONFIG3_REG::CRC_FORMAT_32_BIT;
     } else {
         buffer[0] &= ~MCP3564R_CONFIG3_REG_MASK::CRC_FORMAT;
     }
-    if(!write_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG3, buffer);
     return true;
 }
 
@@ -469,13 +519,13 @@ bool MCP3564R::set_crc_format(bool trailing_zeros) {
 */
 bool MCP3564R::set_en_crccom(bool enabled) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG3, buffer);
     if(enabled) {
         buffer[0] |= MCP3564R_CONFIG3_REG::CRCCOM_ENABLED;
     } else {
         buffer[0] &= ~MCP3564R_CONFIG3_REG_MASK::EN_CRCCOM;
     }
-    if(!write_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG3, buffer);
     return true;
 }
 
@@ -487,13 +537,13 @@ bool MCP3564R::set_en_crccom(bool enabled) {
 */
 bool MCP3564R::set_en_offcal(bool enabled) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG3, buffer);
     if(enabled) {
         buffer[0] |= MCP3564R_CONFIG3_REG::OFFCAL_ENABLED;
     } else {
         buffer[0] &= ~MCP3564R_CONFIG3_REG_MASK::EN_OFFCAL;
     }
-    if(!write_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG3, buffer);
     return true;
 }
 
@@ -505,13 +555,13 @@ bool MCP3564R::set_en_offcal(bool enabled) {
 */
 bool MCP3564R::set_en_gaincal(bool enabled) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::CONFIG3, buffer);
     if(enabled) {
         buffer[0] |= MCP3564R_CONFIG3_REG::GAINCAL_ENABLED;
     } else {
         buffer[0] &= ~MCP3564R_CONFIG3_REG_MASK::EN_GAINCAL;
     }
-    if(!write_register(MCP3564R_REG::CONFIG3, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::CONFIG3, buffer);
     return true;
 }
 
@@ -523,13 +573,13 @@ bool MCP3564R::set_en_gaincal(bool enabled) {
 */
 bool MCP3564R::set_irq_mode_mdat(bool mdat) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::IRQ, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::IRQ, buffer);
     if(mdat) {
         buffer[0] |= MCP3564R_IRQ_REG::IRQ_MODE_MDAT_OUT;
     } else {
         buffer[0] &= ~MCP3564R_IRQ_REG_MASK::IRQ_MODE_1;
     }
-    if(!write_register(MCP3564R_REG::IRQ, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::IRQ, buffer);
     return true;
 }
 
@@ -541,13 +591,13 @@ bool MCP3564R::set_irq_mode_mdat(bool mdat) {
 */
 bool MCP3564R::set_irq_mode_hiz(bool hiz) {
     uint8_t buffer[1];
-    if(!read_register(MCP3564R_REG::IRQ, buffer, 1)) return false;
+    get_shadow(MCP3564R_REG::IRQ, buffer);
     if(hiz) {
         buffer[0] &= ~MCP3564R_IRQ_REG_MASK::IRQ_MODE_0;
     } else {
         buffer[0] |= MCP3564R_IRQ_REG::IRQ_MODE_HIGH;
     }
-    if(!write_register(MCP3564R_REG::IRQ, buffer, 1)) return false;
+    set_shadow(MCP3564R_REG::IRQ, buffer);
     return true;
 }
 
@@ -558,14 +608,10 @@ bool MCP3564R::set_irq_mode_hiz(bool hiz) {
  * @return True if successful, false if not
 */
 bool MCP3564R::enable_scan_channel(uint8_t channel) {
-    uint8_t buffer[3] = {0};
-    // Read the current state of the register
-    if(!read_register(MCP3564R_REG::SCAN, buffer, 3)) return false;
+    uint8_t buffer[3];
+    get_shadow(MCP3564R_REG::SCAN, buffer);
     // Copy channels content into a variable to work with
-    uint16_t channels = 0;
-    channels |= buffer[1];
-    channels <<= 8;
-    channels |= buffer[2];
+    uint16_t channels = ((uint16_t)buffer[1] << 8) | buffer[2];
 
     switch (channel) {
         case 0:  channels |= MCP3564R_SCAN_REG::SINGLE_CH_0;    break;
@@ -588,8 +634,7 @@ bool MCP3564R::enable_scan_channel(uint8_t channel) {
     }
     buffer[1] = (channels & 0xFF00) >> 8;
     buffer[2] = channels & 0x00FF;
-    //memcpy(buffer+1, &channels, sizeof(channels));
-    if(!write_register(MCP3564R_REG::SCAN, buffer, 3)) return false;
+    set_shadow(MCP3564R_REG::SCAN, buffer);
     return true;
 }
 
@@ -600,12 +645,10 @@ bool MCP3564R::enable_scan_channel(uint8_t channel) {
  * @return True if successful, false if not
 */
 bool MCP3564R::disable_scan_channel(uint8_t channel) {
-    uint8_t buffer[3] = {0};
-    // Read the current state of the register
-    if(!read_register(MCP3564R_REG::SCAN, buffer, 3)) return false;
+    uint8_t buffer[3];
+    get_shadow(MCP3564R_REG::SCAN, buffer);
     // Copy channels content into a variable to work with
-    uint16_t channels = 0;
-    memcpy(&channels, buffer+1, sizeof(channels));
+    uint16_t channels = ((uint16_t)buffer[1] << 8) | buffer[2];
 
     switch (channel) {
         case 0:  channels &= ~MCP3564R_SCAN_REG::SINGLE_CH_0;    break;
@@ -626,8 +669,9 @@ bool MCP3564R::disable_scan_channel(uint8_t channel) {
         case 15: channels &= ~MCP3564R_SCAN_REG::OFFSET;         break;
         default: return false;
     }
-    memcpy(buffer+1, &channels, sizeof(channels));
-    if(!write_register(MCP3564R_REG::SCAN, buffer, 3)) return false;
+    buffer[1] = (channels & 0xFF00) >> 8;
+    buffer[2] = channels & 0x00FF;
+    set_shadow(MCP3564R_REG::SCAN, buffer);
     return true;
 }
 
@@ -640,7 +684,7 @@ bool MCP3564R::disable_scan_channel(uint8_t channel) {
 */
 bool MCP3564R::set_scan_delay_multiplier(uint8_t multiplier) {
     uint8_t buffer[3];
-    if(!read_register(MCP3564R_REG::SCAN, buffer, 3)) return false;
+    get_shadow(MCP3564R_REG::SCAN, buffer);
 
     // Set the bits for the CLK_SEL to 0, keeping the rest
     buffer[0] = buffer[0] & ~MCP3564R_SCAN_REG_MASK::DLY;
@@ -657,7 +701,7 @@ bool MCP3564R::set_scan_delay_multiplier(uint8_t multiplier) {
         default: return false; break;
     }
 
-    if(!write_register(MCP3564R_REG::SCAN, buffer, 3)) return false;
+    set_shadow(MCP3564R_REG::SCAN, buffer);
     return true;
 }
 
@@ -690,23 +734,22 @@ void MCP3564R::debug(void) {
     printf("\n DEBUG: Dumping full register...\n");
     uint8_t buf[31] = {0x00};
 
-    uint old_baudrate = spi_get_baudrate(_spi);
-    spi_set_baudrate(_spi, 1000000u);
+    _bus->acquire(_device);
     uint8_t header = 0x00;
     header |= (_addr & 0x03) << 6;
     header |= (0x00 & 0x07) << 2;
     header |= 0x03;
 
-    gpio_put(_csn_pin, false);
+    HAL::gpio_put(_csn_pin, false);
 
-    spi_write_blocking(_spi, &header, 1);
+    HAL::spi_write_blocking(_spi, &header, 1);
     
-    sleep_us(10);
-    spi_read_blocking(_spi, 0x00, buf, sizeof(buf));
+    HAL::sleep_us(10);
+    HAL::spi_read_blocking(_spi, 0x00, buf, sizeof(buf));
     
-    gpio_put(_csn_pin, true);
+    HAL::gpio_put(_csn_pin, true);
 
-    spi_set_baudrate(_spi, old_baudrate);
+    _bus->release();
 
     // counter to use since ADCDATA is variable length
     uint8_t n = 0;
@@ -958,6 +1001,138 @@ void MCP3564R::debug(void) {
 
 /******************************* PRIVATE METHODS *******************************/
 
+/**
+ * @brief Copy a register out of the shadow
+ * @param address Register from CONFIG0 to TIMER
+*/
+void MCP3564R::get_shadow(uint8_t address, uint8_t* data) const {
+    memcpy(data, &_shadow[SHADOW_OFFSET[address]], SHADOW_OFFSET[address + 1] - SHADOW_OFFSET[address]);
+}
+
+/**
+ * @brief Change a register in the shadow, it is written at the next commit
+ * @param address Register from CONFIG0 to TIMER
+*/
+void MCP3564R::set_shadow(uint8_t address, const uint8_t* data) {
+    memcpy(&_shadow[SHADOW_OFFSET[address]], data, SHADOW_OFFSET[address + 1] - SHADOW_OFFSET[address]);
+    _dirty |= 1u << address;
+}
+
+/**
+ * @brief Data ready interrupt, takes the bus and starts reading the conversion. If the bus is
+ *      busy the read stays pending and starts from bus_released when the holder is done.
+*/
+void MCP3564R::data_ready(void* user_data) {
+    MCP3564R* self = (MCP3564R*)user_data;
+    if(!self->_streaming.load(std::memory_order_relaxed)) return;
+    if(self->_pending.load(std::memory_order_relaxed)) {
+        // The previous conversion was never read and the ADC has overwritten it
+        self->_dropped.store(self->_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    self->_pending.store(true, std::memory_order_relaxed);
+    if(self->_bus->try_acquire_or_wait(self->_device)) self->start_read();
+}
+
+/**
+ * @brief Release hook on the bus, starts the read that data_ready could not
+*/
+void MCP3564R::bus_released(void* user_data) {
+    MCP3564R* self = (MCP3564R*)user_data;
+    if(!self->_pending.load(std::memory_order_relaxed)) return;
+    if(self->_bus->try_acquire_or_wait(self->_device)) self->start_read();
+}
+
+/**
+ * @brief Start the DMA read of a pending conversion, called with the bus held.
+ *      Only the bus holder clears the pending flag, so a conversion is read once.
+*/
+void MCP3564R::start_read(void) {
+    if(!_pending.load(std::memory_order_relaxed) || !_streaming.load(std::memory_order_relaxed)) {
+        _bus->release();
+        return;
+    }
+    _pending.store(false, std::memory_order_relaxed);
+    _reading.store(true, std::memory_order_relaxed);
+    HAL::gpio_put(_csn_pin, false);
+    HAL::spi_dma_transfer(&_dma, _stream_tx, _stream_rx, STREAM_FRAME_BYTES);
+}
+
+/**
+ * @brief DMA completion interrupt, queues the sample and hands the bus back.
+ *      The release comes last since it can start the next read into the same buffer.
+*/
+void MCP3564R::dma_complete(void* user_data) {
+    MCP3564R* self = (MCP3564R*)user_data;
+    HAL::gpio_put(self->_csn_pin, true);
+
+    int32_t data = 0;
+    uint8_t channel = 0;
+    bool fresh = (self->_stream_rx[0] & MCP3564R_STATUS_MASK::DR_STATUS) == 0;
+    if(!fresh || !decode(&self->_stream_rx[1], 3, &data, &channel) || !self->_stream.push(data)) {
+        self->_dropped.store(self->_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    self->_reading.store(false, std::memory_order_release);
+    self->_bus->release();
+}
+
+/**
+ * @brief Turn the bytes of ADCDATA into a sign extended code
+ * @param format Data format the bytes were read in, see set_data_format
+ * @return True if successful, false if the format is unknown
+*/
+bool MCP3564R::decode(const uint8_t* buffer, uint8_t format, int32_t* data, uint8_t* channel) {
+    uint8_t selected_channel = 255u;
+    int32_t output_data = 0;
+    int32_t temp = 0x00000000;
+    switch(format) {
+        case 0:
+            output_data = ((buffer[0] & 0x80) == 1) ? 0xFF800000 : 0x00000000;
+            temp |= buffer[0];
+            temp <<= 8;
+            temp |= buffer[1];
+            temp <<= 8;
+            temp |= buffer[2] & 0x7F;
+            output_data |= temp;
+            break;
+        case 1:
+            output_data = ((buffer[0] & 0x80) == 1) ? 0xFF800000 : 0x00000000;
+            temp |= buffer[0];
+            temp <<= 8;
+            temp |= buffer[1];
+            temp <<= 8;
+            temp |= buffer[2] & 0x7F;
+            output_data |= temp;
+            break;
+        case 2:
+            output_data = ((buffer[0]) == 0xFF) ? 0xFF000000 : 0x00000000;
+            temp |= buffer[1];
+            temp <<= 8;
+            temp |= buffer[2];
+            temp <<= 8;
+            temp |= buffer[3];
+            output_data |= temp;
+            break;
+        case 3:
+            output_data = (buffer[0] & 0x08) ? 0xFF000000 : 0x00000000;
+            temp <<= 8;
+            temp |= buffer[1];
+            temp <<= 8;
+            temp |= buffer[2];
+            temp <<= 8;
+            temp |= buffer[3];
+            output_data |= temp;
+            selected_channel = (buffer[0] & 0xF0) >> 4;
+            break;
+        default:
+            return false;
+            break;
+    }
+
+    *channel = selected_channel;
+    *data = output_data;
+    return true;
+}
+
 /**
  * @brief Read data from register
  * @param address
@@ -969,30 +1144,28 @@ void MCP3564R::debug(void) {
  * @return True if successful, false if not
 */
 bool MCP3564R::read_register(uint8_t address, uint8_t* data, uint8_t len) {
-    uint old_baudrate = spi_get_baudrate(_spi);
-    spi_set_baudrate(_spi, 1000000u);
     uint8_t header = 0x00;
     header |= (_addr & 0x03) << 6;
-    header |= (address & 0x07) << 2;
+    header |= (address & 0x0F) << 2;
     header |= 0x03;
     
-    gpio_put(_csn_pin, false);
-    if(spi_write_blocking(_spi, &header, 1) != 1) {
-        gpio_put(_csn_pin, true);
+    _bus->acquire(_device);
+    HAL::gpio_put(_csn_pin, false);
+    if(HAL::spi_write_blocking(_spi, &header, 1) != 1) {
+        HAL::gpio_put(_csn_pin, true);
+        _bus->release();
         return false;
     }
 
     // Need to make it wait to set data at register? See page 74 of datasheet
-    sleep_us(1);
-    if(spi_read_blocking(_spi, 0x00, data, len) != len) {
-        gpio_put(_csn_pin, true);
+    HAL::sleep_us(1);
+    if(HAL::spi_read_blocking(_spi, 0x00, data, len) != len) {
+        HAL::gpio_put(_csn_pin, true);
+        _bus->release();
         return false;
     }    
-    gpio_put(_csn_pin, true);
-
-    if(spi_set_baudrate(_spi, old_baudrate) != old_baudrate) {
-        return false;
-    }
+    HAL::gpio_put(_csn_pin, true);
+    _bus->release();
     return true;
 }
 
@@ -1009,30 +1182,28 @@ bool MCP3564R::read_register(uint8_t address, uint8_t* data, uint8_t len) {
  * @return True if successful, false if not
 */
 bool MCP3564R::read_register(uint8_t address, uint8_t* data, uint8_t len, uint8_t* status_byte) {
-    uint old_baudrate = spi_get_baudrate(_spi);
-    spi_set_baudrate(_spi, 1000000u);
     uint8_t header = 0x00;
     header |= (_addr & 0x03) << 6;
-    header |= (address & 0x07) << 2;
+    header |= (address & 0x0F) << 2;
     header |= 0x03;
     
-    gpio_put(_csn_pin, false);
-    if(spi_write_read_blocking(_spi, &header, status_byte, 1) != 1) {
-        gpio_put(_csn_pin, true);
+    _bus->acquire(_device);
+    HAL::gpio_put(_csn_pin, false);
+    if(HAL::spi_write_read_blocking(_spi, &header, status_byte, 1) != 1) {
+        HAL::gpio_put(_csn_pin, true);
+        _bus->release();
         return false;
     }
 
     // Need to make it wait to set data at register? See page 74 of datasheet
-    sleep_us(1);
-    if(spi_read_blocking(_spi, 0x00, data, len) != len) {
-        gpio_put(_csn_pin, true);
+    HAL::sleep_us(1);
+    if(HAL::spi_read_blocking(_spi, 0x00, data, len) != len) {
+        HAL::gpio_put(_csn_pin, true);
+        _bus->release();
         return false;
     }    
-    gpio_put(_csn_pin, true);
-
-    if(spi_set_baudrate(_spi, old_baudrate) != old_baudrate) {
-        return false;
-    }
+    HAL::gpio_put(_csn_pin, true);
+    _bus->release();
    return true;
 }
 
@@ -1047,28 +1218,26 @@ bool MCP3564R::read_register(uint8_t address, uint8_t* data, uint8_t len, uint8_
  * @return True if successful, false if not
 */
 bool MCP3564R::write_register(uint8_t address, uint8_t* data, uint8_t len) {
-    uint old_baudrate = spi_get_baudrate(_spi);
-    spi_set_baudrate(_spi, 1000000u);
     uint8_t header = 0x00;
     header |= (_addr & 0x03) << 6;
-    header |= (address & 0x07) << 2;
+    header |= (address & 0x0F) << 2;
     header |= 0x02;
 
-    gpio_put(_csn_pin, false);
-    if(spi_write_blocking(_spi, &header, 1) != 1) {
-        gpio_put(_csn_pin, true);
+    _bus->acquire(_device);
+    HAL::gpio_put(_csn_pin, false);
+    if(HAL::spi_write_blocking(_spi, &header, 1) != 1) {
+        HAL::gpio_put(_csn_pin, true);
+        _bus->release();
         return false;
     }
     // Need to make it wait to set data at register? See page 74 of datasheet
-    sleep_us(1);
-    if(spi_write_blocking(_spi, data, len) != len) {
-        gpio_put(_csn_pin, true);
-        return false;
-    }
-    gpio_put(_csn_pin, true);
-
-    if(spi_set_baudrate(_spi, old_baudrate) != old_baudrate) {
+    HAL::sleep_us(1);
+    if(HAL::spi_write_blocking(_spi, data, len) != len) {
+        HAL::gpio_put(_csn_pin, true);
+        _bus->release();
         return false;
     }
+    HAL::gpio_put(_csn_pin, true);
+    _bus->release();
     return true;
 }
\ No newline at end of file
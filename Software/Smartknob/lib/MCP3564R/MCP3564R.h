@@ -1,13 +1,18 @@
 /*
  *  Title: MCP3564R
 
- *  Description: Reads data from and sends commands to the MCP3564R ADC
+ *  Description: Reads data from and sends commands to the MCP3564R ADC. The configuration
+ *      registers are kept in a shadow, the setters only change the shadow and commit writes
+ *      everything changed in one SPI transaction.
  * 
  *  Author: Mani Magnusson
  */
 
 #pragma once
-#include <hardware/spi.h>
+#include <atomic>
+#include <HAL.h>
+#include <SPIBus.h>
+#include <SPSCQueue.h>
 #include "MCP3564R_regs.h"
 
 /* TODO:
@@ -16,11 +21,22 @@
 
 class MCP3564R {
 public:
-    MCP3564R(spi_inst_t* spi, uint csn_pin, uint8_t addr = 0x1);
-    void init(void);
+    static const uint32_t STREAM_SIZE = 256; // Samples the stream buffers, 50 ms at 4.8 ksps
+
+    MCP3564R(SPIBus* bus, uint csn_pin, uint8_t addr = 0x1);
+    bool init(void);
+
+    bool load(void);
+    bool commit(void);
+    bool is_dirty(void) const { return _dirty != 0; };
 
     bool read_data(int32_t* data, uint8_t* channel);
 
+    bool start_stream(uint irq_pin);
+    void stop_stream(void);
+    uint32_t read_stream(int32_t* samples, uint32_t max_count);
+    uint32_t get_dropped(void) const { return _dropped.load(std::memory_order_relaxed); };
+
     bool select_vref_source(bool internal);
     bool set_clock_source(uint8_t source);
     bool set_current_source_sink(uint8_t config);
@@ -54,12 +70,45 @@ public:
     void debug(void);
     //bool quick_setup(void);
 private:
-    spi_inst_t* _spi;
+    SPIBus* _bus;
+    HAL::spi_t* _spi;
+    uint8_t _device = SPIBus::NO_DEVICE;
     uint _csn_pin;
     uint8_t _addr;
     uint8_t data_format = 0;
     bool locked = false;
 
+    // CONFIG0 to TIMER in register order as one incremental write sends them. The setters only
+    // change this, commit writes what changed.
+    static const uint8_t SHADOW_FIRST = MCP3564R_REG::CONFIG0;
+    static const uint8_t SHADOW_LAST = MCP3564R_REG::TIMER;
+    static const uint8_t SHADOW_BYTES = 12;
+    static constexpr uint8_t SHADOW_OFFSET[SHADOW_LAST + 2] = {0, 0, 1, 2, 3, 4, 5, 6, 9, 12}; // By address, SCAN and TIMER are 3 bytes
+    uint8_t _shadow[SHADOW_BYTES];
+    uint16_t _dirty = 0; // Bit per register address
+
+    // Streaming, the data ready interrupt starts a DMA read and its completion queues the sample
+    static const uint8_t STREAM_FRAME_BYTES = 5; // Status byte and 32 bits of data
+    HAL::spi_dma_t _dma;
+    bool _dma_ready = false;
+    uint _irq_pin = 0;
+    uint8_t _stream_tx[STREAM_FRAME_BYTES];
+    uint8_t _stream_rx[STREAM_FRAME_BYTES];
+    std::atomic<bool> _streaming{false};
+    std::atomic<bool> _pending{false};  // A conversion is waiting to be read
+    std::atomic<bool> _reading{false};
+    std::atomic<uint32_t> _dropped{0};  // Interrupts only
+    SPSCQueue<int32_t, STREAM_SIZE> _stream;
+
+    static void data_ready(void* user_data);
+    static void bus_released(void* user_data);
+    static void dma_complete(void* user_data);
+    void start_read(void);
+    static bool decode(const uint8_t* buffer, uint8_t format, int32_t* data, uint8_t* channel);
+
+    void get_shadow(uint8_t address, uint8_t* data) const;
+    void set_shadow(uint8_t address, const uint8_t* data);
+
     bool read_register(uint8_t address, uint8_t* data, uint8_t len);
     bool read_register(uint8_t address, uint8_t* data, uint8_t len, uint8_t* status_byte);
     bool write_register(uint8_t address, uint8_t* data, uint8_t len);
@@ -108,8 +108,8 @@ namespace MCP3564R_CONFIG1_REG {
     const uint8_t DEFAULT       = (0x0C);
 
     const uint8_t AMCLK_MCLK_8  = (0xC0);
-    const uint8_t AMCLK_MCLK_4  = (0x08);
-    const uint8_t AMCLK_MCLK_2  = (0x04);
+    const uint8_t AMCLK_MCLK_4  = (0x80);
+    const uint8_t AMCLK_MCLK_2  = (0x40);
     const uint8_t AMCLK_MCLK    = (0x00);
     
     const uint8_t OSR_98304     = (0x3C);
@@ -135,7 +135,7 @@ namespace MCP3564R_CONFIG1_REG {
 */
 namespace MCP3564R_CONFIG2_REG_MASK {
     const uint8_t BOOST     = (0xC0);
-    const uint8_t GAIN      = (0x30);
+    const uint8_t GAIN      = (0x38);
     const uint8_t AZ_MUX    = (0x04);
     const uint8_t AZ_REF    = (0x02);
 };
@@ -244,6 +244,13 @@ namespace MCP3564R_MUX_REG_MASK {
     const uint8_t MUX_VIN_N = (0x0F);
 };
 
+/**
+ * @brief Map of the MUX register
+*/
+namespace MCP3564R_MUX_REG {
+    const uint8_t DEFAULT = (0x01); // CH0 against CH1
+};
+
 /**
  * @brief Map of MUX VIN, note that the MUX register has two of these 4 bit wide fields
 */
@@ -306,4 +313,23 @@ namespace MCP3564R_SCAN_REG {
     const uint16_t AVDD         = (0x2000);
     const uint16_t VCM          = (0x4000);
     const uint16_t OFFSET       = (0x8000);
-};
\ No newline at end of file
+};
+
+/**
+ * @brief Status byte clocked out while the command byte goes in
+*/
+namespace MCP3564R_STATUS_MASK {
+    const uint8_t DR_STATUS     = (0x04); // Low while a conversion is waiting to be read
+    const uint8_t CRCCFG_STATUS = (0x02);
+    const uint8_t POR_STATUS    = (0x01);
+};
+
+/**
+ * @brief Command types in the two low bits of the command byte
+*/
+namespace MCP3564R_COMMAND {
+    const uint8_t FAST_COMMAND      = (0x00);
+    const uint8_t STATIC_READ       = (0x01);
+    const uint8_t INCREMENTAL_WRITE = (0x02);
+    const uint8_t INCREMENTAL_READ  = (0x03);
+};
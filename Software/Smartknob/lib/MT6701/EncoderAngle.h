@@ -0,0 +1,60 @@
+/*
+ *  Title: Encoder Angle Library
+
+ *  Description: Unwrapped multi-turn angle built from the 14 bit MT6701 count.
+ *      The count is kept as an integer plus a turn counter, the wrap is handled by
+ *      sign extending the difference between reads, so there is no fmodf anywhere.
+ *      Differences between two angles are exact integer subtractions.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+
+class EncoderAngle {
+public:
+    static const int32_t COUNT_BITS = 14;
+    static const int32_t COUNTS_PER_TURN = 1 << COUNT_BITS;
+    static constexpr float RADIANS_PER_COUNT = 6.28318530717958647692f / COUNTS_PER_TURN;
+
+    EncoderAngle() {};
+
+    /**
+     * @brief Start tracking from a count, the angle becomes this count on turn zero
+     * @param count Raw 14 bit count from the encoder
+    */
+    void reset(uint16_t count) {
+        _count = count & (COUNTS_PER_TURN - 1);
+        _turns = 0;
+    };
+
+    /**
+     * @brief Add a new count, assumes less than half a turn between calls
+     * @param count Raw 14 bit count from the encoder
+     * @return Unwrapped angle in counts
+    */
+    int32_t update(uint16_t count) {
+        count &= COUNTS_PER_TURN - 1;
+        // Shortest way around, sign extend the 14 bit difference
+        int32_t delta = (int32_t)((uint32_t)(count - _count) << (32 - COUNT_BITS)) >> (32 - COUNT_BITS);
+        if(_count + delta >= COUNTS_PER_TURN) _turns++;
+        else if(_count + delta < 0) _turns--;
+        _count = count;
+        return get_count();
+    };
+
+    int32_t get_count(void) const { return _turns * COUNTS_PER_TURN + _count; };    // Unwrapped, COUNTS_PER_TURN per turn
+    int32_t get_turns(void) const { return _turns; };
+    uint16_t get_raw(void) const { return _count; };                                // Count within the turn [0, 16383]
+    uint16_t get_angle_q16(void) const { return (uint16_t)(_count << (16 - COUNT_BITS)); }; // Within the turn, 65536 per turn
+    float get_radians(void) const { return (float)_count * RADIANS_PER_COUNT; };   // Within the turn [0, 2pi)
+
+    /**
+     * @brief Convert a difference in counts to radians, use on differences so the float keeps its precision
+    */
+    static float to_radians(int32_t counts) { return (float)counts * RADIANS_PER_COUNT; };
+private:
+    uint16_t _count = 0;    // Last count within the turn
+    int32_t _turns = 0;     // Whole turns since reset
+};
@@ -0,0 +1,80 @@
+/*
+ *  Title: Fixed-Point Tracking Observer Library
+
+ *  Description: Integer version of TrackingObserver for the fixed-point control path
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <math.h>
+#include "FixedTrackingObserver.h"
+
+/**
+ * @brief Constructor for the FixedTrackingObserver class
+ * @param bandwidth Bandwidth of the loop in rad/s, higher follows faster but lets through more noise
+ * @param dt Time between updates in seconds
+*/
+FixedTrackingObserver::FixedTrackingObserver(float bandwidth, float dt) {
+    configure(bandwidth, dt);
+    reset(0);
+}
+
+/******************************* PUBLIC METHODS *******************************/
+
+/**
+ * @brief Work out the gains that put all three poles at exp(-bandwidth * dt), same as TrackingObserver
+*/
+void FixedTrackingObserver::configure(float bandwidth, float dt) {
+    float r = expf(-bandwidth * dt);
+    float k = 1.0f - r;
+    const float scale = (float)(1 << GAIN_BITS);
+    _alpha = (int32_t)((1.0f - r * r * r) * scale);
+    _beta = (int32_t)(1.5f * k * k * (1.0f + r) * scale);
+    _gamma = (int32_t)(k * k * k * scale);
+    _rate = (int32_t)(1.0f / dt + 0.5f);
+}
+
+/**
+ * @brief Start tracking from standstill at an angle
+ * @param angle Measured angle, 65536 per turn
+*/
+void FixedTrackingObserver::reset(uint16_t angle) {
+    _angle = (int64_t)angle << 16;
+    _velocity = 0;
+    _acceleration = 0;
+}
+
+/**
+ * @brief Run one step of the loop, call once per dt
+ * @param angle Measured angle, 65536 per turn
+*/
+void FixedTrackingObserver::update(uint16_t angle) {
+    // Predict forward one step, then correct by the residual which wraps for free in 32 bits
+    int64_t predicted = _angle + _velocity + (_acceleration >> 1);
+    int32_t residual = (int32_t)(((uint32_t)angle << 16) - (uint32_t)predicted);
+
+    _angle = predicted + (((int64_t)_alpha * residual) >> GAIN_BITS);
+    _velocity += _acceleration + (int32_t)(((int64_t)_beta * residual) >> GAIN_BITS);
+    _acceleration += (int32_t)(((int64_t)_gamma * residual) >> GAIN_BITS);
+}
+
+/**
+ * @brief Unwrapped multi-turn angle, 65536 per turn, wraps after 32768 turns
+*/
+int32_t FixedTrackingObserver::get_angle(void) const {
+    return (int32_t)(_angle >> 16);
+}
+
+/**
+ * @brief Velocity in turns per second with 16 fractional bits
+*/
+int32_t FixedTrackingObserver::get_velocity(void) const {
+    return (int32_t)(((int64_t)_velocity * _rate) >> 16);
+}
+
+/**
+ * @brief Acceleration in turns per second squared with 16 fractional bits
+*/
+int32_t FixedTrackingObserver::get_acceleration(void) const {
+    return (int32_t)(((int64_t)_acceleration * _rate * _rate) >> 16);
+}
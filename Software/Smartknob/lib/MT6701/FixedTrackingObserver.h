@@ -0,0 +1,35 @@
+/*
+ *  Title: Fixed-Point Tracking Observer Library
+
+ *  Description: Integer version of TrackingObserver for the fixed-point control path.
+ *      Works on 16 bit angles (65536 per turn). Internally the state is kept per tick
+ *      with 32 fractional bits per turn, so nothing divides and the cost is a few multiplies.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+
+class FixedTrackingObserver {
+public:
+    FixedTrackingObserver(float bandwidth, float dt);
+    void configure(float bandwidth, float dt);
+    void reset(uint16_t angle);
+    void update(uint16_t angle);
+
+    int32_t get_angle(void) const;
+    int32_t get_velocity(void) const;
+    int32_t get_acceleration(void) const;
+private:
+    static const int GAIN_BITS = 24;
+
+    int32_t _alpha;         // Gains with GAIN_BITS fractional bits
+    int32_t _beta;
+    int32_t _gamma;
+    int32_t _rate;          // Updates per second
+
+    int64_t _angle;         // Turns with 32 fractional bits, upper bits count whole turns
+    int32_t _velocity;      // Turns per tick with 32 fractional bits
+    int32_t _acceleration;  // Turns per tick squared with 32 fractional bits
+};
@@ -7,18 +7,18 @@
  */
 
 #include <string.h>
-#include <hardware/spi.h>
-#include <hardware/gpio.h>
+#include <HAL.h>
 #include <stdio.h>
 #include "MT6701.h"
 
 static uint8_t crc6(const uint8_t *data);
+static mt6701_err_t decode_frame(const uint8_t* buffer, uint16_t* count);
 
 /**
  * @brief Constructor for the MT6701 class
  */
-MT6701::MT6701(spi_inst_t* spi, uint csn_pin) {
-    _spi = spi;
+MT6701::MT6701(SPIBus* bus, uint csn_pin) {
+    _bus = bus;
     _csn_pin = csn_pin;
 }
 
@@ -27,76 +27,201 @@ MT6701::MT6701(spi_inst_t* spi, uint csn_pin) {
  * @return True if successful, false if not
 */
 void MT6701::init(void) {
-    gpio_init(_csn_pin);
-    gpio_set_dir(_csn_pin, GPIO_OUT);
-    gpio_pull_up(_csn_pin);
-    gpio_put(_csn_pin, true);
+    HAL::gpio_init(_csn_pin);
+    HAL::gpio_set_dir(_csn_pin, true);
+    HAL::gpio_pull_up(_csn_pin);
+    HAL::gpio_put(_csn_pin, true);
+    _device = _bus->add_device(15000000u, 8, 0, 1); // 15 MHz max, mode 1
 }
 
 
 /**
  * @brief Read angle and status bits from sensor
  * @param angle
- *          Pointer to a float in which the angle value in degrees will be placed
+ *          Pointer to a float in which the angle value in radians [0, 2pi) will be placed
  * @return Error type derived from status bits and CRC
  */
 mt6701_err_t MT6701::read(float* angle) {
-    // Get old baudrate to be respectful of other devices on the bus
-    uint old_baudrate = spi_get_baudrate(_spi);
-    spi_set_baudrate(_spi, 15000000u); // set baudrate to 15 MHz
-    spi_set_format(_spi, 8, SPI_CPOL_0, SPI_CPHA_1, SPI_MSB_FIRST);
+    uint16_t raw_angle = UINT16_MAX; // Never a valid count, tells us if read_raw got a frame
+    mt6701_err_t error = read_raw(&raw_angle);
+    if(raw_angle != UINT16_MAX) {
+        *angle = raw_angle * (3.14159265358979f / 8192.0f);
+    }
+    return error;
+}
 
+/**
+ * @brief Read the raw angle count and status bits from sensor
+ * @param count
+ *          Pointer to an integer in which the 14 bit angle count [0, 16383] will be placed, untouched if the frame is bad
+ * @return Error type derived from status bits and CRC
+ */
+mt6701_err_t MT6701::read_raw(uint16_t* count) {
     uint8_t buffer[3];
-    gpio_put(_csn_pin, false);
-    if(spi_read_blocking(_spi, 0x00, buffer, 3) != 3) {
-        gpio_put(_csn_pin, true);
-        spi_set_format(_spi, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
-        return mt6701_err_t::FAILED_OTHER;
+    _bus->acquire(_device);
+    HAL::gpio_put(_csn_pin, false);
+    int read = HAL::spi_read_blocking(_bus->get_spi(), 0x00, buffer, 3);
+    HAL::gpio_put(_csn_pin, true);
+    _bus->release();
+
+    if(read != 3) return mt6701_err_t::FAILED_OTHER;
+    mt6701_err_t error = decode_frame(buffer, count);
+    if(error != mt6701_err_t::FAILED_CRC) *count = apply_calibration(*count);
+    return error;
+}
+
+/**
+ * @brief Set up reads in the background over DMA, call from the core that runs the control loop
+ * @return True if successful, false if no DMA channels are free
+*/
+bool MT6701::init_async(void) {
+    _slots[0] = {0, mt6701_err_t::FAILED_OTHER};
+    _slots[1] = _slots[0];
+    _latest.store(0);
+    _busy.store(false);
+    return HAL::spi_dma_init(&_dma, _bus->get_spi(), dma_complete, this);
+}
+
+/**
+ * @brief Start a read in the background, the result shows up once the DMA interrupt has run.
+ *      The bus is held until finish_read or finish_read_raw.
+ * @return True if started, false if the previous read is still in flight
+*/
+bool MT6701::start_read(void) {
+    if(_busy.load(std::memory_order_acquire)) return false;
+    _bus->acquire(_device);
+    _bus_held = true;
+    _busy.store(true, std::memory_order_relaxed);
+    HAL::gpio_put(_csn_pin, false);
+    HAL::spi_dma_read(&_dma, 0x00, _dma_buffer, 3);
+    return true;
+}
+
+/**
+ * @brief Wait for the read started by start_read and get the raw angle count
+ * @param count
+ *          Pointer to an integer in which the 14 bit angle count [0, 16383] will be placed, untouched if the frame is bad
+ * @return Error type derived from status bits and CRC
+*/
+mt6701_err_t MT6701::finish_read_raw(uint16_t* count) {
+    while(_busy.load(std::memory_order_acquire)) {
+        HAL::tight_loop_contents();
+    }
+    if(_bus_held) {
+        _bus->release();
+        _bus_held = false;
     }
-    
-    gpio_put(_csn_pin, true);
-    spi_set_format(_spi, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+    return get_latest_raw(count);
+}
 
-    // To understand what's about to happen here just read the datasheet
-    // This may seem like a mess but I challenge you to propose a better solution
-    mt6701_err_t error = mt6701_err_t::OK;
-    uint8_t crc = 0;
-    crc |= buffer[2] & 0x3F; // Mask out the two msb
-    if(crc6(buffer) != crc) {
-        printf("Expected %#x, got %#x\n", crc6(buffer), crc);
-        return mt6701_err_t::FAILED_CRC;
+/**
+ * @brief Wait for the read started by start_read and get the angle
+ * @param angle
+ *          Pointer to a float in which the angle value in radians [0, 2pi) will be placed
+ * @return Error type derived from status bits and CRC
+*/
+mt6701_err_t MT6701::finish_read(float* angle) {
+    uint16_t raw_angle = UINT16_MAX;
+    mt6701_err_t error = finish_read_raw(&raw_angle);
+    if(raw_angle != UINT16_MAX) {
+        *angle = raw_angle * (3.14159265358979f / 8192.0f);
     }
+    return error;
+}
 
-    // Time to check some status bits!
-    if((buffer[1] & 0x01)) error = mt6701_err_t::LOSS_OF_TRACK;
-    switch (buffer[2] & 0xC0) {
-        case 0x00:
-            // Nothing to see here, carry on
-            break;
-        case 0x40:
-            error = mt6701_err_t::FIELD_TOO_STRONG;
-            break;
-        case 0x80:
-            error = mt6701_err_t::FIELD_TOO_WEAK;
-            break;
-        default:
-            error = mt6701_err_t::FAILED_OTHER;
-            break;
+/**
+ * @brief Get the last completed background read without waiting
+ * @param count
+ *          Pointer to an integer in which the 14 bit angle count [0, 16383] will be placed, untouched if the frame is bad
+ * @return Error type of the last completed read
+*/
+mt6701_err_t MT6701::get_latest_raw(uint16_t* count) {
+    const sample_t& sample = _slots[_latest.load(std::memory_order_acquire)];
+    if(sample.error != mt6701_err_t::FAILED_CRC && sample.error != mt6701_err_t::FAILED_OTHER) {
+        *count = sample.count;
     }
+    return sample.error;
+}
 
-    uint16_t raw_angle = 0;
-    raw_angle |= buffer[0];
-    raw_angle <<= 8;
-    raw_angle |= buffer[1];
-    raw_angle = raw_angle & 0xFFFC; // Mask out the two lsb
-    raw_angle >>= 2;
-    *angle = raw_angle * 3.14159265358979 / 8192.0;
+/**
+ * @brief Start correcting every read with a calibration table, don't call while core 1 is reading
+ * @param table CAL_SIZE corrections in counts, entry i applies at count i * 16384 / CAL_SIZE
+*/
+void MT6701::set_calibration(const int16_t* table) {
+    memcpy(_cal_table, table, CAL_SIZE * sizeof(int16_t));
+    _cal_table[CAL_SIZE] = table[0];
+    _cal_enabled = true;
+}
 
-    // Set baudrate to old baudrate again
-    if(spi_set_baudrate(_spi, old_baudrate) != old_baudrate) {
-        error = mt6701_err_t::FAILED_OTHER;
-    }
-    return error;
+/**
+ * @brief Go back to raw counts, needed while measuring a new calibration
+*/
+void MT6701::clear_calibration(void) {
+    _cal_enabled = false;
+}
+
+/**
+ * @brief Copy out the calibration table
+ * @param table Pointer to CAL_SIZE entries
+ * @return True if a calibration is in use, false if not
+*/
+bool MT6701::get_calibration(int16_t* table) const {
+    memcpy(table, _cal_table, CAL_SIZE * sizeof(int16_t));
+    return _cal_enabled;
+}
+
+/**
+ * @brief Load the calibration table from flash
+ * @param flash_offset Byte offset of the record from the start of flash
+ * @return True if a valid table was found and is now in use, false if not
+*/
+bool MT6701::load_calibration(uint32_t flash_offset) {
+    int16_t table[CAL_SIZE];
+    if(!Storage::load(flash_offset, CAL_MAGIC, table, sizeof(table))) return false;
+    set_calibration(table);
+    return true;
+}
+
+/**
+ * @brief Store the calibration table in flash, erases the whole sector
+ * @param flash_offset Byte offset of the record from the start of flash, sector aligned
+ * @return True if successful, false if there is no calibration or the write failed
+*/
+bool MT6701::save_calibration(uint32_t flash_offset) const {
+    if(!_cal_enabled) return false;
+    return Storage::save(flash_offset, CAL_MAGIC, _cal_table, CAL_SIZE * sizeof(int16_t));
+}
+
+/******************************* PRIVATE METHODS *******************************/
+
+/**
+ * @brief Correct a raw count with the calibration table, linear interpolation between nodes
+ * @param count Raw 14 bit count
+ * @return Corrected 14 bit count
+*/
+uint16_t MT6701::apply_calibration(uint16_t count) const {
+    if(!_cal_enabled) return count;
+    uint32_t node = count >> CAL_SHIFT;
+    int32_t frac = count & ((1 << CAL_SHIFT) - 1);
+    int32_t a = _cal_table[node];
+    int32_t b = _cal_table[node + 1];
+    int32_t correction = a + (((b - a) * frac) >> CAL_SHIFT);
+    return (uint16_t)((count + correction) & 0x3FFF);
+}
+
+/**
+ * @brief DMA completion interrupt, decodes into the slot that is not being read and publishes it
+*/
+void MT6701::dma_complete(void* user_data) {
+    MT6701* self = (MT6701*)user_data;
+    HAL::gpio_put(self->_csn_pin, true);
+
+    uint8_t next = self->_latest.load(std::memory_order_relaxed) ^ 1;
+    sample_t& sample = self->_slots[next];
+    sample.error = decode_frame(self->_dma_buffer, &sample.count);
+    if(sample.error != mt6701_err_t::FAILED_CRC) sample.count = self->apply_calibration(sample.count);
+    self->_latest.store(next, std::memory_order_release);
+    self->_busy.store(false, std::memory_order_release);
 }
 
 /**
@@ -142,4 +267,45 @@ static uint8_t crc6(const uint8_t* data) {
     b_CRC = tableCRC6[b_Index];
 
     return b_CRC;
+}
+
+/**
+ * @brief Check and unpack a 3 byte SSI frame
+ * @param count
+ *          Pointer to an integer in which the 14 bit angle count will be placed, untouched if the CRC fails
+ * @return Error type derived from status bits and CRC
+ */
+static mt6701_err_t decode_frame(const uint8_t* buffer, uint16_t* count) {
+    // To understand what's about to happen here just read the datasheet
+    // This may seem like a mess but I challenge you to propose a better solution
+    mt6701_err_t error = mt6701_err_t::OK;
+    uint8_t crc = 0;
+    crc |= buffer[2] & 0x3F; // Mask out the two msb
+    if(crc6(buffer) != crc) return mt6701_err_t::FAILED_CRC; // Reported by the caller, this runs in the control loop
+
+    // Time to check some status bits!
+    if((buffer[1] & 0x01)) error = mt6701_err_t::LOSS_OF_TRACK;
+    switch (buffer[2] & 0xC0) {
+        case 0x00:
+            // Nothing to see here, carry on
+            break;
+        case 0x40:
+            error = mt6701_err_t::FIELD_TOO_STRONG;
+            break;
+        case 0x80:
+            error = mt6701_err_t::FIELD_TOO_WEAK;
+            break;
+        default:
+            error = mt6701_err_t::FAILED_OTHER;
+            break;
+    }
+
+    uint16_t raw_angle = 0;
+    raw_angle |= buffer[0];
+    raw_angle <<= 8;
+    raw_angle |= buffer[1];
+    raw_angle = raw_angle & 0xFFFC; // Mask out the two lsb
+    raw_angle >>= 2;
+    *count = raw_angle;
+    return error;
 } 
\ No newline at end of file
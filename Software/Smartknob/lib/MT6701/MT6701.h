@@ -7,7 +7,10 @@
  */
 
 #pragma once
-#include <hardware/spi.h>
+#include <HAL.h>
+#include <SPIBus.h>
+#include <Storage.h>
+#include <atomic>
 
 // Error type for the read function
 enum class mt6701_err_t {
@@ -21,10 +24,51 @@ enum class mt6701_err_t {
 
 class MT6701 {
 public:
-    MT6701(spi_inst_t* spi, uint csn_pin);
+    // Correction table, one node every 256 counts, interpolated in between
+    static const int CAL_BITS = 6;
+    static const int CAL_SIZE = 1 << CAL_BITS;
+
+    MT6701(SPIBus* bus, uint csn_pin);
     void init(void);
     mt6701_err_t read(float* angle);
+    mt6701_err_t read_raw(uint16_t* count);
+
+    bool init_async(void);
+    bool start_read(void);
+    mt6701_err_t finish_read(float* angle);
+    mt6701_err_t finish_read_raw(uint16_t* count);
+    mt6701_err_t get_latest_raw(uint16_t* count);
+
+    void set_calibration(const int16_t* table);
+    void clear_calibration(void);
+    bool get_calibration(int16_t* table) const;
+    bool load_calibration(uint32_t flash_offset);
+    bool save_calibration(uint32_t flash_offset) const;
 private:
-    spi_inst_t* _spi;
+    static const int CAL_SHIFT = 14 - CAL_BITS;
+    static const uint32_t CAL_MAGIC = 0x4C414336; // "6CAL", change when the table layout changes
+
+    struct sample_t {
+        uint16_t count;
+        mt6701_err_t error;
+    };
+
+    SPIBus* _bus;
+    uint8_t _device = SPIBus::NO_DEVICE;
     uint _csn_pin;
+
+    // Background reads, the DMA interrupt fills one slot while the other is read
+    HAL::spi_dma_t _dma;
+    uint8_t _dma_buffer[3];
+    sample_t _slots[2];
+    std::atomic<uint8_t> _latest{0};
+    std::atomic<bool> _busy{false};
+    bool _bus_held = false;
+
+    // Counts to add to the raw count at each node, the last entry repeats the first for the wrap
+    int16_t _cal_table[CAL_SIZE + 1];
+    bool _cal_enabled = false;
+
+    uint16_t apply_calibration(uint16_t count) const;
+    static void dma_complete(void* user_data);
 };
\ No newline at end of file
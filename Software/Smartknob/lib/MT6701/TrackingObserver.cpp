@@ -0,0 +1,77 @@
+/*
+ *  Title: Tracking Observer Library
+
+ *  Description: Third order tracking loop on the encoder angle
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <math.h>
+#include <FastTrig.h>
+#include "TrackingObserver.h"
+
+/**
+ * @brief Constructor for the TrackingObserver class
+ * @param bandwidth Bandwidth of the loop in rad/s, higher follows faster but lets through more noise
+ * @param dt Time between updates in seconds
+*/
+TrackingObserver::TrackingObserver(float bandwidth, float dt) {
+    configure(bandwidth, dt);
+    reset(0.0f);
+}
+
+/******************************* PUBLIC METHODS *******************************/
+
+/**
+ * @brief Work out the gains that put all three poles at exp(-bandwidth * dt)
+*/
+void TrackingObserver::configure(float bandwidth, float dt) {
+    float r = expf(-bandwidth * dt);
+    float k = 1.0f - r;
+    _dt = dt;
+    _alpha = 1.0f - r * r * r;
+    _beta = 1.5f * k * k * (1.0f + r) / dt;
+    _gamma = k * k * k / (dt * dt);
+}
+
+/**
+ * @brief Start tracking from standstill at an angle
+ * @param angle Measured angle in radians [0, 2pi)
+*/
+void TrackingObserver::reset(float angle) {
+    _turns = 0;
+    _angle = FastTrig::wrap_2pi(angle);
+    _velocity = 0.0f;
+    _acceleration = 0.0f;
+}
+
+/**
+ * @brief Run one step of the loop, call once per dt
+ * @param angle Measured angle in radians [0, 2pi)
+*/
+void TrackingObserver::update(float angle) {
+    // Predict forward one step, then correct by the wrapped residual
+    float predicted = _angle + (_velocity + 0.5f * _acceleration * _dt) * _dt;
+    float residual = FastTrig::wrap_pi(angle - predicted);
+
+    _angle = predicted + _alpha * residual;
+    _velocity += _acceleration * _dt + _beta * residual;
+    _acceleration += _gamma * residual;
+
+    // Move whole turns over to the counter, the angle can't be more than a turn out
+    const float two_pi = 6.28318530718f;
+    if(_angle >= two_pi) {
+        _angle -= two_pi;
+        _turns++;
+    } else if(_angle < 0.0f) {
+        _angle += two_pi;
+        _turns--;
+    }
+}
+
+/**
+ * @brief Unwrapped multi-turn angle in radians
+*/
+float TrackingObserver::get_angle(void) const {
+    return (float)_turns * 6.28318530718f + _angle;
+}
@@ -0,0 +1,36 @@
+/*
+ *  Title: Tracking Observer Library
+
+ *  Description: Third order tracking loop on the encoder angle. Gives the unwrapped
+ *      multi-turn angle, velocity and acceleration every tick at a fixed cost.
+ *      The loop has a triple pole at the given bandwidth, so it settles without ringing.
+ *      Ramps and constant acceleration are followed without lag, a step overshoots by about 16%.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+
+class TrackingObserver {
+public:
+    TrackingObserver(float bandwidth, float dt);
+    void configure(float bandwidth, float dt);
+    void reset(float angle);
+    void update(float angle);
+
+    float get_angle(void) const;
+    int32_t get_turns(void) const { return _turns; };
+    float get_velocity(void) const { return _velocity; };
+    float get_acceleration(void) const { return _acceleration; };
+private:
+    float _dt;
+    float _alpha;       // Gains for position, velocity and acceleration, dt folded in
+    float _beta;
+    float _gamma;
+
+    int32_t _turns;     // Whole turns, kept apart so the angle doesn't lose precision
+    float _angle;       // Angle within the turn in radians [0, 2pi)
+    float _velocity;    // Radians per second
+    float _acceleration;// Radians per second squared
+};
@@ -0,0 +1,99 @@
+/*
+ *  Title: Fixed-Point PID Library
+
+ *  Description: Integer version of SMARTKNOB::PID for the fixed-point control path
+ * 
+ *  Author: Mani Magnusson
+ */
+
+#include <stdint.h>
+#include <Fixed.h>
+#include "FixedPID.h"
+
+static q15_t saturate_q15(int64_t x)
+{
+    if(x > Fixed::Q15_MAX) return Fixed::Q15_MAX;
+    if(x < Fixed::Q15_MIN) return Fixed::Q15_MIN;
+    return (q15_t)x;
+}
+
+/**
+ * @brief Convert the float gains into integer gains for the fixed sample time
+*/
+void SMARTKNOB::FixedPID::configure(void)
+{
+    // One input unit expressed in Q15 output units
+    float unit = _input_scale / _output_scale * 32768.0f;
+    _kp = Fixed::float_to_q24(kP * unit);
+    _ki = Fixed::float_to_q24(kI * _dt * unit);
+    _kd = Fixed::float_to_q24(kD / _dt * unit / (float)(1 << DERIV_SHIFT));
+
+    float limit = enableAntiwindup ? (antiwindup / (_dt * _input_scale)) : 2.0e9f;
+    _integrator_limit = (limit > 2.0e9f) ? 2000000000 : (int32_t)limit;
+
+    _filter_a = (int32_t)((1.0f / (1.0f + N * _dt)) * 1073741824.0f);
+    _filter_b = (int32_t)(N * _dt * 65536.0f * (float)(1 << DERIV_SHIFT));
+}
+
+// PID update function, the sample time is fixed by the constructor
+q15_t SMARTKNOB::FixedPID::update(int32_t pv)
+{
+    // Calculate this timestep's error, based on setpoint and input
+    error = setpoint - pv;
+
+    // Angular inputs are 16 bit turns so the wrap is a plain truncation
+    if(errorMode == ErrorMode::ANGULAR)
+    {
+        error = (int16_t)error;
+    }
+
+    // Integrate and clamp, always clamped to keep the sum from overflowing
+    integrator += error;
+    if(integrator > _integrator_limit) // Upper bound
+    {
+        integrator = _integrator_limit;
+    }
+    else if(integrator < -_integrator_limit) // Lower bound
+    {
+        integrator = -_integrator_limit;
+    }
+
+    // Calculate this timestep's derivative, per tick rather than per second
+    int32_t delta = 0;
+    if(derivativeMode == DerivativeMode::DERIVATIVE_ON_ERROR || derivativeMode == DerivativeMode::DERIVATIVE_ON_ERROR_FILTERED)
+    {
+        delta = error - derivLast;
+        derivLast = error;
+    }
+    else
+    {
+        delta = pv - derivLast;
+        derivLast = pv;
+    }
+    if(errorMode == ErrorMode::ANGULAR)
+    {
+        delta = (int16_t)delta;
+    }
+
+    if(derivativeMode == DerivativeMode::DERIVATIVE_ON_ERROR || derivativeMode == DerivativeMode::DERIVATIVE_ON_MEASUREMENT)
+    {
+        derivative = delta << DERIV_SHIFT;
+    }
+    else
+    {
+        int64_t filtered = (int64_t)derivative + (((int64_t)_filter_b * delta) >> 16);
+        derivative = (int32_t)((filtered * _filter_a) >> 30);
+    }
+
+    // Sum the total controller output
+    int32_t proportional = (proportionalMode == ProportionalMode::PROPORTIONAL_ON_ERROR) ? error : pv;
+    int64_t p = (int64_t)_kp * proportional;
+    int64_t i = (int64_t)_ki * integrator;
+    int64_t d = (int64_t)_kd * derivative;
+    pTerm = saturate_q15(p >> 24);
+    iTerm = saturate_q15(i >> 24);
+    dTerm = saturate_q15(d >> 24);
+    output = saturate_q15((p + i + d) >> 24);
+
+    return output;
+}
@@ -0,0 +1,72 @@
+/*
+ *  Title: Fixed-Point PID Library
+
+ *  Description: Integer version of SMARTKNOB::PID for the fixed-point control path.
+ *      Gains are set in the same float units as PID and converted once by configure().
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <Fixed.h>
+#include "PID.h"
+
+namespace SMARTKNOB
+{
+    class FixedPID
+    {
+    public:
+        // Float configuration, call configure() after changing any of these
+        float kP;
+        float kI;
+        float kD;
+        float N;
+        float antiwindup;
+        bool enableAntiwindup = false;
+
+        int32_t setpoint;   // In input units
+        int32_t error;      // In input units
+        q15_t output;       // Q15 fraction of output_scale
+        q15_t pTerm;        // Contributions to the last output, saturated to Q15
+        q15_t iTerm;
+        q15_t dTerm;
+
+        ErrorMode errorMode = ErrorMode::LINEAR;
+        ProportionalMode proportionalMode = ProportionalMode::PROPORTIONAL_ON_ERROR;
+        DerivativeMode derivativeMode = DerivativeMode::DERIVATIVE_ON_ERROR;
+
+        /**
+         * @brief Constructor, gains have the same units as for PID
+         * @param dt Fixed sample time in seconds
+         * @param input_scale Size of one input unit, for example 2pi/65536 rad for a 16 bit angle
+         * @param output_scale Output value that maps to a Q15 of 1.0, for example the FOC voltage limit
+        */
+        FixedPID(float p, float i, float d, float n, float dt, float input_scale, float output_scale)
+            : kP(p), kI(i), kD(d), N(n), antiwindup(0), setpoint(0), error(0), output(0),
+              _dt(dt), _input_scale(input_scale), _output_scale(output_scale) { configure(); reset(); };
+
+        void configure(void);
+        q15_t update(int32_t pv);
+
+        void reset() { setpoint = error = output = pTerm = iTerm = dTerm = 0; integrator = derivative = derivLast = 0; };
+    private:
+        static const int DERIV_SHIFT = 8;   // Fractional bits of the derivative state
+
+        float _dt;
+        float _input_scale;
+        float _output_scale;
+
+        // Gains with 24 fractional bits, producing Q15 output
+        int32_t _kp;
+        int32_t _ki;
+        int32_t _kd;
+        int32_t _integrator_limit;
+        int32_t _filter_a;  // 1/(1 + N*dt) with 30 fractional bits
+        int32_t _filter_b;  // N*dt with 16 + DERIV_SHIFT fractional bits
+
+        int32_t integrator; // Sum of errors in input units times ticks
+        int32_t derivative; // Change per tick in input units with DERIV_SHIFT fractional bits
+        int32_t derivLast;
+    };
+}
@@ -10,7 +10,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <array>
-#include "pico/stdlib.h"
+#include <FastTrig.h>
 #include "PID.h"
 
 // PID update function
@@ -22,7 +22,7 @@ float SMARTKNOB::PID::update(float pv, float dt)
     // Convert 0-360 to -180-180 for angular errors
     if(errorMode == ErrorMode::ANGULAR)
     {
-        error = fmodf(error + _3pi, _2pi) - _pi;
+        error = FastTrig::wrap_pi(error);
     }
 
     // Integrate and apply antiwindup clamp
@@ -64,12 +64,15 @@ float SMARTKNOB::PID::update(float pv, float dt)
     // Sum the total controller output
     if(proportionalMode == ProportionalMode::PROPORTIONAL_ON_ERROR)
     {
-        output = (kP * error) + (kI * integrator) + (kD * derivative);
+        pTerm = kP * error;
     }
     else if(proportionalMode == ProportionalMode::PROPORTIONAL_ON_MEASUREMENT)
     {
-        output = (kP * pv) + (kI * integrator) + (kD * derivative);
+        pTerm = kP * pv;
     }
+    iTerm = kI * integrator;
+    dTerm = kD * derivative;
+    output = pTerm + iTerm + dTerm;
 
     return output;
 }
\ No newline at end of file
@@ -46,6 +46,9 @@ namespace SMARTKNOB
         bool enableAntiwindup = false;
 
         float output;
+        float pTerm; // Contributions to the last output
+        float iTerm;
+        float dTerm;
 
         ErrorMode errorMode = ErrorMode::LINEAR;
         ProportionalMode proportionalMode = ProportionalMode::PROPORTIONAL_ON_ERROR;
@@ -58,11 +61,8 @@ namespace SMARTKNOB
 
         float update(float pv, float dt);
 
-        void reset() { setpoint = output = error = integrator = derivative = derivLast = 0; };
+        void reset() { setpoint = output = error = integrator = derivative = derivLast = 0; pTerm = iTerm = dTerm = 0; };
     private:
-        const float _pi = 3.14159265358f;
-        const float _3pi = 9.42477796076f;
-        const float _2pi = 6.28318530717f;
         float integrator;
         float derivative;
         float derivLast;
@@ -0,0 +1,156 @@
+/*
+ *  Title: PID Bank Library
+
+ *  Description: K float PID controllers updated together, for running several loops in one
+ *      tick. Gains and state are kept as one array per field rather than one object per
+ *      controller, and the modes of each controller are turned into weights, so the update
+ *      is the same arithmetic for every controller and the compiler vectorizes it on the
+ *      host. Each controller is loaded from a configured SMARTKNOB::PID and gives the same
+ *      output as that PID would, bit for bit.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <FastTrig.h>
+#include "PID.h"
+
+namespace SMARTKNOB
+{
+    /**
+     * @brief PIDBank class
+     * @param K Number of controllers
+    */
+    template <uint K> class PIDBank
+    {
+        static_assert(K >= 1, "K is 0");
+    public:
+        alignas(16) float setpoint[K];
+
+        // Last update of each controller
+        alignas(16) float error[K];
+        alignas(16) float output[K];
+        alignas(16) float pTerm[K]; // Contributions to the last output
+        alignas(16) float iTerm[K];
+        alignas(16) float dTerm[K];
+
+        PIDBank()
+        {
+            for(uint k = 0; k < K; k++) configure(k, PID());
+            reset();
+        };
+
+        /**
+         * @brief Load the gains, modes and setpoint of a controller, its state is left alone
+         * @param k Controller, below K
+         * @param pid Configured PID to copy
+         * @return False if k is out of range
+        */
+        bool configure(uint k, const PID& pid)
+        {
+            if(k >= K) return false;
+            _kP[k] = pid.kP;
+            _kI[k] = pid.kI;
+            _kD[k] = pid.kD;
+            _limit[k] = pid.enableAntiwindup ? pid.antiwindup : INFINITY;
+
+            bool p_on_error = pid.proportionalMode == ProportionalMode::PROPORTIONAL_ON_ERROR;
+            _p_error[k] = p_on_error ? 1.0f : 0.0f;
+            _p_measurement[k] = p_on_error ? 0.0f : 1.0f;
+
+            bool d_on_error = pid.derivativeMode == DerivativeMode::DERIVATIVE_ON_ERROR ||
+                pid.derivativeMode == DerivativeMode::DERIVATIVE_ON_ERROR_FILTERED;
+            bool filtered = pid.derivativeMode == DerivativeMode::DERIVATIVE_ON_ERROR_FILTERED ||
+                pid.derivativeMode == DerivativeMode::DERIVATIVE_ON_MEASUREMENT_FILTERED;
+            _d_error[k] = d_on_error ? 1.0f : 0.0f;
+            _d_measurement[k] = d_on_error ? 0.0f : 1.0f;
+            // (keep * derivative + gain * change) / (keep + gain * dt) is the filter of PID with N, or a plain difference over dt
+            _d_keep[k] = filtered ? 1.0f : 0.0f;
+            _d_gain[k] = filtered ? pid.N : 1.0f;
+
+            _angular[k] = pid.errorMode == ErrorMode::ANGULAR;
+            _angular_count = 0;
+            for(uint i = 0; i < K; i++) _angular_count += _angular[i] ? 1 : 0;
+
+            setpoint[k] = pid.setpoint;
+            return true;
+        };
+
+        /**
+         * @brief Update every controller
+         * @param pv Input of each controller, K values
+         * @param dt Time since the last update in seconds, the same for all
+         * @return The K outputs, the same as output
+        */
+        const float* update(const float* pv, float dt)
+        {
+            // A copy the compiler knows does not overlap the rest of the bank
+            memcpy(_pv, pv, sizeof(_pv));
+
+            for(uint k = 0; k < K; k++) error[k] = setpoint[k] - _pv[k];
+
+            // Angular errors wrap with branches, so only the controllers that need it go through here
+            if(_angular_count > 0)
+            {
+                for(uint k = 0; k < K; k++)
+                {
+                    if(_angular[k]) error[k] = FastTrig::wrap_pi(error[k]);
+                }
+            }
+
+            for(uint k = 0; k < K; k++)
+            {
+                // Integrate and apply antiwindup clamp, the limit is infinite without antiwindup
+                float integrator = _integrator[k] + error[k] * dt;
+                integrator = integrator > _limit[k] ? _limit[k] : integrator;
+                integrator = integrator < -_limit[k] ? -_limit[k] : integrator;
+                _integrator[k] = integrator;
+
+                // The weights are 0 or 1 so the unused source adds an exact 0
+                float source = _d_error[k] * error[k] + _d_measurement[k] * _pv[k];
+                float derivative = (_d_keep[k] * _derivative[k] + _d_gain[k] * (source - _derivLast[k])) / (_d_keep[k] + _d_gain[k] * dt);
+                _derivative[k] = derivative;
+                _derivLast[k] = source;
+
+                pTerm[k] = _kP[k] * (_p_error[k] * error[k] + _p_measurement[k] * _pv[k]);
+                iTerm[k] = _kI[k] * integrator;
+                dTerm[k] = _kD[k] * derivative;
+                output[k] = pTerm[k] + iTerm[k] + dTerm[k];
+            }
+            return output;
+        };
+
+        void reset()
+        {
+            for(uint k = 0; k < K; k++)
+            {
+                setpoint[k] = output[k] = error[k] = 0;
+                pTerm[k] = iTerm[k] = dTerm[k] = 0;
+                _integrator[k] = _derivative[k] = _derivLast[k] = 0;
+            }
+        };
+    private:
+        // Gains and mode weights
+        alignas(16) float _kP[K];
+        alignas(16) float _kI[K];
+        alignas(16) float _kD[K];
+        alignas(16) float _limit[K];
+        alignas(16) float _p_error[K];
+        alignas(16) float _p_measurement[K];
+        alignas(16) float _d_error[K];
+        alignas(16) float _d_measurement[K];
+        alignas(16) float _d_keep[K];
+        alignas(16) float _d_gain[K];
+        bool _angular[K] = {};
+        uint _angular_count = 0;
+
+        // State
+        alignas(16) float _pv[K];
+        alignas(16) float _integrator[K];
+        alignas(16) float _derivative[K];
+        alignas(16) float _derivLast[K];
+    };
+}
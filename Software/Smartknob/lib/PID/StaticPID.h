@@ -0,0 +1,265 @@
+/*
+ *  Title: Static PID Library
+
+ *  Description: SMARTKNOB::PID and FixedPID with the modes chosen at compile time by policy
+ *      classes, so update has no branches on them and compiles to straight line code.
+ *      StaticPID<..., float> gives the same output as PID and StaticPID<..., q15_t> the same
+ *      as FixedPID, bit for bit, for the same modes. Use PID or FixedPID where the modes
+ *      are changed while tuning.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <FastTrig.h>
+#include <Fixed.h>
+#include "PID.h"
+
+namespace SMARTKNOB
+{
+    namespace PIDPolicy
+    {
+        // How the error is formed from the setpoint and input
+        struct LinearError
+        {
+            static const ErrorMode MODE = ErrorMode::LINEAR;
+            static float wrap(float error) { return error; };
+            static int32_t wrap(int32_t error) { return error; };
+        };
+
+        struct AngularError
+        {
+            static const ErrorMode MODE = ErrorMode::ANGULAR;
+            static float wrap(float error) { return FastTrig::wrap_pi(error); };
+            static int32_t wrap(int32_t error) { return (int16_t)error; }; // 16 bit turns, as for FixedPID
+        };
+
+        // What the derivative is taken of, and whether it goes through the first order filter with N
+        template <bool ON_MEASUREMENT, bool IS_FILTERED, DerivativeMode M> struct Derivative
+        {
+            static const DerivativeMode MODE = M;
+            static const bool FILTERED = IS_FILTERED;
+            template <typename T> static T source(T error, T pv) { return ON_MEASUREMENT ? pv : error; };
+        };
+        typedef Derivative<false, false, DerivativeMode::DERIVATIVE_ON_ERROR> DerivativeOnError;
+        typedef Derivative<false, true, DerivativeMode::DERIVATIVE_ON_ERROR_FILTERED> DerivativeOnErrorFiltered;
+        typedef Derivative<true, false, DerivativeMode::DERIVATIVE_ON_MEASUREMENT> DerivativeOnMeasurement;
+        typedef Derivative<true, true, DerivativeMode::DERIVATIVE_ON_MEASUREMENT_FILTERED> DerivativeOnMeasurementFiltered;
+
+        // What the proportional gain multiplies
+        struct ProportionalOnError
+        {
+            static const ProportionalMode MODE = ProportionalMode::PROPORTIONAL_ON_ERROR;
+            template <typename T> static T source(T error, T) { return error; };
+        };
+
+        struct ProportionalOnMeasurement
+        {
+            static const ProportionalMode MODE = ProportionalMode::PROPORTIONAL_ON_MEASUREMENT;
+            template <typename T> static T source(T, T pv) { return pv; };
+        };
+
+        // Whether the integrator is clamped to +-antiwindup
+        struct NoAntiwindup
+        {
+            static const bool ENABLED = false;
+            static float clamp(float integrator, float) { return integrator; };
+        };
+
+        struct ClampAntiwindup
+        {
+            static const bool ENABLED = true;
+            static float clamp(float integrator, float limit)
+            {
+                if(integrator > limit) // Upper bound
+                {
+                    return limit;
+                }
+                else if(integrator < -limit) // Lower bound
+                {
+                    return -limit;
+                }
+                return integrator;
+            };
+        };
+    }
+
+    /**
+     * @brief PID with compile time modes
+     * @param ErrorPolicy PIDPolicy::LinearError or AngularError
+     * @param DerivPolicy PIDPolicy::DerivativeOnError, DerivativeOnErrorFiltered, DerivativeOnMeasurement
+     *      or DerivativeOnMeasurementFiltered
+     * @param PropPolicy PIDPolicy::ProportionalOnError or ProportionalOnMeasurement
+     * @param AntiwindupPolicy PIDPolicy::NoAntiwindup or ClampAntiwindup
+     * @param Scalar float for the PID arithmetic, q15_t for the FixedPID arithmetic
+    */
+    template <class ErrorPolicy, class DerivPolicy, class PropPolicy, class AntiwindupPolicy, typename Scalar = float> class StaticPID;
+
+    template <class ErrorPolicy, class DerivPolicy, class PropPolicy, class AntiwindupPolicy>
+    class StaticPID<ErrorPolicy, DerivPolicy, PropPolicy, AntiwindupPolicy, float>
+    {
+    public:
+        float kP;
+        float kI;
+        float kD;
+        float N;
+        float setpoint;
+
+        float error;
+
+        float antiwindup; // Only used with ClampAntiwindup
+
+        float output;
+        float pTerm; // Contributions to the last output
+        float iTerm;
+        float dTerm;
+
+        StaticPID(float p = 1, float i = 0, float d = 0, float n = 1, float a = 0) : kP(p), kI(i), kD(d), N(n), antiwindup(a) { reset(); };
+
+        // PID update function, the same steps as PID::update without the mode checks
+        float update(float pv, float dt)
+        {
+            error = ErrorPolicy::wrap(setpoint - pv);
+
+            integrator += error * dt;
+            integrator = AntiwindupPolicy::clamp(integrator, antiwindup);
+
+            float source = DerivPolicy::source(error, pv);
+            if constexpr(DerivPolicy::FILTERED)
+            {
+                derivative = (derivative + N * (source - derivLast)) / (1 + N * dt);
+            }
+            else
+            {
+                derivative = (source - derivLast) / dt;
+            }
+            derivLast = source;
+
+            pTerm = kP * PropPolicy::source(error, pv);
+            iTerm = kI * integrator;
+            dTerm = kD * derivative;
+            output = pTerm + iTerm + dTerm;
+
+            return output;
+        };
+
+        void reset() { setpoint = output = error = integrator = derivative = derivLast = 0; pTerm = iTerm = dTerm = 0; };
+    private:
+        float integrator;
+        float derivative;
+        float derivLast;
+    };
+
+    template <class ErrorPolicy, class DerivPolicy, class PropPolicy, class AntiwindupPolicy>
+    class StaticPID<ErrorPolicy, DerivPolicy, PropPolicy, AntiwindupPolicy, q15_t>
+    {
+    public:
+        // Float configuration, call configure() after changing any of these
+        float kP;
+        float kI;
+        float kD;
+        float N;
+        float antiwindup;   // Only used with ClampAntiwindup, the integrator is always clamped to keep it from overflowing
+
+        int32_t setpoint;   // In input units
+        int32_t error;      // In input units
+        q15_t output;       // Q15 fraction of output_scale
+        q15_t pTerm;        // Contributions to the last output, saturated to Q15
+        q15_t iTerm;
+        q15_t dTerm;
+
+        /**
+         * @brief Constructor, the same as for FixedPID
+         * @param dt Fixed sample time in seconds
+         * @param input_scale Size of one input unit, for example 2pi/65536 rad for a 16 bit angle
+         * @param output_scale Output value that maps to a Q15 of 1.0, for example the FOC voltage limit
+        */
+        StaticPID(float p, float i, float d, float n, float dt, float input_scale, float output_scale)
+            : kP(p), kI(i), kD(d), N(n), antiwindup(0), setpoint(0), error(0), output(0),
+              _dt(dt), _input_scale(input_scale), _output_scale(output_scale) { configure(); reset(); };
+
+        /**
+         * @brief Convert the float gains into integer gains for the fixed sample time
+        */
+        void configure(void)
+        {
+            float unit = _input_scale / _output_scale * 32768.0f;
+            _kp = Fixed::float_to_q24(kP * unit);
+            _ki = Fixed::float_to_q24(kI * _dt * unit);
+            _kd = Fixed::float_to_q24(kD / _dt * unit / (float)(1 << DERIV_SHIFT));
+
+            float limit = AntiwindupPolicy::ENABLED ? (antiwindup / (_dt * _input_scale)) : 2.0e9f;
+            _integrator_limit = (limit > 2.0e9f) ? 2000000000 : (int32_t)limit;
+
+            _filter_a = (int32_t)((1.0f / (1.0f + N * _dt)) * 1073741824.0f);
+            _filter_b = (int32_t)(N * _dt * 65536.0f * (float)(1 << DERIV_SHIFT));
+        };
+
+        // PID update function, the same steps as FixedPID::update without the mode checks
+        q15_t update(int32_t pv)
+        {
+            error = ErrorPolicy::wrap(setpoint - pv);
+
+            integrator += error;
+            if(integrator > _integrator_limit) // Upper bound
+            {
+                integrator = _integrator_limit;
+            }
+            else if(integrator < -_integrator_limit) // Lower bound
+            {
+                integrator = -_integrator_limit;
+            }
+
+            int32_t source = DerivPolicy::source(error, pv);
+            int32_t delta = ErrorPolicy::wrap(source - derivLast);
+            derivLast = source;
+            if constexpr(DerivPolicy::FILTERED)
+            {
+                int64_t filtered = (int64_t)derivative + (((int64_t)_filter_b * delta) >> 16);
+                derivative = (int32_t)((filtered * _filter_a) >> 30);
+            }
+            else
+            {
+                derivative = delta << DERIV_SHIFT;
+            }
+
+            int64_t p = (int64_t)_kp * PropPolicy::source(error, pv);
+            int64_t i = (int64_t)_ki * integrator;
+            int64_t d = (int64_t)_kd * derivative;
+            pTerm = saturate_q15(p >> 24);
+            iTerm = saturate_q15(i >> 24);
+            dTerm = saturate_q15(d >> 24);
+            output = saturate_q15((p + i + d) >> 24);
+
+            return output;
+        };
+
+        void reset() { setpoint = error = output = pTerm = iTerm = dTerm = 0; integrator = derivative = derivLast = 0; };
+    private:
+        static const int DERIV_SHIFT = 8;   // Fractional bits of the derivative state
+
+        float _dt;
+        float _input_scale;
+        float _output_scale;
+
+        // Gains with 24 fractional bits, producing Q15 output
+        int32_t _kp;
+        int32_t _ki;
+        int32_t _kd;
+        int32_t _integrator_limit;
+        int32_t _filter_a;  // 1/(1 + N*dt) with 30 fractional bits
+        int32_t _filter_b;  // N*dt with 16 + DERIV_SHIFT fractional bits
+
+        int32_t integrator; // Sum of errors in input units times ticks
+        int32_t derivative; // Change per tick in input units with DERIV_SHIFT fractional bits
+        int32_t derivLast;
+
+        static q15_t saturate_q15(int64_t x)
+        {
+            if(x > Fixed::Q15_MAX) return Fixed::Q15_MAX;
+            if(x < Fixed::Q15_MIN) return Fixed::Q15_MIN;
+            return (q15_t)x;
+        };
+    };
+}
@@ -0,0 +1,77 @@
+/*
+ *  Title: Press Library
+
+ *  Description: Press and release detection on strain gauge samples
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include "Press.h"
+
+/**
+ * @brief Constructor for the PressDetector class
+ * @param config Thresholds, debounce and baseline settings
+*/
+PressDetector::PressDetector(press_config_t config) {
+    _config = config;
+    if(_config.debounce == 0) _config.debounce = 1;
+    reset();
+}
+
+/******************************* PUBLIC METHODS *******************************/
+
+/**
+ * @brief Forget the baseline and go back to released, the next sample sets the baseline
+*/
+void PressDetector::reset(void) {
+    _baseline = 0;
+    _seeded = false;
+    _pressed = false;
+    _count = 0;
+    _signal = 0;
+    _samples = 0;
+}
+
+/**
+ * @brief Run one sample through the detector
+ * @param sample ADC code
+ * @return True if the sample changed the state, see is_pressed
+*/
+bool PressDetector::update(int32_t sample) {
+    _samples++;
+    if(!_seeded) {
+        _baseline = (int64_t)sample << _config.baseline_shift;
+        _seeded = true;
+    }
+    _signal = (sample - get_baseline()) * _config.polarity;
+
+    bool past = _pressed ? (_signal < _config.release_threshold) : (_signal > _config.press_threshold);
+    if(!past) {
+        _count = 0;
+        // Only follow the baseline while released and not on the way to a press, a press would drag it along
+        if(!_pressed) _baseline += sample - get_baseline();
+        return false;
+    }
+    if(++_count < _config.debounce) return false;
+    _count = 0;
+    _pressed = !_pressed;
+    return true;
+}
+
+/**
+ * @brief Run a block of samples through the detector
+ * @param samples ADC codes, oldest first
+ * @param count Number of samples
+ * @param events Where the state changes go, can be NULL if max_events is 0
+ * @param max_events Room in events, further changes in the block still happen but are not reported
+ * @return Number of events written
+*/
+uint32_t PressDetector::process(const int32_t* samples, uint32_t count, press_event_t* events, uint32_t max_events) {
+    uint32_t written = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        if(update(samples[i]) && written < max_events) {
+            events[written++] = {_pressed, _samples};
+        }
+    }
+    return written;
+}
@@ -0,0 +1,49 @@
+/*
+ *  Title: Press Library
+
+ *  Description: Turns strain gauge samples into press and release events. A baseline follows
+ *      the released signal to take out drift and temperature, the distance from it has to
+ *      pass the press threshold to press and drop under the lower release threshold to
+ *      release, and either has to hold for a number of samples in a row so noise and
+ *      bounce do not make extra events. Works on blocks of samples as the ADC streams them.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+
+struct press_config_t {
+    int32_t press_threshold;    // ADC codes above the baseline that press
+    int32_t release_threshold;  // ADC codes above the baseline to get back under to release, below press_threshold
+    uint16_t debounce;          // Samples in a row past a threshold before the state changes, at least 1
+    uint8_t baseline_shift;     // Baseline time constant of 2^shift samples
+    int8_t polarity;            // 1 if pressing raises the ADC code, -1 if it lowers it
+};
+
+struct press_event_t {
+    bool pressed;               // True for a press, false for a release
+    uint32_t sample;            // Sample number the state changed on, counted from reset
+};
+
+class PressDetector {
+public:
+    PressDetector(press_config_t config);
+    void reset(void);
+
+    bool update(int32_t sample);
+    uint32_t process(const int32_t* samples, uint32_t count, press_event_t* events, uint32_t max_events);
+
+    bool is_pressed(void) const { return _pressed; };
+    int32_t get_baseline(void) const { return (int32_t)(_baseline >> _config.baseline_shift); };
+    int32_t get_signal(void) const { return _signal; };
+    uint32_t get_sample_count(void) const { return _samples; };
+private:
+    press_config_t _config;
+    int64_t _baseline = 0;      // Baseline shifted up by baseline_shift
+    bool _seeded = false;       // The first sample sets the baseline
+    bool _pressed = false;
+    uint16_t _count = 0;        // Samples in a row past the threshold of the other state
+    int32_t _signal = 0;        // Last sample minus the baseline, with the polarity applied
+    uint32_t _samples = 0;
+};
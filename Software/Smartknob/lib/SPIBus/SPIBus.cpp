@@ -0,0 +1,109 @@
+/*
+ *  Title: SPI Bus Library
+
+ *  Description: Shares one SPI peripheral between several devices and both cores
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <HAL.h>
+#include "SPIBus.h"
+
+SPIBus::SPIBus(HAL::spi_t* spi) {
+    _spi = spi;
+}
+
+/******************************* PUBLIC METHODS *******************************/
+
+/**
+ * @brief Initialize the SPI peripheral and the lock, safe to call more than once
+ * @param baudrate Initial baudrate, every device sets its own when it takes the bus
+*/
+void SPIBus::init(uint baudrate) {
+    if(_initialized) return;
+    HAL::spi_init(_spi, baudrate);
+    HAL::mutex_init(&_mutex);
+    _current = NO_DEVICE;
+    _initialized = true;
+}
+
+/**
+ * @brief Register a device on the bus, call before the control loop starts
+ * @param baudrate Baudrate for the device
+ * @param data_bits Number of data bits per frame
+ * @param cpol Clock polarity, 0 or 1
+ * @param cpha Clock phase, 0 or 1
+ * @return Device handle to pass to acquire, NO_DEVICE if the bus is full
+*/
+uint8_t SPIBus::add_device(uint baudrate, uint data_bits, uint cpol, uint cpha) {
+    if(_num_devices >= MAX_DEVICES) return NO_DEVICE;
+    _configs[_num_devices] = HAL::spi_make_config(baudrate, data_bits, cpol, cpha);
+    return _num_devices++;
+}
+
+/**
+ * @brief Take the bus for a device, waiting for the other core if it holds it.
+ *      Never call from an interrupt that can preempt a holder on the same core.
+*/
+void SPIBus::acquire(uint8_t device) {
+    HAL::mutex_enter_blocking(&_mutex);
+    select(device);
+}
+
+/**
+ * @brief Take the bus for a device if it is free
+ * @return True if the bus was taken, false if someone else holds it
+*/
+bool SPIBus::try_acquire(uint8_t device) {
+    if(!HAL::mutex_try_enter(&_mutex)) return false;
+    select(device);
+    return true;
+}
+
+/**
+ * @brief Take the bus for a device if it is free, otherwise have its release hook called when
+ *      the holder is done. Safe from interrupts, the hook runs in whatever context releases the bus.
+ * @return True if the bus was taken, false if the hook will be called instead
+*/
+bool SPIBus::try_acquire_or_wait(uint8_t device) {
+    if(try_acquire(device)) return true;
+    if(device >= _num_devices) return false;
+    _waiting[device].store(true);
+    // The holder may have released between the two, in which case it did not see the flag
+    if(!try_acquire(device)) return false;
+    _waiting[device].store(false, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Hand the bus back, the configuration stays until another device takes it.
+ *      Calls the release hooks of devices waiting for the bus.
+*/
+void SPIBus::release(void) {
+    HAL::mutex_exit(&_mutex);
+    std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with the store in try_acquire_or_wait
+    for(uint8_t i = 0; i < _num_devices; i++) {
+        if(!_waiting[i].load(std::memory_order_relaxed)) continue;
+        _waiting[i].store(false, std::memory_order_relaxed);
+        if(_hooks[i] != NULL) _hooks[i](_hook_data[i]);
+    }
+}
+
+/**
+ * @brief Set the function called when the bus is released while a device waits for it
+ * @param hook Called with user_data, usually tries try_acquire_or_wait again. NULL to remove.
+*/
+void SPIBus::set_release_hook(uint8_t device, release_hook_t hook, void* user_data) {
+    if(device >= _num_devices) return;
+    _hook_data[device] = user_data;
+    _hooks[device] = hook;
+}
+
+/******************************* PRIVATE METHODS *******************************/
+
+void SPIBus::select(uint8_t device) {
+    if(device == _current || device >= _num_devices) return;
+    HAL::spi_apply_config(_spi, _configs[device]);
+    _current = device;
+    _switches++;
+}
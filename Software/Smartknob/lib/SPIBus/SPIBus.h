@@ -0,0 +1,48 @@
+/*
+ *  Title: SPI Bus Library
+
+ *  Description: Shares one SPI peripheral between several devices and both cores.
+ *      Every device registers its baudrate and format once, the divider and format register
+ *      values are worked out up front and only written when a different device takes the bus.
+ *      A device that found the bus busy from an interrupt can wait for it, its release hook runs
+ *      when the holder hands the bus back.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <atomic>
+#include <HAL.h>
+
+class SPIBus {
+public:
+    static const uint8_t MAX_DEVICES = 4;
+    static const uint8_t NO_DEVICE = 0xFF;
+    typedef void (*release_hook_t)(void* user_data);
+
+    SPIBus(HAL::spi_t* spi);
+    void init(uint baudrate);
+    uint8_t add_device(uint baudrate, uint data_bits, uint cpol, uint cpha);
+
+    void acquire(uint8_t device);
+    bool try_acquire(uint8_t device);
+    bool try_acquire_or_wait(uint8_t device);
+    void release(void);
+    void set_release_hook(uint8_t device, release_hook_t hook, void* user_data);
+
+    HAL::spi_t* get_spi(void) { return _spi; };
+    uint32_t get_switches(void) const { return _switches; };
+private:
+    HAL::spi_t* _spi;
+    HAL::spi_config_t _configs[MAX_DEVICES];
+    uint8_t _num_devices = 0;
+    uint8_t _current = NO_DEVICE;   // Device the peripheral is configured for
+    uint32_t _switches = 0;         // Number of times the configuration was written
+    HAL::mutex_t _mutex;
+    release_hook_t _hooks[MAX_DEVICES] = {};
+    void* _hook_data[MAX_DEVICES] = {};
+    std::atomic<bool> _waiting[MAX_DEVICES] = {}; // Set by a device that wants the bus, cleared by whoever calls its hook
+    bool _initialized = false;
+
+    void select(uint8_t device);
+};
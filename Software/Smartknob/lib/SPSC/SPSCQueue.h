@@ -0,0 +1,111 @@
+/*
+ *  Title: SPSC Queue Library
+
+ *  Description: Wait-free single-producer/single-consumer ring buffer for passing data
+ *      between the cores or from an interrupt to the main loop.
+ *      The producer only writes _head and the consumer only writes _tail, so neither side
+ *      ever waits on the other. Release stores publish the slots, acquire loads pick them up,
+ *      which is a dmb on the RP2040 and plain moves on x86.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+#ifdef SMARTKNOB_HOST
+#define SPSC_ALIGNMENT 64 // Keep the indices on separate cache lines so the cores don't fight over them
+#else
+#define SPSC_ALIGNMENT 4 // No data cache on the RP2040
+#endif
+
+/**
+ * @brief SPSC queue class, one side pushes and the other pops without any locking
+ * @param T Type of the items, copied in and out
+ * @param N Number of slots - must be a power of two, holds up to N items
+*/
+template <typename T, uint32_t N> class SPSCQueue {
+    static_assert((N >= 2) && ((N & (N - 1)) == 0), "N is not a power of two");
+    // The Cortex-M0+ has no compare and swap so 32 bit atomics are not lock-free there, but the
+    // queue only loads and stores its indices and aligned word loads and stores are single-copy atomic
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Indices are not plain words");
+    static_assert(alignof(std::atomic<uint32_t>) >= alignof(uint32_t), "Indices are not word aligned");
+public:
+    SPSCQueue() {};
+
+    /**
+     * @brief Push an item, only call from the producer
+     * @return True if successful, false if the queue is full
+    */
+    bool push(const T& item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if(head - _tail.load(std::memory_order_acquire) == N) return false;
+        _buffer[head & MASK] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    };
+
+    /**
+     * @brief Push as many items as fit, only call from the producer
+     * @param items Pointer to the items
+     * @param count Number of items to push
+     * @return Number of items pushed
+    */
+    uint32_t push(const T* items, uint32_t count) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t free = N - (head - _tail.load(std::memory_order_acquire));
+        if(count > free) count = free;
+        for(uint32_t i = 0; i < count; i++) {
+            _buffer[(head + i) & MASK] = items[i];
+        }
+        _head.store(head + count, std::memory_order_release); // Publish the whole batch at once
+        return count;
+    };
+
+    /**
+     * @brief Pop an item, only call from the consumer
+     * @return True if successful, false if the queue is empty
+    */
+    bool pop(T* item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if(_head.load(std::memory_order_acquire) == tail) return false;
+        *item = _buffer[tail & MASK];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    };
+
+    /**
+     * @brief Pop up to max_count items, only call from the consumer
+     * @param items Pointer to where the items will go
+     * @param max_count Maximum number of items to pop
+     * @return Number of items popped
+    */
+    uint32_t pop(T* items, uint32_t max_count) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t count = _head.load(std::memory_order_acquire) - tail;
+        if(count > max_count) count = max_count;
+        for(uint32_t i = 0; i < count; i++) {
+            items[i] = _buffer[(tail + i) & MASK];
+        }
+        _tail.store(tail + count, std::memory_order_release); // Hand the slots back in one go
+        return count;
+    };
+
+    /**
+     * @brief Number of items in the queue, exact from either side's own point of view
+    */
+    uint32_t size(void) const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    };
+
+    bool empty(void) const { return size() == 0; };
+    static constexpr uint32_t capacity(void) { return N; };
+private:
+    static constexpr uint32_t MASK = N - 1;
+
+    // Indices run freely and wrap at 2^32, which N divides evenly
+    alignas(SPSC_ALIGNMENT) std::atomic<uint32_t> _head{0}; // Written by the producer only
+    alignas(SPSC_ALIGNMENT) std::atomic<uint32_t> _tail{0}; // Written by the consumer only
+    alignas(SPSC_ALIGNMENT) T _buffer[N];
+};
@@ -0,0 +1,68 @@
+/*
+ *  Title: Storage Library
+
+ *  Description: Configuration records in flash
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <string.h>
+#include <HAL.h>
+#include "Storage.h"
+
+namespace {
+    struct header_t {
+        uint32_t magic;
+        uint16_t length;
+        uint16_t checksum;
+    };
+}
+
+/**
+ * @brief Load a record
+ * @param flash_offset Byte offset of the record from the start of flash
+ * @param magic Identifies the kind and version of the record
+ * @param data Pointer to where the record goes, untouched unless the record is valid
+ * @param len Size of the record
+ * @return True if a valid record was found, false if not
+*/
+bool Storage::load(uint32_t flash_offset, uint32_t magic, void* data, size_t len) {
+    if(len > MAX_RECORD_SIZE) return false;
+    header_t header;
+    HAL::flash_read(flash_offset, &header, sizeof(header));
+    if(header.magic != magic || header.length != len) return false;
+
+    uint8_t buffer[MAX_RECORD_SIZE];
+    HAL::flash_read(flash_offset + sizeof(header), buffer, len);
+    if(fletcher16(buffer, len) != header.checksum) return false;
+    memcpy(data, buffer, len);
+    return true;
+}
+
+/**
+ * @brief Save a record, erases the sector first
+ * @param flash_offset Byte offset of the record from the start of flash, sector aligned
+ * @param magic Identifies the kind and version of the record
+ * @return True if successful, false if the record is too large or the write failed
+*/
+bool Storage::save(uint32_t flash_offset, uint32_t magic, const void* data, size_t len) {
+    if(len > MAX_RECORD_SIZE) return false;
+    uint8_t buffer[sizeof(header_t) + MAX_RECORD_SIZE];
+    header_t header = {magic, (uint16_t)len, fletcher16((const uint8_t*)data, len)};
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), data, len);
+    return HAL::flash_write(flash_offset, buffer, sizeof(header) + len);
+}
+
+/**
+ * @brief Fletcher-16 checksum
+*/
+uint16_t Storage::fletcher16(const uint8_t* data, size_t len) {
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+    for(size_t i = 0; i < len; i++) {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (uint16_t)((sum2 << 8) | sum1);
+}
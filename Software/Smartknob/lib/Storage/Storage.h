@@ -0,0 +1,22 @@
+/*
+ *  Title: Storage Library
+
+ *  Description: Configuration records in flash. Each record has its own sector and starts
+ *      with a header holding a magic number, the length and a Fletcher-16 checksum, so a blank
+ *      sector, a record from another firmware version or a torn write are all rejected on load.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <HAL.h>
+
+namespace Storage {
+    const size_t MAX_RECORD_SIZE = 1024;
+
+    bool load(uint32_t flash_offset, uint32_t magic, void* data, size_t len);
+    bool save(uint32_t flash_offset, uint32_t magic, const void* data, size_t len);
+    uint16_t fletcher16(const uint8_t* data, size_t len);
+}
@@ -8,11 +8,8 @@
 
 #include <string.h>
 #include <math.h>
-#include <hardware/pwm.h>
-#include <hardware/gpio.h>
-#include <hardware/clocks.h>
 #include <stdio.h>
-#include "pico/stdlib.h"
+#include <HAL.h>
 #include "TMC6300.h"
 
 template <typename T> T constrain(T amt, T low, T high) {
@@ -21,18 +18,6 @@ template <typename T> T constrain(T amt, T low, T high) {
     return amt;
 }
 
-/**
- * @brief Add the dead zone value to the requested value, clamping if above max
- * @param val value
- * @param dt deadzone value
- * @return val+dt clamped to a max of 1
-*/
-inline float swDti(float val, float dt) {
-	float ret = dt+val;
-	if (ret>1.0) ret = 1.0f;
-	return ret;
-}
-
 /**
  * @brief Constructor for TMC6300 class
  * @param u_h GPIO pin connected to the u_h pin on the TMC6300
@@ -61,40 +46,53 @@ TMC6300::TMC6300(uint u_h, uint v_h, uint w_h, uint u_l, uint v_l, uint w_l, flo
  * @param dead_zone Dead zone percentage [0,1], default 0.02 (2%)
 */
 void TMC6300::init(long frequency, float dead_zone) {
-    gpio_set_function(_gpio_pins.u_h, GPIO_FUNC_PWM);
-    gpio_set_function(_gpio_pins.v_h, GPIO_FUNC_PWM);
-    gpio_set_function(_gpio_pins.w_h, GPIO_FUNC_PWM);
-    gpio_set_function(_gpio_pins.u_l, GPIO_FUNC_PWM);
-    gpio_set_function(_gpio_pins.v_l, GPIO_FUNC_PWM);
-    gpio_set_function(_gpio_pins.w_l, GPIO_FUNC_PWM);
-    slices[0] = pwm_gpio_to_slice_num(_gpio_pins.u_h);
-    slices[1] = pwm_gpio_to_slice_num(_gpio_pins.v_h);
-    slices[2] = pwm_gpio_to_slice_num(_gpio_pins.w_h);
-    slices[3] = pwm_gpio_to_slice_num(_gpio_pins.u_l);
-    slices[4] = pwm_gpio_to_slice_num(_gpio_pins.v_l);
-    slices[5] = pwm_gpio_to_slice_num(_gpio_pins.w_l);
-    channels[0] = pwm_gpio_to_channel(_gpio_pins.u_h);
-    channels[1] = pwm_gpio_to_channel(_gpio_pins.v_h);
-    channels[2] = pwm_gpio_to_channel(_gpio_pins.w_h);
-    channels[3] = pwm_gpio_to_channel(_gpio_pins.u_l);
-    channels[4] = pwm_gpio_to_channel(_gpio_pins.v_l);
-    channels[5] = pwm_gpio_to_channel(_gpio_pins.w_l);
+    HAL::gpio_set_function(_gpio_pins.u_h, HAL::gpio_func::PWM);
+    HAL::gpio_set_function(_gpio_pins.v_h, HAL::gpio_func::PWM);
+    HAL::gpio_set_function(_gpio_pins.w_h, HAL::gpio_func::PWM);
+    HAL::gpio_set_function(_gpio_pins.u_l, HAL::gpio_func::PWM);
+    HAL::gpio_set_function(_gpio_pins.v_l, HAL::gpio_func::PWM);
+    HAL::gpio_set_function(_gpio_pins.w_l, HAL::gpio_func::PWM);
+    slices[0] = HAL::pwm_gpio_to_slice_num(_gpio_pins.u_h);
+    slices[1] = HAL::pwm_gpio_to_slice_num(_gpio_pins.v_h);
+    slices[2] = HAL::pwm_gpio_to_slice_num(_gpio_pins.w_h);
+    slices[3] = HAL::pwm_gpio_to_slice_num(_gpio_pins.u_l);
+    slices[4] = HAL::pwm_gpio_to_slice_num(_gpio_pins.v_l);
+    slices[5] = HAL::pwm_gpio_to_slice_num(_gpio_pins.w_l);
+    channels[0] = HAL::pwm_gpio_to_channel(_gpio_pins.u_h);
+    channels[1] = HAL::pwm_gpio_to_channel(_gpio_pins.v_h);
+    channels[2] = HAL::pwm_gpio_to_channel(_gpio_pins.w_h);
+    channels[3] = HAL::pwm_gpio_to_channel(_gpio_pins.u_l);
+    channels[4] = HAL::pwm_gpio_to_channel(_gpio_pins.v_l);
+    channels[5] = HAL::pwm_gpio_to_channel(_gpio_pins.w_l);
     wrapvalue = ((125L * 1000L * 1000L) / frequency) / 2L - 1L;
     for(int i = 0; i < 6; i++) {
-        pwm_set_clkdiv_int_frac(slices[i], 1, 0);
-        pwm_set_phase_correct(slices[i], true);
-        pwm_set_wrap(slices[i], wrapvalue);
+        HAL::pwm_set_clkdiv_int_frac(slices[i], 1, 0);
+        HAL::pwm_set_phase_correct(slices[i], true);
+        HAL::pwm_set_wrap(slices[i], wrapvalue);
         if(i > 2) {
-            if(channels[i] == 0) {
-                hw_write_masked(&pwm_hw->slice[slices[i]].csr, 0x1 << PWM_CH0_CSR_A_INV_LSB, PWM_CH0_CSR_A_INV_BITS);
-            } else {
-                hw_write_masked(&pwm_hw->slice[slices[i]].csr, 0x1 << PWM_CH0_CSR_B_INV_LSB, PWM_CH0_CSR_B_INV_BITS);
-            }
+            HAL::pwm_set_channel_inverted(slices[i], channels[i], true);
+        }
+        HAL::pwm_set_chan_level(slices[i], channels[i], 0); // Turn off
+    }
+
+    // Group the pins by slice so set_levels writes each compare register once
+    _batch_count = 0;
+    for(int i = 0; i < 6; i++) {
+        uint entry = 0;
+        while(entry < _batch_count && _batch_slices[entry] != slices[i]) entry++;
+        if(entry == _batch_count) {
+            _batch_slices[entry] = slices[i];
+            _batch_channels[entry] = 0;
+            _batch_count++;
         }
-        pwm_set_chan_level(slices[0], channels[i], 0); // Turn off
+        _batch_channels[entry] |= 1u << channels[i];
+        _batch_index[i] = entry;
     }
+
     sync_slices();
     _dead_zone = dead_zone;
+    _dead_zone_level = (uint16_t)((wrapvalue+1) * dead_zone);
+    _levels_per_volt = ((float)wrapvalue + 1.0f) / _supply_voltage;
 }
 
 /**
@@ -102,6 +100,7 @@ void TMC6300::init(long frequency, float dead_zone) {
  * @param enabled True if motor can run, false if not
 */
 void TMC6300::set_enabled(bool enabled) {
+    if(!enabled) stop();
     _enabled = enabled;
 }
 
@@ -112,13 +111,135 @@ void TMC6300::set_enabled(bool enabled) {
  * @param v_w Voltage on W coil [0, supply_voltage]
 */
 void TMC6300::set_voltages(float v_u, float v_v, float v_w) {
-    v_u = constrain(v_u, 0.0f, _supply_voltage);
-    v_v = constrain(v_v, 0.0f, _supply_voltage);
-    v_w = constrain(v_w, 0.0f, _supply_voltage);
-    float dc_u = constrain(v_u / _supply_voltage, 0.0f, 1.0f);
-    float dc_v = constrain(v_v / _supply_voltage, 0.0f, 1.0f);
-    float dc_w = constrain(v_w / _supply_voltage, 0.0f, 1.0f);
-    write_duty_cycle(dc_u, dc_v, dc_w);
+    set_levels(voltage_to_level(v_u), voltage_to_level(v_v), voltage_to_level(v_w));
+}
+
+/**
+ * @brief Set the PWM compare levels for the coils directly, no floating point involved.
+ *      Both channels of a slice go out in one store, and the stores are kept away from the
+ *      wrap so the three phases change in the same PWM period. Does nothing while a waveform plays.
+ * @param level_u Compare level for U coil [0, wrap+1]
+ * @param level_v Compare level for V coil [0, wrap+1]
+ * @param level_w Compare level for W coil [0, wrap+1]
+*/
+void TMC6300::set_levels(uint16_t level_u, uint16_t level_v, uint16_t level_w) {
+    if(_playing.load() != NULL) return; // The waveform player owns the compare registers
+    uint16_t levels[6] = {0, 0, 0, 0, 0, 0};
+    if(_enabled) {
+        uint32_t top = (uint32_t)wrapvalue + 1;
+        levels[0] = level_u;
+        levels[1] = level_v;
+        levels[2] = level_w;
+        levels[3] = constrain<uint32_t>(level_u + _dead_zone_level, 0, top);
+        levels[4] = constrain<uint32_t>(level_v + _dead_zone_level, 0, top);
+        levels[5] = constrain<uint32_t>(level_w + _dead_zone_level, 0, top);
+    }
+    uint16_t cc[6][2];
+    for(int i = 0; i < 6; i++) {
+        cc[_batch_index[i]][channels[i]] = levels[i];
+    }
+
+    // The slices are synced, a wrap between the first and last store would split the update over two periods
+    if(_batch_count > 0) {
+        while(HAL::pwm_get_counter(_batch_slices[0]) < LATCH_GUARD) HAL::tight_loop_contents();
+    }
+    for(uint i = 0; i < _batch_count; i++) {
+        if(_batch_channels[i] == 0x03) {
+            HAL::pwm_set_both_levels(_batch_slices[i], cc[i][0], cc[i][1]);
+        } else {
+            uint channel = _batch_channels[i] >> 1; // The one channel in use
+            HAL::pwm_set_chan_level(_batch_slices[i], channel, cc[i][channel]);
+        }
+    }
+}
+
+/**
+ * @brief Get the wrap value of the PWM slices, a level of wrap+1 is 100% duty cycle
+ * @return Wrap value
+*/
+uint16_t TMC6300::get_wrap(void) {
+    return wrapvalue;
+}
+
+/**
+ * @brief Get the supply voltage the library was constructed with
+ * @return Supply voltage in volts
+*/
+float TMC6300::get_supply_voltage(void) {
+    return _supply_voltage;
+}
+
+/**
+ * @brief Convert a coil voltage to a PWM compare level
+ * @param voltage Voltage, clamped to [0, supply_voltage]
+ * @return Compare level [0, wrap+1]
+*/
+uint16_t TMC6300::voltage_to_level(float voltage) {
+    return (uint16_t)(constrain(voltage, 0.0f, _supply_voltage) * _levels_per_volt);
+}
+
+/**
+ * @brief Claim the DMA channels for the waveform player, call after init
+ * @return True if successful, false if there are no free channels or the high and low side
+ *      of a phase are not on the same PWM slice
+*/
+bool TMC6300::init_player(void) {
+    if(_batch_count != 3) return false;
+    for(uint8_t phase = 0; phase < 3; phase++) {
+        if(_batch_index[phase] != phase || _batch_index[phase + 3] != phase) return false;
+    }
+    _player_ready = HAL::pwm_dma_init(&_player, _batch_slices, 3, player_done, this);
+    return _player_ready;
+}
+
+/**
+ * @brief Fill in one PWM period of a waveform, the dead zone is added like in set_levels
+ * @param wave Waveform to write to
+ * @param index PWM period [0, length)
+ * @param level_u Compare level for U coil [0, wrap+1]
+ * @param level_v Compare level for V coil [0, wrap+1]
+ * @param level_w Compare level for W coil [0, wrap+1]
+*/
+void TMC6300::set_waveform_levels(tmc6300_waveform_t* wave, size_t index, uint16_t level_u, uint16_t level_v, uint16_t level_w) {
+    uint16_t levels[3] = {level_u, level_v, level_w};
+    uint32_t top = (uint32_t)wrapvalue + 1;
+    for(int phase = 0; phase < 3; phase++) {
+        uint32_t low = constrain<uint32_t>(levels[phase] + _dead_zone_level, 0, top);
+        wave->words[phase][index] = ((uint32_t)levels[phase] << (16 * channels[phase])) | (low << (16 * channels[phase + 3]));
+    }
+}
+
+/**
+ * @brief Play a waveform, one step per PWM period. Starts right away if nothing is playing,
+ *      otherwise it is queued and follows the current one without a gap. The last step stays
+ *      on the coils when the waveform ends, set_levels takes over again after that.
+ * @param wave Waveform, has to stay untouched until it has finished playing
+ * @return True if playing or queued, false if something is queued already, the player is not
+ *      initialized or the motor is disabled
+*/
+bool TMC6300::play(const tmc6300_waveform_t* wave) {
+    if(!_player_ready || !_enabled || wave->length == 0 || _queued.load() != NULL) return false;
+    _queued.store(wave);
+    // If one is playing the completion interrupt starts this one, it can not fire once _playing is NULL
+    if(_playing.load() == NULL) start_queued();
+    return true;
+}
+
+/**
+ * @brief Check if a waveform is playing
+ * @return True if playing, queued waveforms included
+*/
+bool TMC6300::is_playing(void) {
+    return _playing.load() != NULL;
+}
+
+/**
+ * @brief Stop playing and drop the queued waveform, the coils keep the step that was playing
+*/
+void TMC6300::stop(void) {
+    _queued.store(NULL);
+    if(_player_ready) HAL::pwm_dma_abort(&_player);
+    _playing.store(NULL);
 }
 
 /******************************* PRIVATE METHODS *******************************/
@@ -129,40 +250,29 @@ void TMC6300::set_voltages(float v_u, float v_v, float v_w) {
 void TMC6300::sync_slices(void) {
     uint8_t mask = 0;
     for(int i = 0; i < 6; i++) {
-        pwm_set_enabled(i, false);
-        pwm_set_counter(i, 0);
+        HAL::pwm_set_enabled(slices[i], false);
+        HAL::pwm_set_counter(slices[i], 0);
         mask |= 0x01 << slices[i]; // Set mask bit for each slice to 1
     }
-    pwm_set_mask_enabled(mask);
+    HAL::pwm_set_mask_enabled(mask);
 }
 
 /**
- * @brief Write PWM duty cycles given a voltage input ranging from 0 to 1
- * @param dc_u Normalized U coil voltage
- * @param dc_v Normalized V coil voltage
- * @param dc_w Normalized W coil voltage
+ * @brief Hand the queued waveform to the DMA
 */
-void TMC6300::write_duty_cycle(float dc_u, float dc_v, float dc_w) {
-    if(_enabled) {
-        pwm_set_chan_level(slices[0], channels[0], (wrapvalue+1) * dc_u);
-        pwm_set_chan_level(slices[3], channels[3], (wrapvalue+1) * swDti(dc_u, _dead_zone));
-        pwm_set_chan_level(slices[1], channels[1], (wrapvalue+1) * dc_v);
-        pwm_set_chan_level(slices[4], channels[4], (wrapvalue+1) * swDti(dc_v, _dead_zone));
-        pwm_set_chan_level(slices[2], channels[2], (wrapvalue+1) * dc_w);
-        pwm_set_chan_level(slices[5], channels[5], (wrapvalue+1) * swDti(dc_w, _dead_zone));
-    } else {
-        for(int i = 0; i < 6; i++){
-            pwm_set_chan_level(slices[i], channels[i], 0);
-        }
-    }
+void TMC6300::start_queued(void) {
+    const tmc6300_waveform_t* wave = _queued.load();
+    if(wave == NULL) return;
+    _queued.store(NULL);
+    _playing.store(wave);
+    HAL::pwm_dma_start(&_player, wave->words, wave->length);
 }
 
 /**
- * @brief Get the wrap level of a PWM slice
- * @param slice_num The PWM slice to get the wrap level from
- * @return Wrap level
+ * @brief Completion interrupt of the player, moves on to the queued waveform if there is one
 */
-uint16_t pwm_get_wrap(uint slice_num) {
-    check_slice_num_param(slice_num);
-    return pwm_hw->slice[slice_num].top;
-}
\ No newline at end of file
+void TMC6300::player_done(void* user_data) {
+    TMC6300* motor = (TMC6300*)user_data;
+    motor->_playing.store(NULL);
+    motor->start_queued();
+}
@@ -7,20 +7,36 @@
  */
 
 #pragma once
-#include <hardware/pwm.h>
-#include <hardware/gpio.h>
-#include <hardware/clocks.h>
+#include <atomic>
+#include <HAL.h>
 
 /* TODO:
  - Add everything
 */
 
+// Compare words played by TMC6300::play, one word per phase and PWM period
+struct tmc6300_waveform_t {
+    uint32_t* words[3];     // U, V and W, filled in with TMC6300::set_waveform_levels
+    size_t length;          // PWM periods
+};
+
 class TMC6300 {
 public:
     TMC6300(uint u_h, uint v_h, uint w_h, uint u_l, uint v_l, uint w_l, float supply_voltage);
     void init(long frequency, float dead_zone);
     void set_enabled(bool enabled);
     void set_voltages(float v_u, float v_v, float v_w);
+    void set_levels(uint16_t level_u, uint16_t level_v, uint16_t level_w);
+    uint16_t get_wrap(void);
+    float get_supply_voltage(void);
+    uint16_t voltage_to_level(float voltage);
+
+    // Waveform player, DMA writes the compare registers at each PWM wrap without the CPU
+    bool init_player(void);
+    void set_waveform_levels(tmc6300_waveform_t* wave, size_t index, uint16_t level_u, uint16_t level_v, uint16_t level_w);
+    bool play(const tmc6300_waveform_t* wave);
+    bool is_playing(void);
+    void stop(void);
 private:
     struct gpio_pins {
         uint u_h;
@@ -31,14 +47,31 @@ private:
         uint w_l;
     } _gpio_pins;
     
+    // Counts from the wrap where set_levels stays off the compare registers, so all phases latch in the same period
+    static const uint16_t LATCH_GUARD = 64;
+
     uint16_t wrapvalue = 0;
     uint slices[6];
     uint channels[6];
     bool _enabled = false;
 
+    // Slices in use, each written with one store to its compare register, pins in the same order as slices
+    uint _batch_slices[6];
+    uint8_t _batch_channels[6];     // Bit per channel driven from here, the other channel is left alone
+    uint8_t _batch_index[6];        // Batch entry of each pin
+    uint _batch_count = 0;
+
     float _dead_zone = 0.02f;
+    uint16_t _dead_zone_level = 0;
     float _supply_voltage = 0.0f;
+    float _levels_per_volt = 0.0f;
+
+    HAL::pwm_dma_t _player;
+    bool _player_ready = false;
+    std::atomic<const tmc6300_waveform_t*> _playing{NULL};
+    std::atomic<const tmc6300_waveform_t*> _queued{NULL};
 
     void sync_slices(void);
-    void write_duty_cycle(float dc_u, float dc_v, float dc_w);
+    void start_queued(void);
+    static void player_done(void* user_data);
 };
\ No newline at end of file
@@ -0,0 +1,190 @@
+/*
+ *  Title: Telemetry Library
+
+ *  Description: Binary telemetry stream for the control loop
+ *
+ *  Author: Mani Magnusson
+ */
+
+#include <string.h>
+#include "Telemetry.h"
+
+namespace {
+    void put_u16(uint8_t* p, uint16_t v) {
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+    }
+
+    void put_u32(uint8_t* p, uint32_t v) {
+        put_u16(p, v & 0xFFFF);
+        put_u16(p + 2, v >> 16);
+    }
+
+    uint16_t get_u16(const uint8_t* p) {
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    uint32_t get_u32(const uint8_t* p) {
+        return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+    }
+}
+
+/******************************* PUBLIC METHODS *******************************/
+
+/**
+ * @brief Queue a sample, safe to call from the control loop since it never blocks
+ * @param sample The sample to queue
+ * @return True if successful, false if the queue was full and the sample was dropped
+*/
+bool Telemetry::log(const telemetry_sample_t& sample) {
+    // The sequence counter also counts dropped samples so the reader can see the gap
+    entry_t entry = {_sequence++, sample};
+    if(_queue.push(entry)) return true;
+    _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return false;
+}
+
+/**
+ * @brief Frame queued samples and hand them to a writer, call from the main loop
+ * @param write Function writing the frame bytes out, HAL::stdio_write for USB
+ * @param max_frames Maximum number of frames to write in this call
+ * @return Number of frames written
+*/
+uint32_t Telemetry::drain(void (*write)(const uint8_t* data, size_t len), uint32_t max_frames) {
+    entry_t entries[16];
+    uint8_t frames[16 * FRAME_SIZE];
+    uint32_t total = 0;
+    while(total < max_frames) {
+        uint32_t batch = max_frames - total;
+        if(batch > 16) batch = 16;
+        uint32_t n = _queue.pop(entries, batch);
+        if(n == 0) break;
+
+        size_t len = 0;
+        for(uint32_t i = 0; i < n; i++) {
+            len += encode_frame(entries[i].sample, entries[i].sequence, frames + len);
+        }
+        write(frames, len);
+        total += n;
+    }
+    return total;
+}
+
+/**
+ * @brief Throw away all queued samples, call from the main loop while not streaming
+*/
+void Telemetry::clear(void) {
+    entry_t entries[16];
+    while(_queue.pop(entries, 16) > 0) {}
+}
+
+/**
+ * @brief Build a complete frame from a sample
+ * @param frame Pointer to a buffer of at least FRAME_SIZE bytes
+ * @return Length of the frame including the zero delimiter
+*/
+size_t Telemetry::encode_frame(const telemetry_sample_t& sample, uint16_t sequence, uint8_t* frame) {
+    uint8_t packet[PACKET_SIZE];
+    put_u16(&packet[0], sequence);
+    put_u32(&packet[2], sample.time_us);
+    put_u16(&packet[6], sample.angle);
+    put_u32(&packet[8], (uint32_t)sample.velocity);
+    put_u16(&packet[12], (uint16_t)sample.torque);
+    put_u16(&packet[14], (uint16_t)sample.p_term);
+    put_u16(&packet[16], (uint16_t)sample.i_term);
+    put_u16(&packet[18], (uint16_t)sample.d_term);
+    put_u32(&packet[20], (uint32_t)sample.position);
+    packet[24] = sample.error;
+    put_u16(&packet[25], crc16(packet, PACKET_SIZE - 2));
+
+    size_t len = cobs_encode(packet, PACKET_SIZE, frame);
+    frame[len++] = 0x00;
+    return len;
+}
+
+/**
+ * @brief Check and unpack a frame
+ * @param frame Pointer to the frame bytes, without the zero delimiter
+ * @param len Length of the frame
+ * @return True if the frame is intact, false if it is malformed or fails the CRC
+*/
+bool Telemetry::decode_frame(const uint8_t* frame, size_t len, telemetry_sample_t* sample, uint16_t* sequence) {
+    if(len > FRAME_SIZE) return false;
+    uint8_t packet[FRAME_SIZE];
+    if(cobs_decode(frame, len, packet) != PACKET_SIZE) return false;
+    if(crc16(packet, PACKET_SIZE - 2) != get_u16(&packet[25])) return false;
+
+    *sequence = get_u16(&packet[0]);
+    sample->time_us = get_u32(&packet[2]);
+    sample->angle = get_u16(&packet[6]);
+    sample->velocity = (int32_t)get_u32(&packet[8]);
+    sample->torque = (int16_t)get_u16(&packet[12]);
+    sample->p_term = (int16_t)get_u16(&packet[14]);
+    sample->i_term = (int16_t)get_u16(&packet[16]);
+    sample->d_term = (int16_t)get_u16(&packet[18]);
+    sample->position = (int32_t)get_u32(&packet[20]);
+    sample->error = packet[24];
+    return true;
+}
+
+/**
+ * @brief Consistent Overhead Byte Stuffing, removes every zero byte from the data
+ * @param out Pointer to a buffer of at least len + len / 254 + 1 bytes
+ * @return Length of the encoded data
+*/
+size_t Telemetry::cobs_encode(const uint8_t* data, size_t len, uint8_t* out) {
+    size_t code_index = 0;
+    size_t out_index = 1;
+    uint8_t code = 1;
+    for(size_t i = 0; i < len; i++) {
+        if(data[i] == 0) {
+            out[code_index] = code;
+            code_index = out_index++;
+            code = 1;
+        } else {
+            out[out_index++] = data[i];
+            code++;
+            if(code == 0xFF) {
+                out[code_index] = code;
+                code_index = out_index++;
+                code = 1;
+            }
+        }
+    }
+    out[code_index] = code;
+    return out_index;
+}
+
+/**
+ * @brief Undo COBS
+ * @param out Pointer to a buffer of at least len bytes
+ * @return Length of the decoded data, 0 if the data is malformed
+*/
+size_t Telemetry::cobs_decode(const uint8_t* data, size_t len, uint8_t* out) {
+    size_t in_index = 0;
+    size_t out_index = 0;
+    while(in_index < len) {
+        uint8_t code = data[in_index++];
+        if(code == 0 || in_index + code - 1 > len) return 0;
+        for(uint8_t i = 1; i < code; i++) {
+            if(data[in_index] == 0) return 0;
+            out[out_index++] = data[in_index++];
+        }
+        if(code != 0xFF && in_index < len) out[out_index++] = 0;
+    }
+    return out_index;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE, polynomial 0x1021 and initial value 0xFFFF
+*/
+uint16_t Telemetry::crc16(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for(size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for(uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
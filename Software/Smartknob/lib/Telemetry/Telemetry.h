@@ -0,0 +1,59 @@
+/*
+ *  Title: Telemetry Library
+
+ *  Description: Binary telemetry stream for the control loop.
+ *      Samples are queued from the control loop without blocking and framed by the main loop.
+ *      Each frame is a little endian packet with a sequence counter and CRC-16/CCITT,
+ *      COBS encoded and terminated by a zero byte so a reader can always resynchronize.
+ *
+ *  Author: Mani Magnusson
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <SPSCQueue.h>
+
+/**
+ * @brief One control loop tick, in the fixed point units of the control path
+*/
+struct telemetry_sample_t {
+    uint32_t time_us;   // Lower 32 bits of the time since boot
+    uint16_t angle;     // Mechanical angle, 65536 per turn
+    int32_t velocity;   // Turns per second with 16 fractional bits
+    int16_t torque;     // Torque command, Q15 fraction of the FOC voltage limit
+    int16_t p_term;     // Contributions to the torque command, same scale. Profile torque, 0 and damping for the haptic loop
+    int16_t i_term;
+    int16_t d_term;
+    int32_t position;   // Detent position
+    uint8_t error;      // Encoder error code, see mt6701_err_t
+};
+
+class Telemetry {
+public:
+    static const size_t PACKET_SIZE = 27;                           // Sequence, sample and CRC
+    static const size_t FRAME_SIZE = PACKET_SIZE + PACKET_SIZE / 254 + 2; // COBS overhead and delimiter
+    static const uint32_t QUEUE_SIZE = 256;
+
+    Telemetry() {};
+
+    bool log(const telemetry_sample_t& sample);
+    uint32_t drain(void (*write)(const uint8_t* data, size_t len), uint32_t max_frames = QUEUE_SIZE);
+    void clear(void);
+    uint32_t get_dropped(void) const { return _dropped.load(std::memory_order_relaxed); };
+
+    static size_t encode_frame(const telemetry_sample_t& sample, uint16_t sequence, uint8_t* frame);
+    static bool decode_frame(const uint8_t* frame, size_t len, telemetry_sample_t* sample, uint16_t* sequence);
+    static size_t cobs_encode(const uint8_t* data, size_t len, uint8_t* out);
+    static size_t cobs_decode(const uint8_t* data, size_t len, uint8_t* out);
+    static uint16_t crc16(const uint8_t* data, size_t len);
+private:
+    struct entry_t {
+        uint16_t sequence;
+        telemetry_sample_t sample;
+    };
+
+    SPSCQueue<entry_t, QUEUE_SIZE> _queue;
+    uint16_t _sequence = 0;                 // Producer side only
+    std::atomic<uint32_t> _dropped{0};      // Written by the producer only
+};
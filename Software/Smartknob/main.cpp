@@ -11,48 +11,92 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
-#include <pico/stdlib.h>
-#include <pico/time.h>
-#include <hardware/spi.h>
+#include <HAL.h>
 #include <MT6701.h>
+#include <SPIBus.h>
 #include <MCP3564R.h>
 #include <FOC.h>
 #include <TMC6300.h>
-#include <PID.h>
+#include <FastTrig.h>
+#include <EncoderAngle.h>
+#include <TrackingObserver.h>
+#include <FixedTrackingObserver.h>
+#include <SPSCQueue.h>
+#include <Telemetry.h>
+#include <PIDBank.h>
+#include <Haptic.h>
+#include <HapticProfiles.h>
+#include <Press.h>
+#include <Decimator.h>
 #include "pin_assignments.h"
 
 // Defines & constants
 const float _pi = 3.14159265358f;
-const float _3pi = 9.42477796076f;
-const float _2pi = 6.28318530717f;
+const uint64_t CONTROL_PERIOD_US = 1000; // Control loop tick on core 1, the haptic loop. The FOC is voltage mode, there is no current loop to run faster
+const bool STRAIN_ENABLED = true; // Strain gauge ADC, streamed to core 0 for press detection
+const uint32_t ENCODER_CAL_FLASH_OFFSET = HAL::FLASH_SIZE_BYTES - HAL::FLASH_SECTOR_BYTES; // Last sector of flash
+const uint32_t MOTOR_CAL_FLASH_OFFSET = HAL::FLASH_SIZE_BYTES - 2 * HAL::FLASH_SECTOR_BYTES;
+const float DEFAULT_ZERO_ELECTRIC_ANGLE = 4.062365f; // Only used if the motor calibration fails
 
 // Constructors
-MT6701 mt6701(spi1, MAG_CSN);
-MCP3564R mcp3564r(spi1, STRAIN_CSN);
+SPIBus spi1_bus(spi1); // Shared by the encoder on core 1 and the strain ADC on core 0
+MT6701 mt6701(&spi1_bus, MAG_CSN);
+MCP3564R mcp3564r(&spi1_bus, STRAIN_CSN);
 TMC6300 tmc6300(UH, VH, WH, UL, VL, WL, 5.0f);
 FOC foc(7, &mt6701, &tmc6300, Direction::CCW, 5.0f);
-SMARTKNOB::PID knob_pid(8.0f, 0.0f, 0.02f, 10.0f);
+#if SMARTKNOB_FIXED_POINT
+FixedTrackingObserver knob_observer(150.0f, CONTROL_PERIOD_US * 1e-6f);
+#else
+TrackingObserver knob_observer(150.0f, CONTROL_PERIOD_US * 1e-6f); // Bandwidth in rad/s
+#endif
+Haptic haptic; // Profiles are selected by core 0 and played by core 1
+#if !SMARTKNOB_FIXED_POINT
+SMARTKNOB::PIDBank<2> damping_loops; // Damping everywhere and on top past the end stops, both hold the observed velocity at 0
+#endif
 
 // Variables and data structures
 struct Config {
-    bool coarse = true;
-    bool smooth = false;
-    int32_t position = 0;
-    int32_t min_position = INT32_MIN;
-    int32_t max_position = INT32_MAX;
-    float detent_center = 0.0f;
-    float snap_radians_decrease = -_pi / 16.0f;
-    float snap_radians_increase = _pi / 16.0f;
+    int32_t position = 0; // Detent position, only written by core 1
+    float damping = 0.02f; // V*s/rad, keeps the knob from ringing in the detents
+    float end_stop_damping = 0.05f; // V*s/rad on top past the end stops, so the knob does not bounce off them
     float torque_limit = 2.5f;
 } config;
 
-struct repeating_timer timer;
-float angle = 0.0f;
-uint8_t channel = 0;
-int32_t measurement = 0;
+#if SMARTKNOB_FIXED_POINT
+// Config converted to Q15 voltages
+struct FixedConfig {
+    int32_t damping = 0; // Q15 voltage per turn/s in Q16, shifted down by 16
+    int32_t end_stop_damping = 0;
+    q15_t torque_limit = 0;
+} fixed_config;
+#endif
+
+// Detent position changes, pushed by core 1 and printed by core 0
+struct DetentEvent {
+    int32_t position;
+    uint64_t time_us;
+};
+
+SPSCQueue<DetentEvent, 16> detent_events;
+Telemetry telemetry; // Control loop state every tick, logged by core 1 and streamed by core 0
+telemetry_sample_t tick_sample; // Filled in by a tick and logged by the next, only touched by core 1
+bool tick_sample_ready = false;
+
+EncoderAngle knob_angle; // Multi-turn knob angle, only touched by core 1 after init
+bool telemetry_enabled = false; // Only touched by core 0
+// The strain gauge is decimated from the ADC rate by 8 to 600 Hz before press detection, both only touched by core 0.
+// The FIR stage runs after the CIC divides the 4.8 ksps by 4
+constexpr FIR_params STRAIN_FILTER = {FIR_type::LPF, 100.0f, 1200.0f};
+static_assert(FIR_design::is_valid(STRAIN_FILTER));
+constexpr auto strain_taps = FIR_design::generate<31, q15_t>(STRAIN_FILTER);
+Decimator<2, 4, 31, 2> strain_decimator(strain_taps);
+// Starting points for the bridge, ADC codes at a gain of 16
+PressDetector press_detector({8000, 4000, 2, 7, 1});
 
 // Forward declarations
-bool repeating_timer_callback(struct repeating_timer* t); // Interrupt timer callback
+void core1_entry(void); // Real-time control loop, runs on core 1
+void push_detent_event(void);
+void control_tick(void); // One iteration of encoder -> haptics -> FOC -> PWM
 
 template <typename T> T constrain(T amt, T low, T high) {
     if(amt < low) return low;
@@ -61,20 +105,21 @@ template <typename T> T constrain(T amt, T low, T high) {
 }
 
 void init() {
-    stdio_init_all();
-    sleep_ms(100);
-    spi_init(spi1, 10000000u);
-    spi_set_format(spi1, 8, spi_cpol_t::SPI_CPOL_0, spi_cpha_t::SPI_CPHA_0, spi_order_t::SPI_MSB_FIRST);
+    HAL::init();
+    HAL::sleep_ms(100);
+    spi1_bus.init(10000000u);
 
     // Initialize GPIO
-    gpio_set_function(MAG_MISO, GPIO_FUNC_SPI);
-    gpio_set_function(MAG_CLK, GPIO_FUNC_SPI);
-    //gpio_set_function(STRAIN_CLK, GPIO_FUNC_SPI);
-    //gpio_set_function(STRAIN_MISO, GPIO_FUNC_SPI);
-    //gpio_set_function(STRAIN_MOSI, GPIO_FUNC_SPI);
-    //gpio_init(STRAIN_IRQ);
-    //gpio_set_dir(STRAIN_IRQ, GPIO_IN);
-    //gpio_pull_up(STRAIN_IRQ); // Required for MCP3564R to work!
+    HAL::gpio_set_function(MAG_MISO, HAL::gpio_func::SPI);
+    HAL::gpio_set_function(MAG_CLK, HAL::gpio_func::SPI);
+    if(STRAIN_ENABLED) {
+        HAL::gpio_set_function(STRAIN_CLK, HAL::gpio_func::SPI);
+        HAL::gpio_set_function(STRAIN_MISO, HAL::gpio_func::SPI);
+        HAL::gpio_set_function(STRAIN_MOSI, HAL::gpio_func::SPI);
+        HAL::gpio_init(STRAIN_IRQ);
+        HAL::gpio_set_dir(STRAIN_IRQ, false);
+        HAL::gpio_pull_up(STRAIN_IRQ); // Required for MCP3564R to work!
+    }
 
     // Init MT6701
     mt6701.init();
@@ -84,75 +129,226 @@ void init() {
     tmc6300.set_enabled(true);
 
     // Init FOC
-    foc.init(false, true); // Set to sine mode
-    foc._zero_electric_angle = 4.062365f;
+    foc.init(true); // The motor calibration below replaces the zero angle check
+
+    // Motor calibration, measured on first boot and kept in flash, loading it takes no time
+    if(!foc.load_calibration(MOTOR_CAL_FLASH_OFFSET)) {
+        motor_calibration_t calibration;
+        if(foc.calibrate_motor(2.0f, &calibration)) {
+            printf("Motor calibration: %d pole pairs (%f), direction %d, residual %f rad\n", calibration.pole_pairs,
+                calibration.pole_pairs_estimate, (int)calibration.direction, calibration.residual);
+            if(!foc.save_calibration(MOTOR_CAL_FLASH_OFFSET)) printf("Saving motor calibration failed\n");
+        } else {
+            printf("Motor calibration failed, using the default zero electric angle\n");
+            foc.set_zero_electric_angle(DEFAULT_ZERO_ELECTRIC_ANGLE);
+        }
+    }
     printf("Zero Electric Angle: %f\n", foc._zero_electric_angle);
 
-    // Init detents
-    mt6701.read(&angle);
-    config.detent_center = angle; 
-    config.max_position = 50;
-    config.min_position = 0;
+    // Encoder calibration, measured on first boot and kept in flash
+    if(!mt6701.load_calibration(ENCODER_CAL_FLASH_OFFSET)) {
+        encoder_calibration_t calibration;
+        if(foc.calibrate_encoder(2.0f, &calibration)) {
+            printf("Encoder calibration: peak error %f rad before, %f rad after\n", calibration.error_before, calibration.error_after);
+            if(!mt6701.save_calibration(ENCODER_CAL_FLASH_OFFSET)) printf("Saving encoder calibration failed\n");
+        } else {
+            printf("Encoder calibration failed\n");
+        }
+    }
+
+    // Init detents, hold the knob where it is at position 0
+    haptic.select(&HapticProfiles::coarse);
+    uint16_t count = 0;
+    mt6701.read_raw(&count);
+    knob_angle.reset(count);
+    haptic.reset(knob_angle.get_count(), 0);
+    config.position = haptic.get_position();
 
     // Init MCP3564R
-    /*
-    mcp3564r.init();
-    mcp3564r.set_clock_source(3);
-    sleep_us(100);
-    mcp3564r.select_vref_source(false);
-    sleep_us(10);
-    mcp3564r.set_data_format(3);
-    sleep_us(10);
-    mcp3564r.enable_scan_channel(8);
-    sleep_us(10);
-    mcp3564r.set_adc_gain(5);
-    sleep_us(10);
-    mcp3564r.set_oversample_ratio(6);
-    sleep_us(10);
-    mcp3564r.set_conv_mode(3);
-    sleep_us(10);
-    mcp3564r.set_adc_mode(3);
-    sleep_us(100);
-    printf("Finished initializing.\n\n");
-    */
-
-   // Init PID
-   knob_pid.errorMode = SMARTKNOB::ErrorMode::ANGULAR;
-   knob_pid.derivativeMode = SMARTKNOB::DerivativeMode::DERIVATIVE_ON_ERROR_FILTERED;
-   knob_pid.setpoint = angle;
-
-   // Add an interrupt timer
-    add_repeating_timer_us(-1000, repeating_timer_callback, NULL, &timer);
+    if(STRAIN_ENABLED) {
+        if(!mcp3564r.init()) printf("Strain ADC not responding\n");
+        // Only staged here, start_stream writes them together with its own settings
+        mcp3564r.set_clock_source(3);
+        mcp3564r.select_vref_source(false);
+        mcp3564r.enable_scan_channel(8);
+        mcp3564r.set_adc_gain(5);
+        mcp3564r.set_oversample_ratio(3); // 256, about 4.8 ksps so a debounced press is seen within a millisecond
+        if(!mcp3564r.start_stream(STRAIN_IRQ)) printf("Strain ADC streaming failed\n");
+        printf("Finished initializing.\n\n");
+    }
+
+#if SMARTKNOB_FIXED_POINT
+    fixed_config.damping = (int32_t)(config.damping * 2.0f * _pi / 5.0f * 32768.0f);
+    fixed_config.end_stop_damping = (int32_t)(config.end_stop_damping * 2.0f * _pi / 5.0f * 32768.0f);
+    fixed_config.torque_limit = Fixed::float_to_q15(config.torque_limit / 5.0f);
+    knob_observer.reset(knob_angle.get_angle_q16());
+#else
+    // P only, the output is the damping torque
+    damping_loops.configure(0, SMARTKNOB::PID(config.damping, 0.0f, 0.0f));
+    damping_loops.configure(1, SMARTKNOB::PID(config.end_stop_damping, 0.0f, 0.0f));
+    knob_observer.reset(knob_angle.get_radians());
+#endif
+
+    // Hand the control loop over to core 1, core 0 keeps USB, logging and configuration
+    HAL::multicore_launch_core1(core1_entry);
 }
 
 void loop() {
-    //mcp3564r.read_data(&measurement, &channel);
-    //printf("ADC data: %d\n", measurement);
-}
+    // Text would corrupt the binary stream, the position is in the telemetry anyway
+    DetentEvent event;
+    while(detent_events.pop(&event)) {
+        if(!telemetry_enabled) printf("Gain: %d dB\n", event.position);
+    }
 
-bool repeating_timer_callback(struct repeating_timer* t) {
-    mt6701.read(&angle);
-    knob_pid.setpoint = config.detent_center;
-    float torque = knob_pid.update(-angle, 0.001f); // Set dt to 1 ms since this loop is interrupt based
-    foc.update(constrain(torque, -config.torque_limit, config.torque_limit), &angle);
-    if((knob_pid.error > config.snap_radians_increase) && (config.position > config.min_position)){
-        config.detent_center = fmodf(config.detent_center - 2.0f * config.snap_radians_increase + _3pi, _2pi) - _pi;
-        config.position--;
-        printf("Gain: %d dB\n", config.position);
+    // Always drain the telemetry so core 1 never has to drop samples
+    if(telemetry_enabled) {
+        telemetry.drain(HAL::stdio_write);
+    } else {
+        telemetry.clear();
     }
-    if((knob_pid.error < config.snap_radians_decrease) && (config.position < config.max_position)){
-        config.detent_center = fmodf(config.detent_center - 2.0f * config.snap_radians_decrease + _3pi, _2pi) - _pi;
-        config.position++;
-        printf("Gain: %d dB\n", config.position);
+
+    // Conversions arrive over DMA on the data ready interrupt, only the filtering and detection run here
+    if(STRAIN_ENABLED) {
+        int32_t samples[32];
+        int32_t decimated[32 / 8 + 1];
+        press_event_t events[4];
+        uint32_t count;
+        while((count = mcp3564r.read_stream(samples, 32)) > 0) {
+            count = strain_decimator.process(samples, count, decimated);
+            uint32_t event_count = press_detector.process(decimated, count, events, 4);
+            for(uint32_t i = 0; i < event_count; i++) {
+                if(!telemetry_enabled) printf("%s at %llu us\n", events[i].pressed ? "Press" : "Release", (unsigned long long)HAL::time_us());
+            }
+        }
+    }
+
+    // 'c' coarse detents, 'f' fine detents, 'u' unbounded coarse detents, 'b' 0 to 10 with a bump before 5,
+    // 's' free spin, 't' toggles telemetry streaming. The tables are in flash, switching is a pointer swap
+    int c = HAL::getchar_timeout_us(0);
+    const Haptic::table_t* profile = NULL;
+    if(c == 'c') profile = &HapticProfiles::coarse;
+    if(c == 'f') profile = &HapticProfiles::fine;
+    if(c == 'u') profile = &HapticProfiles::unbounded;
+    if(c == 'b') profile = &HapticProfiles::bounded;
+    if(c == 's') profile = &HapticProfiles::free_spin;
+    if(profile != NULL) {
+        if(!haptic.select(profile)) printf("Haptic profile not changed, the last change is still pending\n");
+    } else if(c == 't') {
+        telemetry_enabled = !telemetry_enabled;
+        const uint8_t delimiter = 0x00;
+        if(telemetry_enabled) HAL::stdio_write(&delimiter, 1); // Terminate any text so the first frame decodes
     }
-    //printf("%f\n", angle);
-    return true;
 }
 
+/**
+ * @brief Report the detent position when the haptic engine has moved it
+*/
+void update_detent(void) {
+    if(haptic.get_position() == config.position) return;
+    config.position = haptic.get_position();
+    push_detent_event();
+}
+
+void push_detent_event() {
+    DetentEvent event = {config.position, HAL::time_us()};
+    detent_events.push(event); // Dropped if core 0 falls behind, never block the control loop
+}
+
+/**
+ * @brief Stamp the telemetry sample of this tick, the next tick logs it
+*/
+void stamp_sample(telemetry_sample_t& sample) {
+    sample.time_us = (uint32_t)HAL::time_us();
+    sample.position = config.position;
+    tick_sample_ready = true;
+}
+
+/**
+ * @brief Log the sample of the last tick, done while the encoder frame is in flight
+*/
+void log_last_sample(void) {
+    if(!tick_sample_ready) return;
+    telemetry.log(tick_sample);
+    tick_sample_ready = false;
+}
+
+void core1_entry() {
+    // The DMA interrupt has to fire on this core
+    if(!mt6701.init_async()) printf("MT6701 DMA init failed\n");
+
+    uint64_t next_tick = HAL::time_us();
+    while(HAL::running()) {
+        next_tick += CONTROL_PERIOD_US;
+        HAL::busy_wait_until_us(next_tick);
+        control_tick();
+    }
+}
+
+#if SMARTKNOB_FIXED_POINT
+void control_tick() {
+    // Get the encoder frame moving first and log the telemetry of the last tick while it is in flight
+    mt6701.start_read();
+    log_last_sample();
+
+    uint16_t count = knob_angle.get_raw(); // Keep the last count if the frame is bad
+    mt6701_err_t error = mt6701.finish_read_raw(&count);
+    int32_t angle = knob_angle.update(count);
+    knob_observer.update(knob_angle.get_angle_q16());
+    // Torque from the profile table, minus damping on the observed velocity, more of it past the end stops
+    q15_t profile_torque = haptic.update(angle);
+    int32_t damping_gain = fixed_config.damping + (haptic.past_end_stop() ? fixed_config.end_stop_damping : 0);
+    q15_t damping = Fixed::q15_sat((int32_t)(((int64_t)damping_gain * knob_observer.get_velocity()) >> 16));
+    q15_t torque = constrain<q15_t>(Fixed::q15_sat(profile_torque - damping), -fixed_config.torque_limit, fixed_config.torque_limit);
+    foc.update_q15(foc.get_direction() * torque, count);
+    update_detent();
+    telemetry_sample_t& sample = tick_sample;
+    sample.angle = knob_angle.get_angle_q16();
+    sample.velocity = knob_observer.get_velocity();
+    sample.torque = torque;
+    sample.p_term = profile_torque;
+    sample.i_term = 0;
+    sample.d_term = -damping;
+    sample.error = (uint8_t)error;
+    stamp_sample(sample);
+}
+#else
+void control_tick() {
+    // Get the encoder frame moving first and log the telemetry of the last tick while it is in flight
+    mt6701.start_read();
+    log_last_sample();
+
+    uint16_t count = knob_angle.get_raw(); // Keep the last count if the frame is bad
+    mt6701_err_t error = mt6701.finish_read_raw(&count);
+    int32_t angle = knob_angle.update(count);
+    knob_observer.update(knob_angle.get_radians());
+    // The profile table is integer, only its torque goes to float
+    float profile_torque = haptic.update(angle) * (5.0f / 32768.0f);
+    // The end stop loop only sees the velocity past the end stops
+    float velocity[2] = {knob_observer.get_velocity(), 0.0f};
+    if(haptic.past_end_stop()) velocity[1] = velocity[0];
+    const float* damping_torque = damping_loops.update(velocity, CONTROL_PERIOD_US * 1e-6f);
+    float damping = -(damping_torque[0] + damping_torque[1]);
+    float torque = constrain(profile_torque - damping, -config.torque_limit, config.torque_limit);
+    foc.update(foc.get_direction() * torque, count);
+    update_detent();
+    // Telemetry uses the units of the fixed point path, Q15 of the 5 V voltage limit
+    telemetry_sample_t& sample = tick_sample;
+    sample.angle = knob_angle.get_angle_q16();
+    sample.velocity = (int32_t)(knob_observer.get_velocity() * (65536.0f / (2.0f * _pi)));
+    sample.torque = Fixed::float_to_q15(torque / 5.0f);
+    sample.p_term = Fixed::float_to_q15(profile_torque / 5.0f);
+    sample.i_term = 0;
+    sample.d_term = Fixed::float_to_q15(-damping / 5.0f);
+    sample.error = (uint8_t)error;
+    stamp_sample(sample);
+}
+#endif
+
 int main() {
     init();
-    while(1) {
+    while(HAL::running()) {
         loop();
+        HAL::tight_loop_contents();
     }
     return 0;
 }
\ No newline at end of file